@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ripple_calc.h"
+#include "bench_util.h"
+
+// Runs calc's batch mode over a file of two-column rows: totals only, one
+// result printed per row, and the same sum through awk. The evaluator is
+// also timed alone on rows already in memory, a block at a time and one
+// row at a time, to show what running each instruction over a block saves.
+// The totals must agree with strtod and with awk.
+//
+// Usage: bench_calc [rows [expression]]
+// Defaults to 1000000 rows and "$1 * 2 + sqrt($2) - $2 ^ 2 / 3".
+
+static double stream(const char *file, struct ripple_calc_prog *prog, int summary, FILE *out,
+                     struct ripple_calc_stream_stats *stats) {
+    struct ripple_calc_stream_opts opts = { 0, summary };
+    int fd = open(file, O_RDONLY);
+    double start = now_ms();
+    if (fd < 0 || ripple_calc_stream(fd, prog, &opts, out, stats) != 0) {
+        perror("bench_calc");
+        exit(2);
+    }
+    double ms = now_ms() - start;
+    close(fd);
+    return ms;
+}
+
+static int close_enough(double a, double b) {
+    return fabs(a - b) <= 1e-9 * fmax(1.0, fabs(b));
+}
+
+int main(int argc, char **argv) {
+    long rows = argc > 1 ? atol(argv[1]) : 1000000;
+    const char *expr = argc > 2 ? argv[2] : "$1 * 2 + sqrt($2) - $2 ^ 2 / 3";
+    char file[64], err[256], cmd[512];
+    struct ripple_calc_prog prog, second;
+    struct ripple_calc_stream_stats stats;
+    int failed = 0;
+
+    if (rows <= 0 || ripple_calc_compile(expr, &prog, err, sizeof(err)) != 0 ||
+        ripple_calc_compile("$2", &second, err, sizeof(err)) != 0 || prog.columns > 2) {
+        fprintf(stderr, "Usage: %s [rows [expression over $1 and $2]]\n", argv[0]);
+        return 2;
+    }
+    snprintf(file, sizeof(file), "/tmp/ripple-bench-calc.%d", (int)getpid());
+    FILE *f = fopen(file, "w");
+    double *cols = malloc(sizeof(double) * 2 * rows);
+    if (!f || !cols) {
+        perror("bench_calc");
+        return 2;
+    }
+    double col2_sum = 0;
+    for (long i = 0; i < rows; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.3f", (i % 100000) * 0.017 + 0.5);
+        fprintf(f, "%ld %s\n", i, text);
+        cols[i] = (double)i;
+        cols[rows + i] = strtod(text, NULL);
+        col2_sum += cols[rows + i];
+    }
+    fclose(f);
+    printf("%ld rows: %s\n", rows, expr);
+    ripple_calc_dump(&prog, stdout);
+    printf("%-26s %10s %12s\n", "", "ms", "ns/row");
+
+    double ms = stream(file, &second, 1, stdout, &stats);
+    printf("%-26s %10.1f %12.1f\n", "parse only ($2, totals)", ms, ms * 1e6 / rows);
+    failed |= stats.rows != rows || !close_enough(stats.sum, col2_sum);
+
+    ms = stream(file, &prog, 1, stdout, &stats);
+    double sum = stats.sum;
+    printf("%-26s %10.1f %12.1f\n", "stream, totals", ms, ms * 1e6 / rows);
+    failed |= stats.rows != rows;
+
+    FILE *null = fopen("/dev/null", "w");
+    ms = stream(file, &prog, 0, null, &stats);
+    fclose(null);
+    printf("%-26s %10.1f %12.1f\n", "stream, row per line", ms, ms * 1e6 / rows);
+
+    // Evaluator alone over rows in memory: blocks, then one row per call
+    double block[2 * RIPPLE_CALC_BLOCK], out[RIPPLE_CALC_BLOCK], check = 0;
+    double start = now_ms();
+    for (long i = 0; i < rows; i += RIPPLE_CALC_BLOCK) {
+        int n = rows - i < RIPPLE_CALC_BLOCK ? (int)(rows - i) : RIPPLE_CALC_BLOCK;
+        memcpy(block, cols + i, sizeof(double) * n);
+        memcpy(block + RIPPLE_CALC_BLOCK, cols + rows + i, sizeof(double) * n);
+        ripple_calc_eval(&prog, block, n, out);
+        for (int j = 0; j < n; j++) {
+            check += out[j];
+        }
+    }
+    ms = now_ms() - start;
+    printf("%-26s %10.1f %12.1f\n", "eval, blocks", ms, ms * 1e6 / rows);
+    failed |= !close_enough(check, sum);
+
+    check = 0;
+    start = now_ms();
+    for (long i = 0; i < rows; i++) {
+        block[0] = cols[i];
+        block[RIPPLE_CALC_BLOCK] = cols[rows + i];
+        ripple_calc_eval(&prog, block, 1, out);
+        check += out[0];
+    }
+    ms = now_ms() - start;
+    printf("%-26s %10.1f %12.1f\n", "eval, row at a time", ms, ms * 1e6 / rows);
+    failed |= !close_enough(check, sum);
+
+    // awk spelling of the default expression
+    if (argc <= 2) {
+        snprintf(cmd, sizeof(cmd), "awk '{ s += $1 * 2 + sqrt($2) - $2 ^ 2 / 3 } END { printf \"%%.17g\", s }' %s",
+                 file);
+        start = now_ms();
+        FILE *awk = popen(cmd, "r");
+        double awk_sum = NAN;
+        if (awk && fscanf(awk, "%lf", &awk_sum) == 1) {
+            ms = now_ms() - start;
+            printf("%-26s %10.1f %12.1f\n", "awk, totals", ms, ms * 1e6 / rows);
+            failed |= !close_enough(sum, awk_sum);
+        } else {
+            printf("%-26s %10s\n", "awk, totals", "n/a");
+        }
+        if (awk) {
+            pclose(awk);
+        }
+    }
+
+    if (failed) {
+        fprintf(stderr, "bench_calc: totals disagree\n");
+    }
+    unlink(file);
+    free(cols);
+    ripple_calc_free(&prog);
+    ripple_calc_free(&second);
+    return failed;
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ollama_codec.h"
+#include "bench_util.h"
+
+#ifdef __APPLE__
+#include "/opt/homebrew/include/json-c/json.h"
+#else
+#include <json-c/json.h>
+#endif
+
+// Benchmark for the Ollama request writer and response scanner.
+// Checks a few tricky inputs first, then times both directions and
+// compares response parsing against a json-c DOM parse.
+
+static int failures = 0;
+
+static void check(int cond, const char *what) {
+    if (!cond) {
+        printf("\033[31mFAIL\033[0m %s\n", what);
+        failures++;
+    }
+}
+
+// Feed a body to a fresh scanner in chunks of the given size
+static int scan_chunked(struct ollama_response *r, const char *body, size_t chunk) {
+    struct ollama_scanner s;
+    size_t len = strlen(body);
+    ollama_response_reset(r);
+    ollama_scanner_init(&s, r);
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        if (ollama_scanner_feed(&s, body + off, n) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void run_checks(void) {
+    struct ollama_buf b = { 0 };
+    struct ollama_response r = { 0 };
+
+    // Control characters, quotes and invalid UTF-8 in the prompt
+    ollama_buf_reset(&b);
+    ollama_json_escape(&b, "a\"b\\c\n\x01\xc3\xa9\xff", 10);
+    check(strcmp(b.data, "a\\\"b\\\\c\\n\\u0001\xc3\xa9\\ufffd") == 0, "escape control/utf-8");
+
+    // Long prompts are no longer truncated
+    char *big = malloc(20000);
+    memset(big, 'x', 19999);
+    big[19999] = '\0';
+    struct ollama_request req = { "tinyllama", "pre ", big, " post", 0, 0.2, 0.9, 40, 300 };
+    check(ollama_write_request(&b, &req) == 0 && b.len > 20000, "long prompt written in full");
+    check(b.data[b.len - 1] == '}', "long prompt closes the object");
+    free(big);
+
+    // Escapes, surrogate pairs and a context array, at every chunk size
+    const char *body =
+        "{\"model\":\"tinyllama\",\"response\":\"1. ls -la\\n2. caf\\u00e9 \\ud83d\\ude00\\\"q\\\"\","
+        "\"nested\":{\"response\":\"ignored\",\"x\":[1,2,{\"done\":true}]},"
+        "\"done\":true,\"context\":[1, 22,333 ,-4],\"total_duration\":12345}";
+    const char *want = "1. ls -la\n2. caf\xc3\xa9 \xf0\x9f\x98\x80\"q\"";
+    for (size_t chunk = 1; chunk <= strlen(body); chunk++) {
+        int ok = scan_chunked(&r, body, chunk) == 0 && strcmp(r.text.data, want) == 0 &&
+                 r.done == 1 && r.context_len == 4 && r.context[2] == 333 && r.context[3] == -4 &&
+                 r.total_duration == 12345;
+        if (!ok) {
+            printf("chunk size %zu\n", chunk);
+            check(0, "scanner result independent of chunking");
+            break;
+        }
+    }
+
+    // Streaming responses are a sequence of objects
+    check(scan_chunked(&r, "{\"response\":\"ab\",\"done\":false}\n{\"response\":\"cd\",\"done\":true}\n", 7) == 0 &&
+          strcmp(r.text.data, "abcd") == 0 && r.done == 1, "streamed objects concatenate");
+
+    check(scan_chunked(&r, "{\"error\":\"model 'x' not found\"}", 5) == 0 &&
+          strcmp(r.error.data, "model 'x' not found") == 0, "error field");
+    check(scan_chunked(&r, "{\"response\":\"a\"]", 4) != 0, "malformed input rejected");
+    check(scan_chunked(&r, "<html>", 4) != 0, "non-JSON rejected");
+
+    // Format schema and stop sequences
+    static const char *const stop[] = { "\n\n", NULL };
+    struct ollama_request jreq = { "tinyllama", "", "ls", "", 1, 0.2, 0.9, 40, 128 };
+    jreq.format = "{\"type\":\"array\"}";
+    jreq.stop = stop;
+    check(ollama_write_request(&b, &jreq) == 0 && strstr(b.data, "\"stop\":[\"\\n\\n\"]") &&
+          strstr(b.data, ",\"format\":{\"type\":\"array\"}"), "format and stop written");
+
+    // Suggestions from JSON, truncated JSON and the free-text format
+    struct ollama_suggestion sug[3];
+    check(ollama_parse_suggestions("[{\"cmd\":\"ls -la\",\"desc\":\"List \\\"all\\\"\"},"
+                                   "{\"desc\":\"x\",\"cmd\":\"pwd\"}]", sug, 3) == 2 &&
+          strcmp(sug[0].cmd, "ls -la") == 0 && strcmp(sug[0].desc, "List \"all\"") == 0 &&
+          strcmp(sug[1].cmd, "pwd") == 0, "JSON suggestions");
+    check(ollama_parse_suggestions("[{\"cmd\":\"ls\",\"desc\":\"a\"},{\"cmd\":\"pw", sug, 3) == 1,
+          "truncated JSON keeps complete objects");
+    check(ollama_parse_suggestions("Here you go:\n1. ls -la - List files\n2. `pwd` - Where am I\n", sug, 3) == 2 &&
+          strcmp(sug[1].cmd, "pwd") == 0 && strcmp(sug[1].desc, "Where am I") == 0, "numbered lines");
+    check(ollama_parse_suggestions("no idea", sug, 3) == 0, "unparseable text");
+
+    // Embedding replies, batched and legacy
+    float vec[2 * 4];
+    int dim = 0;
+    check(ollama_parse_embeddings("{\"model\":\"m\",\"embeddings\":[[0.5,-1e-2,3],[1, 2 ,3]]}", vec, 2, 4, &dim) == 2 &&
+          dim == 3 && vec[1] == -0.01f && vec[4] == 1.0f, "batched embeddings");
+    check(ollama_parse_embeddings("{\"embedding\":[1,2]}", vec, 1, 4, &dim) == 1 && dim == 2, "legacy embedding");
+    check(ollama_parse_embeddings("{\"embeddings\":[[1,2],[3]]}", vec, 2, 4, &dim) < 0, "ragged embeddings rejected");
+    check(ollama_parse_embeddings("{\"error\":\"model not found\"}", vec, 1, 4, &dim) < 0, "embed error");
+
+    ollama_buf_free(&b);
+    ollama_response_free(&r);
+}
+
+// Build a response body that looks like Ollama's non-streaming output
+static char *make_body(int context_len) {
+    struct ollama_buf b = { 0 };
+    char num[32];
+    const char *head = "{\"model\":\"tinyllama\",\"created_at\":\"2024-01-01T00:00:00Z\",\"response\":\"";
+    ollama_buf_append(&b, head, strlen(head));
+    for (int i = 0; i < 3; i++) {
+        const char *line = "1. find . -type f -name '*.txt' - Find all \\\"txt\\\" files recursively\\n";
+        ollama_buf_append(&b, line, strlen(line));
+    }
+    const char *mid = "\",\"done\":true,\"context\":[";
+    ollama_buf_append(&b, mid, strlen(mid));
+    for (int i = 0; i < context_len; i++) {
+        int n = snprintf(num, sizeof(num), "%s%d", i ? "," : "", 1000 + i * 7);
+        ollama_buf_append(&b, num, n);
+    }
+    const char *tail = "],\"total_duration\":512345678,\"load_duration\":1234567,\"prompt_eval_count\":120,"
+                       "\"prompt_eval_duration\":98765432,\"eval_count\":64,\"eval_duration\":345678901}";
+    ollama_buf_append(&b, tail, strlen(tail));
+    return b.data;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+    run_checks();
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("codec checks passed\n\n");
+
+    // Request writer: the same buffer is reused for every request
+    struct ollama_buf req_buf = { 0 };
+    char prompt[256];
+    unsigned long allocs_before = ollama_codec_allocs;
+    double t0 = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        snprintf(prompt, sizeof(prompt), "git commit -m \"fix %d\"\t", i);
+        struct ollama_request req = { "tinyllama", "You are a Unix/Linux shell expert. The user typed '",
+                                      prompt, "'. Suggest exactly 3 completions.\n", 0, 0.2, 0.9, 40, 300 };
+        ollama_write_request(&req_buf, &req);
+    }
+    double t1 = now_ns();
+    printf("request writer:   %8.0f ns/request, %lu allocations over %d requests\n",
+           (t1 - t0) / iterations, ollama_codec_allocs - allocs_before, iterations);
+
+    // Response scanner, fed in network-sized chunks
+    char *body = make_body(2048);
+    size_t body_len = strlen(body);
+    struct ollama_response resp = { 0 };
+    allocs_before = ollama_codec_allocs;
+    t0 = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        scan_chunked(&resp, body, 1400);
+    }
+    t1 = now_ns();
+    printf("response scanner: %8.0f ns/response, %lu allocations over %d responses (%zu byte body)\n",
+           (t1 - t0) / iterations, ollama_codec_allocs - allocs_before, iterations, body_len);
+
+    // The previous approach: buffer the whole body, build a DOM, strdup the text
+    t0 = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        struct json_object *parsed = json_tokener_parse(body);
+        struct json_object *obj;
+        if (parsed && json_object_object_get_ex(parsed, "response", &obj)) {
+            free(strdup(json_object_get_string(obj)));
+        }
+        json_object_put(parsed);
+    }
+    t1 = now_ns();
+    printf("json-c DOM:       %8.0f ns/response (allocates per node)\n", (t1 - t0) / iterations);
+
+    free(body);
+    ollama_buf_free(&req_buf);
+    ollama_response_free(&resp);
+    return 0;
+}
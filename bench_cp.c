@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "ripple_copy.h"
+#include "bench_util.h"
+
+// Copies a tree shaped like a source checkout (many directories of small
+// files) plus one large file, with the cp builtin on one thread and on
+// several, and with coreutils cp -r. Each copy is compared with the source
+// by diff -r before it is deleted, so a fast wrong copy does not pass.
+//
+// Usage: bench_cp [dirs [files_per_dir [big_megabytes [base]]]]
+// Defaults to 200 directories of 100 4 KB files and a 256 MB file under
+// /tmp. Exits non-zero if a copy differs.
+
+static int run(char **argv) {
+    int status;
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int build_tree(const char *root, int dirs, int per_dir, long big_mb) {
+    char path[4096], block[4096];
+    memset(block, 'x', sizeof(block));
+    if (mkdir(root, 0755) != 0) {
+        return -1;
+    }
+    for (int d = 0; d < dirs; d++) {
+        snprintf(path, sizeof(path), "%s/dir%03d", root, d);
+        if (mkdir(path, 0755) != 0) {
+            return -1;
+        }
+        for (int f = 0; f < per_dir; f++) {
+            snprintf(path, sizeof(path), "%s/dir%03d/file%03d.c", root, d, f);
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0 || write(fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+                return -1;
+            }
+            close(fd);
+        }
+    }
+    snprintf(path, sizeof(path), "%s/big.bin", root);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    char *chunk = malloc(1 << 20);
+    if (fd < 0 || !chunk) {
+        return -1;
+    }
+    for (long i = 0; i < big_mb; i++) {
+        memset(chunk, (int)(i & 0xff), 1 << 20);
+        if (write(fd, chunk, 1 << 20) != 1 << 20) {
+            return -1;
+        }
+    }
+    free(chunk);
+    return close(fd);
+}
+
+// diff -r the copy against the source, then delete it
+static int check_and_remove(const char *src, const char *copy) {
+    char *diff[] = { "diff", "-rq", (char *)src, (char *)copy, NULL };
+    char *rm[] = { "rm", "-rf", (char *)copy, NULL };
+    int rc = run(diff);
+    run(rm);
+    if (rc != 0) {
+        fprintf(stderr, "bench_cp: %s differs from %s\n", copy, src);
+    }
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    int dirs = argc > 1 ? atoi(argv[1]) : 200;
+    int per_dir = argc > 2 ? atoi(argv[2]) : 100;
+    long big_mb = argc > 3 ? atol(argv[3]) : 256;
+    const char *base = argc > 4 ? argv[4] : "/tmp";
+    char src[1024], dst[1100];
+    int failed = 0;
+
+    if (dirs <= 0 || per_dir <= 0 || big_mb < 0) {
+        fprintf(stderr, "Usage: %s [dirs [files_per_dir [big_megabytes [base]]]]\n", argv[0]);
+        return 2;
+    }
+    snprintf(src, sizeof(src), "%s/ripple-bench-cp.%d", base, (int)getpid());
+    snprintf(dst, sizeof(dst), "%s.copy", src);
+    if (build_tree(src, dirs, per_dir, big_mb) != 0) {
+        perror("bench_cp: building the tree");
+        return 2;
+    }
+    double mb = (dirs * (double)per_dir * 4096 + big_mb * 1048576.0) / 1048576.0;
+    printf("%d directories x %d files + %ld MB file (%.0f MB)\n", dirs, per_dir, big_mb, mb);
+    printf("%-14s %10s %10s %10s\n", "", "ms", "MB/s", "reflinked");
+
+    static const int threads[] = { 1, 8 };
+    for (int t = 0; t < 2; t++) {
+        struct ripple_copy_opts opts = { 1, 0, threads[t] };
+        struct ripple_copy_stats stats;
+        char *sources[] = { src };
+        char name[32];
+        double start = now_ms();
+        int rc = ripple_copy(sources, 1, dst, &opts, &stats);
+        double ms = now_ms() - start;
+        snprintf(name, sizeof(name), "cp -j%d", threads[t]);
+        printf("%-14s %10.1f %10.0f %10ld\n", name, ms, mb / (ms / 1000.0), stats.cloned);
+        failed |= rc != 0 || stats.files != (long)dirs * per_dir + 1;
+        failed |= check_and_remove(src, dst) != 0;
+    }
+
+    char *cp[] = { "cp", "-r", src, dst, NULL };
+    double start = now_ms();
+    int rc = run(cp);
+    double ms = now_ms() - start;
+    printf("%-14s %10.1f %10.0f %10s\n", "coreutils", ms, mb / (ms / 1000.0), "-");
+    failed |= rc != 0 || check_and_remove(src, dst) != 0;
+
+    char *rm[] = { "rm", "-rf", src, NULL };
+    run(rm);
+    return failed;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "ripple_proto.h"
+#include "test_mock.h"
+#include "bench_util.h"
+
+// Load test for ripple-daemon: many shells at once, each on its own
+// connection, pressing TAB on a shared pool of prompts with think time in
+// between. Starts mock_ollama and the daemon itself; run from the source
+// directory.
+//
+// Usage: bench_daemon [sessions] [requests_per_session]
+
+static const char *prompts[] = {
+    "git comm", "git push", "git log --on", "find . -na", "tar -x", "grep -r", "docker ps", "docker run",
+    "ls -l", "make cl", "ssh ", "scp ", "curl -s", "kill -9", "ps aux", "du -sh", "df -h", "chmod +x",
+    "python3 -m", "pip inst", "npm run", "cargo bu", "go test", "kubectl get", "systemctl sta",
+    "journalctl -u", "rsync -av", "sed -i", "awk '{", "xargs -n"
+};
+#define NUM_PROMPTS (sizeof(prompts) / sizeof(prompts[0]))
+
+static const char *socket_path;
+static int per_session;
+static double *latencies;          // one per request, -1 when it failed
+static int errors;
+static pthread_mutex_t errors_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int connect_daemon(void) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+static void failed(void) {
+    pthread_mutex_lock(&errors_lock);
+    errors++;
+    pthread_mutex_unlock(&errors_lock);
+}
+
+static void *session_thread(void *arg) {
+    int id = (int)(long)arg;
+    unsigned seed = id * 2654435761u;
+    struct rp_msg *msg = malloc(sizeof(*msg));
+    struct ollama_suggestion out[3];
+    double *mine = latencies + (size_t)id * per_session;
+    int fd = connect_daemon();
+
+    for (int i = 0; i < per_session; i++) {
+        mine[i] = -1;
+        usleep(20000 + rand_r(&seed) % 80000); // the user types for a while
+        if (fd < 0) {
+            failed();
+            continue;
+        }
+        const char *prompt = prompts[rand_r(&seed) % NUM_PROMPTS];
+        int type, flags;
+        char *raw = NULL;
+
+        double t0 = now_ms();
+        rp_reset(msg);
+        rp_put_u8(msg, 3);
+        rp_put_str(msg, prompt, strlen(prompt));
+        if (rp_send(fd, RP_SUGGEST, msg) != 0 || rp_recv(fd, &type, msg, 10000) != 0 ||
+            type != RP_SUGGEST_REPLY || rp_get_suggestions(msg, &flags, out, 3, &raw) <= 0) {
+            failed();
+        } else {
+            mine[i] = now_ms() - t0;
+        }
+        free(raw);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(msg);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static pid_t spawn(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stdout);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    int sessions = argc > 1 ? atoi(argv[1]) : 100;
+    per_session = argc > 2 ? atoi(argv[2]) : 20;
+    int port = 20000 + getpid() % 1000;
+    char dir[] = "/tmp/ripple-bench-XXXXXX", config[64], sock[64];
+
+    if (!mkdtemp(dir)) {
+        perror("bench_daemon: mkdtemp");
+        return 1;
+    }
+    snprintf(config, sizeof(config), "%s/ai.conf", dir);
+    snprintf(sock, sizeof(sock), "%s/ripple.sock", dir);
+    socket_path = sock;
+
+    FILE *f = fopen(config, "w");
+    if (!f) {
+        perror("bench_daemon: config");
+        return 1;
+    }
+    fprintf(f, "endpoint = http://127.0.0.1:%d/api/generate\nmodel = small\nmax_inflight = 4\nrate_limit = 0\n",
+            port);
+    fclose(f);
+    // The daemon must not pick up the user's own config or index
+    setenv("RIPPLE_AI_CONFIG", config, 1);
+    setenv("HOME", dir, 1);
+
+    pid_t mock = start_mock(port, "-d 2");
+    if (mock < 0) {
+        unlink(config);
+        rmdir(dir);
+        return 1;
+    }
+    pid_t daemon = spawn((char *[]){ "./ripple-daemon", "-s", sock, "-q", NULL });
+    for (int i = 0; i < 50; i++) {
+        int fd = connect_daemon();
+        if (fd >= 0) {
+            close(fd);
+            break;
+        }
+        usleep(100 * 1000);
+    }
+
+    int total = sessions * per_session;
+    latencies = malloc(sizeof(double) * total);
+    pthread_t *threads = malloc(sizeof(pthread_t) * sessions);
+    double t0 = now_ms();
+    for (int i = 0; i < sessions; i++) {
+        pthread_create(&threads[i], NULL, session_thread, (void *)(long)i);
+    }
+    for (int i = 0; i < sessions; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double wall = now_ms() - t0;
+
+    // What the daemon saw
+    struct rp_msg *msg = malloc(sizeof(*msg));
+    struct rp_stats ds = { 0 };
+    int fd = connect_daemon(), type;
+    rp_reset(msg);
+    if (fd >= 0 && rp_send(fd, RP_STATS, msg) == 0 && rp_recv(fd, &type, msg, 2000) == 0 &&
+        type == RP_STATS_REPLY) {
+        ds.sessions = rp_get_u32(msg);
+        ds.requests = rp_get_u32(msg);
+        ds.cache_hits = rp_get_u32(msg);
+        ds.shared = rp_get_u32(msg);
+        ds.sent = rp_get_u32(msg);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    stop(daemon);
+    stop_mock(mock);
+
+    int ok = 0;
+    for (int i = 0; i < total; i++) {
+        if (latencies[i] >= 0) {
+            latencies[ok++] = latencies[i];
+        }
+    }
+    qsort(latencies, ok, sizeof(double), compare_double);
+    printf("%d sessions x %d requests in %.0f ms (%.0f req/s)\n", sessions, per_session, wall,
+           total / (wall / 1000.0));
+    if (ok > 0) {
+        printf("latency   p50 %.2f ms  p95 %.2f ms  p99 %.2f ms  max %.2f ms\n", latencies[ok / 2],
+               latencies[(int)(ok * 0.95)], latencies[(int)(ok * 0.99)], latencies[ok - 1]);
+    }
+    printf("daemon    %u requests, %u from its cache, %u shared, %u sent to the model\n", ds.requests,
+           ds.cache_hits, ds.shared, ds.sent);
+    printf("errors    %d\n", errors);
+
+    unlink(config);
+    rmdir(dir);
+    free(latencies);
+    free(threads);
+    free(msg);
+    return errors == 0 && ds.requests == (uint32_t)total ? 0 : 1;
+}
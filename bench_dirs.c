@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ripple_dirs.h"
+#include "bench_util.h"
+
+// Visits real directories under /usr with a skewed distribution (a few
+// favourites, a long tail), then times cd-style queries against the
+// database and checks that the file reopens with the same contents.
+//
+// Usage: bench_dirs [root]
+
+#define MAX_DIRS 4000
+#define VISITS 20000
+#define QUERIES 2000
+
+static char *dirs[MAX_DIRS];
+static int num_dirs;
+
+static void walk(const char *path, int depth) {
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    struct stat st;
+    char child[1024];
+
+    if (!dir) {
+        return;
+    }
+    while (num_dirs < MAX_DIRS && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (strlen(child) < 200 && lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+            dirs[num_dirs++] = strdup(child);
+            if (depth < 4) {
+                walk(child, depth + 1);
+            }
+        }
+    }
+    closedir(dir);
+}
+
+int main(int argc, char **argv) {
+    char db[64];
+    struct ripple_dir found[6];
+    unsigned seed = 5;
+    int failed = 0;
+
+    walk(argc > 1 ? argv[1] : "/usr", 0);
+    if (num_dirs < 10) {
+        printf("not enough directories to visit\n");
+        return 1;
+    }
+    snprintf(db, sizeof(db), "/tmp/bench_dirs.%d", (int)getpid());
+    unlink(db);
+    if (ripple_dirs_open(db) != 0) {
+        printf("\033[31mFAIL\033[0m could not create %s\n", db);
+        return 1;
+    }
+
+    // Half the visits go to 8 favourites, the rest anywhere
+    double visit_ns = 0;
+    for (int i = 0; i < VISITS; i++) {
+        seed = seed * 1103515245 + 12345;
+        int d = (seed >> 16) % 2 ? (seed >> 8) % 8 : (seed >> 8) % num_dirs;
+        double t0 = now_ns();
+        ripple_dirs_visit(dirs[d]);
+        visit_ns += now_ns() - t0;
+    }
+
+    // The last segment of a favourite must find it first
+    double query_ns = 0;
+    int hits = 0;
+    for (int i = 0; i < QUERIES; i++) {
+        const char *dir = dirs[i % 8];
+        const char *term = strrchr(dir, '/') + 1;
+        double t0 = now_ns();
+        int n = ripple_dirs_query(term, NULL, found, 6);
+        query_ns += now_ns() - t0;
+        hits += n > 0;
+        if (n == 0 || (strcmp(found[0].path, dir) != 0 && strstr(found[0].path, term) == NULL)) {
+            printf("\033[31mFAIL\033[0m '%s' did not find %s\n", term, dir);
+            failed = 1;
+            break;
+        }
+    }
+
+    // Terms match in order and the last one must be in the last segment
+    ripple_dirs_visit("/tmp");
+    if (ripple_dirs_query("tm", NULL, found, 6) == 0 || ripple_dirs_query("tmp zzz_none", NULL, found, 6) != 0) {
+        printf("\033[31mFAIL\033[0m segment matching\n");
+        failed = 1;
+    }
+
+    unsigned count = ripple_dirs_count();
+    ripple_dirs_close();
+    if (ripple_dirs_open(db) != 0 || ripple_dirs_count() != count) {
+        printf("\033[31mFAIL\033[0m reopened database has %u entries, expected %u\n", ripple_dirs_count(), count);
+        failed = 1;
+    }
+    ripple_dirs_close();
+    unlink(db);
+    if (failed) {
+        return 1;
+    }
+
+    printf("%d directories, %d visits, %u kept (capacity %d)\n", num_dirs, VISITS, count, RIPPLE_DIRS_CAPACITY);
+    printf("visit: %.2f us, query: %.2f us (%d/%d found)\n",
+           visit_ns / VISITS / 1e3, query_ns / QUERIES / 1e3, hits, QUERIES);
+    for (int i = 0; i < num_dirs; i++) {
+        free(dirs[i]);
+    }
+    return 0;
+}
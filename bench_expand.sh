@@ -0,0 +1,38 @@
+#!/bin/sh
+# Benchmark command substitution: ripple (in-process builtins) vs bash (subshells)
+# Usage: ./bench_expand.sh [iterations]
+
+N=${1:-2000}
+SHELL_BIN=./shell2_complete_ai
+SCRIPT=$(mktemp)
+
+if [ ! -x "$SHELL_BIN" ]; then
+    echo "Build the shell first: make shell2_complete_ai"
+    exit 1
+fi
+
+# Each line does two builtin substitutions and a variable expansion
+i=0
+while [ $i -lt "$N" ]; do
+    echo 'echo $(pwd) $(echo sub) $HOME $?' >> "$SCRIPT"
+    i=$((i + 1))
+done
+
+# date +%N is GNU only; Time::HiRes ships with every perl
+now_ms() {
+    perl -MTime::HiRes=time -e 'printf "%d\n", time() * 1000'
+}
+
+start=$(now_ms)
+(cat "$SCRIPT"; echo exit) | "$SHELL_BIN" > /dev/null 2>&1
+ripple_ms=$(( $(now_ms) - start ))
+
+start=$(now_ms)
+bash "$SCRIPT" > /dev/null 2>&1
+bash_ms=$(( $(now_ms) - start ))
+
+rm -f "$SCRIPT"
+
+echo "iterations: $N (2 substitutions each)"
+echo "ripple: ${ripple_ms} ms"
+echo "bash:   ${bash_ms} ms"
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "ripple_fsops.h"
+#include "bench_util.h"
+
+// Builds and deletes a tree of empty files the way a build tree looks:
+// many directories of many small files. The builtins' batched mkdir -p
+// and touch run once on io_uring and once on the thread pool, followed by
+// rm -r, which runs in order either way. They are compared with coreutils
+// doing the same work with as few processes as it can (one mkdir -p, one
+// touch per directory, one rm -rf).
+//
+// Usage: bench_fsops [dirs [files_per_dir [base]]]
+// Defaults to 100 directories of 1000 files under /tmp.
+
+static int run(char **argv) {
+    int status;
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// Paths of the tree rooted at root: dirs[d] = root/dNNN/sub, files of dir
+// d are files[d * per_dir ..]
+static char **make_names(const char *root, int num_dirs, int per_dir, char ***files_out) {
+    char **dirs = malloc(sizeof(char *) * (num_dirs + 1));
+    char **files = malloc(sizeof(char *) * ((size_t)num_dirs * per_dir + 1));
+    char path[4096];
+
+    for (int d = 0; d < num_dirs; d++) {
+        snprintf(path, sizeof(path), "%s/d%03d/sub", root, d);
+        dirs[d] = strdup(path);
+        for (int f = 0; f < per_dir; f++) {
+            snprintf(path, sizeof(path), "%s/d%03d/sub/file%04d.o", root, d, f);
+            files[(size_t)d * per_dir + f] = strdup(path);
+        }
+    }
+    dirs[num_dirs] = NULL;
+    files[(size_t)num_dirs * per_dir] = NULL;
+    *files_out = files;
+    return dirs;
+}
+
+static void free_names(char **names) {
+    for (int i = 0; names[i]; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+struct timing {
+    const char *backend;          // that mkdir and touch ran on
+    double create_ms;
+    double remove_ms;
+    long errors;
+};
+
+static struct timing bench_ripple(const char *root, int num_dirs, int per_dir, int ring) {
+    struct ripple_fs_result result;
+    struct timing t = { NULL, 0, 0, 0 };
+    char **files, **dirs = make_names(root, num_dirs, per_dir, &files);
+    char *top[] = { (char *)root, NULL };
+
+    if (ring) {
+        unsetenv("RIPPLE_NO_URING");
+    } else {
+        setenv("RIPPLE_NO_URING", "1", 1);
+    }
+    double start = now_ms();
+    t.errors += ripple_fs_mkdir(dirs, num_dirs, 1, &result);
+    t.errors += ripple_fs_touch(files, num_dirs * per_dir, &result);
+    t.create_ms = now_ms() - start;
+    t.backend = ripple_fs_backend();
+
+    start = now_ms();
+    t.errors += ripple_fs_remove(top, 1, RIPPLE_RM_RECURSIVE, &result);
+    t.remove_ms = now_ms() - start;
+    if (result.files != (long)num_dirs * per_dir) {
+        fprintf(stderr, "bench_fsops: removed %ld files, expected %ld\n", result.files, (long)num_dirs * per_dir);
+        t.errors++;
+    }
+    free_names(dirs);
+    free_names(files);
+    return t;
+}
+
+static struct timing bench_coreutils(const char *root, int num_dirs, int per_dir) {
+    struct timing t = { "coreutils", 0, 0, 0 };
+    char **files, **dirs = make_names(root, num_dirs, per_dir, &files);
+    char **argv = malloc(sizeof(char *) * (num_dirs + per_dir + 3));
+
+    double start = now_ms();
+    argv[0] = "mkdir";
+    argv[1] = "-p";
+    memcpy(argv + 2, dirs, sizeof(char *) * (num_dirs + 1));
+    t.errors += run(argv) != 0;
+    for (int d = 0; d < num_dirs; d++) {
+        argv[0] = "touch";
+        memcpy(argv + 1, files + (size_t)d * per_dir, sizeof(char *) * per_dir);
+        argv[per_dir + 1] = NULL;
+        t.errors += run(argv) != 0;
+    }
+    t.create_ms = now_ms() - start;
+
+    start = now_ms();
+    char *rm[] = { "rm", "-rf", (char *)root, NULL };
+    t.errors += run(rm) != 0;
+    t.remove_ms = now_ms() - start;
+
+    free(argv);
+    free_names(dirs);
+    free_names(files);
+    return t;
+}
+
+static void print_row(const char *name, struct timing t, long files) {
+    printf("%-12s %10.1f %10.1f %12.0f\n", name, t.create_ms, t.remove_ms, files / (t.remove_ms / 1000.0));
+}
+
+int main(int argc, char **argv) {
+    int num_dirs = argc > 1 ? atoi(argv[1]) : 100;
+    int per_dir = argc > 2 ? atoi(argv[2]) : 1000;
+    const char *base = argc > 3 ? argv[3] : "/tmp";
+    char root[4096];
+
+    if (num_dirs <= 0 || per_dir <= 0) {
+        fprintf(stderr, "Usage: %s [dirs [files_per_dir [base]]]\n", argv[0]);
+        return 2;
+    }
+    long files = (long)num_dirs * per_dir;
+    snprintf(root, sizeof(root), "%s/ripple-bench-fs.%d", base, (int)getpid());
+
+    struct timing ring = bench_ripple(root, num_dirs, per_dir, 1);
+    struct timing pool = bench_ripple(root, num_dirs, per_dir, 0);
+    struct timing core = bench_coreutils(root, num_dirs, per_dir);
+
+    printf("%d directories x %d files\n", num_dirs, per_dir);
+    printf("%-12s %10s %10s %12s\n", "", "create ms", "rm -r ms", "unlinks/s");
+    print_row(ring.backend, ring, files);
+    print_row("threads", pool, files);
+    print_row("coreutils", core, files);
+
+    if (ring.errors || pool.errors || core.errors) {
+        fprintf(stderr, "bench_fsops: %ld errors\n", ring.errors + pool.errors + core.errors);
+        return 1;
+    }
+    return 0;
+}
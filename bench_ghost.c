@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ripple_ghost.h"
+#include "bench_util.h"
+
+// Replays a shell history through the inline suggestion index. Before each
+// line is added, every prefix of it is looked up as if typed one key at a
+// time; a keystroke is saved when the ghost text already shows the line.
+// Afterwards the index is checked against a linear scan of the history.
+//
+// Usage: bench_ghost [history_file]
+// Uses ~/.ripple_history, or a synthetic history if it has too few lines.
+
+struct unique_line {
+    const char *text;
+    int uses;
+    int last;
+};
+
+static int by_text(const void *a, const void *b) {
+    const struct unique_line *x = a, *y = b;
+    int cmp = strcmp(x->text, y->text);
+    return cmp ? cmp : x->last - y->last;
+}
+
+// Distinct lines with their use count and last position
+static struct unique_line *count_lines(char **lines, int count, int *unique) {
+    struct unique_line *all = malloc(sizeof(*all) * count);
+
+    for (int i = 0; i < count; i++) {
+        all[i].text = lines[i];
+        all[i].uses = 1;
+        all[i].last = i;
+    }
+    qsort(all, count, sizeof(*all), by_text);
+    *unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (*unique > 0 && strcmp(all[*unique - 1].text, all[i].text) == 0) {
+            all[*unique - 1].uses++;
+            all[*unique - 1].last = all[i].last;
+        } else {
+            all[(*unique)++] = all[i];
+        }
+    }
+    return all;
+}
+
+// The line the index should suggest: most used, then most recent
+static const char *scan_best(const struct unique_line *all, int unique, const char *prefix, size_t len) {
+    const struct unique_line *best = NULL;
+
+    for (int i = 0; i < unique; i++) {
+        if (strncmp(all[i].text, prefix, len) == 0 &&
+            (!best || all[i].uses > best->uses || (all[i].uses == best->uses && all[i].last > best->last))) {
+            best = &all[i];
+        }
+    }
+    return best && strlen(best->text) > len ? best->text : NULL;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : ripple_history_path();
+    int count;
+    char **lines = read_history(path, &count);
+
+    if (count < 100) {
+        path = "synthetic";
+        lines = synthetic_history(50000, &count);
+    }
+
+    long keystrokes = 0, saved = 0, lookups = 0;
+    double lookup_ns = 0, add_ns = 0, worst_ns = 0;
+
+    ripple_ghost_reset();
+    for (int i = 0; i < count; i++) {
+        const char *line = lines[i];
+        size_t len = strlen(line);
+        int accepted = 0;
+
+        keystrokes += len;
+        for (size_t k = 1; k < len; k++) {
+            double t0 = now_ns();
+            const char *ghost = ripple_ghost_lookup(line, k);
+            double t = now_ns() - t0;
+            lookup_ns += t;
+            worst_ns = t > worst_ns ? t : worst_ns;
+            lookups++;
+            if (!accepted && ghost && strcmp(ghost, line) == 0) {
+                saved += len - k - 1; // one right arrow instead of the rest
+                accepted = 1;
+            }
+        }
+        double t0 = now_ns();
+        ripple_ghost_add(line);
+        add_ns += now_ns() - t0;
+    }
+
+    // Spot-check prefixes against a linear scan
+    int unique_count;
+    struct unique_line *all = count_lines(lines, count, &unique_count);
+    unsigned seed = 3;
+    int checked = 0;
+    for (int i = 0; i < 200; i++) {
+        seed = seed * 1103515245 + 12345;
+        const char *line = lines[(seed >> 8) % count];
+        size_t k = 1 + (seed >> 4) % strlen(line);
+        const char *want = scan_best(all, unique_count, line, k);
+        const char *got = ripple_ghost_lookup(line, k);
+        if ((want == NULL) != (got == NULL) || (want && strcmp(want, got) != 0)) {
+            printf("\033[31mFAIL\033[0m prefix '%.*s': index '%s', scan '%s'\n",
+                   (int)k, line, got ? got : "(none)", want ? want : "(none)");
+            return 1;
+        }
+        checked++;
+    }
+    free(all);
+
+    size_t unique, nodes;
+    ripple_ghost_stats(&unique, &nodes);
+    printf("replayed %d lines from %s (%zu unique, %zu trie nodes)\n", count, path, unique, nodes);
+    printf("keystrokes saved by right arrow: %.1f%% of %ld\n", 100.0 * saved / keystrokes, keystrokes);
+    printf("lookup: %.0f ns/keystroke (worst %.1f us), add: %.2f us/line\n",
+           lookup_ns / lookups, worst_ns / 1e3, add_ns / count / 1e3);
+    printf("%d prefixes match a linear scan\n", checked);
+
+    for (int i = 0; i < count; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    ripple_ghost_reset();
+    return 0;
+}
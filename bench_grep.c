@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "ripple_grep.h"
+#include "bench_util.h"
+
+// Compares the grep builtin's search with GNU grep on a source tree: each
+// pattern is searched with line numbers, output going to /dev/null, best of
+// a few runs after one to warm the page cache. Match counts are checked
+// against grep -rc, so a faster wrong answer does not pass. Binary files
+// are skipped (-I) by both: GNU grep splits them at NULs as well as
+// newlines, so its counts there are not comparable.
+//
+// Usage: bench_grep [-j threads] [tree]
+// The tree defaults to /usr/include. Exits non-zero if counts differ.
+
+#define RUNS 3
+
+struct pattern {
+    const char *text;
+    const char *flags;             // for both; "-" for none
+    const char *kind;
+};
+
+static const struct pattern patterns[] = {
+    { "EXPORT_SYMBOL", "-", "rare literal" },
+    { "static", "-", "common literal" },
+    { "unsigned long", "-i", "literal, -i" },
+    { "#define [A-Z_]+_H$", "-E", "regex with a literal" },
+    { "(struct|union) [a-z_]+ \\{", "-E", "alternation" },
+    { "[0-9]{8}", "-E", "regex, no literal" },
+};
+#define NUM_PATTERNS (int)(sizeof(patterns) / sizeof(patterns[0]))
+
+static void set_opts(struct ripple_grep_opts *opts, const char *flags, int threads) {
+    memset(opts, 0, sizeof(*opts));
+    opts->line_numbers = 1;
+    opts->skip_binary = 1;
+    opts->ignore_case = strchr(flags, 'i') != NULL;
+    opts->extended = strchr(flags, 'E') != NULL;
+    opts->threads = threads;
+}
+
+// Run GNU grep with stdout to /dev/null, or to a pipe whose lines are
+// summed as per-file counts; returns the elapsed ms, or -1
+static double run_gnu(const struct pattern *p, const char *mode, const char *tree, long *total) {
+    int fds[2];
+    if (total && pipe(fds) != 0) {
+        return -1;
+    }
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int out = total ? fds[1] : open("/dev/null", O_WRONLY);
+        dup2(out, 1);
+        if (total) {
+            close(fds[0]);
+        }
+        setenv("LC_ALL", "C", 1);
+        if (strcmp(p->flags, "-") == 0) {
+            execlp("grep", "grep", mode, "--", p->text, tree, (char *)NULL);
+        } else {
+            execlp("grep", "grep", mode, p->flags, "--", p->text, tree, (char *)NULL);
+        }
+        _exit(127);
+    }
+    if (total) {
+        FILE *in = fdopen(fds[0], "r");
+        char line[8192];
+        close(fds[1]);
+        *total = 0;
+        while (fgets(line, sizeof(line), in)) {
+            char *colon = strrchr(line, ':');
+            *total += colon ? atol(colon + 1) : 0;
+        }
+        fclose(in);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+        return -1;
+    }
+    return now_ms() - start;
+}
+
+int main(int argc, char **argv) {
+    const char *tree = "/usr/include";
+    int threads = 0, opt, failed = 0;
+    char *paths[1];
+
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        if (opt == 'j') {
+            threads = atoi(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-j threads] [tree]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc) {
+        tree = argv[optind];
+    }
+    paths[0] = (char *)tree;
+    FILE *devnull = fopen("/dev/null", "w");
+    if (!devnull) {
+        perror("bench_grep: /dev/null");
+        return 2;
+    }
+
+    printf("%-22s %10s %10s %10s %8s\n", "pattern", "matches", "ripple ms", "grep ms", "speedup");
+    for (int i = 0; i < NUM_PATTERNS; i++) {
+        const struct pattern *p = &patterns[i];
+        struct ripple_grep_opts opts;
+        double ours = 1e18, theirs = 1e18;
+        long matches = 0, expected = 0;
+
+        set_opts(&opts, p->flags, threads);
+        for (int r = 0; r <= RUNS; r++) {
+            double start = now_ms();
+            if (ripple_grep_search(p->text, paths, 1, &opts, devnull, &matches) != 0) {
+                return 2;
+            }
+            double t = now_ms() - start;
+            double g = run_gnu(p, "-rnI", tree, NULL);
+            if (r > 0) {
+                ours = t < ours ? t : ours;
+                theirs = g >= 0 && g < theirs ? g : theirs;
+            }
+        }
+        if (run_gnu(p, "-rcI", tree, &expected) < 0) {
+            fprintf(stderr, "bench_grep: GNU grep failed on '%s'\n", p->text);
+            return 2;
+        }
+
+        printf("%-22s %10ld %10.1f %10.1f %7.2fx\n", p->kind, matches, ours, theirs, theirs / ours);
+        if (matches != expected) {
+            fprintf(stderr, "bench_grep: '%s': %ld matches, GNU grep found %ld\n", p->text, matches, expected);
+            failed = 1;
+        }
+    }
+    fclose(devnull);
+    return failed;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ripple_predict.h"
+#include "bench_util.h"
+
+// Replays a shell history through the offline predictor. Before each line
+// is learned, it asks for the next command (nothing typed) and for the
+// arguments after the first word, and scores the answers.
+//
+// Usage: bench_predict [history_file]
+// Uses $HISTFILE or ~/.bash_history, or a synthetic history if neither has
+// enough lines.
+
+// Follow cd so predictions are keyed by the directory the line ran in
+static void track_cd(char *cwd, size_t size, const char *line) {
+    if (strncmp(line, "cd ", 3) != 0) {
+        return;
+    }
+    const char *dir = line + 3;
+    if (dir[0] == '/' || dir[0] == '~') {
+        snprintf(cwd, size, "%s", dir);
+    } else if (strcmp(dir, "..") == 0) {
+        char *slash = strrchr(cwd, '/');
+        if (slash && slash != cwd) {
+            *slash = '\0';
+        }
+    } else {
+        size_t len = strlen(cwd);
+        snprintf(cwd + len, size - len, "/%s", dir);
+    }
+}
+
+// A prediction counts when it is the line or the line up to a word boundary
+static int matches(const char *prediction, const char *line) {
+    size_t len = strlen(prediction);
+    return strncmp(prediction, line, len) == 0 && (line[len] == '\0' || line[len] == ' ');
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : getenv("HISTFILE");
+    char default_path[1024];
+    int count;
+
+    if (!path || !*path) {
+        const char *home = getenv("HOME");
+        snprintf(default_path, sizeof(default_path), "%s/.bash_history", home ? home : ".");
+        path = default_path;
+    }
+    char **lines = read_history(path, &count);
+    if (count < 100) {
+        path = "synthetic";
+        lines = synthetic_history(3000, &count);
+    }
+
+    struct ripple_prediction out[3];
+    char cwd[1024] = "~";
+    int next_total = 0, next_top1 = 0, next_top3 = 0;
+    int arg_total = 0, arg_top1 = 0, arg_top3 = 0;
+    double predict_ns = 0, observe_ns = 0;
+    int predictions = 0;
+
+    ripple_predict_reset();
+    for (int i = 0; i < count; i++) {
+        const char *line = lines[i];
+        double t0 = now_ns();
+        int n = ripple_predict(cwd, "", out, 3);
+        predict_ns += now_ns() - t0;
+        predictions++;
+        next_total++;
+        for (int j = 0; j < n; j++) {
+            if (strcmp(out[j].text, line) == 0) {
+                next_top1 += j == 0;
+                next_top3++;
+                break;
+            }
+        }
+
+        // Arguments once the first word and a space are typed
+        const char *space = strchr(line, ' ');
+        if (space) {
+            char typed[1024];
+            snprintf(typed, sizeof(typed), "%.*s ", (int)(space - line), line);
+            t0 = now_ns();
+            n = ripple_predict(cwd, typed, out, 3);
+            predict_ns += now_ns() - t0;
+            predictions++;
+            arg_total++;
+            for (int j = 0; j < n; j++) {
+                if (matches(out[j].text, line)) {
+                    arg_top1 += j == 0;
+                    arg_top3++;
+                    break;
+                }
+            }
+        }
+
+        t0 = now_ns();
+        ripple_predict_observe(cwd, line);
+        observe_ns += now_ns() - t0;
+        track_cd(cwd, sizeof(cwd), line);
+    }
+
+    // The saved model must predict exactly what the live one does
+    char model_path[64];
+    struct ripple_prediction before[3], after[3];
+    snprintf(model_path, sizeof(model_path), "/tmp/bench_predict.%d", (int)getpid());
+    int n_before = ripple_predict(cwd, "", before, 3);
+    int failed = ripple_predict_save(model_path) != 0 || ripple_predict_load(model_path) != 0;
+    int n_after = ripple_predict(cwd, "", after, 3);
+    failed |= n_before != n_after;
+    for (int i = 0; !failed && i < n_after; i++) {
+        failed |= strcmp(before[i].text, after[i].text) != 0 || before[i].score != after[i].score;
+    }
+    FILE *file = fopen(model_path, "rb");
+    long size = 0;
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fclose(file);
+    }
+    unlink(model_path);
+    if (failed) {
+        printf("\033[31mFAIL\033[0m saved model predicts differently\n");
+        return 1;
+    }
+
+    unsigned strings, contexts;
+    unsigned long observed;
+    ripple_predict_stats(&strings, &contexts, &observed);
+    printf("replayed %d lines from %s (%u strings, %u contexts, %ld byte model file)\n",
+           count, path, strings, contexts, size);
+    printf("next command: top-1 %5.1f%%  top-3 %5.1f%%  (%d predictions)\n",
+           100.0 * next_top1 / next_total, 100.0 * next_top3 / next_total, next_total);
+    if (arg_total > 0) {
+        printf("arguments:    top-1 %5.1f%%  top-3 %5.1f%%  (%d predictions)\n",
+               100.0 * arg_top1 / arg_total, 100.0 * arg_top3 / arg_total, arg_total);
+    }
+    printf("latency:      %.2f us/prediction, %.2f us/update\n",
+           predict_ns / predictions / 1e3, observe_ns / count / 1e3);
+
+    for (int i = 0; i < count; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    return 0;
+}
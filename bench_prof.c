@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ripple_prof.h"
+#include "ollama_integration.h"
+#include "ripple_expand.h"
+#include "bench_util.h"
+
+// Measures what the span profiler costs: a begin/end pair with profiling
+// off and on, the slowdown of parsing alone (split and expand, timed the
+// way ripple_loop times them), and the share of a whole command cycle,
+// parse plus fork, exec and wait of /bin/true, that its spans take.
+//
+// Usage: bench_prof [iterations]
+// Exits non-zero when spans add over 1% to a command cycle.
+
+#define DEFAULT_ITERATIONS 200000
+#define COMMANDS 200               // /bin/true runs per round
+#define SPANS_PER_COMMAND 8        // prompt, split_line, expand, launch, fork, wait, two spare
+#define MAX_OVERHEAD 0.01
+#define ROUNDS 5                   // alternate off/on runs and keep the best of each
+
+static const char *lines[] = {
+    "ls -la /usr/local/bin",
+    "git commit -m \"fix the parser\" --amend",
+    "grep -rn 'TODO' src include | sort | uniq -c",
+    "echo $HOME/projects/*.c",
+    "cd ~/src/ripple && make -j8 shell2_complete_ai",
+};
+#define NUM_LINES (int)(sizeof(lines) / sizeof(lines[0]))
+
+// Normally the shell core's; the lines below have no command substitution
+int (*builtin_func[])(char **) = { NULL };
+
+int ripple_builtin_index(const char *name) {
+    (void)name;
+    return -1;
+}
+
+int ripple_run_line(char **tokens) {
+    (void)tokens;
+    return 1;
+}
+
+// One parse as the loop does it, with its two spans
+static void parse(const char *text) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s", text);
+
+    uint64_t span = ripple_prof_begin();
+    char **args = ripple_split_line(line);
+    ripple_prof_end(span, "split_line");
+
+    span = ripple_prof_begin();
+    char **expanded = ripple_expand_args(args);
+    ripple_prof_end(span, "expand");
+    ripple_free_args(expanded);
+    free(args);
+}
+
+static double time_parsing(int iterations) {
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        parse(lines[i % NUM_LINES]);
+    }
+    return (now_ns() - start) / iterations;
+}
+
+static double time_commands(void) {
+    char *argv[] = { "/bin/true", NULL };
+    double start = now_ns();
+    for (int i = 0; i < COMMANDS; i++) {
+        parse(lines[i % NUM_LINES]);
+        pid_t pid = fork();
+        if (pid == 0) {
+            execv(argv[0], argv);
+            _exit(127);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return (now_ns() - start) / COMMANDS;
+}
+
+static double time_spans(int iterations) {
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        uint64_t span = ripple_prof_begin();
+        ripple_prof_end(span, "empty");
+    }
+    return (now_ns() - start) / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    double off_span = 1e18, on_span = 1e18, off_parse = 1e18, on_parse = 1e18, command = 1e18;
+    long events = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+    for (int r = 0; r < ROUNDS; r++) {
+        double t = time_spans(iterations * 10);
+        off_span = t < off_span ? t : off_span;
+        t = time_parsing(iterations);
+        off_parse = t < off_parse ? t : off_parse;
+        t = time_commands();
+        command = t < command ? t : command;
+
+        ripple_prof_start();
+        t = time_spans(iterations * 10);
+        on_span = t < on_span ? t : on_span;
+        t = time_parsing(iterations);
+        on_parse = t < on_parse ? t : on_parse;
+        if (ripple_prof_stop("/dev/null", &events) != 0) {
+            perror("bench_prof: /dev/null");
+            return 2;
+        }
+    }
+
+    // Parsing alone is a microsecond, so two spans show up there; what
+    // the user waits on is the command
+    double parse_overhead = (on_parse - off_parse) / off_parse;
+    double overhead = SPANS_PER_COMMAND * (on_span - off_span) / command;
+    printf("span pair, profiling off: %10.2f ns\n", off_span);
+    printf("span pair, profiling on:  %10.2f ns\n", on_span);
+    printf("parse, profiling off:     %10.1f ns\n", off_parse);
+    printf("parse, profiling on:      %10.1f ns (%+.2f%%, %ld spans kept)\n", on_parse, parse_overhead * 100,
+           events);
+    printf("command cycle:            %10.1f ns (%d spans add %.3f%%)\n", command, SPANS_PER_COMMAND,
+           overhead * 100);
+
+    if (overhead > MAX_OVERHEAD) {
+        fprintf(stderr, "bench_prof: spans add %.2f%% to a command, over %.0f%%\n", overhead * 100,
+                MAX_OVERHEAD * 100);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "ripple_prompt.h"
+#include "bench_util.h"
+
+// Times what drawing the prompt costs the shell inside a git repository:
+// computing the git segment synchronously (a git status per prompt), the
+// render the shell now does before every command, and how long after a cold
+// render the background result arrives.
+//
+// Usage: bench_prompt [dir [rounds]]
+// Defaults to the current directory and 200 rounds. Exits non-zero if dir
+// is not in a repository or the background result never arrives.
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, double *ms, int n) {
+    qsort(ms, n, sizeof(double), cmp_double);
+    printf("%-22s %10.3f %10.3f %10.3f\n", name, ms[n / 2], ms[n * 95 / 100], ms[n - 1]);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : ".";
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    char segment[RIPPLE_PROMPT_SEGMENT], out[RIPPLE_PROMPT_SIZE];
+
+    if (rounds <= 0 || chdir(dir) != 0) {
+        fprintf(stderr, "Usage: %s [dir [rounds]]\n", argv[0]);
+        return 2;
+    }
+    if (!ripple_prompt_git(ripple_prompt_cwd(), segment, sizeof(segment))) {
+        fprintf(stderr, "bench_prompt: %s is not in a git repository\n", dir);
+        return 2;
+    }
+    int sync_rounds = rounds < 20 ? rounds : 20;
+    double *ms = malloc(sizeof(double) * rounds);
+    printf("%s: (%s)\n", ripple_prompt_cwd(), segment);
+    printf("%-22s %10s %10s %10s\n", "ms", "p50", "p95", "max");
+
+    for (int i = 0; i < sync_rounds; i++) {
+        double start = now_ms();
+        ripple_prompt_git(ripple_prompt_cwd(), segment, sizeof(segment));
+        ms[i] = now_ms() - start;
+    }
+    report("synchronous git", ms, sync_rounds);
+
+    // A cold render shows no git segment and queues the refresh; the line
+    // editor would redraw when the notify fd turns readable
+    struct pollfd pfd = { 0, POLLIN, 0 };
+    double start = now_ms();
+    double first = 0;
+    ripple_prompt_render(out, sizeof(out));
+    first = now_ms() - start;
+    pfd.fd = ripple_prompt_notify_fd();
+    int arrived = ripple_prompt_pending() && poll(&pfd, 1, 10000) == 1;
+    ripple_prompt_drain();
+    printf("%-22s %10.3f\n", "cold render", first);
+    printf("%-22s %10.3f\n", "background result", now_ms() - start);
+
+    for (int i = 0; i < rounds; i++) {
+        double start = now_ms();
+        ripple_prompt_render(out, sizeof(out));
+        ms[i] = now_ms() - start;
+    }
+    report("cached render", ms, rounds);
+    free(ms);
+    return !arrived;
+}
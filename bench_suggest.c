@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ollama_integration.h"
+#include "ollama_config.h"
+#include "bench_util.h"
+
+// Compares free-text suggestions against schema-constrained JSON ones:
+// tokens generated, wall time and how many suggestions parse.
+//
+// Usage: bench_suggest [endpoint] [rounds]
+// Uses the configured endpoint (~/.ripple_ai.conf) when none is given.
+
+static const char *prompts[] = {
+    "git comm", "find . -na", "tar -x", "cd sr", "grep -r", "docker ps", "ls -l", "cd /var"
+};
+#define NUM_PROMPTS (sizeof(prompts) / sizeof(prompts[0]))
+
+static void run_mode(const char *label, const char *structured, const char *num_predict, int rounds) {
+    struct ollama_suggestion out[RIPPLE_MAX_SUGGESTIONS];
+    long long tokens = 0;
+    double wall = 0;
+    int parsed = 0, failed = 0, requests = 0;
+
+    ollama_config_set("structured", structured);
+    ollama_config_set("num_predict", num_predict);
+
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < NUM_PROMPTS; i++) {
+            double t0 = now_ms();
+            int n = get_ollama_suggestions(prompts[i], out, RIPPLE_MAX_SUGGESTIONS, NULL);
+            wall += now_ms() - t0;
+            requests++;
+            if (n < 0) {
+                failed++;
+                continue;
+            }
+            long long eval_count, total_ns;
+            ollama_get_last_metrics(&eval_count, &total_ns);
+            tokens += eval_count;
+            parsed += n;
+        }
+    }
+
+    int ok = requests - failed;
+    printf("%-11s num_predict=%-4s %6.1f tokens  %8.1f ms  %4.2f parsed  (%d/%d ok)\n", label, num_predict,
+           ok ? (double)tokens / ok : 0.0, requests ? wall / requests : 0.0,
+           ok ? (double)parsed / ok : 0.0, ok, requests);
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 2 ? atoi(argv[2]) : 3;
+
+    ollama_config_load(NULL);
+    if (argc > 1) {
+        ollama_config_set("endpoint", argv[1]);
+    }
+    // Same route every time so only the output format differs
+    ollama_config_set("large_model", "");
+
+    printf("per request averages over %d prompts x %d rounds\n", (int)NUM_PROMPTS, rounds);
+    run_mode("free text", "0", "300", rounds);
+    run_mode("structured", "1", "128", rounds);
+    return 0;
+}
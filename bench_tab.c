@@ -0,0 +1,422 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include "ollama_integration.h"
+#include "ollama_config.h"
+#include "test_mock.h"
+#include "bench_util.h"
+
+// End-to-end TAB latency against mock_ollama, so it runs without a model.
+// Each scenario starts a mock with its own delays and failure mode, then
+// times get_ollama_completion, suggest_command, or the whole shell driven
+// through a pty (keystrokes in, suggestions out). Prints one JSON document
+// on stdout for regression tracking; progress goes to stderr.
+//
+// Usage: bench_tab [-n iterations] [scenario...]
+// Run from the source directory after building shell2_complete_ai and
+// mock_ollama.
+
+enum { DRIVE_COMPLETION, DRIVE_SUGGEST, DRIVE_PTY };
+
+static const struct scenario {
+    const char *name;
+    int drive;
+    const char *mock_args;     // extra mock_ollama options
+} scenarios[] = {
+    { "completion", DRIVE_COMPLETION, "-d 2" },
+    { "suggest", DRIVE_SUGGEST, "-d 2" },
+    { "suggest_slow_start", DRIVE_SUGGEST, "-d 2 -l 150" },
+    { "suggest_jitter", DRIVE_SUGGEST, "-d 2 -j 20" },
+    { "suggest_flaky", DRIVE_SUGGEST, "-d 2 -f 500 -r 20" },
+    { "suggest_slow_tokens", DRIVE_SUGGEST, "-d 25" },
+    { "tab_pty", DRIVE_PTY, "-d 2" },
+    { "tab_pty_jitter", DRIVE_PTY, "-d 2 -j 20" },
+};
+#define NUM_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+#define PTY_TIMEOUT_MS 10000
+#define PROMPT_MARKER "\033[0m > "    // end of the prompt, redrawn under the suggestions
+
+// Every allocation in the process, libcurl's included. glibc lets a program
+// replace malloc and still reach the real one; elsewhere nothing is counted.
+#ifdef __GLIBC__
+#define HAVE_ALLOC_COUNT 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+static unsigned long allocations;
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(p, size);
+}
+
+static unsigned long allocation_count(void) {
+    return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+#endif
+
+struct result {
+    int ok;
+    int errors;
+    double *first;            // time to the first suggestion per request
+    double *total;            // time until the prompt is back
+    long allocs;              // -1 when not measured
+    long syscalls;
+    long switches;
+};
+
+// read and write calls made by a process so far (Linux /proc/<pid>/io),
+// or -1 where that is not available
+static long io_syscalls(pid_t pid) {
+    char path[64], line[128];
+    long total = 0, n;
+    int found = 0;
+
+    snprintf(path, sizeof(path), pid ? "/proc/%d/io" : "/proc/self/io", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "syscr: %ld", &n) == 1 || sscanf(line, "syscw: %ld", &n) == 1) {
+            total += n;
+            found++;
+        }
+    }
+    fclose(f);
+    return found == 2 ? total : -1;
+}
+
+static long context_switches(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+static void stop_child(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+// In-process: the client library alone, stdout (suggest_command's menu)
+// sent to /dev/null
+static void drive_in_process(const struct scenario *sc, int iterations, struct result *r) {
+    struct ollama_suggestion out[RIPPLE_MAX_SUGGESTIONS];
+    char prompt[64];
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+#ifdef HAVE_ALLOC_COUNT
+    unsigned long allocs0 = allocation_count();
+#endif
+    long sys0 = io_syscalls(0), cs0 = context_switches();
+    for (int i = 0; i < iterations; i++) {
+        // Distinct prompts, so nothing is shared with the previous request
+        snprintf(prompt, sizeof(prompt), "git comm %d", i);
+        double t0 = now_ms();
+        int good;
+        if (sc->drive == DRIVE_COMPLETION) {
+            char *text = get_ollama_completion(prompt);
+            good = text != NULL;
+            free(text);
+        } else {
+            good = suggest_command(prompt, out, 0, RIPPLE_MAX_SUGGESTIONS) > 0;
+        }
+        fflush(stdout);
+        double elapsed = now_ms() - t0;
+        if (good) {
+            // The menu is printed in one go once the model has answered
+            r->first[r->ok] = elapsed;
+            r->total[r->ok++] = elapsed;
+        } else {
+            r->errors++;
+        }
+    }
+    long sys1 = io_syscalls(0);
+#ifdef HAVE_ALLOC_COUNT
+    r->allocs = allocation_count() - allocs0;
+#endif
+    r->syscalls = sys0 >= 0 && sys1 >= 0 ? sys1 - sys0 : -1;
+    r->switches = context_switches() - cs0;
+
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+// Wait until marker shows up in what the shell printed since *len was
+// reset; returns the time it did, or -1 on timeout
+static double wait_for(int fd, char *buf, size_t *len, size_t size, const char *marker, double deadline) {
+    while (!strstr(buf, marker)) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int wait = (int)(deadline - now_ms());
+        if (wait <= 0 || poll(&pfd, 1, wait) <= 0) {
+            return -1;
+        }
+        ssize_t n = read(fd, buf + *len, size - 1 - *len);
+        if (n <= 0) {
+            return -1;
+        }
+        *len += n;
+        buf[*len] = '\0';
+        if (*len >= size - 1) {
+            // Keep the tail; a marker never spans more than that
+            memmove(buf, buf + *len - 64, 64);
+            *len = 64;
+            buf[*len] = '\0';
+        }
+    }
+    return now_ms();
+}
+
+static void drain(int fd, int quiet_ms) {
+    char junk[4096];
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (poll(&pfd, 1, quiet_ms) > 0 && read(fd, junk, sizeof(junk)) > 0) {
+    }
+}
+
+// The whole shell on a pty: type a command, press TAB, and time the first
+// suggestion line and the redrawn prompt
+static void drive_pty(int port, int iterations, struct result *r, const char *home) {
+    char config[512], buf[65536], prompt[64];
+    size_t len;
+
+    snprintf(config, sizeof(config), "%s/ai.conf", home);
+    FILE *f = fopen(config, "w");
+    if (!f) {
+        perror("bench_tab: config");
+        r->errors = iterations;
+        return;
+    }
+    fprintf(f, "endpoint = http://127.0.0.1:%d/api/generate\nmodel = small\nrate_limit = 0\nbreaker_failures = 0\n",
+            port);
+    fclose(f);
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("bench_tab: pty");
+        r->errors = iterations;
+        return;
+    }
+    struct winsize ws = { 24, 120, 0, 0 };
+    pid_t pid = fork();
+    if (pid == 0) {
+        setsid();
+        int slave = open(ptsname(master), O_RDWR);
+        ioctl(slave, TIOCSCTTY, 0);
+        ioctl(slave, TIOCSWINSZ, &ws);
+        dup2(slave, 0);
+        dup2(slave, 1);
+        dup2(slave, 2);
+        close(master);
+        close(slave);
+        setenv("HOME", home, 1);
+        setenv("RIPPLE_AI_CONFIG", config, 1);
+        setenv("RIPPLE_NO_DAEMON", "1", 1);
+        execl("./shell2_complete_ai", "shell2_complete_ai", (char *)NULL);
+        _exit(127);
+    }
+
+    // Wait for the first prompt and for the warm-up to finish
+    len = 0;
+    buf[0] = '\0';
+    if (wait_for(master, buf, &len, sizeof(buf), "> ", now_ms() + PTY_TIMEOUT_MS) < 0) {
+        fprintf(stderr, "bench_tab: the shell did not start\n");
+        r->errors = iterations;
+        stop_child(pid);
+        close(master);
+        return;
+    }
+    drain(master, 500);
+
+    long sys0 = io_syscalls(pid);
+    for (int i = 0; i < iterations; i++) {
+        int n = snprintf(prompt, sizeof(prompt), "git comm %d", i);
+        write(master, prompt, n);
+        drain(master, 20);
+
+        len = 0;
+        buf[0] = '\0';
+        double t0 = now_ms();
+        write(master, "\t", 1);
+        double first = wait_for(master, buf, &len, sizeof(buf), "  1) ", t0 + PTY_TIMEOUT_MS);
+        double done = wait_for(master, buf, &len, sizeof(buf), PROMPT_MARKER, t0 + PTY_TIMEOUT_MS);
+        if (first < 0 || done < 0) {
+            r->errors++;
+        } else {
+            r->first[r->ok] = first - t0;
+            r->total[r->ok++] = done - t0;
+        }
+
+        // Erase the line for the next round
+        for (int j = 0; j < n; j++) {
+            write(master, "\x7f", 1);
+        }
+        drain(master, 20);
+    }
+    long sys1 = io_syscalls(pid);
+    r->syscalls = sys0 >= 0 && sys1 >= 0 ? sys1 - sys0 : -1;
+
+    write(master, "exit\r", 5);
+    drain(master, 200);
+    stop_child(pid);
+    close(master);
+    unlink(config);
+}
+
+// The shell leaves its history and directory files behind
+static void remove_home(const char *home) {
+    char path[1024];
+    DIR *dir = opendir(home);
+    struct dirent *e;
+
+    while (dir && (e = readdir(dir)) != NULL) {
+        if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+            snprintf(path, sizeof(path), "%s/%s", home, e->d_name);
+            unlink(path);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    rmdir(home);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array
+static double percentile(const double *v, int n, double p) {
+    int i = (int)(p / 100.0 * n + 0.999999) - 1;
+    return v[i < 0 ? 0 : i >= n ? n - 1 : i];
+}
+
+static void print_latency(const char *key, double *v, int n) {
+    if (n == 0) {
+        printf("\"%s\": null", key);
+        return;
+    }
+    qsort(v, n, sizeof(double), compare_double);
+    printf("\"%s\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}", key,
+           percentile(v, n, 50), percentile(v, n, 95), percentile(v, n, 99), v[n - 1]);
+}
+
+static void print_per_op(const char *key, long count, int ops) {
+    if (count < 0 || ops == 0) {
+        printf("\"%s\": null", key);
+    } else {
+        printf("\"%s\": %.1f", key, (double)count / ops);
+    }
+}
+
+static int selected(const char *name, int argc, char **argv) {
+    if (optind >= argc) {
+        return 1;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int iterations = 50, opt, first_result = 1;
+    int port = 21000 + getpid() % 1000;
+    char home[] = "/tmp/ripple-tab-XXXXXX";
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [scenario...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (iterations <= 0 || !mkdtemp(home)) {
+        fprintf(stderr, "bench_tab: bad iteration count or no temp dir\n");
+        return 1;
+    }
+    // Keep the user's config, index and history out of the numbers
+    setenv("HOME", home, 1);
+    ollama_config_set("model", "small");
+    ollama_config_set("rate_limit", "0");
+    ollama_config_set("breaker_failures", "0");
+
+    printf("{\"benchmark\": \"bench_tab\", \"iterations\": %d, \"results\": [", iterations);
+    for (size_t s = 0; s < NUM_SCENARIOS; s++) {
+        const struct scenario *sc = &scenarios[s];
+        struct result r = { 0, 0, calloc(iterations, sizeof(double)), calloc(iterations, sizeof(double)),
+                            -1, -1, -1 };
+        if (!selected(sc->name, argc, argv)) {
+            free(r.first);
+            free(r.total);
+            continue;
+        }
+        fprintf(stderr, "bench_tab: %s (mock %s)\n", sc->name, sc->mock_args);
+
+        port++;
+        pid_t mock = start_mock(port, sc->mock_args);
+        if (sc->drive == DRIVE_PTY) {
+            drive_pty(port, iterations, &r, home);
+        } else {
+            use_port(port);
+            ollama_warmup_async();
+            usleep(300 * 1000);
+            drive_in_process(sc, iterations, &r);
+        }
+        stop_mock(mock);
+
+        printf("%s\n  {\"name\": \"%s\", \"mock\": \"%s\", \"driver\": \"%s\", \"ok\": %d, \"errors\": %d, ",
+               first_result ? "" : ",", sc->name, sc->mock_args,
+               sc->drive == DRIVE_PTY ? "pty" : sc->drive == DRIVE_SUGGEST ? "suggest_command" : "get_ollama_completion",
+               r.ok, r.errors);
+        print_latency("first_suggestion_ms", r.first, r.ok);
+        printf(", ");
+        print_latency("total_ms", r.total, r.ok);
+        printf(", ");
+        print_per_op("allocs_per_op", r.allocs, iterations);
+        printf(", ");
+        print_per_op("io_syscalls_per_op", r.syscalls, iterations);
+        printf(", ");
+        print_per_op("context_switches_per_op", r.switches, iterations);
+        printf("}");
+        fflush(stdout);
+        first_result = 0;
+        free(r.first);
+        free(r.total);
+    }
+    printf("\n]}\n");
+    remove_home(home);
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "ripple_tail.h"
+#include "bench_util.h"
+
+// Shows that head and tail cost the same on a small file and a huge one,
+// and how quickly tail -f passes on an append. Files of growing size are
+// written once; for each, the time of tail -n 10 and head -n 10 is taken
+// against reading the whole file line by line with fgets, which is what
+// viewing the end of a file with cat costs. Output is compared byte for
+// byte with GNU head and tail, including files without a final newline.
+// Follow latency is the time from write() of a line to reading it back
+// from the pipe tail -f prints to.
+//
+// Usage: bench_tail [max_megabytes]
+// Defaults to 1024. Exits non-zero if output differs from GNU.
+
+#define RUNS 5
+#define APPENDS 200
+
+static int write_lines(const char *path, long megabytes, int final_newline) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    long target = megabytes << 20, written = 0;
+    for (long i = 0; written < target; i++) {
+        written += fprintf(f, "%ld request served in %ld us\n", i, (i * 7919) % 1000);
+    }
+    if (!final_newline) {
+        fputs("partial last line", f);
+    }
+    return fclose(f);
+}
+
+// Run fn into a memory buffer; returns the output (caller frees)
+static char *capture_ours(const char *path, int tail, long count, int bytes, size_t *len) {
+    char *out = NULL;
+    FILE *mem = open_memstream(&out, len);
+    int fd = open(path, O_RDONLY);
+    off_t end;
+    if (tail) {
+        ripple_tail_fd(fd, count, bytes, mem, &end);
+    } else {
+        ripple_head_fd(fd, count, bytes, mem);
+    }
+    close(fd);
+    fclose(mem);
+    return out;
+}
+
+static char *capture_gnu(const char *path, int tail, long count, int bytes, size_t *len) {
+    char arg[32], *out = NULL;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return NULL;
+    }
+    snprintf(arg, sizeof(arg), "-%c%ld", bytes ? 'c' : 'n', count);
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], 1);
+        close(fds[0]);
+        execlp(tail ? "tail" : "head", tail ? "tail" : "head", arg, path, (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    FILE *mem = open_memstream(&out, len);
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, (size_t)n, mem);
+    }
+    fclose(mem);
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    return out;
+}
+
+static int check(const char *path, int tail, long count, int bytes) {
+    size_t ours_len, gnu_len;
+    char *ours = capture_ours(path, tail, count, bytes, &ours_len);
+    char *gnu = capture_gnu(path, tail, count, bytes, &gnu_len);
+    int same = ours && gnu && ours_len == gnu_len && memcmp(ours, gnu, ours_len) == 0;
+    if (!same) {
+        fprintf(stderr, "bench_tail: %s -%c %ld %s differs from GNU (%zu vs %zu bytes)\n", tail ? "tail" : "head",
+                bytes ? 'c' : 'n', count, path, ours_len, gnu_len);
+    }
+    free(ours);
+    free(gnu);
+    return same ? 0 : 1;
+}
+
+static double best_of(const char *path, int tail, FILE *devnull) {
+    double best = 1e18;
+    for (int r = 0; r < RUNS; r++) {
+        int fd = open(path, O_RDONLY);
+        off_t end;
+        double start = now_ms();
+        if (tail) {
+            ripple_tail_fd(fd, 10, 0, devnull, &end);
+        } else {
+            ripple_head_fd(fd, 10, 0, devnull);
+        }
+        double t = now_ms() - start;
+        close(fd);
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+// Keep the last 10 lines while reading every line, as the fgets loop of cat would
+static double fgets_tail(const char *path) {
+    char line[4096], last[10][4096];
+    long n = 0;
+    double start = now_ms();
+    FILE *f = fopen(path, "r");
+    while (f && fgets(line, sizeof(line), f)) {
+        memcpy(last[n++ % 10], line, strlen(line) + 1);
+    }
+    if (f) {
+        fclose(f);
+    }
+    return now_ms() - start;
+}
+
+struct follower {
+    const char *path;
+    int out_fd;
+    int stop_fd;
+};
+
+static void *follow_thread(void *arg) {
+    struct follower *f = arg;
+    FILE *out = fdopen(f->out_fd, "w");
+    int fd = open(f->path, O_RDONLY);
+    off_t end = lseek(fd, 0, SEEK_END);
+    ripple_tail_follow(f->path, fd, end, out, f->stop_fd);
+    fclose(out);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Append lines one at a time and time each one's arrival through tail -f
+static int follow_latency(const char *path) {
+    int out[2], stop[2];
+    double lat[APPENDS];
+    if (write_lines(path, 1, 1) != 0 || pipe(out) != 0 || pipe(stop) != 0) {
+        return -1;
+    }
+    struct follower f = { path, out[1], stop[0] };
+    pthread_t tid;
+    pthread_create(&tid, NULL, follow_thread, &f);
+    usleep(100000); // let it reach the end and start waiting
+
+    int fd = open(path, O_WRONLY | O_APPEND);
+    char buf[256];
+    for (int i = 0; i < APPENDS; i++) {
+        int len = snprintf(buf, sizeof(buf), "appended line %d\n", i);
+        double start = now_ms();
+        if (write(fd, buf, (size_t)len) != len) {
+            return -1;
+        }
+        for (int got = 0; got < len;) {
+            ssize_t n = read(out[0], buf + got, sizeof(buf) - got);
+            if (n <= 0) {
+                return -1;
+            }
+            got += (int)n;
+        }
+        lat[i] = now_ms() - start;
+    }
+    close(fd);
+    close(stop[1]);
+    pthread_join(tid, NULL);
+    close(out[0]);
+    close(stop[0]);
+
+    qsort(lat, APPENDS, sizeof(double), compare_double);
+    printf("tail -f append-to-output latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", lat[APPENDS / 2],
+           lat[APPENDS * 99 / 100], lat[APPENDS - 1]);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long max_mb = argc > 1 ? atol(argv[1]) : 1024;
+    char path[4096];
+    int failed = 0;
+    FILE *devnull = fopen("/dev/null", "w");
+
+    if (max_mb <= 0 || !devnull) {
+        fprintf(stderr, "Usage: %s [max_megabytes]\n", argv[0]);
+        return 2;
+    }
+    snprintf(path, sizeof(path), "/tmp/ripple-bench-tail.%d", (int)getpid());
+
+    // Edge cases first: no final newline, fewer lines than asked, blocks
+    for (int final_newline = 0; final_newline <= 1; final_newline++) {
+        static const long counts[] = { 0, 1, 10, 5000, 100000 };
+        if (write_lines(path, 2, final_newline) != 0) {
+            perror("bench_tail: sample");
+            return 2;
+        }
+        for (int c = 0; c < 5; c++) {
+            failed |= check(path, 1, counts[c], 0) | check(path, 0, counts[c], 0);
+            failed |= check(path, 1, counts[c] * 3, 1) | check(path, 0, counts[c] * 3, 1);
+        }
+    }
+
+    printf("%-10s %12s %12s %12s\n", "size MB", "tail ms", "head ms", "fgets ms");
+    for (long mb = 1; mb <= max_mb; mb *= 8) {
+        if (write_lines(path, mb, 1) != 0) {
+            perror("bench_tail: sample");
+            return 2;
+        }
+        failed |= check(path, 1, 10, 0);
+        printf("%-10ld %12.3f %12.3f %12.1f\n", mb, best_of(path, 1, devnull), best_of(path, 0, devnull),
+               fgets_tail(path));
+    }
+    if (follow_latency(path) != 0) {
+        fprintf(stderr, "bench_tail: follow failed\n");
+        failed = 1;
+    }
+    unlink(path);
+    fclose(devnull);
+    return failed;
+}
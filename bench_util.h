@@ -0,0 +1,83 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Clocks and inputs shared by the benchmarks and tests.
+
+#define BENCH_MAX_HISTORY 200000
+
+static inline double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static inline double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The non-empty lines of a history file, oldest first, without bash's
+// "#<epoch>" timestamp lines. An unreadable file gives no lines.
+static inline char **read_history(const char *path, int *count) {
+    FILE *file = fopen(path, "r");
+    char line[1024];
+    char **lines = malloc(sizeof(char *) * BENCH_MAX_HISTORY);
+
+    *count = 0;
+    if (!file) {
+        return lines;
+    }
+    while (*count < BENCH_MAX_HISTORY && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0' && !(line[0] == '#' && line[1] >= '0' && line[1] <= '9')) {
+            lines[(*count)++] = strdup(line);
+        }
+    }
+    fclose(file);
+    return lines;
+}
+
+// About want lines of repetitive sessions in a project and a log directory,
+// with some noise and a long tail of one-off commands, like a real
+// developer's history. The same want always gives the same lines.
+static inline char **synthetic_history(int want, int *count) {
+    static const char *project[] = { "git status", "git diff", "make -j8", "./run_tests", "git add -A",
+                                     "git commit -m wip", "git push" };
+    static const char *logs[] = { "ls -la", "tail -n 100 app.log", "grep ERROR app.log", "less app.log" };
+    static const char *noise[] = { "htop", "df -h", "ssh build01", "vim notes.txt", "man tar", "date" };
+    char **lines = malloc(sizeof(char *) * (want + 16));
+    unsigned seed = 7;
+    char line[128];
+
+    *count = 0;
+    while (*count < want) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 3 == 0) {
+            lines[(*count)++] = strdup("cd /var/log/myapp");
+            for (int i = 0; i < 4; i++) {
+                lines[(*count)++] = strdup(logs[i]);
+            }
+            continue;
+        }
+        lines[(*count)++] = strdup("cd ~/src/project");
+        for (int i = 0; i < 7; i++) {
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 16) % 5 == 0) {
+                lines[(*count)++] = strdup(noise[(seed >> 8) % 6]);
+            } else if ((seed >> 16) % 5 == 1) {
+                snprintf(line, sizeof(line), "vim src/module_%u/file_%u.c", (seed >> 4) % 97, (seed >> 8) % 503);
+                lines[(*count)++] = strdup(line);
+            }
+            lines[(*count)++] = strdup(project[i]);
+        }
+    }
+    return lines;
+}
+
+#endif // BENCH_UTIL_H
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "ripple_watch.h"
+#include "bench_util.h"
+
+// Runs watch -f on a scratch directory from a second thread, its frames
+// going to a pipe, and measures: the time from writing a watched file to
+// the frame of the run it caused, the CPU used while nothing changes, and
+// how many runs a burst of writes turns into. Changes to files the pattern
+// does not match must cause no runs at all.
+//
+// Usage: bench_watch [changes]
+// Defaults to 50 changes.
+
+struct watcher {
+    char pattern[128];
+    int stop[2];
+    int frames[2];
+    struct ripple_watch_stats stats;
+};
+
+static void exec_cmd(char **argv) {
+    execvp(argv[0], argv);
+    _exit(127);
+}
+
+static void *run_watch(void *arg) {
+    struct watcher *w = arg;
+    static char *cmd[] = { "true", NULL };
+    char *patterns[] = { w->pattern };
+    struct ripple_watch_opts opts = { 0, patterns, 1, RIPPLE_WATCH_DEBOUNCE_MS };
+    if (ripple_watch(cmd, &opts, exec_cmd, w->stop[0], w->frames[1], &w->stats) != 0) {
+        perror("bench_watch");
+        exit(2);
+    }
+    close(w->frames[1]);
+    return NULL;
+}
+
+// Wait up to timeout_ms for frames; returns how many arrived and, in
+// first, when the first of them did
+static int read_frames(int fd, int timeout_ms, double *first) {
+    char buf[4096];
+    int frames = 0;
+    struct pollfd p = { fd, POLLIN, 0 };
+    while (poll(&p, 1, timeout_ms) > 0) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        if (frames == 0 && first) {
+            *first = now_ms();
+        }
+        for (ssize_t i = 0; i + 3 < n; i++) {
+            frames += memcmp(buf + i, "--- ", 4) == 0;
+        }
+        if (timeout_ms > 0) {
+            timeout_ms = 5;       // the rest of this frame, if split
+        }
+    }
+    return frames;
+}
+
+static void touch(const char *path, int i) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        dprintf(fd, "%d\n", i);
+        close(fd);
+    }
+}
+
+static double cpu_ms(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
+static int compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    int changes = argc > 1 ? atoi(argv[1]) : 50;
+    char dir[] = "/tmp/ripple-bench-watch.XXXXXX", path[256], other[256];
+    struct watcher w;
+    pthread_t thread;
+    int failed = 0;
+
+    if (changes <= 0 || !mkdtemp(dir) || pipe(w.stop) != 0 || pipe(w.frames) != 0) {
+        fprintf(stderr, "Usage: %s [changes]\n", argv[0]);
+        return 2;
+    }
+    snprintf(w.pattern, sizeof(w.pattern), "%s/*.c", dir);
+    snprintf(path, sizeof(path), "%s/main.c", dir);
+    snprintf(other, sizeof(other), "%s/notes.txt", dir);
+    pthread_create(&thread, NULL, run_watch, &w);
+    read_frames(w.frames[0], 2000, NULL);  // the first run
+
+    // Write to frame, one change at a time
+    double *latency = malloc(sizeof(double) * changes);
+    for (int i = 0; i < changes; i++) {
+        double start = now_ms(), frame = start;
+        touch(path, i);
+        if (read_frames(w.frames[0], 2000, &frame) != 1) {
+            failed = 1;
+        }
+        latency[i] = frame - start;
+    }
+    qsort(latency, changes, sizeof(double), compare);
+    printf("%d changes, debounce %d ms\n", changes, RIPPLE_WATCH_DEBOUNCE_MS);
+    printf("%-28s %8.1f ms\n", "change to frame, p50", latency[changes / 2]);
+    printf("%-28s %8.1f ms\n", "change to frame, p95", latency[changes * 95 / 100]);
+
+    // Nothing changing, and then only files the pattern ignores
+    double cpu = cpu_ms(), start = now_ms();
+    int idle_frames = read_frames(w.frames[0], 1000, NULL);
+    printf("%-28s %8.2f ms over %.0f ms\n", "cpu while idle", cpu_ms() - cpu, now_ms() - start);
+    for (int i = 0; i < 20; i++) {
+        touch(other, i);
+    }
+    idle_frames += read_frames(w.frames[0], 200, NULL);
+    printf("%-28s %8d\n", "runs for unmatched files", idle_frames);
+    failed |= idle_frames != 0;
+
+    // A burst: 200 writes as fast as they go
+    start = now_ms();
+    for (int i = 0; i < 200; i++) {
+        touch(path, i);
+    }
+    double burst_ms = now_ms() - start;
+    int burst_frames = read_frames(w.frames[0], 500, NULL);
+    printf("%-28s %8d (writes took %.1f ms)\n", "runs for 200 writes", burst_frames, burst_ms);
+    failed |= burst_frames < 1 || burst_frames > 1 + (int)(burst_ms / RIPPLE_WATCH_MAX_DELAY_MS) + 1;
+
+    if (write(w.stop[1], "q", 1) != 1) {
+        failed = 1;
+    }
+    pthread_join(thread, NULL);
+    printf("%-28s %8ld runs, %ld events\n", "total", w.stats.runs, w.stats.events);
+
+    if (failed) {
+        fprintf(stderr, "bench_watch: wrong number of runs\n");
+    }
+    unlink(path);
+    unlink(other);
+    rmdir(dir);
+    free(latency);
+    return failed;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ripple_wc.h"
+#include "bench_util.h"
+
+// Measures the wc builtin's counting throughput against the cost of just
+// reading the same file, and against GNU wc. A text file shaped like a log
+// (lines of a few words, varied spacing) is written once and counted from
+// the page cache: best of a few runs for every kernel the CPU supports,
+// one thread and one per CPU. Counts are checked against wc, so a fast
+// wrong answer does not pass.
+//
+// Usage: bench_wc [megabytes [file]]
+// Defaults to 1024 MB in /tmp. Exits non-zero if counts differ.
+
+#define RUNS 3
+
+static int write_sample(const char *path, long megabytes) {
+    static const char *words[] = { "GET", "/api/v1/items", "200", "ok", "user=42", "\tlatency=3ms", "cache", "miss" };
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    unsigned seed = 1;
+    long target = megabytes << 20, written = 0;
+    char line[256];
+    while (written < target) {
+        int len = snprintf(line, sizeof(line), "2025-01-01T00:00:%02u", (seed >> 8) % 60);
+        int n = 3 + (seed >> 4) % 6;
+        for (int w = 0; w < n; w++) {
+            seed = seed * 1103515245 + 12345;
+            len += snprintf(line + len, sizeof(line) - len, "%s%s", (seed >> 16) % 5 ? " " : "  ",
+                            words[(seed >> 12) % 8]);
+        }
+        line[len++] = '\n';
+        fwrite(line, 1, len, f);
+        written += len;
+    }
+    return fclose(f);
+}
+
+// Read the whole file in the same blocks the builtin uses, counting nothing
+static double read_only(const char *path) {
+    void *buf;
+    if (posix_memalign(&buf, 4096, RIPPLE_WC_BUFSIZE) != 0) {
+        return -1;
+    }
+    int fd = open(path, O_RDONLY);
+    double start = now_ms();
+    while (fd >= 0 && read(fd, buf, RIPPLE_WC_BUFSIZE) > 0) {
+    }
+    double t = now_ms() - start;
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buf);
+    return t;
+}
+
+// GNU wc's counts and elapsed ms, or -1
+static double run_gnu(const char *path, struct ripple_wc_counts *counts) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], 1);
+        close(fds[0]);
+        setenv("LC_ALL", "C", 1);
+        execlp("wc", "wc", path, (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    FILE *in = fdopen(fds[0], "r");
+    int ok = fscanf(in, "%ld %ld %ld", &counts->lines, &counts->words, &counts->bytes) == 3;
+    fclose(in);
+    int status;
+    waitpid(pid, &status, 0);
+    double t = now_ms() - start;
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? t : -1;
+}
+
+static double best_of(const char *path, const struct ripple_wc_opts *opts, struct ripple_wc_counts *counts) {
+    double best = 1e18;
+    char *paths[] = { (char *)path };
+    int err;
+    for (int r = 0; r < RUNS; r++) {
+        double start = now_ms();
+        if (ripple_wc_files(paths, 1, opts, counts, &err) != 0) {
+            return -1;
+        }
+        double t = now_ms() - start;
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    long megabytes = argc > 1 ? atol(argv[1]) : 1024;
+    char path[4096];
+    int failed = 0, own_file = argc <= 2;
+
+    if (megabytes <= 0) {
+        fprintf(stderr, "Usage: %s [megabytes [file]]\n", argv[0]);
+        return 2;
+    }
+    if (own_file) {
+        snprintf(path, sizeof(path), "/tmp/ripple-bench-wc.%d", (int)getpid());
+    } else {
+        snprintf(path, sizeof(path), "%s", argv[2]);
+    }
+    if (write_sample(path, megabytes) != 0) {
+        perror("bench_wc: sample");
+        return 2;
+    }
+
+    struct ripple_wc_counts expected, counts;
+    double gnu = 1e18;
+    for (int r = 0; r <= RUNS; r++) {
+        double t = run_gnu(path, &expected);
+        if (t < 0) {
+            fprintf(stderr, "bench_wc: GNU wc failed\n");
+            unlink(path);
+            return 2;
+        }
+        gnu = r > 0 && t < gnu ? t : gnu;
+    }
+    double mb = expected.bytes / 1048576.0;
+    double io = 1e18;
+    for (int r = 0; r < RUNS; r++) {
+        double t = read_only(path);
+        io = t < io ? t : io;
+    }
+
+    printf("%.0f MB, %ld lines, %ld words\n", mb, expected.lines, expected.words);
+    printf("%-20s %10s %10s\n", "", "ms", "MB/s");
+    printf("%-20s %10.1f %10.0f\n", "read only", io, mb / (io / 1000.0));
+    printf("%-20s %10.1f %10.0f\n", "GNU wc", gnu, mb / (gnu / 1000.0));
+
+    static const char *kernels[] = { "avx2", "sse2", "scalar" };
+    for (int k = 0; k < 3; k++) {
+        if (ripple_wc_use_kernel(kernels[k]) != 0) {
+            continue;
+        }
+        for (int threads = 1; threads >= 0; threads--) {
+            struct ripple_wc_opts opts = { 1, 1, 1, threads };
+            char name[64];
+            double t = best_of(path, &opts, &counts);
+            snprintf(name, sizeof(name), "%s, %s", kernels[k], threads ? "1 thread" : "all CPUs");
+            printf("%-20s %10.1f %10.0f\n", name, t, mb / (t / 1000.0));
+            if (t < 0 || counts.lines != expected.lines || counts.words != expected.words ||
+                counts.bytes != expected.bytes) {
+                fprintf(stderr, "bench_wc: %s counted %ld %ld %ld, wc %ld %ld %ld\n", name, counts.lines,
+                        counts.words, counts.bytes, expected.lines, expected.words, expected.bytes);
+                failed = 1;
+            }
+        }
+        struct ripple_wc_opts lines = { 1, 0, 0, 1 };
+        char name[64];
+        double t = best_of(path, &lines, &counts);
+        snprintf(name, sizeof(name), "%s, -l", kernels[k]);
+        printf("%-20s %10.1f %10.0f\n", name, t, mb / (t / 1000.0));
+        if (counts.lines != expected.lines) {
+            fprintf(stderr, "bench_wc: %s counted %ld lines, wc %ld\n", name, counts.lines, expected.lines);
+            failed = 1;
+        }
+    }
+    if (own_file) {
+        unlink(path);
+    }
+    return failed;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ripple_xargs.h"
+#include "bench_util.h"
+
+// Feeds a list of paths, the shape find prints, to the xargs builtin and
+// times running /bin/true over all of them: packed up to ARG_MAX, packed
+// with -P4, one exec per path (timed on a slice and scaled up), findutils
+// xargs, and a builtin run in-process. Each run must see every path.
+//
+// Usage: bench_xargs [paths [slice]]
+// Defaults to 100000 paths and a 2000 path slice for the one-per-exec run.
+// Exits non-zero if a run loses arguments.
+
+struct counter {
+    long args;
+    long bytes;
+};
+
+// Stands in for a builtin such as wc: looks at every argument it is handed
+static int count_args(char **argv, void *ctx) {
+    struct counter *c = ctx;
+    for (int i = 1; argv[i]; i++) {
+        c->args++;
+        c->bytes += (long)strlen(argv[i]);
+    }
+    return 0;
+}
+
+static int write_paths(const char *file, long n) {
+    FILE *f = fopen(file, "w");
+    if (!f) {
+        return -1;
+    }
+    for (long i = 0; i < n; i++) {
+        fprintf(f, "/home/user/src/project/module%03ld/source_file_%06ld.c\n", i / 1000, i);
+    }
+    return fclose(f);
+}
+
+static double run_xargs(const char *file, char **cmd, int max_args, int max_procs, ripple_xargs_builtin_fn fn,
+                        void *ctx, struct ripple_xargs_stats *stats, int *rc) {
+    struct ripple_xargs_opts opts = { 0, max_args, max_procs };
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        *rc = -1;
+        return 0;
+    }
+    double start = now_ms();
+    *rc = ripple_xargs(fd, cmd, &opts, fn, ctx, stats);
+    double ms = now_ms() - start;
+    close(fd);
+    return ms;
+}
+
+// findutils xargs over the same input, or a negative time if it is missing
+static double run_findutils(const char *file) {
+    int status;
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int fd = open(file, O_RDONLY);
+        if (fd < 0 || dup2(fd, STDIN_FILENO) < 0) {
+            _exit(127);
+        }
+        execlp("xargs", "xargs", "true", (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, &status, 0);
+    double ms = now_ms() - start;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? ms : -1.0;
+}
+
+int main(int argc, char **argv) {
+    long n = argc > 1 ? atol(argv[1]) : 100000;
+    long slice = argc > 2 ? atol(argv[2]) : 2000;
+    char file[64], part[80];
+    char *true_cmd[] = { "true", NULL };
+    char *wc_cmd[] = { "wc", NULL };
+    struct ripple_xargs_stats stats;
+    int rc, failed = 0;
+
+    if (n <= 0 || slice <= 0) {
+        fprintf(stderr, "Usage: %s [paths [slice]]\n", argv[0]);
+        return 2;
+    }
+    if (slice > n) {
+        slice = n;
+    }
+    snprintf(file, sizeof(file), "/tmp/ripple-bench-xargs.%d", (int)getpid());
+    snprintf(part, sizeof(part), "%s.slice", file);
+    if (write_paths(file, n) != 0 || write_paths(part, slice) != 0) {
+        perror("bench_xargs: writing paths");
+        return 2;
+    }
+    printf("%ld paths, ARG_MAX room %ld bytes\n", n, ripple_xargs_limit(true_cmd));
+    printf("%-18s %10s %10s %12s\n", "", "ms", "commands", "us/path");
+
+    double ms = run_xargs(file, true_cmd, 0, 1, NULL, NULL, &stats, &rc);
+    printf("%-18s %10.1f %10ld %12.2f\n", "packed", ms, stats.commands, ms * 1000.0 / n);
+    failed |= rc != 0 || stats.args != n;
+
+    ms = run_xargs(file, true_cmd, 0, 4, NULL, NULL, &stats, &rc);
+    printf("%-18s %10.1f %10ld %12.2f\n", "packed -P4", ms, stats.commands, ms * 1000.0 / n);
+    failed |= rc != 0 || stats.args != n;
+
+    ms = run_xargs(part, true_cmd, 1, 1, NULL, NULL, &stats, &rc);
+    printf("%-18s %10.1f %10ld %12.2f  (%ld measured)\n", "one per exec", ms * n / slice, n, ms * 1000.0 / slice,
+           slice);
+    failed |= rc != 0 || stats.args != slice;
+
+    double gnu = run_findutils(file);
+    if (gnu >= 0) {
+        printf("%-18s %10.1f %10s %12.2f\n", "findutils xargs", gnu, "-", gnu * 1000.0 / n);
+    } else {
+        printf("%-18s %10s\n", "findutils xargs", "n/a");
+    }
+
+    struct counter counter = { 0, 0 };
+    ms = run_xargs(file, wc_cmd, 0, 1, count_args, &counter, &stats, &rc);
+    printf("%-18s %10.1f %10ld %12.2f\n", "builtin in-process", ms, stats.commands, ms * 1000.0 / n);
+    failed |= rc != 0 || counter.args != n;
+
+    if (failed) {
+        fprintf(stderr, "bench_xargs: a run did not see all %ld paths\n", n);
+    }
+    unlink(file);
+    unlink(part);
+    return failed;
+}
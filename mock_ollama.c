@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Minimal stand-in for the Ollama HTTP API, for testing the client without
+// a model. Answers /api/generate with canned suggestions, one token at a time,
+// as a JSON array when the request carries a "format" schema. /api/embed
+// returns hashed-trigram vectors. The same text is streamed as server-sent
+// events by /completion, as llama.cpp's server would, and /v1/completions,
+// as an OpenAI-compatible server would.
+//
+// Usage: mock_ollama [-p port] [-d token_ms] [-l first_token_ms] [-j jitter_ms]
+//                    [-m model=extra_ms]... [-f hang|500|close|garbage] [-r fail_percent]
+//
+// -j adds a random 0..jitter_ms to every token; -r applies the -f failure
+// to only that share of requests.
+
+#define MAX_MODEL_DELAYS 8
+#define MAX_REQUEST (1 << 20)
+
+static const char *canned_response =
+    "1. ls -la - List all files with details\n"
+    "2. grep -rn 'TODO' . - Find TODO comments\n"
+    "3. find . -name '*.c' - Find C sources\n";
+
+// What a schema-constrained request gets back
+static const char *canned_json =
+    "[{\"cmd\":\"ls -la\",\"desc\":\"List all files with details\"},"
+    "{\"cmd\":\"grep -rn 'TODO' .\",\"desc\":\"Find TODO comments\"},"
+    "{\"cmd\":\"find . -name '*.c'\",\"desc\":\"Find C sources\"}]";
+
+static struct {
+    int port;
+    int token_ms;
+    int first_token_ms;
+    int jitter_ms;
+    const char *fail;
+    int fail_percent;
+    int context_len;
+    struct {
+        char model[64];
+        int extra_ms;
+    } model_delays[MAX_MODEL_DELAYS];
+    int num_model_delays;
+} opts = { 11434, 5, 0, 0, "none", 100, 64 };
+
+static pthread_mutex_t rand_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Uniform in 0..n-1, shared by all connection threads
+static int roll(int n) {
+    pthread_mutex_lock(&rand_lock);
+    int r = rand() % n;
+    pthread_mutex_unlock(&rand_lock);
+    return r;
+}
+
+static void sleep_ms(int ms) {
+    if (ms <= 0) {
+        return;
+    }
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Copy the string value of "key" out of a flat JSON body
+static void json_string_field(const char *body, const char *key, char *out, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    out[0] = '\0';
+    const char *p = strstr(body, pattern);
+    if (!p) {
+        return;
+    }
+    p += strlen(pattern);
+    size_t i = 0;
+    while (*p && *p != '"' && i + 1 < size) {
+        out[i++] = *p++;
+    }
+    out[i] = '\0';
+}
+
+// Escape a token for a JSON string
+static void json_escape(const char *in, size_t len, char *out, size_t size) {
+    size_t j = 0;
+    for (size_t i = 0; i < len && j + 7 < size; i++) {
+        char c = in[i];
+        if (c == '\n') {
+            out[j++] = '\\';
+            out[j++] = 'n';
+        } else if (c == '"' || c == '\\') {
+            out[j++] = '\\';
+            out[j++] = c;
+        } else {
+            out[j++] = c;
+        }
+    }
+    out[j] = '\0';
+}
+
+// Read headers and body; returns the body or NULL. path must hold 256 bytes.
+static char *read_request(int fd, char *path) {
+    char *buf = malloc(MAX_REQUEST + 1);
+    size_t len = 0;
+    char *body = NULL;
+    long content_length = -1;
+
+    if (!buf) {
+        return NULL;
+    }
+    while (len < MAX_REQUEST) {
+        ssize_t n = read(fd, buf + len, MAX_REQUEST - len);
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+        buf[len] = '\0';
+        if (!body) {
+            char *end = strstr(buf, "\r\n\r\n");
+            if (!end) {
+                continue;
+            }
+            body = end + 4;
+            const char *cl = strstr(buf, "Content-Length:");
+            if (!cl) {
+                cl = strstr(buf, "content-length:");
+            }
+            content_length = cl ? atol(cl + 15) : 0;
+            sscanf(buf, "%*s %255s", path);
+        }
+        if (body && (long)(len - (body - buf)) >= content_length) {
+            memmove(buf, body, len - (body - buf) + 1);
+            return buf;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static int model_delay(const char *model) {
+    for (int i = 0; i < opts.num_model_delays; i++) {
+        if (strcmp(opts.model_delays[i].model, model) == 0) {
+            return opts.model_delays[i].extra_ms;
+        }
+    }
+    return 0;
+}
+
+static void write_final(int fd, const char *model, const char *text, int tokens, int elapsed_ms, int stream) {
+    char out[8192];
+    char escaped[4096];
+    int n;
+
+    json_escape(text, strlen(text), escaped, sizeof(escaped));
+    n = snprintf(out, sizeof(out), "{\"model\":\"%s\",\"response\":\"%s\",\"done\":true,\"context\":[",
+                 model, escaped);
+    for (int i = 0; i < opts.context_len && n < (int)sizeof(out) - 256; i++) {
+        n += snprintf(out + n, sizeof(out) - n, i ? ",%d" : "%d", 100 + i);
+    }
+    n += snprintf(out + n, sizeof(out) - n,
+                  "],\"total_duration\":%lld,\"load_duration\":0,\"prompt_eval_count\":10,"
+                  "\"prompt_eval_duration\":1000000,\"eval_count\":%d,\"eval_duration\":%lld}\n",
+                  elapsed_ms * 1000000LL, tokens, (long long)tokens * opts.token_ms * 1000000LL);
+    if (!stream) {
+        char header[256];
+        int h = snprintf(header, sizeof(header),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                         "Connection: close\r\n\r\n", n);
+        write_all(fd, header, h);
+    }
+    write_all(fd, out, n);
+}
+
+static void handle_generate(int fd, const char *body) {
+    char model[64];
+    json_string_field(body, "model", model, sizeof(model));
+    int stream = strstr(body, "\"stream\":true") != NULL;
+    const char *text = strstr(body, "\"format\":") ? canned_json : canned_response;
+    const char *np = strstr(body, "\"num_predict\":");
+    int max_tokens = np ? atoi(np + 14) : -1;
+    int elapsed = opts.first_token_ms + model_delay(model);
+
+    sleep_ms(elapsed);
+
+    if (stream) {
+        const char *header = "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nConnection: close\r\n\r\n";
+        write_all(fd, header, strlen(header));
+    }
+
+    // Emit the canned text a word (plus trailing whitespace) at a time
+    int tokens = 0;
+    const char *p = text;
+    while (*p && (max_tokens < 0 || tokens < max_tokens)) {
+        const char *start = p;
+        while (*p && *p != ' ' && *p != '\n') p++;
+        while (*p == ' ' || *p == '\n') p++;
+        tokens++;
+        int delay = opts.token_ms + (opts.jitter_ms > 0 ? roll(opts.jitter_ms + 1) : 0);
+        sleep_ms(delay);
+        elapsed += delay;
+        if (stream) {
+            char escaped[512], line[768];
+            json_escape(start, p - start, escaped, sizeof(escaped));
+            int n = snprintf(line, sizeof(line), "{\"model\":\"%s\",\"response\":\"%s\",\"done\":false}\n",
+                             model, escaped);
+            if (write_all(fd, line, n) != 0) {
+                return;
+            }
+        }
+    }
+    if (!stream) {
+        char partial[4096];
+        snprintf(partial, sizeof(partial), "%.*s", (int)(p - text), text);
+        write_final(fd, model, partial, tokens, elapsed, stream);
+        return;
+    }
+    write_final(fd, model, "", tokens, elapsed, stream);
+}
+
+// llama.cpp /completion or OpenAI /v1/completions, always streamed
+static void handle_sse(int fd, const char *body, int openai) {
+    char model[64];
+    json_string_field(body, "model", model, sizeof(model));
+    const char *text = strstr(body, "\"json_schema\":") ? canned_json : canned_response;
+    const char *np = strstr(body, openai ? "\"max_tokens\":" : "\"n_predict\":");
+    int max_tokens = np ? atoi(strchr(np, ':') + 1) : -1;
+    int elapsed = opts.first_token_ms + model_delay(model);
+    char escaped[512], line[1024];
+
+    sleep_ms(elapsed);
+    const char *header = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nConnection: close\r\n\r\n";
+    write_all(fd, header, strlen(header));
+
+    int tokens = 0;
+    const char *p = text;
+    while (*p && (max_tokens < 0 || tokens < max_tokens)) {
+        const char *start = p;
+        while (*p && *p != ' ' && *p != '\n') p++;
+        while (*p == ' ' || *p == '\n') p++;
+        tokens++;
+        int delay = opts.token_ms + (opts.jitter_ms > 0 ? roll(opts.jitter_ms + 1) : 0);
+        sleep_ms(delay);
+        elapsed += delay;
+        json_escape(start, p - start, escaped, sizeof(escaped));
+        int n = openai ? snprintf(line, sizeof(line),
+                                  "data: {\"object\":\"text_completion\",\"model\":\"%s\","
+                                  "\"choices\":[{\"text\":\"%s\",\"index\":0,\"finish_reason\":null}]}\n\n",
+                                  model, escaped)
+                       : snprintf(line, sizeof(line), "data: {\"content\":\"%s\",\"stop\":false}\n\n", escaped);
+        if (write_all(fd, line, n) != 0) {
+            return;
+        }
+    }
+    int n = openai ? snprintf(line, sizeof(line), "data: [DONE]\n\n")
+                   : snprintf(line, sizeof(line),
+                              "data: {\"content\":\"\",\"stop\":true,\"tokens_predicted\":%d,"
+                              "\"timings\":{\"prompt_n\":10,\"prompt_ms\":1.0,\"predicted_n\":%d,"
+                              "\"predicted_ms\":%d}}\n\n", tokens, tokens, tokens * opts.token_ms);
+    write_all(fd, line, n);
+}
+
+// Deterministic stand-in for an embedding: hashed character trigrams, so
+// texts sharing words land close together
+#define EMBED_DIM 64
+
+static void fake_embedding(const char *text, size_t len, float *v) {
+    memset(v, 0, sizeof(float) * EMBED_DIM);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        unsigned int h = 2166136261u;
+        for (size_t j = i; j < i + 3; j++) {
+            h = (h ^ (unsigned char)text[j]) * 16777619u;
+        }
+        v[h % EMBED_DIM] += (h & 0x10000) ? 1.0f : -1.0f;
+    }
+}
+
+// /api/embed: one vector per string in "input"
+static void handle_embed(int fd, const char *body) {
+    size_t cap = 4096, n = 0;
+    char *out = malloc(cap);
+    const char *p = strstr(body, "\"input\":[");
+    float v[EMBED_DIM];
+
+    n += snprintf(out + n, cap - n, "{\"model\":\"mock\",\"embeddings\":[");
+    int first = 1;
+    if (p) {
+        p += 8;
+    }
+    while (p && (p = strchr(p + 1, '"')) != NULL) {
+        const char *start = ++p;
+        while (*p && *p != '"') {
+            p += (*p == '\\' && p[1]) ? 2 : 1;
+        }
+        if (!*p) {
+            break;
+        }
+        fake_embedding(start, p - start, v);
+        if (cap - n < EMBED_DIM * 16 + 16) {
+            cap = cap * 2 + EMBED_DIM * 16;
+            out = realloc(out, cap);
+        }
+        n += snprintf(out + n, cap - n, first ? "[" : ",[");
+        for (int i = 0; i < EMBED_DIM; i++) {
+            n += snprintf(out + n, cap - n, i ? ",%g" : "%g", v[i]);
+        }
+        n += snprintf(out + n, cap - n, "]");
+        first = 0;
+        if (p[1] == ']') {
+            break;
+        }
+    }
+    n += snprintf(out + n, cap - n, "]}");
+
+    char header[256];
+    int h = snprintf(header, sizeof(header),
+                     "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n", n);
+    write_all(fd, header, h);
+    write_all(fd, out, n);
+    free(out);
+}
+
+static void *connection_thread(void *arg) {
+    int fd = (int)(long)arg;
+    char path[256] = "";
+    char *body = read_request(fd, path);
+
+    if (!body) {
+        close(fd);
+        return NULL;
+    }
+
+    // Failing requests behave as -f says; the rest are answered normally
+    const char *fail = roll(100) < opts.fail_percent ? opts.fail : "none";
+    if (strcmp(fail, "hang") == 0) {
+        sleep_ms(3600 * 1000);
+    } else if (strcmp(fail, "500") == 0) {
+        const char *r = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 29\r\nConnection: close\r\n\r\n"
+                        "{\"error\":\"mock server error\"}";
+        write_all(fd, r, strlen(r));
+    } else if (strcmp(fail, "garbage") == 0) {
+        const char *r = "HTTP/1.1 200 OK\r\nContent-Length: 12\r\nConnection: close\r\n\r\n<html></html";
+        write_all(fd, r, strlen(r));
+    } else if (strcmp(fail, "close") == 0) {
+        // Drop the connection without answering
+    } else if (strstr(path, "/api/embed")) {
+        handle_embed(fd, body);
+    } else if (strstr(path, "/api/generate")) {
+        handle_generate(fd, body);
+    } else if (strstr(path, "/v1/completions")) {
+        handle_sse(fd, body, 1);
+    } else if (strstr(path, "/completion")) {
+        handle_sse(fd, body, 0);
+    } else {
+        const char *r = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        write_all(fd, r, strlen(r));
+    }
+
+    free(body);
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:l:j:m:f:r:c:")) != -1) {
+        switch (opt) {
+            case 'p': opts.port = atoi(optarg); break;
+            case 'd': opts.token_ms = atoi(optarg); break;
+            case 'l': opts.first_token_ms = atoi(optarg); break;
+            case 'j': opts.jitter_ms = atoi(optarg); break;
+            case 'f': opts.fail = optarg; break;
+            case 'r': opts.fail_percent = atoi(optarg); break;
+            case 'c': opts.context_len = atoi(optarg); break;
+            case 'm': {
+                char *eq = strchr(optarg, '=');
+                if (eq && opts.num_model_delays < MAX_MODEL_DELAYS) {
+                    int i = opts.num_model_delays++;
+                    snprintf(opts.model_delays[i].model, sizeof(opts.model_delays[i].model),
+                             "%.*s", (int)(eq - optarg), optarg);
+                    opts.model_delays[i].extra_ms = atoi(eq + 1);
+                }
+                break;
+            }
+            default:
+                fprintf(stderr, "Usage: %s [-p port] [-d token_ms] [-l first_token_ms] [-j jitter_ms] "
+                        "[-m model=extra_ms] [-f hang|500|close|garbage] [-r fail_percent] [-c context_len]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    srand(getpid());
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 128) != 0) {
+        perror("mock_ollama");
+        return 1;
+    }
+    printf("mock_ollama listening on 127.0.0.1:%d\n", opts.port);
+    fflush(stdout);
+
+    while (1) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("mock_ollama: accept");
+            break;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, connection_thread, (void *)(long)fd) == 0) {
+            pthread_detach(tid);
+        } else {
+            close(fd);
+        }
+    }
+    close(server);
+    return 0;
+}
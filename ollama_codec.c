@@ -0,0 +1,940 @@
+#include "ollama_codec.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Scanner states
+enum {
+    SC_VALUE,   // expecting a value (or a new top-level object)
+    SC_KEY,     // expecting a key or '}'
+    SC_COLON,   // expecting ':'
+    SC_AFTER,   // expecting ',', '}' or ']'
+    SC_STR,     // inside a string
+    SC_STR_ESC, // after a backslash
+    SC_STR_U,   // reading the 4 hex digits of \uXXXX
+    SC_NUM,     // inside a number
+    SC_LIT      // inside true/false/null
+};
+
+// Response fields the scanner knows about
+enum {
+    FIELD_NONE,
+    FIELD_KEY,      // the string being read is an object key
+    FIELD_RESPONSE,
+    FIELD_ERROR,
+    FIELD_DONE,
+    FIELD_CONTEXT,
+    FIELD_TOTAL_DURATION,
+    FIELD_LOAD_DURATION,
+    FIELD_PROMPT_EVAL_COUNT,
+    FIELD_PROMPT_EVAL_DURATION,
+    FIELD_EVAL_COUNT,
+    FIELD_EVAL_DURATION
+};
+
+// Top-level keys and the fields they map to
+static const struct {
+    const char *name;
+    size_t len;
+    int field;
+} known_keys[] = {
+    { "response", 8, FIELD_RESPONSE },
+    { "error", 5, FIELD_ERROR },
+    { "done", 4, FIELD_DONE },
+    { "context", 7, FIELD_CONTEXT },
+    { "total_duration", 14, FIELD_TOTAL_DURATION },
+    { "load_duration", 13, FIELD_LOAD_DURATION },
+    { "prompt_eval_count", 17, FIELD_PROMPT_EVAL_COUNT },
+    { "prompt_eval_duration", 20, FIELD_PROMPT_EVAL_DURATION },
+    { "eval_count", 10, FIELD_EVAL_COUNT },
+    { "eval_duration", 13, FIELD_EVAL_DURATION }
+};
+
+unsigned long ollama_codec_allocs = 0;
+
+static int buf_reserve(struct ollama_buf *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) {
+        return 0;
+    }
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra + 1) {
+        cap *= 2;
+    }
+    char *tmp = realloc(b->data, cap);
+    if (!tmp) {
+        return -1;
+    }
+    ollama_codec_allocs++;
+    b->data = tmp;
+    b->cap = cap;
+    return 0;
+}
+
+// Append bytes, keeping the buffer NUL-terminated
+int ollama_buf_append(struct ollama_buf *b, const char *s, size_t n) {
+    if (buf_reserve(b, n) != 0) {
+        return -1;
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+static int buf_puts(struct ollama_buf *b, const char *s) {
+    return ollama_buf_append(b, s, strlen(s));
+}
+
+static int buf_printf(struct ollama_buf *b, const char *fmt, ...) {
+    char tmp[64];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= sizeof(tmp)) {
+        return -1;
+    }
+    return ollama_buf_append(b, tmp, (size_t)n);
+}
+
+// Drop the contents but keep the allocation for the next request
+void ollama_buf_reset(struct ollama_buf *b) {
+    b->len = 0;
+    if (b->data) {
+        b->data[0] = '\0';
+    }
+}
+
+void ollama_buf_free(struct ollama_buf *b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+// Length of a valid UTF-8 sequence starting at p, or 0 if it is malformed
+static size_t utf8_seq_len(const unsigned char *p, const unsigned char *end) {
+    unsigned char c = p[0];
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xBF;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        if (c == 0xE0) lo = 0xA0;   // overlong
+        if (c == 0xED) hi = 0x9F;   // UTF-16 surrogates
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        if (c == 0xF0) lo = 0x90;   // overlong
+        if (c == 0xF4) hi = 0x8F;   // above U+10FFFF
+    } else {
+        return 0;
+    }
+
+    if ((size_t)(end - p) < len) {
+        return 0;
+    }
+    if (p[1] < lo || p[1] > hi) {
+        return 0;
+    }
+    for (size_t i = 2; i < len; i++) {
+        if (p[i] < 0x80 || p[i] > 0xBF) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+// Escape n bytes of s as the body of a JSON string. Control characters are
+// escaped, valid UTF-8 is copied through and invalid bytes become U+FFFD.
+int ollama_json_escape(struct ollama_buf *b, const char *s, size_t n) {
+    const unsigned char *p = (const unsigned char *)s;
+    const unsigned char *end = p + n;
+
+    if (buf_reserve(b, n + n / 8 + 16) != 0) {
+        return -1;
+    }
+
+    while (p < end) {
+        const unsigned char *run = p;
+        while (p < end && *p >= 0x20 && *p < 0x80 && *p != '"' && *p != '\\') {
+            p++;
+        }
+        if (p > run && ollama_buf_append(b, (const char *)run, p - run) != 0) {
+            return -1;
+        }
+        if (p >= end) {
+            break;
+        }
+
+        unsigned char c = *p;
+        int rc;
+        switch (c) {
+            case '"':  rc = ollama_buf_append(b, "\\\"", 2); break;
+            case '\\': rc = ollama_buf_append(b, "\\\\", 2); break;
+            case '\n': rc = ollama_buf_append(b, "\\n", 2); break;
+            case '\r': rc = ollama_buf_append(b, "\\r", 2); break;
+            case '\t': rc = ollama_buf_append(b, "\\t", 2); break;
+            case '\b': rc = ollama_buf_append(b, "\\b", 2); break;
+            case '\f': rc = ollama_buf_append(b, "\\f", 2); break;
+            default:
+                if (c < 0x20) {
+                    rc = buf_printf(b, "\\u%04x", c);
+                } else {
+                    size_t len = utf8_seq_len(p, end);
+                    if (len == 0) {
+                        rc = ollama_buf_append(b, "\\ufffd", 6);
+                    } else {
+                        rc = ollama_buf_append(b, (const char *)p, len);
+                        p += len - 1;
+                    }
+                }
+                break;
+        }
+        if (rc != 0) {
+            return -1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+static int write_string_field(struct ollama_buf *b, const char *name, const char *value) {
+    if (buf_printf(b, "\"%s\":\"", name) != 0 ||
+        ollama_json_escape(b, value, strlen(value)) != 0 ||
+        ollama_buf_append(b, "\"", 1) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int write_string_field_sep(struct ollama_buf *b, const char *name, const char *value) {
+    return ollama_buf_append(b, ",", 1) == 0 ? write_string_field(b, name, value) : -1;
+}
+
+// Write a complete /api/generate request body into b (replacing its contents)
+int ollama_write_request(struct ollama_buf *b, const struct ollama_request *req) {
+    ollama_buf_reset(b);
+
+    if (buf_puts(b, "{") != 0 ||
+        write_string_field(b, "model", req->model) != 0 ||
+        buf_puts(b, ",\"prompt\":\"") != 0) {
+        return -1;
+    }
+
+    const char *parts[3] = { req->prompt_prefix, req->prompt, req->prompt_suffix };
+    for (int i = 0; i < 3; i++) {
+        if (parts[i] && ollama_json_escape(b, parts[i], strlen(parts[i])) != 0) {
+            return -1;
+        }
+    }
+
+    if (buf_puts(b, "\"") != 0) {
+        return -1;
+    }
+
+    if (req->context_len > 0) {
+        if (buf_puts(b, ",\"context\":[") != 0) {
+            return -1;
+        }
+        for (size_t i = 0; i < req->context_len; i++) {
+            if (buf_printf(b, i ? ",%d" : "%d", req->context[i]) != 0) {
+                return -1;
+            }
+        }
+        if (buf_puts(b, "]") != 0) {
+            return -1;
+        }
+    }
+    if (req->keep_alive && write_string_field_sep(b, "keep_alive", req->keep_alive) != 0) {
+        return -1;
+    }
+
+    if (req->format && (buf_puts(b, ",\"format\":") != 0 || buf_puts(b, req->format) != 0)) {
+        return -1;
+    }
+
+    if (buf_printf(b, ",\"stream\":%s", req->stream ? "true" : "false") != 0 ||
+        buf_printf(b, ",\"options\":{\"temperature\":%g", req->temperature) != 0 ||
+        buf_printf(b, ",\"top_p\":%g", req->top_p) != 0 ||
+        buf_printf(b, ",\"top_k\":%d", req->top_k) != 0 ||
+        buf_printf(b, ",\"num_predict\":%d", req->num_predict) != 0) {
+        return -1;
+    }
+    if (req->stop) {
+        if (buf_puts(b, ",\"stop\":[") != 0) {
+            return -1;
+        }
+        for (int i = 0; req->stop[i] != NULL; i++) {
+            if ((i && buf_puts(b, ",") != 0) || buf_puts(b, "\"") != 0 ||
+                ollama_json_escape(b, req->stop[i], strlen(req->stop[i])) != 0 ||
+                buf_puts(b, "\"") != 0) {
+                return -1;
+            }
+        }
+        if (buf_puts(b, "]") != 0) {
+            return -1;
+        }
+    }
+    if (buf_puts(b, "}}") != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Clear a response for reuse without giving back its buffers
+void ollama_response_reset(struct ollama_response *r) {
+    ollama_buf_reset(&r->text);
+    ollama_buf_reset(&r->error);
+    r->done = 0;
+    r->context_len = 0;
+    r->total_duration = r->load_duration = 0;
+    r->prompt_eval_count = r->prompt_eval_duration = 0;
+    r->eval_count = r->eval_duration = 0;
+}
+
+void ollama_response_free(struct ollama_response *r) {
+    ollama_buf_free(&r->text);
+    ollama_buf_free(&r->error);
+    free(r->context);
+    r->context = NULL;
+    r->context_len = r->context_cap = 0;
+    r->done = 0;
+}
+
+void ollama_scanner_init(struct ollama_scanner *s, struct ollama_response *r) {
+    memset(s, 0, sizeof(*s));
+    s->resp = r;
+    s->state = SC_VALUE;
+}
+
+static int context_push(struct ollama_response *r, int value) {
+    if (r->context_len == r->context_cap) {
+        size_t cap = r->context_cap ? r->context_cap * 2 : 512;
+        int *tmp = realloc(r->context, cap * sizeof(int));
+        if (!tmp) {
+            return -1;
+        }
+        ollama_codec_allocs++;
+        r->context = tmp;
+        r->context_cap = cap;
+    }
+    r->context[r->context_len++] = value;
+    return 0;
+}
+
+// Where decoded string bytes go for the current field
+static int sc_emit(struct ollama_scanner *s, const char *p, size_t n) {
+    switch (s->field) {
+        case FIELD_KEY:
+            if (s->key_len + n >= sizeof(s->key)) {
+                s->key_overflow = 1;
+                return 0;
+            }
+            memcpy(s->key + s->key_len, p, n);
+            s->key_len += n;
+            return 0;
+        case FIELD_RESPONSE:
+            return ollama_buf_append(&s->resp->text, p, n);
+        case FIELD_ERROR:
+            return ollama_buf_append(&s->resp->error, p, n);
+        default:
+            return 0;
+    }
+}
+
+static int sc_emit_codepoint(struct ollama_scanner *s, unsigned int cp) {
+    char out[4];
+    size_t n;
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        out[0] = (char)(0xF0 | (cp >> 18));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    return sc_emit(s, out, n);
+}
+
+// A lone high surrogate followed by anything but a low one is replaced
+static int sc_flush_surrogate(struct ollama_scanner *s) {
+    if (s->high_surrogate) {
+        s->high_surrogate = 0;
+        return sc_emit_codepoint(s, 0xFFFD);
+    }
+    return 0;
+}
+
+// Map a completed top-level key to the field it feeds
+static int field_for_key(const struct ollama_scanner *s) {
+    if (s->key_overflow) {
+        return FIELD_NONE;
+    }
+    for (size_t i = 0; i < sizeof(known_keys) / sizeof(known_keys[0]); i++) {
+        if (s->key_len == known_keys[i].len && memcmp(s->key, known_keys[i].name, s->key_len) == 0) {
+            return known_keys[i].field;
+        }
+    }
+    return FIELD_NONE;
+}
+
+// A value just finished; work out what comes next
+static void sc_value_done(struct ollama_scanner *s) {
+    s->state = s->depth > 0 ? SC_AFTER : SC_VALUE;
+}
+
+static void sc_number_done(struct ollama_scanner *s) {
+    long long value = s->num_neg ? -s->num : s->num;
+    struct ollama_response *r = s->resp;
+
+    if (s->depth == 2 && s->field == FIELD_CONTEXT && s->stack[1] == '[') {
+        if (context_push(r, (int)value) != 0) {
+            s->error = 1;
+        }
+    } else if (s->depth == 1) {
+        switch (s->field) {
+            case FIELD_TOTAL_DURATION: r->total_duration = value; break;
+            case FIELD_LOAD_DURATION: r->load_duration = value; break;
+            case FIELD_PROMPT_EVAL_COUNT: r->prompt_eval_count = value; break;
+            case FIELD_PROMPT_EVAL_DURATION: r->prompt_eval_duration = value; break;
+            case FIELD_EVAL_COUNT: r->eval_count = value; break;
+            case FIELD_EVAL_DURATION: r->eval_duration = value; break;
+            default: break;
+        }
+    }
+    sc_value_done(s);
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Feed the next chunk of the response body. Works across arbitrary chunk
+// boundaries and across a stream of newline-delimited objects.
+// Returns 0 on success, -1 once the input is known to be malformed.
+int ollama_scanner_feed(struct ollama_scanner *s, const char *data, size_t len) {
+    const char *p = data;
+    const char *end = data + len;
+
+    while (p < end && !s->error) {
+        char c = *p;
+
+        switch (s->state) {
+            case SC_VALUE:
+                if (is_space(c)) {
+                    break;
+                }
+                if (s->depth == 0 && c != '{') {
+                    s->error = 1;
+                    break;
+                }
+                if (c == '"') {
+                    // Only top-level string values feed a response field
+                    s->resume = s->field;
+                    if (s->depth != 1) {
+                        s->field = FIELD_NONE;
+                    }
+                    s->state = SC_STR;
+                } else if (c == '{' || c == '[') {
+                    if (s->depth >= (int)sizeof(s->stack)) {
+                        s->error = 1;
+                        break;
+                    }
+                    s->stack[s->depth++] = (unsigned char)c;
+                    s->state = c == '{' ? SC_KEY : SC_VALUE;
+                } else if (c == ']' && s->depth > 0 && s->stack[s->depth - 1] == '[') {
+                    s->depth--;
+                    sc_value_done(s);
+                } else if (c == '-' || (c >= '0' && c <= '9')) {
+                    s->num_neg = c == '-';
+                    s->num = c == '-' ? 0 : c - '0';
+                    s->num_frac = 0;
+                    s->state = SC_NUM;
+                } else if (c == 't' || c == 'f' || c == 'n') {
+                    s->literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+                    s->literal_pos = 1;
+                    s->state = SC_LIT;
+                } else {
+                    s->error = 1;
+                }
+                break;
+
+            case SC_KEY:
+                if (is_space(c)) {
+                    break;
+                }
+                if (c == '"') {
+                    s->key_len = 0;
+                    s->key_overflow = 0;
+                    s->resume = s->field;
+                    s->field = FIELD_KEY;
+                    s->state = SC_STR;
+                } else if (c == '}') {
+                    s->depth--;
+                    if (s->depth == 0) {
+                        s->field = FIELD_NONE;
+                    }
+                    sc_value_done(s);
+                } else {
+                    s->error = 1;
+                }
+                break;
+
+            case SC_COLON:
+                if (is_space(c)) {
+                    break;
+                }
+                if (c == ':') {
+                    s->state = SC_VALUE;
+                } else {
+                    s->error = 1;
+                }
+                break;
+
+            case SC_AFTER:
+                if (is_space(c)) {
+                    break;
+                }
+                if (c == ',') {
+                    s->state = s->stack[s->depth - 1] == '{' ? SC_KEY : SC_VALUE;
+                } else if ((c == '}' && s->stack[s->depth - 1] == '{') ||
+                           (c == ']' && s->stack[s->depth - 1] == '[')) {
+                    s->depth--;
+                    if (s->depth == 0) {
+                        s->field = FIELD_NONE;
+                    }
+                    sc_value_done(s);
+                } else {
+                    s->error = 1;
+                }
+                break;
+
+            case SC_STR: {
+                // Copy the longest run that needs no decoding in one go
+                const char *run = p;
+                while (p < end && *p != '"' && *p != '\\') {
+                    p++;
+                }
+                if (p > run) {
+                    if (sc_flush_surrogate(s) != 0 || sc_emit(s, run, p - run) != 0) {
+                        s->error = 1;
+                    }
+                }
+                if (p >= end) {
+                    continue;
+                }
+                if (*p == '\\') {
+                    s->state = SC_STR_ESC;
+                    break;
+                }
+                // Closing quote
+                if (sc_flush_surrogate(s) != 0) {
+                    s->error = 1;
+                }
+                if (s->field == FIELD_KEY) {
+                    s->field = s->depth == 1 ? field_for_key(s) : s->resume;
+                    s->state = SC_COLON;
+                } else {
+                    s->field = s->resume;
+                    sc_value_done(s);
+                }
+                break;
+            }
+
+            case SC_STR_ESC: {
+                const char *out = NULL;
+                switch (c) {
+                    case 'n': out = "\n"; break;
+                    case 't': out = "\t"; break;
+                    case 'r': out = "\r"; break;
+                    case 'b': out = "\b"; break;
+                    case 'f': out = "\f"; break;
+                    case '/': out = "/"; break;
+                    case '\\': out = "\\"; break;
+                    case '"': out = "\""; break;
+                    case 'u':
+                        s->ucode = 0;
+                        s->uhex = 0;
+                        s->state = SC_STR_U;
+                        break;
+                    default:
+                        s->error = 1;
+                        break;
+                }
+                if (out) {
+                    if (sc_flush_surrogate(s) != 0 || sc_emit(s, out, 1) != 0) {
+                        s->error = 1;
+                    }
+                    s->state = SC_STR;
+                }
+                break;
+            }
+
+            case SC_STR_U: {
+                int h = hex_value(c);
+                if (h < 0) {
+                    s->error = 1;
+                    break;
+                }
+                s->ucode = (s->ucode << 4) | (unsigned int)h;
+                if (++s->uhex < 4) {
+                    break;
+                }
+                unsigned int cp = s->ucode;
+                int rc = 0;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    rc = sc_flush_surrogate(s);
+                    s->high_surrogate = cp;
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    if (s->high_surrogate) {
+                        cp = 0x10000 + ((s->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+                        s->high_surrogate = 0;
+                        rc = sc_emit_codepoint(s, cp);
+                    } else {
+                        rc = sc_emit_codepoint(s, 0xFFFD);
+                    }
+                } else {
+                    rc = sc_flush_surrogate(s);
+                    if (rc == 0) {
+                        rc = sc_emit_codepoint(s, cp);
+                    }
+                }
+                if (rc != 0) {
+                    s->error = 1;
+                }
+                s->state = SC_STR;
+                break;
+            }
+
+            case SC_NUM:
+                // Integers are accumulated as they stream past; Ollama only
+                // sends integers for the fields we keep
+                while (!s->num_frac && p < end && *p >= '0' && *p <= '9') {
+                    s->num = s->num * 10 + (*p - '0');
+                    p++;
+                }
+                if (p >= end) {
+                    continue;
+                }
+                c = *p;
+                if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+                    c == '+' || c == '-') {
+                    s->num_frac = 1;
+                    break;
+                }
+                sc_number_done(s);
+                continue; // Re-read this byte in the new state
+
+            case SC_LIT:
+                if (c != s->literal[s->literal_pos]) {
+                    s->error = 1;
+                    break;
+                }
+                if (s->literal[++s->literal_pos] == '\0') {
+                    if (s->depth == 1 && s->field == FIELD_DONE) {
+                        s->resp->done = s->literal[0] == 't';
+                    }
+                    sc_value_done(s);
+                }
+                break;
+        }
+        p++;
+    }
+
+    return s->error ? -1 : 0;
+}
+
+// Decode the JSON string starting after its opening quote into out (bounded).
+// Returns the position after the closing quote, or NULL if it is unterminated.
+static const char *parse_string(const char *p, char *out, size_t size) {
+    size_t n = 0;
+    while (*p && *p != '"') {
+        char c = *p++;
+        unsigned int cp = 0;
+        if (c == '\\') {
+            c = *p++;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u':
+                    for (int i = 0; i < 4; i++) {
+                        int h = hex_value(p[i]);
+                        if (h < 0) {
+                            return NULL;
+                        }
+                        cp = (cp << 4) | (unsigned int)h;
+                    }
+                    p += 4;
+                    break;
+                case '\0':
+                    return NULL;
+                default:
+                    break; // \" \\ \/ stand for themselves
+            }
+        }
+        if (cp == 0) {
+            if (n + 1 < size) {
+                out[n++] = c;
+            }
+            continue;
+        }
+        // Keep BMP characters; anything needing a surrogate pair is dropped
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+            continue;
+        }
+        char enc[3];
+        size_t len;
+        if (cp < 0x80) {
+            enc[0] = (char)cp;
+            len = 1;
+        } else if (cp < 0x800) {
+            enc[0] = (char)(0xC0 | (cp >> 6));
+            enc[1] = (char)(0x80 | (cp & 0x3F));
+            len = 2;
+        } else {
+            enc[0] = (char)(0xE0 | (cp >> 12));
+            enc[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            enc[2] = (char)(0x80 | (cp & 0x3F));
+            len = 3;
+        }
+        if (n + len < size) {
+            memcpy(out + n, enc, len);
+            n += len;
+        }
+    }
+    if (size > 0) {
+        out[n < size ? n : size - 1] = '\0';
+    }
+    return *p == '"' ? p + 1 : NULL;
+}
+
+static const char *skip_space(const char *p) {
+    while (is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// Parse one {"cmd": ..., "desc": ...} object starting at '{'.
+// Returns the position after it, or NULL if the text ends first.
+static const char *parse_suggestion_object(const char *p, struct ollama_suggestion *s) {
+    char key[16];
+
+    s->cmd[0] = s->desc[0] = '\0';
+    p = skip_space(p + 1);
+    while (*p && *p != '}') {
+        if (*p != '"' || !(p = parse_string(p + 1, key, sizeof(key)))) {
+            return NULL;
+        }
+        p = skip_space(p);
+        if (*p != ':') {
+            return NULL;
+        }
+        p = skip_space(p + 1);
+        if (*p == '"') {
+            char *dest = NULL;
+            size_t size = 0;
+            if (strcmp(key, "cmd") == 0 || strcmp(key, "command") == 0) {
+                dest = s->cmd;
+                size = sizeof(s->cmd);
+            } else if (strcmp(key, "desc") == 0 || strcmp(key, "description") == 0) {
+                dest = s->desc;
+                size = sizeof(s->desc);
+            }
+            char scratch[8];
+            p = parse_string(p + 1, dest ? dest : scratch, dest ? size : sizeof(scratch));
+            if (!p) {
+                return NULL;
+            }
+        } else {
+            // Skip numbers, literals and anything else up to the next separator
+            while (*p && *p != ',' && *p != '}') {
+                p++;
+            }
+        }
+        p = skip_space(p);
+        if (*p == ',') {
+            p = skip_space(p + 1);
+        }
+    }
+    return *p == '}' ? p + 1 : NULL;
+}
+
+// Fallback for free text: lines like "1. ls -la - List all files"
+static int parse_numbered_lines(const char *text, struct ollama_suggestion *out, int max) {
+    int count = 0;
+    const char *line = text;
+
+    while (*line && count < max) {
+        const char *end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        const char *p = line;
+        const char *stop = line + len;
+
+        while (p < stop && is_space(*p)) p++;
+        if (p < stop && *p >= '0' && *p <= '9') {
+            while (p < stop && *p >= '0' && *p <= '9') p++;
+            if (p < stop && (*p == '.' || *p == ')')) {
+                p++;
+                while (p < stop && (is_space(*p) || *p == '`')) p++;
+
+                const char *dash = p;
+                while (dash + 2 < stop && !(dash[0] == ' ' && dash[1] == '-' && dash[2] == ' ')) dash++;
+                const char *cmd_end = dash + 2 < stop ? dash : stop;
+                while (cmd_end > p && (cmd_end[-1] == '`' || is_space(cmd_end[-1]))) cmd_end--;
+
+                struct ollama_suggestion *s = &out[count];
+                snprintf(s->cmd, sizeof(s->cmd), "%.*s", (int)(cmd_end - p), p);
+                if (dash + 2 < stop) {
+                    const char *d = dash + 3;
+                    snprintf(s->desc, sizeof(s->desc), "%.*s", (int)(stop - d), d);
+                } else {
+                    s->desc[0] = '\0';
+                }
+                if (s->cmd[0]) {
+                    count++;
+                }
+            }
+        }
+        line = end ? end + 1 : stop;
+    }
+    return count;
+}
+
+// Turn model output into suggestions. Expects a JSON array of {cmd, desc}
+// objects; a truncated array keeps its complete objects, and free text in
+// the old "1. cmd - desc" format is accepted as a fallback.
+int ollama_parse_suggestions(const char *text, struct ollama_suggestion *out, int max) {
+    int count = 0;
+    const char *p = text;
+
+    while (count < max && (p = strchr(p, '{')) != NULL) {
+        const char *next = parse_suggestion_object(p, &out[count]);
+        if (!next) {
+            break;
+        }
+        if (out[count].cmd[0]) {
+            count++;
+        }
+        p = next;
+    }
+    if (count == 0) {
+        count = parse_numbered_lines(text, out, max);
+    }
+    return count;
+}
+
+// /api/embed request for a batch of texts
+int ollama_write_embed_request(struct ollama_buf *b, const char *model, const char *const *inputs, int count) {
+    ollama_buf_reset(b);
+    if (buf_puts(b, "{") != 0 || write_string_field(b, "model", model) != 0 ||
+        buf_puts(b, ",\"input\":[") != 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if ((i && buf_puts(b, ",") != 0) || buf_puts(b, "\"") != 0 ||
+            ollama_json_escape(b, inputs[i], strlen(inputs[i])) != 0 || buf_puts(b, "\"") != 0) {
+            return -1;
+        }
+    }
+    return buf_puts(b, "]}");
+}
+
+// Read one array of numbers into out; returns the position after ']' or NULL
+static const char *parse_vector(const char *p, float *out, int dim_max, int *dim) {
+    int n = 0;
+
+    p = skip_space(p);
+    if (*p != '[') {
+        return NULL;
+    }
+    p = skip_space(p + 1);
+    while (*p != ']') {
+        char *end;
+        float v = strtof(p, &end);
+        if (end == p) {
+            return NULL;
+        }
+        if (n < dim_max) {
+            out[n] = v;
+        }
+        n++;
+        p = skip_space(end);
+        if (*p == ',') {
+            p = skip_space(p + 1);
+        } else if (*p != ']') {
+            return NULL;
+        }
+    }
+    *dim = n;
+    return p + 1;
+}
+
+// Pull vectors out of an /api/embed ("embeddings":[[...],...]) or legacy
+// /api/embeddings ("embedding":[...]) reply. Vectors are stored dim_max
+// apart; returns how many were read, or -1 if the body has none or their
+// sizes disagree. *dim receives the model's vector size.
+int ollama_parse_embeddings(const char *body, float *out, int max_vectors, int dim_max, int *dim) {
+    const char *p = strstr(body, "\"embeddings\"");
+    int count = 0;
+    int n;
+
+    *dim = 0;
+    if (p) {
+        p = skip_space(p + 12);
+        if (*p != ':') {
+            return -1;
+        }
+        p = skip_space(p + 1);
+        if (*p != '[') {
+            return -1;
+        }
+        p = skip_space(p + 1);
+        while (*p == '[' && count < max_vectors) {
+            p = parse_vector(p, out + (size_t)count * dim_max, dim_max, &n);
+            if (!p || (count && n != *dim)) {
+                return -1;
+            }
+            *dim = n;
+            count++;
+            p = skip_space(p);
+            if (*p == ',') {
+                p = skip_space(p + 1);
+            }
+        }
+        return count > 0 ? count : -1;
+    }
+
+    p = strstr(body, "\"embedding\"");
+    if (!p) {
+        return -1;
+    }
+    p = skip_space(p + 11);
+    if (*p != ':' || !parse_vector(p + 1, out, dim_max, dim) || *dim == 0) {
+        return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,102 @@
+#ifndef OLLAMA_CODEC_H
+#define OLLAMA_CODEC_H
+
+#include <stddef.h>
+
+// Growable byte buffer, reused across requests so steady state does not allocate
+struct ollama_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+// Fields written into a /api/generate request. The prompt is written as
+// prefix + prompt + suffix so callers never have to format it into a temp buffer.
+struct ollama_request {
+    const char *model;
+    const char *prompt_prefix;
+    const char *prompt;
+    const char *prompt_suffix;
+    int stream;
+    double temperature;
+    double top_p;
+    int top_k;
+    int num_predict;
+    const int *context;       // tokens from an earlier response to continue from
+    size_t context_len;
+    const char *keep_alive;   // how long Ollama keeps the model loaded, e.g. "30m"
+    const char *format;       // JSON schema the output must follow, written verbatim
+    const char *const *stop;  // NULL-terminated stop sequences
+};
+
+// One parsed suggestion from the model's output
+struct ollama_suggestion {
+    char cmd[256];
+    char desc[256];
+};
+
+// Fields pulled out of a /api/generate response (or a stream of them)
+struct ollama_response {
+    struct ollama_buf text;   // concatenated "response" fragments
+    struct ollama_buf error;  // "error" message, if any
+    int done;
+    int *context;
+    size_t context_len;
+    size_t context_cap;
+    // Timings reported by Ollama, in nanoseconds, and token counts
+    long long total_duration;
+    long long load_duration;
+    long long prompt_eval_count;
+    long long prompt_eval_duration;
+    long long eval_count;
+    long long eval_duration;
+};
+
+// Incremental scanner state; feed it bytes as they arrive from the socket
+struct ollama_scanner {
+    struct ollama_response *resp;
+    int state;
+    int resume;               // field to restore after a key or nested string
+    int depth;
+    unsigned char stack[32];  // '{' or '[' per nesting level
+    char key[32];
+    size_t key_len;
+    int key_overflow;
+    int field;                // which response field the current value feeds
+    long long num;            // integer part of the number being read
+    int num_neg;
+    int num_frac;             // past the integer part (fraction or exponent)
+    const char *literal;
+    size_t literal_pos;
+    unsigned int ucode;
+    int uhex;
+    unsigned int high_surrogate;
+    int error;
+};
+
+// Buffer helpers
+int ollama_buf_append(struct ollama_buf *b, const char *s, size_t n);
+void ollama_buf_reset(struct ollama_buf *b);
+void ollama_buf_free(struct ollama_buf *b);
+
+// Request writer
+int ollama_json_escape(struct ollama_buf *b, const char *s, size_t n);
+int ollama_write_request(struct ollama_buf *b, const struct ollama_request *req);
+
+// Embeddings
+int ollama_write_embed_request(struct ollama_buf *b, const char *model, const char *const *inputs, int count);
+int ollama_parse_embeddings(const char *body, float *out, int max_vectors, int dim_max, int *dim);
+
+// Suggestion parser
+int ollama_parse_suggestions(const char *text, struct ollama_suggestion *out, int max);
+
+// Response scanner
+void ollama_response_reset(struct ollama_response *r);
+void ollama_response_free(struct ollama_response *r);
+void ollama_scanner_init(struct ollama_scanner *s, struct ollama_response *r);
+int ollama_scanner_feed(struct ollama_scanner *s, const char *data, size_t len);
+
+// Number of buffer (re)allocations made by the codec, for benchmarks
+extern unsigned long ollama_codec_allocs;
+
+#endif // OLLAMA_CODEC_H
@@ -0,0 +1,277 @@
+#include "ollama_config.h"
+#include "ollama_integration.h"
+#include "ripple_backend.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <pthread.h>
+
+// Kinds of config values
+enum { CFG_STRING, CFG_LONG, CFG_INT, CFG_DOUBLE };
+
+// Table of settings so load, save, set and print share one definition
+static const struct {
+    const char *name;
+    int type;
+    size_t offset;
+    size_t size;
+    const char *help;
+} config_keys[] = {
+    { "backend", CFG_STRING, offsetof(struct ollama_config, backend),
+      sizeof(((struct ollama_config *)0)->backend), "ollama, llamacpp or openai" },
+    { "endpoint", CFG_STRING, offsetof(struct ollama_config, endpoint),
+      sizeof(((struct ollama_config *)0)->endpoint), "generate URL" },
+    { "model", CFG_STRING, offsetof(struct ollama_config, model),
+      sizeof(((struct ollama_config *)0)->model), "default (fast) model" },
+    { "large_model", CFG_STRING, offsetof(struct ollama_config, large_model),
+      sizeof(((struct ollama_config *)0)->large_model), "model for a repeated TAB, empty to disable" },
+    { "keep_alive", CFG_STRING, offsetof(struct ollama_config, keep_alive),
+      sizeof(((struct ollama_config *)0)->keep_alive), "how long Ollama keeps the model loaded" },
+    { "connect_timeout_ms", CFG_LONG, offsetof(struct ollama_config, connect_timeout_ms), 0,
+      "connect deadline" },
+    { "timeout_ms", CFG_LONG, offsetof(struct ollama_config, timeout_ms), 0,
+      "total request deadline" },
+    { "num_predict", CFG_INT, offsetof(struct ollama_config, num_predict), 0,
+      "max tokens to generate" },
+    { "structured", CFG_INT, offsetof(struct ollama_config, structured), 0,
+      "1 for JSON-schema output, 0 for free text" },
+    { "temperature", CFG_DOUBLE, offsetof(struct ollama_config, temperature), 0, "sampling temperature" },
+    { "top_p", CFG_DOUBLE, offsetof(struct ollama_config, top_p), 0, "nucleus sampling" },
+    { "top_k", CFG_INT, offsetof(struct ollama_config, top_k), 0, "top-k sampling" },
+    { "p95_budget_ms", CFG_LONG, offsetof(struct ollama_config, p95_budget_ms), 0,
+      "large model p95 latency budget" },
+    { "cooldown_ms", CFG_LONG, offsetof(struct ollama_config, cooldown_ms), 0,
+      "time on the small model after a budget miss" },
+    { "embed_model", CFG_STRING, offsetof(struct ollama_config, embed_model),
+      sizeof(((struct ollama_config *)0)->embed_model), "embedding model for the retrieval index" },
+    { "retrieval_min_score", CFG_DOUBLE, offsetof(struct ollama_config, retrieval_min_score), 0,
+      "index similarity that skips generation" },
+    { "max_inflight", CFG_INT, offsetof(struct ollama_config, max_inflight), 0,
+      "concurrent requests, 0 for no limit" },
+    { "rate_limit", CFG_DOUBLE, offsetof(struct ollama_config, rate_limit), 0,
+      "requests per second, 0 for no limit" },
+    { "rate_burst", CFG_INT, offsetof(struct ollama_config, rate_burst), 0,
+      "requests allowed back to back" },
+    { "breaker_failures", CFG_INT, offsetof(struct ollama_config, breaker_failures), 0,
+      "connection failures before calls stop, 0 to disable" },
+    { "breaker_cooldown_ms", CFG_LONG, offsetof(struct ollama_config, breaker_cooldown_ms), 0,
+      "time calls fail fast after that" },
+    { "llamacpp_endpoint", CFG_STRING, offsetof(struct ollama_config, llamacpp_endpoint),
+      sizeof(((struct ollama_config *)0)->llamacpp_endpoint), "llama.cpp server completion URL" },
+    { "openai_endpoint", CFG_STRING, offsetof(struct ollama_config, openai_endpoint),
+      sizeof(((struct ollama_config *)0)->openai_endpoint), "OpenAI-compatible completions URL" },
+    { "openai_model", CFG_STRING, offsetof(struct ollama_config, openai_model),
+      sizeof(((struct ollama_config *)0)->openai_model), "model name for that server, empty for model" }
+};
+#define NUM_CONFIG_KEYS (sizeof(config_keys) / sizeof(config_keys[0]))
+
+static struct ollama_config config = {
+    .backend = RIPPLE_BACKEND_DEFAULT,
+    .endpoint = OLLAMA_API_URL,
+    .model = "tinyllama",
+    .large_model = "",
+    .keep_alive = "30m",
+    .connect_timeout_ms = 1000,
+    .timeout_ms = 15000,
+    .num_predict = 128,
+    .structured = 1,
+    .temperature = 0.2,
+    .top_p = 0.9,
+    .top_k = 40,
+    .p95_budget_ms = 4000,
+    .cooldown_ms = 60000,
+    .embed_model = "nomic-embed-text",
+    .retrieval_min_score = 0.8,
+    .max_inflight = 1,
+    .rate_limit = 2,
+    .rate_burst = 4,
+    .breaker_failures = 3,
+    .breaker_cooldown_ms = 30000,
+    .llamacpp_endpoint = "",
+    .openai_endpoint = "",
+    .openai_model = ""
+};
+
+static unsigned long generation = 1;
+static char loaded_path[1024];
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+// Set one key; caller holds config_lock
+static int set_locked(const char *key, const char *value) {
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; i++) {
+        if (strcmp(key, config_keys[i].name) != 0) {
+            continue;
+        }
+        char *field = (char *)&config + config_keys[i].offset;
+        char *end = NULL;
+        switch (config_keys[i].type) {
+            case CFG_STRING:
+                if (strlen(value) >= config_keys[i].size ||
+                    (field == config.backend && !ripple_backend_find(value))) {
+                    return -1;
+                }
+                strcpy(field, value);
+                break;
+            case CFG_LONG: {
+                long v = strtol(value, &end, 10);
+                if (end == value || *end != '\0' || v < 0) {
+                    return -1;
+                }
+                *(long *)field = v;
+                break;
+            }
+            case CFG_INT: {
+                long v = strtol(value, &end, 10);
+                if (end == value || *end != '\0' || v < -1) {
+                    return -1;
+                }
+                *(int *)field = (int)v;
+                break;
+            }
+            case CFG_DOUBLE: {
+                double v = strtod(value, &end);
+                if (end == value || *end != '\0') {
+                    return -1;
+                }
+                *(double *)field = v;
+                break;
+            }
+        }
+        generation++;
+        return 0;
+    }
+    return -1;
+}
+
+// Path of the config file: $RIPPLE_AI_CONFIG, else ~/.ripple_ai.conf
+const char *ollama_config_path(void) {
+    static char path[1024];
+    const char *env = getenv("RIPPLE_AI_CONFIG");
+    if (env && *env) {
+        return env;
+    }
+    const char *home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", home ? home : ".", OLLAMA_CONFIG_FILE);
+    return path;
+}
+
+// Load "key = value" lines; a missing file just keeps the defaults
+void ollama_config_load(const char *path) {
+    if (!path) {
+        path = ollama_config_path();
+    }
+
+    FILE *file = fopen(path, "r");
+    if (file) {
+        char line[512];
+        int lineno = 0;
+        pthread_mutex_lock(&config_lock);
+        while (fgets(line, sizeof(line), file)) {
+            lineno++;
+            char *s = trim(line);
+            if (*s == '\0' || *s == '#') {
+                continue;
+            }
+            char *eq = strchr(s, '=');
+            if (!eq) {
+                fprintf(stderr, "ripple: %s:%d: expected key = value\n", path, lineno);
+                continue;
+            }
+            *eq = '\0';
+            char *key = trim(s);
+            char *value = trim(eq + 1);
+            if (set_locked(key, value) != 0) {
+                fprintf(stderr, "ripple: %s:%d: bad setting '%s'\n", path, lineno, key);
+            }
+        }
+        snprintf(loaded_path, sizeof(loaded_path), "%s", path);
+        pthread_mutex_unlock(&config_lock);
+        fclose(file);
+    }
+
+    // Kept for compatibility with the environment variable
+    const char *keep_alive = getenv("RIPPLE_KEEP_ALIVE");
+    if (keep_alive && *keep_alive) {
+        ollama_config_set("keep_alive", keep_alive);
+    }
+}
+
+static void format_value(char *out, size_t size, const struct ollama_config *cfg, size_t i) {
+    const char *field = (const char *)cfg + config_keys[i].offset;
+    switch (config_keys[i].type) {
+        case CFG_STRING: snprintf(out, size, "%s", field); break;
+        case CFG_LONG: snprintf(out, size, "%ld", *(const long *)field); break;
+        case CFG_INT: snprintf(out, size, "%d", *(const int *)field); break;
+        case CFG_DOUBLE: snprintf(out, size, "%g", *(const double *)field); break;
+    }
+}
+
+int ollama_config_save(const char *path) {
+    struct ollama_config cfg;
+    char value[256];
+
+    if (!path) {
+        path = ollama_config_path();
+    }
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+    ollama_config_get(&cfg);
+    fprintf(file, "# Ripple AI backend settings\n");
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; i++) {
+        format_value(value, sizeof(value), &cfg, i);
+        fprintf(file, "%s = %s\n", config_keys[i].name, value);
+    }
+    fclose(file);
+    return 0;
+}
+
+int ollama_config_set(const char *key, const char *value) {
+    pthread_mutex_lock(&config_lock);
+    int rc = set_locked(key, value);
+    pthread_mutex_unlock(&config_lock);
+    return rc;
+}
+
+// Copy the current settings; the client takes one snapshot per request
+void ollama_config_get(struct ollama_config *out) {
+    pthread_mutex_lock(&config_lock);
+    *out = config;
+    pthread_mutex_unlock(&config_lock);
+}
+
+// Bumped on every change so cached state tied to a model can be dropped
+unsigned long ollama_config_generation(void) {
+    pthread_mutex_lock(&config_lock);
+    unsigned long g = generation;
+    pthread_mutex_unlock(&config_lock);
+    return g;
+}
+
+void ollama_config_print(void) {
+    struct ollama_config cfg;
+    char value[256];
+
+    ollama_config_get(&cfg);
+    pthread_mutex_lock(&config_lock);
+    printf("AI backend settings (%s)\n", loaded_path[0] ? loaded_path : "defaults");
+    pthread_mutex_unlock(&config_lock);
+    for (size_t i = 0; i < NUM_CONFIG_KEYS; i++) {
+        format_value(value, sizeof(value), &cfg, i);
+        printf("  %-20s %-40s # %s\n", config_keys[i].name, value, config_keys[i].help);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef OLLAMA_CONFIG_H
+#define OLLAMA_CONFIG_H
+
+// Backend settings, read from ~/.ripple_ai.conf (or $RIPPLE_AI_CONFIG)
+// and changeable at runtime with the aiconfig builtin
+struct ollama_config {
+    char backend[16];         // ollama, llamacpp or openai
+    char endpoint[256];
+    char model[64];           // small, fast model used by default
+    char large_model[64];     // used on a repeated TAB; empty disables it
+    char keep_alive[32];
+    long connect_timeout_ms;  // hard deadline for the TCP connect
+    long timeout_ms;          // hard deadline for the whole request
+    int num_predict;
+    int structured;           // constrain output to a JSON array of {cmd, desc}
+    double temperature;
+    double top_p;
+    int top_k;
+    long p95_budget_ms;       // large model is dropped when its p95 exceeds this
+    long cooldown_ms;         // how long to stay on the small model afterwards
+    char embed_model[64];     // model for the retrieval index
+    double retrieval_min_score; // index hits at or above this skip generation
+    int max_inflight;         // concurrent requests to Ollama, 0 for no limit
+    double rate_limit;        // requests per second, 0 for no limit
+    int rate_burst;           // requests allowed back to back
+    int breaker_failures;     // connection failures in a row that stop calls
+    long breaker_cooldown_ms; // how long calls fail fast after that
+    char llamacpp_endpoint[256]; // llama.cpp server /completion URL
+    char openai_endpoint[256];   // OpenAI-compatible /v1/completions URL
+    char openai_model[64];       // model name that server expects; empty for model
+};
+
+// Function declarations
+void ollama_config_load(const char* path);
+int ollama_config_save(const char* path);
+int ollama_config_set(const char* key, const char* value);
+void ollama_config_get(struct ollama_config* out);
+void ollama_config_print(void);
+const char* ollama_config_path(void);
+unsigned long ollama_config_generation(void);
+
+// Constants
+#define OLLAMA_CONFIG_FILE ".ripple_ai.conf"
+
+#endif // OLLAMA_CONFIG_H
@@ -0,0 +1,319 @@
+#include "ollama_gate.h"
+#include "ollama_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define MAX_FLIGHTS 8
+
+enum { BREAKER_CLOSED, BREAKER_OPEN, BREAKER_HALF_OPEN };
+
+// A request waiting for a slot; the queue is kept in priority order and
+// first come, first served within a priority
+struct gate_waiter {
+    int priority;
+    struct gate_waiter *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct gate_waiter *queue;
+    int inflight;
+    double tokens;
+    double refilled_at;
+    int breaker;
+    int failures;
+    int trial;                // a half-open trial request is out
+    double open_until;
+    unsigned long generation; // config the breaker state belongs to
+    struct ollama_gate_stats stats;
+} gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+// One request in flight, or its answer for a short while afterwards
+struct flight {
+    char *key;
+    int running;
+    int reusable;
+    char *result;
+    double done_at;
+    int waiters;
+};
+
+static struct flight flights[MAX_FLIGHTS];
+static pthread_cond_t flight_cond = PTHREAD_COND_INITIALIZER;
+
+double ollama_gate_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Condition waits take a wall-clock time; deadlines here are monotonic
+static void wait_until(pthread_cond_t *cond, double deadline_ms) {
+    struct timespec ts;
+    double wait_ms = deadline_ms - ollama_gate_now_ms();
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (wait_ms < 0) {
+        wait_ms = 0;
+    }
+    long long ns = ts.tv_nsec + (long long)(wait_ms * 1e6);
+    ts.tv_sec += ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    pthread_cond_timedwait(cond, &gate.lock, &ts);
+}
+
+// Caller holds gate.lock
+static void refill(const struct ollama_config *cfg, double now) {
+    if (cfg->rate_limit <= 0) {
+        return;
+    }
+    if (gate.refilled_at == 0) {
+        gate.tokens = cfg->rate_burst;
+    } else {
+        gate.tokens += (now - gate.refilled_at) / 1000.0 * cfg->rate_limit;
+    }
+    if (gate.tokens > cfg->rate_burst) {
+        gate.tokens = cfg->rate_burst;
+    }
+    gate.refilled_at = now;
+}
+
+// Caller holds gate.lock. Settings changed, e.g. a new endpoint: give the
+// server a fresh chance.
+static void check_generation(unsigned long generation) {
+    if (gate.generation != generation) {
+        gate.generation = generation;
+        gate.breaker = BREAKER_CLOSED;
+        gate.failures = 0;
+        gate.trial = 0;
+    }
+}
+
+// Caller holds gate.lock; returns 1 if the call must fail fast
+static int breaker_rejects(double now) {
+    if (gate.breaker == BREAKER_OPEN && now >= gate.open_until) {
+        gate.breaker = BREAKER_HALF_OPEN;
+        gate.trial = 0;
+    }
+    return gate.breaker == BREAKER_OPEN || (gate.breaker == BREAKER_HALF_OPEN && gate.trial);
+}
+
+static void dequeue(struct gate_waiter *w) {
+    for (struct gate_waiter **p = &gate.queue; *p; p = &(*p)->next) {
+        if (*p == w) {
+            *p = w->next;
+            gate.stats.queued--;
+            break;
+        }
+    }
+}
+
+// Wait for a slot (and a token when metered) until deadline_ms on the
+// ollama_gate_now_ms clock. Speculative requests never wait for a token.
+// Returns OLLAMA_GATE_OK, after which ollama_gate_leave must be called.
+int ollama_gate_enter(int priority, int metered, double deadline_ms) {
+    struct ollama_config cfg;
+    unsigned long generation = ollama_config_generation();
+    struct gate_waiter me = { priority, NULL };
+    int result = OLLAMA_GATE_OK;
+
+    ollama_config_get(&cfg);
+    pthread_mutex_lock(&gate.lock);
+    check_generation(generation);
+
+    struct gate_waiter **p = &gate.queue;
+    while (*p && (*p)->priority <= priority) {
+        p = &(*p)->next;
+    }
+    me.next = *p;
+    *p = &me;
+    gate.stats.queued++;
+
+    while (1) {
+        double now = ollama_gate_now_ms();
+        double until = deadline_ms;
+
+        if (breaker_rejects(now)) {
+            result = OLLAMA_GATE_OPEN;
+            break;
+        }
+        refill(&cfg, now);
+        if (gate.queue == &me && (cfg.max_inflight <= 0 || gate.inflight < cfg.max_inflight)) {
+            if (!metered || cfg.rate_limit <= 0 || gate.tokens >= 1) {
+                break;
+            }
+            if (priority != OLLAMA_PRIORITY_INTERACTIVE) {
+                result = OLLAMA_GATE_LIMITED;
+                break;
+            }
+            double next_token = now + (1 - gate.tokens) / cfg.rate_limit * 1000.0;
+            until = next_token < deadline_ms ? next_token : deadline_ms;
+        }
+        if (now >= deadline_ms) {
+            result = OLLAMA_GATE_LIMITED;
+            break;
+        }
+        wait_until(&gate.cond, until);
+    }
+
+    dequeue(&me);
+    if (result == OLLAMA_GATE_OK) {
+        if (metered && cfg.rate_limit > 0) {
+            gate.tokens -= 1;
+        }
+        if (gate.breaker == BREAKER_HALF_OPEN) {
+            gate.trial = 1;
+        }
+        gate.inflight++;
+        gate.stats.admitted++;
+    } else if (result == OLLAMA_GATE_OPEN) {
+        gate.stats.rejected++;
+    } else {
+        gate.stats.limited++;
+    }
+    // The next in line may be able to go now
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+    return result;
+}
+
+// Release a slot. reachable is 0 when the server could not be connected to
+// or sent nothing before the deadline. Returns 1 if this opened the circuit.
+int ollama_gate_leave(int reachable) {
+    struct ollama_config cfg;
+    int tripped = 0;
+
+    ollama_config_get(&cfg);
+    pthread_mutex_lock(&gate.lock);
+    gate.inflight--;
+    if (reachable) {
+        gate.failures = 0;
+        gate.breaker = BREAKER_CLOSED;
+        gate.trial = 0;
+    } else {
+        gate.failures++;
+        if (cfg.breaker_failures > 0 &&
+            (gate.breaker == BREAKER_HALF_OPEN || gate.failures >= cfg.breaker_failures)) {
+            tripped = gate.breaker != BREAKER_OPEN;
+            gate.breaker = BREAKER_OPEN;
+            gate.open_until = ollama_gate_now_ms() + cfg.breaker_cooldown_ms;
+            gate.trial = 0;
+            gate.stats.trips += tripped;
+        }
+    }
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+    return tripped;
+}
+
+void ollama_gate_get_stats(struct ollama_gate_stats *out) {
+    pthread_mutex_lock(&gate.lock);
+    *out = gate.stats;
+    out->inflight = gate.inflight;
+    out->tokens = gate.tokens;
+    out->failures = gate.failures;
+    out->open_ms = 0;
+    if (gate.breaker == BREAKER_OPEN) {
+        double left = gate.open_until - ollama_gate_now_ms();
+        out->open_ms = left > 0 ? left : 0;
+    }
+    pthread_mutex_unlock(&gate.lock);
+}
+
+// Forget limiter, breaker and shared answers; nothing may be in flight
+void ollama_gate_reset(void) {
+    pthread_mutex_lock(&gate.lock);
+    gate.queue = NULL;
+    gate.inflight = 0;
+    gate.tokens = 0;
+    gate.refilled_at = 0;
+    gate.breaker = BREAKER_CLOSED;
+    gate.failures = 0;
+    gate.trial = 0;
+    memset(&gate.stats, 0, sizeof(gate.stats));
+    for (int i = 0; i < MAX_FLIGHTS; i++) {
+        free(flights[i].key);
+        free(flights[i].result);
+    }
+    memset(flights, 0, sizeof(flights));
+    pthread_mutex_unlock(&gate.lock);
+}
+
+static struct flight *find_flight(const char *key) {
+    for (int i = 0; i < MAX_FLIGHTS; i++) {
+        if (flights[i].key && strcmp(flights[i].key, key) == 0) {
+            return &flights[i];
+        }
+    }
+    return NULL;
+}
+
+// Join the request for key. If an identical one is in flight, wait for it;
+// if one finished within OLLAMA_FLIGHT_REUSE_MS, take its answer. Either way
+// *leader is 0 and the shared answer (a copy, or NULL) is returned.
+// Otherwise *leader is 1 and the caller must call ollama_flight_done.
+char *ollama_flight_join(const char *key, int *leader) {
+    char *result = NULL;
+    int waited = 0;
+
+    pthread_mutex_lock(&gate.lock);
+    struct flight *f = find_flight(key);
+    if (f && f->running) {
+        f->waiters++;
+        while (f->running) {
+            pthread_cond_wait(&flight_cond, &gate.lock);
+        }
+        f->waiters--;
+        waited = 1;
+    }
+    if (f && (waited || (f->reusable && ollama_gate_now_ms() - f->done_at < OLLAMA_FLIGHT_REUSE_MS))) {
+        result = f->result ? strdup(f->result) : NULL;
+        gate.stats.coalesced++;
+        *leader = 0;
+        pthread_mutex_unlock(&gate.lock);
+        return result;
+    }
+
+    // Lead a new flight, in this key's old slot, a free one or the oldest idle one
+    for (int i = 0; !f && i < MAX_FLIGHTS; i++) {
+        if (!flights[i].key) {
+            f = &flights[i];
+        }
+    }
+    for (int i = 0; !f && i < MAX_FLIGHTS; i++) {
+        struct flight *c = &flights[i];
+        if (!c->running && c->waiters == 0 && (!f || c->done_at < f->done_at)) {
+            f = c;
+        }
+    }
+    if (f && !f->running && f->waiters == 0) {
+        free(f->key);
+        free(f->result);
+        f->key = strdup(key);
+        f->result = NULL;
+        f->reusable = 0;
+        f->running = f->key != NULL;
+    }
+    *leader = 1;
+    pthread_mutex_unlock(&gate.lock);
+    return NULL;
+}
+
+// Publish the leader's answer. Waiters always share it; later identical
+// requests only reuse it if it is reusable (complete and successful).
+void ollama_flight_done(const char *key, const char *result, int reusable) {
+    pthread_mutex_lock(&gate.lock);
+    struct flight *f = find_flight(key);
+    if (f && f->running) {
+        f->result = result ? strdup(result) : NULL;
+        f->reusable = reusable && f->result != NULL;
+        f->done_at = ollama_gate_now_ms();
+        f->running = 0;
+        pthread_cond_broadcast(&flight_cond);
+    }
+    pthread_mutex_unlock(&gate.lock);
+}
@@ -0,0 +1,47 @@
+#ifndef OLLAMA_GATE_H
+#define OLLAMA_GATE_H
+
+// Admission control in front of the single local Ollama instance:
+// identical requests share one answer (single-flight), requests wait for a
+// slot in priority order and for a rate-limit token, and a circuit breaker
+// fails calls fast for a while after repeated connection failures.
+
+// Request priorities, highest first
+enum {
+    OLLAMA_PRIORITY_INTERACTIVE,  // an explicit TAB
+    OLLAMA_PRIORITY_SPECULATIVE   // warm-ups and other work nobody waits on
+};
+
+// Results of ollama_gate_enter
+enum {
+    OLLAMA_GATE_OK = 0,
+    OLLAMA_GATE_LIMITED = -1,     // no slot or token before the deadline
+    OLLAMA_GATE_OPEN = -2         // circuit open after connection failures
+};
+
+struct ollama_gate_stats {
+    unsigned long admitted;
+    unsigned long coalesced;      // answered by an identical request
+    unsigned long limited;
+    unsigned long rejected;       // failed fast while the circuit was open
+    unsigned long trips;
+    int inflight;
+    int queued;
+    double tokens;
+    int failures;                 // consecutive connection failures
+    double open_ms;               // time left before a trial request, 0 if closed
+};
+
+// Function declarations
+int ollama_gate_enter(int priority, int metered, double deadline_ms);
+int ollama_gate_leave(int reachable);
+void ollama_gate_get_stats(struct ollama_gate_stats* out);
+void ollama_gate_reset(void);
+char* ollama_flight_join(const char* key, int* leader);
+void ollama_flight_done(const char* key, const char* result, int reusable);
+double ollama_gate_now_ms(void);
+
+// Constants
+#define OLLAMA_FLIGHT_REUSE_MS 1500   // a finished answer is shared this long
+
+#endif // OLLAMA_GATE_H
@@ -11,8 +11,17 @@
 #include <math.h>
 #include <fnmatch.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #include <curl/curl.h>
-#include <json-c/json.h>
+#include "ollama_codec.h"
+#include "ollama_config.h"
+#include "ripple_index.h"
+#include "ollama_gate.h"
+#include "ripple_client.h"
+#include "ripple_trace.h"
+#include "ripple_metrics.h"
+#include "ripple_prof.h"
+#include "ripple_backend.h"
 
 // Constants
 #define RIPPLE_RL_BUFSIZE 1024
@@ -21,220 +30,1038 @@
 #define RIPPLE_VERSION "1.0.0"
 #define OLLAMA_API_URL "http://localhost:11434/api/generate"
 
-// Struct for curl response
-struct MemoryStruct {
-    char *memory;
-    size_t size;
+// Fixed instructions for each kind of completion. They come first in the
+// prompt so Ollama's context for them can be evaluated once and reused.
+#define CD_INSTRUCTIONS \
+    "You are a Unix/Linux shell expert. For what the user typed, suggest exactly 3 most useful directory paths they might want to navigate to. Format each suggestion EXACTLY like this:\n\n" \
+    "1. /usr/bin - System executables and commands directory\n" \
+    "2. /etc - System configuration files directory\n" \
+    "3. /var/log - System and application logs directory\n\n" \
+    "Keep descriptions to a single line, starting with the path followed by a brief description."
+#define CMD_INSTRUCTIONS \
+    "You are a Unix/Linux shell expert. For what the user typed, suggest exactly 3 most useful command completions. Format each suggestion EXACTLY like this:\n\n" \
+    "1. ls -la - List all files with detailed permissions and ownership info\n" \
+    "2. grep -r 'pattern' . - Search for text recursively in all files\n" \
+    "3. find . -type f -name '*.txt' - Find all .txt files in current directory and subdirectories\n\n" \
+    "Keep descriptions to a single line, starting with the command followed by a brief description."
+
+// Structured variants: the output is constrained to a JSON array of
+// {cmd, desc} objects, which is far shorter than the free-text format
+#define CD_JSON_INSTRUCTIONS \
+    "You are a Unix/Linux shell expert. For what the user typed, suggest exactly 3 most useful directories to change to. " \
+    "Reply with only a JSON array of 3 objects with \"cmd\" (the full cd command) and \"desc\" (a few words), like:\n" \
+    "[{\"cmd\":\"cd /var/log\",\"desc\":\"System logs\"},{\"cmd\":\"cd ~/src\",\"desc\":\"Source checkouts\"},{\"cmd\":\"cd /etc\",\"desc\":\"Configuration files\"}]"
+#define CMD_JSON_INSTRUCTIONS \
+    "You are a Unix/Linux shell expert. For what the user typed, suggest exactly 3 most useful complete commands. " \
+    "Reply with only a JSON array of 3 objects with \"cmd\" (the full command) and \"desc\" (a few words), like:\n" \
+    "[{\"cmd\":\"ls -la\",\"desc\":\"List all files with details\"},{\"cmd\":\"grep -r 'pattern' .\",\"desc\":\"Search text recursively\"},{\"cmd\":\"find . -name '*.txt'\",\"desc\":\"Find .txt files\"}]"
+
+// Ollama "format" schema for the structured variants
+#define SUGGESTION_SCHEMA \
+    "{\"type\":\"array\",\"maxItems\":3,\"items\":{\"type\":\"object\"," \
+    "\"properties\":{\"cmd\":{\"type\":\"string\"},\"desc\":{\"type\":\"string\"}}," \
+    "\"required\":[\"cmd\",\"desc\"]}}"
+
+#define USER_PREFIX "The user typed '"
+#define USER_SUFFIX "'. Give the 3 suggestions now."
+
+#define LATENCY_WINDOW 32     // requests kept per model for the rolling p95
+#define REPEAT_TAB_MS 10000    // a TAB on the same buffer within this escalates
+#define RETRIEVAL_MARGIN 0.15  // index hits this close to the threshold are still shown
+
+// JSON output only ever needs a blank line to be over
+static const char *const structured_stop[] = { "\n\n", NULL };
+
+// States of a cached instruction prefix
+enum { PREFIX_COLD, PREFIX_WARMING, PREFIX_READY, PREFIX_FAILED };
+
+// Ollama context tokens for one instruction block, filled in by the warm-up.
+// The tokens are only valid for the model and settings they were made with.
+struct prompt_prefix {
+    const char *name;
+    int structured;
+    const char *instructions;  // what the warm-up request evaluates
+    const char *full_prefix;   // instructions + user prefix, used without a context
+    int *context;
+    size_t context_len;
+    int state;
+    char model[64];
+    unsigned long generation;
 };
 
-// Function to escape JSON string
-static char* escape_json_string(const char* input) {
-    if (!input) return NULL;
-    
-    size_t len = strlen(input);
-    char* escaped = malloc(len * 2 + 1); // Worst case: every char needs escaping
-    if (!escaped) return NULL;
-    
-    size_t j = 0;
-    for (size_t i = 0; i < len; i++) {
-        switch (input[i]) {
-            case '\n':
-                escaped[j++] = '\\';
-                escaped[j++] = 'n';
-                break;
-            case '\r':
-                escaped[j++] = '\\';
-                escaped[j++] = 'r';
-                break;
-            case '\t':
-                escaped[j++] = '\\';
-                escaped[j++] = 't';
-                break;
-            case '\\':
-                escaped[j++] = '\\';
-                escaped[j++] = '\\';
-                break;
-            case '"':
-                escaped[j++] = '\\';
-                escaped[j++] = '"';
-                break;
-            default:
-                escaped[j++] = input[i];
-        }
-    }
-    escaped[j] = '\0';
-    return escaped;
-}
-
-// Function to handle memory allocation for curl response
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
+static struct prompt_prefix prompt_prefixes[] = {
+    { "command", 1, CMD_JSON_INSTRUCTIONS, CMD_JSON_INSTRUCTIONS "\n\n" USER_PREFIX, NULL, 0, PREFIX_COLD, "", 0 },
+    { "cd", 1, CD_JSON_INSTRUCTIONS, CD_JSON_INSTRUCTIONS "\n\n" USER_PREFIX, NULL, 0, PREFIX_COLD, "", 0 },
+    { "command", 0, CMD_INSTRUCTIONS, CMD_INSTRUCTIONS "\n\n" USER_PREFIX, NULL, 0, PREFIX_COLD, "", 0 },
+    { "cd", 0, CD_INSTRUCTIONS, CD_INSTRUCTIONS "\n\n" USER_PREFIX, NULL, 0, PREFIX_COLD, "", 0 }
+};
+#define NUM_PREFIXES (sizeof(prompt_prefixes) / sizeof(prompt_prefixes[0]))
+
+// Metrics Ollama reported for one request
+struct ollama_metrics {
+    long long total_duration;
+    long long load_duration;
+    long long prompt_eval_count;
+    long long prompt_eval_duration;
+    long long eval_count;
+    long long eval_duration;
+    int used_context;
+};
+
+// Running totals shown by the diagnostics builtin
+struct ollama_stats {
+    unsigned long requests;
+    unsigned long failures;
+    unsigned long warmups;
+    unsigned long deadline_hits;
+    struct ollama_metrics last;
+    struct ollama_metrics last_warmup;
+    unsigned long with_context;
+    long long prompt_eval_with_context;
+    unsigned long without_context;
+    long long prompt_eval_without_context;
+    long long load_total;
+    unsigned long retrieved;       // answered from the index without generating
+    unsigned long retrieval_misses;
+    double last_embed_ms;
+    double last_scan_ms;
+};
+
+// Client-side wall-clock latencies of recent requests to one model
+struct latency_window {
+    long samples[LATENCY_WINDOW];
+    int count;
+    int next;
+};
+
+// Model routing: small model by default, large model on a repeated TAB,
+// back to the small one for a cool-down when the large one is over budget.
+// What counts as a repeat is per session; see struct ollama_session.
+struct route_state {
+    struct latency_window small;
+    struct latency_window large;
+    double degraded_until;
+    unsigned long escalations;
+    unsigned long fallbacks;
+};
+
+static struct ollama_stats stats;
+static struct route_state route;
+
+// Guards prompt_prefixes, stats and route, which the warm-up thread (and
+// the daemon's session threads) also use
+static pthread_mutex_t ollama_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+// A backend connection plus request/response buffers kept between calls so
+// steady state does not allocate. Each thread talking to Ollama has its own; for
+// the shell's main thread and daemon sessions it also remembers the last
+// prompt, which decides whether a TAB is a repeat.
+struct ollama_session {
+    struct ripple_backend_conn conn;  // completions, on the configured backend
+    CURL *curl;                   // embeddings, which only Ollama serves
+    struct ollama_buf request;
+    struct ollama_response response;
+    struct ollama_buf body;       // embedding replies
+    int *context;                 // private copy of a cached prefix context
+    size_t context_cap;
+    char last_prompt[RIPPLE_RL_BUFSIZE];
+    double last_time;
+    char last_model[64];
+};
+
+static pthread_key_t session_key;
+
+static void session_free(struct ollama_session *sess);
+
+static void session_destroy(void *arg) {
+    session_free(arg);
+    free(arg);
+}
+
+static void curl_init_once(void) {
+    curl_global_init(CURL_GLOBAL_ALL);
+    pthread_key_create(&session_key, session_destroy);
+}
+
+// The calling thread's session, created on first use
+static struct ollama_session *thread_session(void) {
+    pthread_once(&curl_once, curl_init_once);
+    struct ollama_session *sess = pthread_getspecific(session_key);
+    if (!sess && (sess = calloc(1, sizeof(*sess))) != NULL) {
+        pthread_setspecific(session_key, sess);
+    }
+    return sess;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static size_t BufferWriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
-    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
-    
-    char *ptr = realloc(mem->memory, mem->size + realsize + 1);
-    if(!ptr) {
-        printf("Not enough memory (realloc returned NULL)\n");
-        return 0;
+    return ollama_buf_append((struct ollama_buf *)userp, contents, realsize) == 0 ? realsize : 0;
+}
+
+static void session_free(struct ollama_session *sess) {
+    if (sess->curl) {
+        curl_easy_cleanup(sess->curl);
+        sess->curl = NULL;
     }
-    
-    mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->memory[mem->size] = 0;
-    
-    return realsize;
+    ripple_backend_close(&sess->conn);
+    ollama_buf_free(&sess->request);
+    ollama_response_free(&sess->response);
+    ollama_buf_free(&sess->body);
+    free(sess->context);
+    sess->context = NULL;
+    sess->context_cap = 0;
+}
+
+// Fill in the request fields that come from the config
+static void request_from_config(struct ollama_request *req, const struct ollama_config *cfg) {
+    req->model = cfg->model;
+    req->stream = 1; // Streamed so a deadline still leaves the text so far
+    req->temperature = cfg->temperature;
+    req->top_p = cfg->top_p;
+    req->top_k = cfg->top_k;
+    req->num_predict = cfg->num_predict;
+    req->keep_alive = cfg->keep_alive;
+    if (cfg->structured) {
+        req->format = SUGGESTION_SCHEMA;
+        req->stop = structured_stop;
+    }
+}
+
+// Prefix for a prompt under the current output mode
+static struct prompt_prefix *prefix_for(const char *prompt, const struct ollama_config *cfg) {
+    int index = strncmp(prompt, "cd", 2) == 0 ? 1 : 0; // Special handling for cd command
+    return &prompt_prefixes[index + (cfg->structured ? 0 : 2)];
+}
+
+// Nothing came back: the connection failed or the server never answered
+static int unreachable(CURLcode res, size_t received) {
+    return res == CURLE_COULDNT_CONNECT || res == CURLE_COULDNT_RESOLVE_HOST ||
+           (res == CURLE_OPERATION_TIMEDOUT && received == 0);
+}
+
+// Wait for the gate, then report a rejection; returns the gate result
+static int enter_gate(int priority, int metered, double deadline, int quiet) {
+    int gate = ollama_gate_enter(priority, metered, deadline);
+    if (gate == OLLAMA_GATE_OPEN && !quiet) {
+        struct ollama_gate_stats gs;
+        ollama_gate_get_stats(&gs);
+        fprintf(stderr, "ripple: Ollama is unreachable; not trying again for %.1f s\n", gs.open_ms / 1000);
+    } else if (gate == OLLAMA_GATE_LIMITED && !quiet) {
+        fprintf(stderr, "ripple: Ollama is busy; try again shortly\n");
+    }
+    return gate;
+}
+
+// Release the gate and say so when the circuit breaker opens
+static void leave_gate(int reachable, int quiet) {
+    if (ollama_gate_leave(reachable) && !quiet) {
+        struct ollama_config cfg;
+        ollama_config_get(&cfg);
+        fprintf(stderr, "ripple: Ollama unreachable %d times in a row; pausing AI requests for %.1f s\n",
+                cfg.breaker_failures, cfg.breaker_cooldown_ms / 1000.0);
+    }
+}
+
+// Send one generate request to the configured backend and stream the reply
+// into sess->response. Returns 0 on success, 1 if the deadline hit after
+// some text arrived, -1 on failure and -2 if the gate turned it away before
+// it was sent. Errors are printed unless quiet is set.
+static int ollama_generate(struct ollama_session *sess, const struct ollama_config *cfg,
+                           const struct ollama_request *req, int priority, int quiet) {
+    double deadline = now_ms() + cfg->timeout_ms;
+    const struct ripple_backend *be = ripple_backend_find(cfg->backend);
+    const char *url, *model;
+
+    pthread_once(&curl_once, curl_init_once);
+    if (!be) {
+        if (!quiet) {
+            fprintf(stderr, "ripple: unknown AI backend '%s'\n", cfg->backend);
+        }
+        return -1;
+    }
+    ripple_backend_settings(be, cfg, &url, &model);
+    if (ripple_backend_connect(&sess->conn, be, url, model, cfg->connect_timeout_ms) != 0) {
+        return -1;
+    }
+
+    // Time spent queued comes out of the request's deadline
+    if (enter_gate(priority, 1, deadline, quiet) != OLLAMA_GATE_OK) {
+        return -2;
+    }
+    long timeout_ms = (long)(deadline - now_ms());
+    if (timeout_ms < 1) {
+        timeout_ms = 1;
+    }
+
+    uint64_t span = ripple_prof_begin();
+    int rc = ripple_backend_stream(&sess->conn, req, timeout_ms, NULL, NULL, &sess->response);
+    ripple_prof_end(span, "curl_generate");
+    leave_gate(rc != RIPPLE_BACKEND_UNREACHABLE, quiet);
+
+    if (rc == RIPPLE_BACKEND_PARTIAL) {
+        return 1;
+    }
+    if (rc != RIPPLE_BACKEND_OK) {
+        if (!quiet) {
+            fprintf(stderr, "%s\n", sess->conn.error);
+        }
+        return -1;
+    }
+
+    if (sess->response.error.len > 0) {
+        if (!quiet) {
+            fprintf(stderr, "%s error: %s\n", be->label, sess->response.error.data);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void copy_metrics(struct ollama_metrics *m, const struct ollama_response *r, int used_context) {
+    m->total_duration = r->total_duration;
+    m->load_duration = r->load_duration;
+    m->prompt_eval_count = r->prompt_eval_count;
+    m->prompt_eval_duration = r->prompt_eval_duration;
+    m->eval_count = r->eval_count;
+    m->eval_duration = r->eval_duration;
+    m->used_context = used_context;
+}
+
+static void window_add(struct latency_window *w, long ms) {
+    w->samples[w->next] = ms;
+    w->next = (w->next + 1) % LATENCY_WINDOW;
+    if (w->count < LATENCY_WINDOW) {
+        w->count++;
+    }
+}
+
+// 95th percentile of the window, or -1 when it is empty
+static long window_p95(const struct latency_window *w) {
+    long sorted[LATENCY_WINDOW];
+    int n = w->count;
+
+    if (n == 0) {
+        return -1;
+    }
+    memcpy(sorted, w->samples, n * sizeof(long));
+    for (int i = 1; i < n; i++) {
+        long v = sorted[i];
+        int j = i - 1;
+        while (j >= 0 && sorted[j] > v) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+    int index = (95 * n + 99) / 100 - 1;
+    return sorted[index < 0 ? 0 : index];
+}
+
+// Evaluate one instruction block and keep the context Ollama returns for it
+static void warm_prefix(struct ollama_session *sess, struct prompt_prefix *pp) {
+    struct ollama_config cfg;
+    unsigned long generation = ollama_config_generation();
+
+    ollama_config_get(&cfg);
+
+    pthread_mutex_lock(&ollama_lock);
+    if (pp->state == PREFIX_WARMING ||
+        (pp->state == PREFIX_READY && pp->generation == generation)) {
+        pthread_mutex_unlock(&ollama_lock);
+        return;
+    }
+    pp->state = PREFIX_WARMING;
+    pthread_mutex_unlock(&ollama_lock);
+
+    struct ollama_request req = { 0 };
+    request_from_config(&req, &cfg);
+    req.prompt = pp->instructions;
+    // Only the prompt evaluation matters here. Ollama reads 0 as no limit,
+    // so one token is generated and dropped from the context below.
+    req.num_predict = 1;
+
+    // A backend without context tokens still gets the model loaded, and
+    // llama.cpp keeps the evaluated prefix in its own prompt cache
+    const struct ripple_backend *be = ripple_backend_find(cfg.backend);
+    int ok = ollama_generate(sess, &cfg, &req, OLLAMA_PRIORITY_SPECULATIVE, 1) == 0 &&
+             (sess->response.context_len > 0 || (be && !be->has_context));
+    int *context = NULL;
+    size_t len = sess->response.context_len;
+    // The context ends with the generated tokens; a completion continuing
+    // from it must see the instructions alone
+    long long generated = sess->response.eval_count;
+    if (generated > 0 && (size_t)generated < len) {
+        len -= (size_t)generated;
+    }
+    if (ok && len > 0) {
+        context = malloc(len * sizeof(int));
+        if (context) {
+            memcpy(context, sess->response.context, len * sizeof(int));
+        } else {
+            ok = 0;
+        }
+    }
+
+    pthread_mutex_lock(&ollama_lock);
+    if (ok) {
+        free(pp->context);
+        pp->context = context;
+        pp->context_len = len;
+        pp->state = PREFIX_READY;
+        pp->generation = generation;
+        snprintf(pp->model, sizeof(pp->model), "%s", cfg.model);
+        stats.warmups++;
+        stats.load_total += sess->response.load_duration;
+        copy_metrics(&stats.last_warmup, &sess->response, 0);
+    } else {
+        pp->state = PREFIX_FAILED;
+    }
+    pthread_mutex_unlock(&ollama_lock);
+}
+
+static void *warmup_thread(void *arg) {
+    struct ollama_session sess = { 0 };
+    (void)arg;
+
+    struct ollama_config cfg;
+    ollama_config_get(&cfg);
+
+    for (size_t i = 0; i < NUM_PREFIXES; i++) {
+        if (prompt_prefixes[i].structured == (cfg.structured != 0)) {
+            warm_prefix(&sess, &prompt_prefixes[i]);
+        }
+    }
+    session_free(&sess);
+    return NULL;
+}
+
+// Load the model and evaluate the instruction prefixes in the background, so
+// the first TAB neither waits for a cold model load nor re-reads the template
+void ollama_warmup_async(void) {
+    pthread_t tid;
+
+    pthread_once(&curl_once, curl_init_once);
+    if (pthread_create(&tid, NULL, warmup_thread, NULL) == 0) {
+        pthread_detach(tid);
+    }
+}
+
+// Pick the model for this prompt; returns 1 if the large model was chosen
+static int choose_model(struct ollama_session *sess, const char *prompt, const struct ollama_config *cfg,
+                        double now) {
+    int repeated = strcmp(prompt, sess->last_prompt) == 0 && now - sess->last_time < REPEAT_TAB_MS;
+    int large = 0;
+
+    snprintf(sess->last_prompt, sizeof(sess->last_prompt), "%s", prompt);
+    sess->last_time = now;
+
+    pthread_mutex_lock(&ollama_lock);
+    if (repeated && cfg->large_model[0] && strcmp(cfg->large_model, cfg->model) != 0 &&
+        now >= route.degraded_until) {
+        route.escalations++;
+        large = 1;
+    }
+    pthread_mutex_unlock(&ollama_lock);
+    return large;
+}
+
+// Record a request's latency and drop back to the small model when the
+// large model's rolling p95 goes over budget
+static void record_latency(int large, long ms, const struct ollama_config *cfg, double now) {
+    pthread_mutex_lock(&ollama_lock);
+    if (!large) {
+        window_add(&route.small, ms);
+        pthread_mutex_unlock(&ollama_lock);
+        return;
+    }
+
+    window_add(&route.large, ms);
+    long p95 = window_p95(&route.large);
+    int fell_back = cfg->p95_budget_ms > 0 && p95 > cfg->p95_budget_ms;
+    if (fell_back) {
+        route.degraded_until = now + cfg->cooldown_ms;
+        route.fallbacks++;
+        route.large.count = route.large.next = 0;
+    }
+    pthread_mutex_unlock(&ollama_lock);
+    if (fell_back) {
+        fprintf(stderr, "ripple: %s p95 %ld ms is over the %ld ms budget, using %s for %ld s\n",
+                cfg->large_model, p95, cfg->p95_budget_ms, cfg->model, cfg->cooldown_ms / 1000);
+    }
+}
+
+// Model used by the calling thread's most recent completion request
+const char *ollama_last_model(void) {
+    struct ollama_session *sess = thread_session();
+    return sess ? sess->last_model : "";
+}
+
+// Generate suggestions for prompt with the chosen model. *reusable is set
+// when the answer is complete and may be shared with identical requests.
+static char *generate_completion(struct ollama_session *sess, const char *prompt,
+                                 const struct ollama_config *cfg, int large, double start,
+                                 unsigned long generation, int *reusable) {
+    size_t context_len = 0;
+    int need_warmup = 0;
+    const char *model = large ? cfg->large_model : cfg->model;
+
+    *reusable = 0;
+    struct prompt_prefix *pp = prefix_for(prompt, cfg);
+
+    // Take a private copy of the cached context so the warm-up thread can replace it
+    pthread_mutex_lock(&ollama_lock);
+    if (pp->state == PREFIX_READY && pp->generation != generation) {
+        pp->state = PREFIX_COLD; // Settings changed since the warm-up
+    }
+    if (pp->state == PREFIX_READY && strcmp(pp->model, model) == 0) {
+        if (pp->context_len > sess->context_cap) {
+            int *tmp = realloc(sess->context, pp->context_len * sizeof(int));
+            if (tmp) {
+                sess->context = tmp;
+                sess->context_cap = pp->context_len;
+            }
+        }
+        if (pp->context_len > 0 && pp->context_len <= sess->context_cap) {
+            memcpy(sess->context, pp->context, pp->context_len * sizeof(int));
+            context_len = pp->context_len;
+        }
+    } else if (pp->state == PREFIX_COLD || pp->state == PREFIX_FAILED) {
+        need_warmup = 1;
+    }
+    pthread_mutex_unlock(&ollama_lock);
+
+    struct ollama_request req = { 0 };
+    request_from_config(&req, cfg);
+    req.model = model;
+    req.prompt = prompt;
+    req.prompt_suffix = USER_SUFFIX;
+
+    // With a cached context only the user's part of the prompt is sent
+    if (context_len > 0) {
+        req.prompt_prefix = USER_PREFIX;
+        req.context = sess->context;
+        req.context_len = context_len;
+    } else {
+        req.prompt_prefix = pp->full_prefix;
+    }
+
+    int rc = ollama_generate(sess, cfg, &req, OLLAMA_PRIORITY_INTERACTIVE, 0);
+    struct ollama_response *resp = &sess->response;
+    double end = now_ms();
+
+    // Turned away by the gate: nothing was sent, so nothing to record
+    if (rc == -2) {
+        return NULL;
+    }
+
+    // A failure counts as taking the whole deadline
+    record_latency(large, rc < 0 ? cfg->timeout_ms : (long)(end - start), cfg, end);
+
+    pthread_mutex_lock(&ollama_lock);
+    stats.requests++;
+    if (rc < 0) {
+        stats.failures++;
+    } else if (rc > 0) {
+        stats.deadline_hits++;
+    } else {
+        copy_metrics(&stats.last, resp, context_len > 0);
+        stats.load_total += resp->load_duration;
+        if (context_len > 0) {
+            stats.with_context++;
+            stats.prompt_eval_with_context += resp->prompt_eval_duration;
+        } else {
+            stats.without_context++;
+            stats.prompt_eval_without_context += resp->prompt_eval_duration;
+        }
+    }
+    pthread_mutex_unlock(&ollama_lock);
+
+    if (rc < 0 || !resp->text.data) {
+        return NULL;
+    }
+
+    // The server is reachable again, so retry a warm-up that failed earlier
+    if (need_warmup) {
+        ollama_warmup_async();
+    }
+
+    // Out of time: hand back whatever suggestions were generated so far
+    if (rc > 0) {
+        char *partial = malloc(resp->text.len + sizeof(OLLAMA_PARTIAL_NOTE));
+        if (partial) {
+            memcpy(partial, resp->text.data, resp->text.len);
+            memcpy(partial + resp->text.len, OLLAMA_PARTIAL_NOTE, sizeof(OLLAMA_PARTIAL_NOTE));
+        }
+        return partial;
+    }
+    *reusable = 1;
+    return strdup(resp->text.data);
 }
 
 // Function to get AI-based command completion using Ollama API
 char* get_ollama_completion(const char* prompt) {
-    CURL *curl;
-    CURLcode res;
-    struct MemoryStruct chunk;
-    chunk.memory = malloc(1);
-    chunk.size = 0;
-    
-    if (!chunk.memory) {
+    struct ollama_config cfg;
+    unsigned long generation = ollama_config_generation();
+    char key[RIPPLE_RL_BUFSIZE + 96];
+    int leader, reusable;
+    struct ollama_session *sess = thread_session();
+    uint64_t span = ripple_prof_begin();
+
+    if (!sess) {
         return NULL;
     }
-    chunk.memory[0] = '\0';
-    
-    curl_global_init(CURL_GLOBAL_ALL);
-    curl = curl_easy_init();
-    
-    if(curl) {
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        
-        // Using tinyllama for quick responses
-        char json_data[4096]; // Increased buffer size for larger prompts
-        const char* prompt_template;
-        
-        // Special handling for cd command
-        if (strncmp(prompt, "cd", 2) == 0) {
-            prompt_template = "You are a Unix/Linux shell expert. The user typed '%s'. Suggest exactly 3 most useful directory paths they might want to navigate to. Format each suggestion EXACTLY like this:\n\n"
-                            "1. /usr/bin - System executables and commands directory\n"
-                            "2. /etc - System configuration files directory\n"
-                            "3. /var/log - System and application logs directory\n\n"
-                            "Keep descriptions to a single line, starting with the path followed by a brief description.";
-        } else {
-            prompt_template = "You are a Unix/Linux shell expert. The user typed '%s'. Suggest exactly 3 most useful command completions. Format each suggestion EXACTLY like this:\n\n"
-                            "1. ls -la - List all files with detailed permissions and ownership info\n"
-                            "2. grep -r 'pattern' . - Search for text recursively in all files\n"
-                            "3. find . -type f -name '*.txt' - Find all .txt files in current directory and subdirectories\n\n"
-                            "Keep descriptions to a single line, starting with the command followed by a brief description.";
-        }
-        
-        // Create the full prompt
-        char full_prompt[2048];
-        snprintf(full_prompt, sizeof(full_prompt), prompt_template, prompt);
-        
-        // Escape the prompt for JSON
-        char* escaped_prompt = escape_json_string(full_prompt);
-        if (!escaped_prompt) {
-            fprintf(stderr, "Failed to escape prompt\n");
-            free(chunk.memory);
-            curl_slist_free_all(headers);
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            return NULL;
-        }
-        
-        // Create the JSON request
-        snprintf(json_data, sizeof(json_data), 
-                "{\"model\": \"tinyllama\", \"prompt\": \"%s\", \"stream\": false, \"temperature\": 0.2, \"top_p\": 0.9, \"top_k\": 40, \"num_predict\": 300}", 
-                escaped_prompt);
-        
-        free(escaped_prompt);
-        
-        curl_easy_setopt(curl, CURLOPT_URL, OLLAMA_API_URL);
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-        
-        res = curl_easy_perform(curl);
-        
-        if(res != CURLE_OK) {
+    ollama_config_get(&cfg);
+    double start = now_ms();
+    int large = choose_model(sess, prompt, &cfg, start);
+    const char *model = large ? cfg.large_model : cfg.model;
+    snprintf(sess->last_model, sizeof(sess->last_model), "%s", model);
+
+    // Identical requests, in flight or just answered, share one answer
+    snprintf(key, sizeof(key), "%s\n%lu\n%s", model, generation, prompt);
+    char *shared = ollama_flight_join(key, &leader);
+    if (!leader) {
+        ripple_metrics_observe(RIPPLE_METRIC_COMPLETION, (now_ms() - start) / 1000.0, shared == NULL);
+        ripple_prof_end(span, "completion_shared");
+        return shared;
+    }
+    char *text = generate_completion(sess, prompt, &cfg, large, start, generation, &reusable);
+    ollama_flight_done(key, text, reusable);
+    ripple_metrics_observe(RIPPLE_METRIC_COMPLETION, (now_ms() - start) / 1000.0, text == NULL);
+    ripple_prof_end(span, "completion");
+    return text;
+}
+
+// The /api/embed URL next to the configured /api/generate one
+static void embed_url(const char *endpoint, char *out, size_t size) {
+    const char *api = strstr(endpoint, "/api/");
+    int base = api ? (int)(api - endpoint) : (int)strlen(endpoint);
+    snprintf(out, size, "%.*s/api/embed", base, endpoint);
+}
+
+// Embed texts with the configured embedding model. Vectors are stored
+// dim_max floats apart in out. Returns the vector size, or -1 on failure.
+int ollama_embed(const char *const *texts, int count, float *out, int dim_max, int quiet) {
+    struct ollama_session *sess = thread_session();
+    struct ollama_config cfg;
+    char url[300];
+    int dim;
+
+    ollama_config_get(&cfg);
+    embed_url(cfg.endpoint, url, sizeof(url));
+
+    if (!sess || (!sess->curl && !(sess->curl = curl_easy_init()))) {
+        return -1;
+    }
+    CURL *curl = sess->curl;
+    struct ollama_buf *request = &sess->request, *body = &sess->body;
+    if (ollama_write_embed_request(request, cfg.embed_model, texts, count) != 0) {
+        return -1;
+    }
+    ollama_buf_reset(body);
+
+    struct curl_slist *headers = curl_slist_append(NULL, "Content-Type: application/json");
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->data);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)request->len);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BufferWriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)body);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, cfg.connect_timeout_ms);
+
+    // Embeddings are cheap and index builds send many, so they take a slot
+    // but no rate-limit token
+    double deadline = now_ms() + cfg.timeout_ms;
+    if (enter_gate(OLLAMA_PRIORITY_INTERACTIVE, 0, deadline, quiet) != OLLAMA_GATE_OK) {
+        curl_slist_free_all(headers);
+        return -1;
+    }
+    long timeout_ms = (long)(deadline - now_ms());
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms < 1 ? 1L : timeout_ms);
+
+    uint64_t span = ripple_prof_begin();
+    CURLcode res = curl_easy_perform(curl);
+    ripple_prof_end(span, "curl_embed");
+    curl_slist_free_all(headers);
+    leave_gate(!unreachable(res, body->len), quiet);
+    if (res != CURLE_OK) {
+        if (!quiet) {
             fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-            free(chunk.memory);
-            curl_slist_free_all(headers);
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            return NULL;
-        }
-        
-        // Parse the response
-        struct json_object *parsed_json = json_tokener_parse(chunk.memory);
-        if (!parsed_json) {
-            fprintf(stderr, "Failed to parse JSON response\n");
-            free(chunk.memory);
-            curl_slist_free_all(headers);
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            return NULL;
-        }
-        
-        struct json_object *response_obj;
-        if (json_object_object_get_ex(parsed_json, "response", &response_obj)) {
-            const char* response_text = json_object_get_string(response_obj);
-            char* result = strdup(response_text);
-            
-            json_object_put(parsed_json);
-            curl_slist_free_all(headers);
-            curl_easy_cleanup(curl);
-            free(chunk.memory);
-            curl_global_cleanup();
+        }
+        return -1;
+    }
+    if (ollama_buf_append(body, "", 1) != 0) {
+        return -1;
+    }
+    if (ollama_parse_embeddings(body->data, out, count, dim_max, &dim) != count || dim > dim_max) {
+        if (!quiet) {
+            fprintf(stderr, "Ollama embed error: %.200s\n", body->data);
+        }
+        return -1;
+    }
+    return dim;
+}
+
+// Add a suggestion unless the same command is already listed
+static void add_suggestion(struct ollama_suggestion *out, int *count, int max,
+                           const char *cmd, int cmd_len, const char *desc, int desc_len) {
+    if (*count >= max || cmd_len == 0) {
+        return;
+    }
+    for (int i = 0; i < *count; i++) {
+        if ((int)strlen(out[i].cmd) == cmd_len && strncmp(out[i].cmd, cmd, cmd_len) == 0) {
+            return;
+        }
+    }
+    snprintf(out[*count].cmd, sizeof(out[*count].cmd), "%.*s", cmd_len, cmd);
+    snprintf(out[*count].desc, sizeof(out[*count].desc), "%.*s", desc_len, desc);
+    (*count)++;
+}
+
+// Look the prompt up in the retrieval index; returns the number of hits
+// worth showing (best first) or 0. cd prompts only match cd entries.
+static int retrieve_suggestions(const char *prompt, struct ripple_hit *hits, int max,
+                                const struct ollama_config *cfg) {
+    struct ripple_hit all[8];
+    double t0 = now_ms(), scan_ms = 0;
+    int is_cd = strncmp(prompt, "cd", 2) == 0;
+
+    if (ripple_index_count() == 0 || prompt[0] == '\0') {
+        return 0;
+    }
+    int n = ripple_index_query(prompt, all, 8, &scan_ms);
+
+    int kept = 0;
+    for (int i = 0; i < n && kept < max; i++) {
+        if (all[i].score < cfg->retrieval_min_score - RETRIEVAL_MARGIN) {
+            break;
+        }
+        if (is_cd && strncmp(all[i].cmd, "cd ", 3) != 0) {
+            continue;
+        }
+        hits[kept++] = all[i];
+    }
+
+    pthread_mutex_lock(&ollama_lock);
+    stats.last_embed_ms = now_ms() - t0 - scan_ms;
+    stats.last_scan_ms = scan_ms;
+    pthread_mutex_unlock(&ollama_lock);
+    return kept;
+}
+
+// Ollama's token count and total time for the last completed request
+void ollama_get_last_metrics(long long *eval_count, long long *total_ns) {
+    pthread_mutex_lock(&ollama_lock);
+    *eval_count = stats.last.eval_count;
+    *total_ns = stats.last.total_duration;
+    pthread_mutex_unlock(&ollama_lock);
+}
+
+static int fetch_suggestions(const char* prompt, struct ollama_suggestion* out, int max, char** raw);
+
+// Get suggestions as a list; returns how many were parsed, or -1 if the
+// request failed. raw (optional) receives the unparsed text.
+int get_ollama_suggestions(const char* prompt, struct ollama_suggestion* out, int max, char** raw) {
+    char *text = NULL;
+    uint64_t span = ripple_prof_begin();
+
+    if (max > RIPPLE_MAX_SUGGESTIONS) {
+        max = RIPPLE_MAX_SUGGESTIONS;
+    }
+    // A replayed session gets the answers recorded with it
+    int result = ripple_trace_lookup(prompt, out, max, &text);
+    if (result == RIPPLE_TRACE_MISS) {
+        double t0 = now_ms();
+        result = fetch_suggestions(prompt, out, max, &text);
+        double elapsed = now_ms() - t0;
+        ripple_metrics_observe(RIPPLE_METRIC_SUGGEST, elapsed / 1000.0, result < 0);
+        ripple_trace_suggestions(prompt, result, out, text, elapsed);
+    }
+    ripple_prof_end(span, "suggest");
+    if (raw) {
+        *raw = text;
+    } else {
+        free(text);
+    }
+    return result;
+}
+
+// The work behind get_ollama_suggestions, which records and replays it
+static int fetch_suggestions(const char* prompt, struct ollama_suggestion* out, int max, char** raw) {
+    struct ollama_config cfg;
+    struct ripple_hit hits[RIPPLE_MAX_SUGGESTIONS];
+    int count = 0;
+
+    ollama_config_get(&cfg);
+    *raw = NULL;
+
+    // A running ripple-daemon answers for every shell from one cache and index
+    if (ripple_client_enabled()) {
+        int result = ripple_client_suggest(prompt, out, max, raw);
+        if (result != RIPPLE_CLIENT_UNAVAILABLE) {
             return result;
         }
-        
-        json_object_put(parsed_json);
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        free(chunk.memory);
-        curl_global_cleanup();
-        return NULL;
     }
-    
-    free(chunk.memory);
-    curl_global_cleanup();
-    return NULL;
+
+    // A confident match in the index answers without generating anything
+    int num_hits = retrieve_suggestions(prompt, hits, max, &cfg);
+    if (num_hits > 0 && hits[0].score >= cfg.retrieval_min_score) {
+        for (int i = 0; i < num_hits; i++) {
+            add_suggestion(out, &count, max, hits[i].cmd, hits[i].cmd_len, hits[i].desc, hits[i].desc_len);
+        }
+        pthread_mutex_lock(&ollama_lock);
+        stats.retrieved++;
+        pthread_mutex_unlock(&ollama_lock);
+        return count;
+    }
+    if (ripple_index_count() > 0) {
+        pthread_mutex_lock(&ollama_lock);
+        stats.retrieval_misses++;
+        pthread_mutex_unlock(&ollama_lock);
+    }
+
+    char *text = get_ollama_completion(prompt);
+
+    struct ollama_suggestion generated[RIPPLE_MAX_SUGGESTIONS];
+    int num_generated = text ? ollama_parse_suggestions(text, generated, max) : 0;
+
+    // cd suggestions are sometimes given as bare paths
+    if (strncmp(prompt, "cd", 2) == 0) {
+        for (int i = 0; i < num_generated; i++) {
+            struct ollama_suggestion *g = &generated[i];
+            if (strncmp(g->cmd, "cd ", 3) != 0 && strcmp(g->cmd, "cd") != 0) {
+                char path[sizeof(g->cmd)];
+                memcpy(path, g->cmd, sizeof(path));
+                snprintf(g->cmd, sizeof(g->cmd), "cd %.*s", (int)sizeof(path) - 4, path);
+            }
+        }
+    }
+    // Near misses from the index come first; the model fills in the rest
+    for (int i = 0; i < num_hits; i++) {
+        add_suggestion(out, &count, max, hits[i].cmd, hits[i].cmd_len, hits[i].desc, hits[i].desc_len);
+    }
+    for (int i = 0; i < num_generated; i++) {
+        add_suggestion(out, &count, max, generated[i].cmd, strlen(generated[i].cmd),
+                       generated[i].desc, strlen(generated[i].desc));
+    }
+    if (!text) {
+        return count > 0 ? count : -1;
+    }
+
+    *raw = text;
+    return count;
 }
 
-// Function to suggest next command based on prompt
-void suggest_command(const char* partial_cmd) {
-    printf("\nOllama Suggestions for '%s':\n", partial_cmd);
+static const char *prefix_state_name(int state) {
+    switch (state) {
+        case PREFIX_WARMING: return "warming";
+        case PREFIX_READY: return "ready";
+        case PREFIX_FAILED: return "failed";
+        default: return "cold";
+    }
+}
+
+static void print_metrics(FILE *out, const char *label, const struct ollama_metrics *m) {
+    double eval_ms = m->eval_duration / 1e6;
+    fprintf(out, "  %-16s total %.1f ms, load %.1f ms, prompt eval %lld tokens in %.1f ms, eval %lld tokens in %.1f ms",
+           label, m->total_duration / 1e6, m->load_duration / 1e6,
+           m->prompt_eval_count, m->prompt_eval_duration / 1e6, m->eval_count, eval_ms);
+    if (eval_ms > 0) {
+        fprintf(out, " (%.1f tok/s)", m->eval_count / (eval_ms / 1000.0));
+    }
+    fprintf(out, "\n");
+}
+
+// Write what the client knows about model load and prompt evaluation times
+void ollama_write_diagnostics(FILE *out) {
+    struct ollama_config cfg;
+    ollama_config_get(&cfg);
+
+    pthread_mutex_lock(&ollama_lock);
+    struct ollama_stats snap = stats;
+    fprintf(out, "Ollama diagnostics\n");
+    const struct ripple_backend *be = ripple_backend_find(cfg.backend);
+    const char *url = cfg.endpoint, *model_override = "";
+    if (be) {
+        ripple_backend_settings(be, &cfg, &url, &model_override);
+    }
+    fprintf(out, "  backend:         %s (%s)\n", be ? be->label : cfg.backend, url);
+    fprintf(out, "  model:           %s", cfg.model);
+    if (cfg.large_model[0]) {
+        fprintf(out, " (repeated TAB: %s)", cfg.large_model);
+    }
+    if (model_override[0]) {
+        fprintf(out, ", sent as %s", model_override);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "  keep_alive:      %s\n", cfg.keep_alive);
+    fprintf(out, "  output:          %s\n", cfg.structured ? "structured (JSON schema)" : "free text");
+    for (size_t i = 0; i < NUM_PREFIXES; i++) {
+        struct prompt_prefix *pp = &prompt_prefixes[i];
+        if (pp->structured != (cfg.structured != 0)) {
+            continue;
+        }
+        fprintf(out, "  %-8s prefix: %s", pp->name, prefix_state_name(pp->state));
+        if (pp->state == PREFIX_READY) {
+            fprintf(out, " (%zu context tokens, %s)", pp->context_len, pp->model);
+        }
+        fprintf(out, "\n");
+    }
+    pthread_mutex_unlock(&ollama_lock);
+
+    fprintf(out, "  requests:        %lu (%lu failed, %lu hit the deadline), %lu reused a context, %lu warm-ups\n",
+           snap.requests, snap.failures, snap.deadline_hits, snap.with_context, snap.warmups);
+    if (snap.warmups > 0) {
+        print_metrics(out, "last warm-up:", &snap.last_warmup);
+    }
+    if (snap.requests > snap.failures + snap.deadline_hits) {
+        print_metrics(out, snap.last.used_context ? "last (context):" : "last (full):", &snap.last);
+    }
+    if (snap.with_context > 0) {
+        fprintf(out, "  avg prompt eval: %.1f ms with context\n",
+               snap.prompt_eval_with_context / 1e6 / snap.with_context);
+    }
+    if (snap.without_context > 0) {
+        fprintf(out, "  avg prompt eval: %.1f ms without context\n",
+               snap.prompt_eval_without_context / 1e6 / snap.without_context);
+    }
+    fprintf(out, "  total load time: %.1f ms\n", snap.load_total / 1e6);
+    if (ripple_index_count() > 0) {
+        fprintf(out, "  index:           %zu entries, %d dims (%s), %lu answered, %lu generated",
+               ripple_index_count(), ripple_index_dim(), ripple_index_model(), snap.retrieved,
+               snap.retrieval_misses);
+        if (snap.retrieved + snap.retrieval_misses > 0) {
+            fprintf(out, ", last embed %.1f ms, scan %.3f ms", snap.last_embed_ms, snap.last_scan_ms);
+        }
+        fprintf(out, "\n");
+    }
+
+    pthread_mutex_lock(&ollama_lock);
+    struct route_state rs = route;
+    pthread_mutex_unlock(&ollama_lock);
+    fprintf(out, "  routing:         p95 %ld ms small, %ld ms large (budget %ld ms), %lu escalations, %lu fallbacks",
+           window_p95(&rs.small), window_p95(&rs.large), cfg.p95_budget_ms, rs.escalations, rs.fallbacks);
+    double now = now_ms();
+    if (now < rs.degraded_until) {
+        fprintf(out, ", large model off for %.0f s", (rs.degraded_until - now) / 1000.0);
+    }
+    fprintf(out, "\n");
+
+    struct ollama_gate_stats gs;
+    ollama_gate_get_stats(&gs);
+    fprintf(out, "  gate:            %d in flight, %d queued, %.1f tokens, %lu admitted, %lu shared, %lu rate-limited\n",
+           gs.inflight, gs.queued, gs.tokens, gs.admitted, gs.coalesced, gs.limited);
+    fprintf(out, "  breaker:         %s, %d failures in a row, %lu trips, %lu calls failed fast\n",
+           gs.open_ms > 0 ? "open" : "closed", gs.failures, gs.trips, gs.rejected);
+}
+
+void ollama_print_diagnostics(void) {
+    ollama_write_diagnostics(stdout);
+}
+
+// Function to suggest next command based on prompt. out already holds
+// count suggestions from elsewhere (the history predictor); they are shown
+// first and the model fills up to max. Returns the total stored in out.
+int suggest_command(const char* partial_cmd, struct ollama_suggestion* out, int count, int max) {
+    struct ollama_suggestion generated[RIPPLE_MAX_SUGGESTIONS];
+    int wanted = max - count < RIPPLE_MAX_SUGGESTIONS ? max - count : RIPPLE_MAX_SUGGESTIONS;
+
+    printf("\nSuggestions for '%s':\n", partial_cmd);
+    for (int i = 0; i < count; i++) {
+        printf("  %d) %-32s %s\n", i + 1, out[i].cmd, out[i].desc);
+    }
+    // Local predictions show up before the model is asked
+    fflush(stdout);
+    if (wanted <= 0) {
+        printf("Press 1-%d to use a suggestion\n\n", count);
+        return count;
+    }
+    
+    char* raw = NULL;
+    int num_generated = get_ollama_suggestions(partial_cmd, generated, wanted, &raw);
+    int first = count;
     
-    char* ai_suggestion = get_ollama_completion(partial_cmd);
+    for (int i = 0; i < num_generated; i++) {
+        add_suggestion(out, &count, max, generated[i].cmd, strlen(generated[i].cmd),
+                       generated[i].desc, strlen(generated[i].desc));
+    }
+    for (int i = first; i < count; i++) {
+        printf("  %d) %-32s %s\n", i + 1, out[i].cmd, out[i].desc);
+    }
     
-    if (ai_suggestion) {
-        printf("%s\n", ai_suggestion);
-        free(ai_suggestion);
+    if (num_generated > 0) {
+        if (!raw) {
+            printf("  (from the local index)\n");
+        } else if (strstr(raw, OLLAMA_PARTIAL_NOTE + 1)) {
+            printf("  (partial: request deadline reached)\n");
+        }
+    } else if (num_generated == 0 && raw) {
+        // Nothing parseable; show the model's text as it is
+        printf("%s\n", raw);
+    } else if (count > 0) {
+        printf("  (Ollama unavailable; showing history predictions)\n");
     } else {
         printf("Unable to get AI suggestions. Is Ollama running?\n");
         printf("Try running: ollama serve\n");
         printf("Make sure you have a model: ollama pull tinyllama\n");
     }
+    free(raw);
     
+    if (count > 0) {
+        printf("Press 1-%d to use a suggestion\n", count);
+    }
     printf("\n");
+    return count;
 }
 
-// Split a line into tokens
+// Split a line into tokens. A "$(...)" group stays in one token even if it
+// contains delimiters, so the expansion stage sees the whole substitution.
 char **ripple_split_line(char *line) {
     int bufsize = RIPPLE_TOK_BUFSIZE;
     int position = 0;
     char **tokens = malloc(bufsize * sizeof(char *));
-    char *token;
+    char *p = line;
 
     if (!tokens) {
         fprintf(stderr, "ripple: allocation error\n");
         return NULL;
     }
 
-    token = strtok(line, RIPPLE_TOK_DELIM);
-    while (token != NULL) {
-        tokens[position] = token;
+    while (*p) {
+        while (*p && strchr(RIPPLE_TOK_DELIM, *p)) {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+
+        tokens[position] = p;
         position++;
 
+        int depth = 0;
+        while (*p && (depth > 0 || !strchr(RIPPLE_TOK_DELIM, *p))) {
+            if (p[0] == '$' && p[1] == '(') {
+                depth++;
+                p += 2;
+                continue;
+            }
+            if (*p == ')' && depth > 0) {
+                depth--;
+            }
+            p++;
+        }
+        if (*p) {
+            *p++ = '\0';
+        }
+
         if (position >= bufsize) {
             bufsize += RIPPLE_TOK_BUFSIZE;
             char **temp = realloc(tokens, bufsize * sizeof(char *));
@@ -245,9 +1072,7 @@ char **ripple_split_line(char *line) {
             }
             tokens = temp;
         }
-
-        token = strtok(NULL, RIPPLE_TOK_DELIM);
     }
     tokens[position] = NULL;
     return tokens;
-} 
\ No newline at end of file
+}
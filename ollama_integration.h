@@ -1,11 +1,27 @@
 #ifndef OLLAMA_INTEGRATION_H
 #define OLLAMA_INTEGRATION_H
 
+#include <stdio.h>
+#include "ollama_codec.h"
+
 // Function declarations
 char* get_ollama_completion(const char* prompt);
-void suggest_command(const char* partial_cmd);
+int get_ollama_suggestions(const char* prompt, struct ollama_suggestion* out, int max, char** raw);
+int suggest_command(const char* partial_cmd, struct ollama_suggestion* out, int count, int max);
+int ollama_embed(const char* const* texts, int count, float* out, int dim_max, int quiet);
+void ollama_warmup_async(void);
+void ollama_print_diagnostics(void);
+void ollama_write_diagnostics(FILE* out);
+const char* ollama_last_model(void);
+void ollama_get_last_metrics(long long* eval_count, long long* total_ns);
 char* ripple_read_line(void);
 char** ripple_split_line(char* line);
+int ripple_builtin_index(const char* name);
+int ripple_execute(char** args);
+int ripple_run_line(char** tokens);
+
+// Built-in dispatch table (defined by the shell)
+extern int (*builtin_func[])(char **);
 
 // Constants
 #define RIPPLE_RL_BUFSIZE 1024
@@ -13,5 +29,7 @@ char** ripple_split_line(char* line);
 #define RIPPLE_TOK_DELIM " \t\r\n\a"
 #define RIPPLE_VERSION "1.0.0"
 #define OLLAMA_API_URL "http://localhost:11434/api/generate"
+#define RIPPLE_MAX_SUGGESTIONS 3
+#define OLLAMA_PARTIAL_NOTE "\n(partial: request deadline reached)"
 
 #endif // OLLAMA_INTEGRATION_H 
\ No newline at end of file
@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "ripple_trace.h"
+#include "bench_util.h"
+
+// Replays a session recorded with RIPPLE_TRACE=<file>: starts the shell on a
+// pty with RIPPLE_REPLAY pointing at the trace (so TABs get the recorded
+// answers, no model needed) and types the recorded keys, at the recorded
+// pace or as fast as the shell answers (-f). Measures key echo latency,
+// TAB and command turnaround and the shell's CPU time, printed as JSON.
+// The recorded commands run again, in the current directory.
+//
+// Usage: replay_trace [-f] [-e max_echo_p95_ms] [-t max_command_p95_ms] trace
+// Exits non-zero when the shell stalls or a limit is exceeded, so it can
+// serve as a regression test.
+
+#define ECHO_WAIT_MS 200           // keys that print nothing in this long are not counted
+#define TURNAROUND_WAIT_MS 10000
+#define PROMPT_MARKER "\033[0m > "
+
+static void sleep_ms(double ms) {
+    if (ms > 0) {
+        usleep((useconds_t)(ms * 1000));
+    }
+}
+
+// Output the shell produced since the last reset
+static struct {
+    char data[65536];
+    size_t len;
+    int closed;                    // the shell is gone
+} out;
+
+static void reset_output(void) {
+    out.len = 0;
+    out.data[0] = '\0';
+}
+
+// Read what is there within wait_ms; 1 if something came, 0 if not
+static int pump(int fd, int wait_ms) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (out.closed || poll(&pfd, 1, wait_ms < 0 ? 0 : wait_ms) <= 0) {
+        return 0;
+    }
+    ssize_t n = read(fd, out.data + out.len, sizeof(out.data) - 1 - out.len);
+    if (n <= 0) {
+        out.closed = 1; // EIO once the shell has exited
+        return 0;
+    }
+    out.len += n;
+    out.data[out.len] = '\0';
+    if (out.len >= sizeof(out.data) - 1) {
+        // Keep the tail; a marker never spans more than that
+        memmove(out.data, out.data + out.len - 64, 64);
+        out.len = 64;
+        out.data[out.len] = '\0';
+    }
+    return 1;
+}
+
+// Time marker appeared, or -1 if it did not before the deadline
+static double wait_for(int fd, const char *marker, double deadline) {
+    while (!strstr(out.data, marker)) {
+        if (out.closed || (!pump(fd, (int)(deadline - now_ms())) && now_ms() >= deadline)) {
+            return -1;
+        }
+    }
+    return now_ms();
+}
+
+struct samples {
+    double *v;
+    int n;
+};
+
+static void add_sample(struct samples *s, double v) {
+    s->v[s->n++] = v;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile; sorts the samples
+static double percentile(struct samples *s, double p) {
+    if (s->n == 0) {
+        return 0;
+    }
+    qsort(s->v, s->n, sizeof(double), compare_double);
+    int i = (int)(p / 100.0 * s->n + 0.999999) - 1;
+    return s->v[i < 0 ? 0 : i >= s->n ? s->n - 1 : i];
+}
+
+static void print_latency(const char *key, struct samples *s) {
+    if (s->n == 0) {
+        printf("\"%s\": null", key);
+        return;
+    }
+    printf("\"%s\": {\"count\": %d, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}", key, s->n,
+           percentile(s, 50), percentile(s, 95), percentile(s, 99), s->v[s->n - 1]);
+}
+
+static void remove_dir(const char *path) {
+    char file[1024];
+    DIR *dir = opendir(path);
+    struct dirent *e;
+
+    while (dir && (e = readdir(dir)) != NULL) {
+        if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+            snprintf(file, sizeof(file), "%s/%s", path, e->d_name);
+            unlink(file);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+int main(int argc, char **argv) {
+    int fast = 0, opt, timeouts = 0;
+    double max_echo = 0, max_command = 0;
+    char home[] = "/tmp/ripple-replay-XXXXXX", trace_path[4096];
+
+    while ((opt = getopt(argc, argv, "fe:t:")) != -1) {
+        switch (opt) {
+            case 'f': fast = 1; break;
+            case 'e': max_echo = atof(optarg); break;
+            case 't': max_command = atof(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-f] [-e max_echo_p95_ms] [-t max_command_p95_ms] trace\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-f] [-e max_echo_p95_ms] [-t max_command_p95_ms] trace\n", argv[0]);
+        return 2;
+    }
+    struct ripple_trace_key *keys;
+    int num_keys = ripple_trace_read_keys(argv[optind], &keys);
+    if (num_keys <= 0 || !realpath(argv[optind], trace_path)) {
+        fprintf(stderr, "replay_trace: %s: no keys to replay\n", argv[optind]);
+        return 2;
+    }
+    if (!mkdtemp(home)) {
+        perror("replay_trace: mkdtemp");
+        return 2;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("replay_trace: pty");
+        return 2;
+    }
+    struct winsize ws = { 24, 120, 0, 0 };
+    pid_t pid = fork();
+    if (pid == 0) {
+        setsid();
+        int slave = open(ptsname(master), O_RDWR);
+        ioctl(slave, TIOCSCTTY, 0);
+        ioctl(slave, TIOCSWINSZ, &ws);
+        dup2(slave, 0);
+        dup2(slave, 1);
+        dup2(slave, 2);
+        close(master);
+        close(slave);
+        // A clean history, so ghost text and predictions match a fresh start
+        setenv("HOME", home, 1);
+        setenv("RIPPLE_REPLAY", trace_path, 1);
+        setenv("RIPPLE_NO_DAEMON", "1", 1);
+        if (fast) {
+            setenv("RIPPLE_REPLAY_FAST", "1", 1);
+        }
+        unsetenv("RIPPLE_TRACE");
+        execl("./shell2_complete_ai", "shell2_complete_ai", (char *)NULL);
+        _exit(127);
+    }
+
+    struct samples echo = { malloc(sizeof(double) * num_keys), 0 };
+    struct samples tab = { malloc(sizeof(double) * num_keys), 0 };
+    struct samples command = { malloc(sizeof(double) * num_keys), 0 };
+
+    reset_output();
+    if (wait_for(master, PROMPT_MARKER, now_ms() + TURNAROUND_WAIT_MS) < 0) {
+        fprintf(stderr, "replay_trace: the shell did not start\n");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        remove_dir(home);
+        return 1;
+    }
+    while (pump(master, 50)) {
+    }
+
+    double start = now_ms();
+    for (int i = 0; i < num_keys && !out.closed; i++) {
+        if (!fast) {
+            sleep_ms(start + (keys[i].t_ms - keys[0].t_ms) - now_ms());
+        }
+        unsigned char c = (unsigned char)keys[i].c;
+        reset_output();
+        double t0 = now_ms();
+        if (write(master, &c, 1) != 1) {
+            break;
+        }
+
+        double t;
+        if (c == '\r' || c == '\n') {
+            t = wait_for(master, PROMPT_MARKER, t0 + TURNAROUND_WAIT_MS);
+            if (t >= 0) {
+                add_sample(&command, t - t0);
+            } else if (!out.closed) {
+                fprintf(stderr, "replay_trace: key %d: no prompt after %d ms\n", i, TURNAROUND_WAIT_MS);
+                timeouts++;
+            }
+        } else if (c == '\t') {
+            t = wait_for(master, PROMPT_MARKER, t0 + TURNAROUND_WAIT_MS);
+            if (t >= 0) {
+                add_sample(&tab, t - t0);
+            } else if (!out.closed) {
+                fprintf(stderr, "replay_trace: key %d: TAB got no answer after %d ms\n", i, TURNAROUND_WAIT_MS);
+                timeouts++;
+            }
+        } else if (pump(master, ECHO_WAIT_MS)) {
+            // Escape sequences and the like print nothing until complete
+            add_sample(&echo, now_ms() - t0);
+        }
+        while (pump(master, 0)) {
+        }
+    }
+    double wall = now_ms() - start;
+
+    // The trace normally ends with exit; give the shell a moment, then insist
+    struct rusage ru;
+    int status = 0, exited = 0;
+    for (int i = 0; i < 100 && !exited; i++) {
+        exited = wait4(pid, &status, WNOHANG, &ru) == pid;
+        if (!exited) {
+            if (i == 20 && !out.closed) {
+                write(master, "exit\r", 5);
+            }
+            if (out.closed) {
+                sleep_ms(20);
+            } else {
+                pump(master, 20);
+            }
+        }
+    }
+    if (!exited) {
+        kill(pid, SIGKILL);
+        wait4(pid, &status, 0, &ru);
+    }
+    close(master);
+    remove_dir(home);
+
+    double echo_p95 = percentile(&echo, 95), command_p95 = percentile(&command, 95);
+    printf("{\"trace\": \"%s\", \"speed\": \"%s\", \"keys\": %d, \"wall_ms\": %.1f, ", argv[optind],
+           fast ? "max" : "recorded", num_keys, wall);
+    print_latency("echo_ms", &echo);
+    printf(", ");
+    print_latency("tab_ms", &tab);
+    printf(", ");
+    print_latency("command_ms", &command);
+    printf(", \"cpu_ms\": {\"user\": %.1f, \"sys\": %.1f}, \"timeouts\": %d, \"exited\": %s}\n",
+           ru.ru_utime.tv_sec * 1000.0 + ru.ru_utime.tv_usec / 1000.0,
+           ru.ru_stime.tv_sec * 1000.0 + ru.ru_stime.tv_usec / 1000.0, timeouts, exited ? "true" : "false");
+
+    int failed = timeouts > 0 || !exited;
+    if (max_echo > 0 && echo.n > 0 && echo_p95 > max_echo) {
+        fprintf(stderr, "replay_trace: echo p95 %.1f ms is over %.1f ms\n", echo_p95, max_echo);
+        failed = 1;
+    }
+    if (max_command > 0 && command.n > 0 && command_p95 > max_command) {
+        fprintf(stderr, "replay_trace: command p95 %.1f ms is over %.1f ms\n", command_p95, max_command);
+        failed = 1;
+    }
+    free(keys);
+    free(echo.v);
+    free(tab.v);
+    free(command.v);
+    return failed ? 1 : 0;
+}
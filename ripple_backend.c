@@ -0,0 +1,638 @@
+#include "ripple_backend.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+// Fixed prompts for the benchmark: short, so the first token dominates as
+// it does on a TAB, and the same for every backend
+static const char *const bench_prompts[] = {
+    "list the ten largest files under the current directory",
+    "show which process is listening on port 8080",
+    "count the lines of C code in this repository",
+    "find files changed in the last day and archive them",
+    "follow the system log and highlight errors"
+};
+#define NUM_BENCH_PROMPTS (sizeof(bench_prompts) / sizeof(bench_prompts[0]))
+#define BENCH_PREFIX "You are a Unix shell expert. Suggest one command to "
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int puts_buf(struct ollama_buf *b, const char *s) {
+    return ollama_buf_append(b, s, strlen(s));
+}
+
+static int printf_buf(struct ollama_buf *b, const char *fmt, ...) {
+    char tmp[64];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    return n < 0 || (size_t)n >= sizeof(tmp) ? -1 : ollama_buf_append(b, tmp, (size_t)n);
+}
+
+// "key":"value" with the value escaped
+static int write_string(struct ollama_buf *b, const char *key, const char *value) {
+    return puts_buf(b, "\"") != 0 || puts_buf(b, key) != 0 || puts_buf(b, "\":\"") != 0 ||
+           ollama_json_escape(b, value, strlen(value)) != 0 || puts_buf(b, "\"") != 0 ? -1 : 0;
+}
+
+// "prompt":"prefix + prompt + suffix"
+static int write_prompt(struct ollama_buf *b, const struct ollama_request *req) {
+    const char *parts[3] = { req->prompt_prefix, req->prompt, req->prompt_suffix };
+    if (puts_buf(b, "\"prompt\":\"") != 0) {
+        return -1;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (parts[i] && ollama_json_escape(b, parts[i], strlen(parts[i])) != 0) {
+            return -1;
+        }
+    }
+    return puts_buf(b, "\"");
+}
+
+static int write_stop(struct ollama_buf *b, const char *const *stop) {
+    if (!stop) {
+        return 0;
+    }
+    if (puts_buf(b, ",\"stop\":[") != 0) {
+        return -1;
+    }
+    for (int i = 0; stop[i]; i++) {
+        if ((i && puts_buf(b, ",") != 0) || puts_buf(b, "\"") != 0 ||
+            ollama_json_escape(b, stop[i], strlen(stop[i])) != 0 || puts_buf(b, "\"") != 0) {
+            return -1;
+        }
+    }
+    return puts_buf(b, "]");
+}
+
+// Where the value of "key" starts in a JSON text, or NULL. A key inside a
+// string value would have its quotes escaped, so it cannot match.
+static const char *json_find(const char *json, const char *key) {
+    size_t len = strlen(key);
+    for (const char *p = strchr(json, '"'); p; p = strchr(p + 1, '"')) {
+        if (strncmp(p + 1, key, len) == 0 && p[len + 1] == '"') {
+            const char *v = p + len + 2;
+            while (*v == ' ') {
+                v++;
+            }
+            if (*v == ':') {
+                v++;
+                while (*v == ' ') {
+                    v++;
+                }
+                return v;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void put_utf8(struct ollama_buf *out, unsigned int cp) {
+    char u[4];
+    size_t n;
+    if (cp < 0x80) {
+        u[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        u[0] = (char)(0xC0 | (cp >> 6));
+        u[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        u[0] = (char)(0xE0 | (cp >> 12));
+        u[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        u[0] = (char)(0xF0 | (cp >> 18));
+        u[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        u[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    ollama_buf_append(out, u, n);
+}
+
+static unsigned int hex4(const char *p) {
+    unsigned int v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= (unsigned int)(c - '0');
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            v |= (unsigned int)((c | 0x20) - 'a' + 10);
+        } else {
+            return 0xFFFD;
+        }
+    }
+    return v;
+}
+
+// Append the JSON string starting at p, unescaped; -1 if p is not a string
+static int json_string(const char *p, struct ollama_buf *out) {
+    if (!p || *p != '"') {
+        return -1;
+    }
+    for (p++; *p && *p != '"'; p++) {
+        const char *run = p;
+        while (*p && *p != '"' && *p != '\\') {
+            p++;
+        }
+        ollama_buf_append(out, run, (size_t)(p - run));
+        if (*p != '\\') {
+            p--;
+            continue;
+        }
+        p++;
+        switch (*p) {
+            case 'n': ollama_buf_append(out, "\n", 1); break;
+            case 't': ollama_buf_append(out, "\t", 1); break;
+            case 'r': ollama_buf_append(out, "\r", 1); break;
+            case 'b': ollama_buf_append(out, "\b", 1); break;
+            case 'f': ollama_buf_append(out, "\f", 1); break;
+            case 'u': {
+                if (strlen(p + 1) < 4) {
+                    return -1;
+                }
+                unsigned int cp = hex4(p + 1);
+                p += 4;
+                if (cp >= 0xD800 && cp < 0xDC00 && p[1] == '\\' && p[2] == 'u' && strlen(p + 3) >= 4) {
+                    unsigned int low = hex4(p + 3);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                put_utf8(out, cp >= 0xD800 && cp < 0xE000 ? 0xFFFD : cp);
+                break;
+            }
+            case '\0': return -1;
+            default: ollama_buf_append(out, p, 1); break;
+        }
+    }
+    return *p == '"' ? 0 : -1;
+}
+
+static double json_number(const char *p) {
+    return p ? strtod(p, NULL) : 0;
+}
+
+// An error body: {"error":"..."} or {"error":{"message":"..."}}
+static void read_error(struct ripple_backend_conn *c, const char *json) {
+    const char *message = json_find(json, "message");
+    if (json_string(message, &c->resp->error) != 0) {
+        json_string(json_find(json, "error"), &c->resp->error);
+    }
+}
+
+// Ollama: newline-delimited JSON, read by the codec's scanner
+static int ollama_write(struct ripple_backend_conn *c, const struct ollama_request *req) {
+    return ollama_write_request(&c->request, req);
+}
+
+static int ollama_feed(struct ripple_backend_conn *c, const char *data, size_t len) {
+    if (ollama_scanner_feed(&c->scanner, data, len) != 0) {
+        c->parse_error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// Split a server-sent event stream into "data:" payloads for event()
+static int sse_feed(struct ripple_backend_conn *c, const char *data, size_t len,
+                    int (*event)(struct ripple_backend_conn *c, const char *json)) {
+    if (ollama_buf_append(&c->line, data, len) != 0) {
+        return -1;
+    }
+    char *start = c->line.data, *nl;
+    while ((nl = memchr(start, '\n', c->line.len - (size_t)(start - c->line.data))) != NULL) {
+        *nl = '\0';
+        if (nl > start && nl[-1] == '\r') {
+            nl[-1] = '\0';
+        }
+        if (strncmp(start, "data:", 5) == 0) {
+            const char *json = start + 5 + (start[5] == ' ');
+            if (strcmp(json, "[DONE]") == 0) {
+                c->resp->done = 1;
+            } else if (event(c, json) != 0) {
+                c->parse_error = 1;
+                return -1;
+            }
+        } else if (*start == '{') {
+            read_error(c, start);  // errors come back as plain JSON
+        }
+        start = nl + 1;
+    }
+    size_t rest = c->line.len - (size_t)(start - c->line.data);
+    memmove(c->line.data, start, rest + 1);
+    c->line.len = rest;
+    return 0;
+}
+
+// llama.cpp server: /completion, events {"content":"...","stop":false},
+// the last with its timings
+static int llamacpp_write(struct ripple_backend_conn *c, const struct ollama_request *req) {
+    struct ollama_buf *b = &c->request;
+    ollama_buf_reset(b);
+    if (puts_buf(b, "{") != 0 || write_prompt(b, req) != 0 ||
+        printf_buf(b, ",\"n_predict\":%d", req->num_predict) != 0 ||
+        printf_buf(b, ",\"temperature\":%g", req->temperature) != 0 ||
+        printf_buf(b, ",\"top_p\":%g", req->top_p) != 0 || printf_buf(b, ",\"top_k\":%d", req->top_k) != 0 ||
+        puts_buf(b, ",\"stream\":true,\"cache_prompt\":true") != 0 || write_stop(b, req->stop) != 0) {
+        return -1;
+    }
+    if (req->format && (puts_buf(b, ",\"json_schema\":") != 0 || puts_buf(b, req->format) != 0)) {
+        return -1;
+    }
+    return puts_buf(b, "}");
+}
+
+static int llamacpp_event(struct ripple_backend_conn *c, const char *json) {
+    struct ollama_response *r = c->resp;
+    const char *content = json_find(json, "content");
+    if (content && json_string(content, &r->text) != 0) {
+        return -1;
+    }
+    if (!content && json_find(json, "error")) {
+        read_error(c, json);
+    }
+    const char *stop = json_find(json, "stop");
+    if (stop && strncmp(stop, "true", 4) == 0) {
+        r->done = 1;
+    }
+    const char *timings = json_find(json, "timings");
+    if (timings) {
+        r->prompt_eval_count = (long long)json_number(json_find(timings, "prompt_n"));
+        r->prompt_eval_duration = (long long)(json_number(json_find(timings, "prompt_ms")) * 1e6);
+        r->eval_count = (long long)json_number(json_find(timings, "predicted_n"));
+        r->eval_duration = (long long)(json_number(json_find(timings, "predicted_ms")) * 1e6);
+    }
+    return 0;
+}
+
+static int llamacpp_feed(struct ripple_backend_conn *c, const char *data, size_t len) {
+    return sse_feed(c, data, len, llamacpp_event);
+}
+
+// OpenAI-compatible: /v1/completions, events {"choices":[{"text":"..."}]}
+// ending with [DONE]; token counts only if the server adds "usage"
+static int openai_write(struct ripple_backend_conn *c, const struct ollama_request *req) {
+    struct ollama_buf *b = &c->request;
+    ollama_buf_reset(b);
+    if (puts_buf(b, "{") != 0 || write_string(b, "model", req->model ? req->model : "") != 0 ||
+        puts_buf(b, ",") != 0 || write_prompt(b, req) != 0 ||
+        printf_buf(b, ",\"max_tokens\":%d", req->num_predict) != 0 ||
+        printf_buf(b, ",\"temperature\":%g", req->temperature) != 0 ||
+        printf_buf(b, ",\"top_p\":%g", req->top_p) != 0 || puts_buf(b, ",\"stream\":true") != 0 ||
+        write_stop(b, req->stop) != 0) {
+        return -1;
+    }
+    return puts_buf(b, "}");
+}
+
+static int openai_event(struct ripple_backend_conn *c, const char *json) {
+    struct ollama_response *r = c->resp;
+    const char *choices = json_find(json, "choices");
+    if (!choices) {
+        read_error(c, json);
+        return 0;
+    }
+    // Completions carry "text"; a server that only speaks chat sends "content"
+    const char *text = json_find(choices, "text");
+    if (!text) {
+        text = json_find(choices, "content");
+    }
+    if (text && *text == '"' && json_string(text, &r->text) != 0) {
+        return -1;
+    }
+    const char *usage = json_find(json, "usage");
+    if (usage && *usage == '{') {
+        r->prompt_eval_count = (long long)json_number(json_find(usage, "prompt_tokens"));
+        r->eval_count = (long long)json_number(json_find(usage, "completion_tokens"));
+    }
+    return 0;
+}
+
+static int openai_feed(struct ripple_backend_conn *c, const char *data, size_t len) {
+    return sse_feed(c, data, len, openai_event);
+}
+
+static const struct ripple_backend backends[] = {
+    { "ollama", "Ollama", "http://localhost:11434/api/generate", 1, ollama_write, ollama_feed },
+    { "llamacpp", "llama.cpp server", "http://localhost:8080/completion", 0, llamacpp_write, llamacpp_feed },
+    { "openai", "OpenAI-compatible server", "http://localhost:8000/v1/completions", 0, openai_write, openai_feed }
+};
+#define NUM_BACKENDS ((int)(sizeof(backends) / sizeof(backends[0])))
+
+int ripple_backend_count(void) {
+    return NUM_BACKENDS;
+}
+
+const struct ripple_backend *ripple_backend_at(int i) {
+    return i >= 0 && i < NUM_BACKENDS ? &backends[i] : NULL;
+}
+
+const struct ripple_backend *ripple_backend_find(const char *name) {
+    for (int i = 0; i < NUM_BACKENDS; i++) {
+        if (strcmp(backends[i].name, name) == 0) {
+            return &backends[i];
+        }
+    }
+    return NULL;
+}
+
+// The URL and model override the config gives a backend
+void ripple_backend_settings(const struct ripple_backend *be, const struct ollama_config *cfg, const char **url,
+                             const char **model) {
+    *url = be->default_url;
+    *model = "";
+    if (be == &backends[0]) {
+        *url = cfg->endpoint;
+    } else if (be == &backends[1]) {
+        *url = cfg->llamacpp_endpoint[0] ? cfg->llamacpp_endpoint : be->default_url;
+    } else if (be == &backends[2]) {
+        *url = cfg->openai_endpoint[0] ? cfg->openai_endpoint : be->default_url;
+        *model = cfg->openai_model;
+    }
+}
+
+// Selected, or given an endpoint of its own
+int ripple_backend_configured(const struct ripple_backend *be, const struct ollama_config *cfg) {
+    if (strcmp(cfg->backend, be->name) == 0 || be == &backends[0]) {
+        return 1;
+    }
+    return (be == &backends[1] && cfg->llamacpp_endpoint[0]) || (be == &backends[2] && cfg->openai_endpoint[0]);
+}
+
+// Point a connection at a backend. The handle, and with it the open
+// connection, is kept as long as the URL's server stays the same.
+int ripple_backend_connect(struct ripple_backend_conn *c, const struct ripple_backend *be, const char *url,
+                           const char *model, long connect_timeout_ms) {
+    if (!c->curl && !(c->curl = curl_easy_init())) {
+        snprintf(c->error, sizeof(c->error), "curl_easy_init() failed");
+        return -1;
+    }
+    c->backend = be;
+    snprintf(c->url, sizeof(c->url), "%s", url);
+    snprintf(c->model, sizeof(c->model), "%s", model ? model : "");
+    c->connect_timeout_ms = connect_timeout_ms;
+    return 0;
+}
+
+// Pass the body to the backend, then any new text to the caller
+static size_t stream_write(void *contents, size_t size, size_t nmemb, void *userp) {
+    struct ripple_backend_conn *c = userp;
+    size_t realsize = size * nmemb;
+    size_t before = c->resp->text.len;
+
+    if (c->cancelled || c->backend->feed(c, contents, realsize) != 0) {
+        return 0;
+    }
+    if (c->resp->text.len > before) {
+        c->last = now_ms();
+        if (c->chunks++ == 0) {
+            c->first = c->last;
+        }
+        if (c->on_token && c->on_token(c->resp->text.data + before, c->resp->text.len - before, c->ctx) != 0) {
+            c->cancelled = 1;
+        }
+    }
+    return realsize;
+}
+
+static int stream_progress(void *userp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    return ((struct ripple_backend_conn *)userp)->cancelled;
+}
+
+// Send req and stream the reply into resp, text going to on_token as it
+// comes. Returns one of the RIPPLE_BACKEND_ results; c->error says why a
+// request failed.
+int ripple_backend_stream(struct ripple_backend_conn *c, const struct ollama_request *req, long timeout_ms,
+                          ripple_backend_token_fn on_token, void *ctx, struct ollama_response *resp) {
+    struct ollama_request r = *req;
+    if (c->model[0]) {
+        r.model = c->model;
+    }
+    c->error[0] = '\0';
+    memset(&c->metrics, 0, sizeof(c->metrics));
+    if (c->backend->write_request(c, &r) != 0) {
+        snprintf(c->error, sizeof(c->error), "Failed to build request");
+        return RIPPLE_BACKEND_FAILED;
+    }
+
+    c->resp = resp;
+    c->on_token = on_token;
+    c->ctx = ctx;
+    c->cancelled = 0;
+    c->parse_error = 0;
+    c->chunks = 0;
+    ollama_response_reset(resp);
+    ollama_scanner_init(&c->scanner, resp);
+    ollama_buf_reset(&c->line);
+
+    struct curl_slist *headers = curl_slist_append(NULL, "Content-Type: application/json");
+    curl_easy_reset(c->curl);
+    curl_easy_setopt(c->curl, CURLOPT_URL, c->url);
+    curl_easy_setopt(c->curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(c->curl, CURLOPT_POSTFIELDS, c->request.data);
+    curl_easy_setopt(c->curl, CURLOPT_POSTFIELDSIZE, (long)c->request.len);
+    curl_easy_setopt(c->curl, CURLOPT_WRITEFUNCTION, stream_write);
+    curl_easy_setopt(c->curl, CURLOPT_WRITEDATA, (void *)c);
+    curl_easy_setopt(c->curl, CURLOPT_XFERINFOFUNCTION, stream_progress);
+    curl_easy_setopt(c->curl, CURLOPT_XFERINFODATA, (void *)c);
+    curl_easy_setopt(c->curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(c->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(c->curl, CURLOPT_CONNECTTIMEOUT_MS, c->connect_timeout_ms);
+    curl_easy_setopt(c->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+
+    c->start = now_ms();
+    CURLcode res = curl_easy_perform(c->curl);
+    double end = now_ms();
+    curl_slist_free_all(headers);
+
+    // A body that did not end in a newline: an error object, usually
+    if (c->line.len > 0 && c->line.data[0] == '{') {
+        read_error(c, c->line.data);
+    }
+    long code = 0;
+    double connect = 0;
+    curl_easy_getinfo(c->curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_getinfo(c->curl, CURLINFO_CONNECT_TIME, &connect);
+    if (res == CURLE_OK && code >= 400 && resp->error.len == 0) {
+        char status[32];
+        snprintf(status, sizeof(status), "HTTP %ld", code);
+        ollama_buf_append(&resp->error, status, strlen(status));
+    }
+
+    struct ripple_backend_metrics *m = &c->metrics;
+    m->connect_ms = connect * 1000.0;
+    m->total_ms = end - c->start;
+    m->ttft_ms = c->chunks > 0 ? c->first - c->start : 0;
+    m->tokens = resp->eval_count > 0 ? (long)resp->eval_count : c->chunks;
+    if (resp->eval_count > 0 && resp->eval_duration > 0) {
+        m->tokens_per_s = resp->eval_count / (resp->eval_duration / 1e9);
+    } else if (c->chunks > 1 && c->last > c->first) {
+        m->tokens_per_s = (c->chunks - 1) / ((c->last - c->first) / 1000.0);
+    }
+
+    size_t received = resp->text.len + resp->error.len;
+    if ((res == CURLE_OPERATION_TIMEDOUT || c->cancelled) && resp->text.len > 0) {
+        return RIPPLE_BACKEND_PARTIAL;
+    }
+    if (res == CURLE_COULDNT_CONNECT || res == CURLE_COULDNT_RESOLVE_HOST ||
+        (res == CURLE_OPERATION_TIMEDOUT && received == 0)) {
+        snprintf(c->error, sizeof(c->error), "curl_easy_perform() failed: %s", curl_easy_strerror(res));
+        return RIPPLE_BACKEND_UNREACHABLE;
+    }
+    if (res != CURLE_OK) {
+        if (c->cancelled) {
+            snprintf(c->error, sizeof(c->error), "Request cancelled");
+        } else if (c->parse_error) {
+            snprintf(c->error, sizeof(c->error), "Failed to parse JSON response");
+        } else {
+            snprintf(c->error, sizeof(c->error), "curl_easy_perform() failed: %s", curl_easy_strerror(res));
+        }
+        return RIPPLE_BACKEND_FAILED;
+    }
+    return RIPPLE_BACKEND_OK;
+}
+
+// Safe from another thread; the request stops at its next chunk or progress tick
+void ripple_backend_cancel(struct ripple_backend_conn *c) {
+    c->cancelled = 1;
+}
+
+void ripple_backend_get_metrics(const struct ripple_backend_conn *c, struct ripple_backend_metrics *out) {
+    *out = c->metrics;
+}
+
+void ripple_backend_close(struct ripple_backend_conn *c) {
+    if (c->curl) {
+        curl_easy_cleanup(c->curl);
+        c->curl = NULL;
+    }
+    ollama_buf_free(&c->request);
+    ollama_buf_free(&c->line);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *v, int n) {
+    if (n == 0) {
+        return 0;
+    }
+    qsort(v, n, sizeof(double), compare_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Answered backends first, quickest first token first
+static int compare_score(const void *a, const void *b) {
+    const struct ripple_backend_score *x = a, *y = b;
+    if ((x->runs > 0) != (y->runs > 0)) {
+        return x->runs > 0 ? -1 : 1;
+    }
+    return (x->ttft_ms > y->ttft_ms) - (x->ttft_ms < y->ttft_ms);
+}
+
+// Run the fixed prompt set rounds times against every configured backend,
+// or only the one named, after one untimed request that loads the model.
+// Fills out with medians ranked by time to first token, rate_rank giving
+// the order by tokens per second. Returns the number of backends scored.
+int ripple_backend_bench(const struct ollama_config *cfg, const char *only, int rounds, ripple_backend_token_fn on_token,
+                         void *ctx, struct ripple_backend_score *out, int max) {
+    struct ollama_response resp = { 0 };
+    int count = 0, stopped = 0;
+    int samples = (int)NUM_BENCH_PROMPTS * (rounds > 0 ? rounds : RIPPLE_BACKEND_BENCH_ROUNDS);
+    double *ttft = malloc(sizeof(double) * samples), *rate = malloc(sizeof(double) * samples);
+
+    if (!ttft || !rate) {
+        free(ttft);
+        free(rate);
+        return 0;
+    }
+    for (int b = 0; b < NUM_BACKENDS && count < max && !stopped; b++) {
+        const struct ripple_backend *be = &backends[b];
+        if (only ? strcmp(only, be->name) != 0 : !ripple_backend_configured(be, cfg)) {
+            continue;
+        }
+        struct ripple_backend_score *s = &out[count++];
+        struct ripple_backend_conn conn = { 0 };
+        const char *url, *model;
+        memset(s, 0, sizeof(*s));
+        s->backend = be;
+        ripple_backend_settings(be, cfg, &url, &model);
+        snprintf(s->url, sizeof(s->url), "%s", url);
+        snprintf(s->model, sizeof(s->model), "%s", model[0] ? model : cfg->model);
+        if (ripple_backend_connect(&conn, be, url, model, cfg->connect_timeout_ms) != 0) {
+            s->failures = samples;
+            snprintf(s->error, sizeof(s->error), "%s", conn.error);
+            continue;
+        }
+
+        struct ollama_request req = { 0 };
+        req.model = cfg->model;
+        req.prompt_prefix = BENCH_PREFIX;
+        req.stream = 1;
+        req.temperature = cfg->temperature;
+        req.top_p = cfg->top_p;
+        req.top_k = cfg->top_k;
+        req.num_predict = cfg->num_predict;
+        req.keep_alive = cfg->keep_alive;
+
+        int n = 0;
+        for (int i = -1; i < samples; i++) {
+            req.prompt = bench_prompts[(i < 0 ? 0 : i) % NUM_BENCH_PROMPTS];
+            int rc = ripple_backend_stream(&conn, &req, cfg->timeout_ms, on_token, ctx, &resp);
+            if (conn.cancelled) {
+                stopped = 1;
+                break;
+            }
+            if (rc != RIPPLE_BACKEND_OK || resp.error.len > 0 || conn.chunks == 0) {
+                snprintf(s->error, sizeof(s->error), "%s",
+                         resp.error.len > 0 ? resp.error.data : conn.error[0] ? conn.error : "no text returned");
+                if (i < 0 || rc == RIPPLE_BACKEND_UNREACHABLE) {
+                    s->failures = samples;   // down, or cannot run the prompt at all
+                    break;
+                }
+                s->failures++;
+                continue;
+            }
+            if (i < 0) {
+                s->warmup_ms = conn.metrics.total_ms;
+                continue;
+            }
+            ttft[n] = conn.metrics.ttft_ms;
+            rate[n++] = conn.metrics.tokens_per_s;
+        }
+        s->runs = n;
+        s->ttft_ms = median(ttft, n);
+        s->tokens_per_s = median(rate, n);
+        ripple_backend_close(&conn);
+    }
+
+    qsort(out, count, sizeof(out[0]), compare_score);
+    for (int i = 0; i < count; i++) {
+        out[i].ttft_rank = out[i].runs > 0 ? i + 1 : 0;
+        for (int j = 0; j < count && out[i].runs > 0; j++) {
+            out[i].rate_rank += out[j].runs > 0 && (out[j].tokens_per_s > out[i].tokens_per_s || j == i);
+        }
+    }
+    ollama_response_free(&resp);
+    free(ttft);
+    free(rate);
+    return count;
+}
@@ -0,0 +1,108 @@
+#ifndef RIPPLE_BACKEND_H
+#define RIPPLE_BACKEND_H
+
+#include <stddef.h>
+#include <curl/curl.h>
+#include "ollama_codec.h"
+#include "ollama_config.h"
+
+// Local inference servers behind one streaming interface: Ollama's
+// /api/generate, llama.cpp's server /completion and OpenAI-compatible
+// /v1/completions. Each backend only knows how to write its request body
+// and how to read its stream; connecting, streaming text to a callback,
+// cancelling and timing are shared. Whatever the server, the reply lands
+// in a struct ollama_response, so callers do not care which one answered.
+
+struct ripple_backend_conn;
+
+// Called with each piece of text as it arrives; nonzero cancels the request
+typedef int (*ripple_backend_token_fn)(const char* text, size_t len, void* ctx);
+
+struct ripple_backend {
+    const char* name;             // value of the backend setting
+    const char* label;            // for messages
+    const char* default_url;
+    int has_context;              // replies carry context tokens to continue from
+    int (*write_request)(struct ripple_backend_conn* c, const struct ollama_request* req);
+    int (*feed)(struct ripple_backend_conn* c, const char* data, size_t len);
+};
+
+// Timings of the last request on a connection
+struct ripple_backend_metrics {
+    double connect_ms;            // 0 when the connection was reused
+    double ttft_ms;               // request sent to first text
+    double total_ms;
+    long tokens;                  // as counted by the server, else chunks received
+    double tokens_per_s;          // generation rate after the first token
+};
+
+// A curl handle kept between requests, so the connection stays open, and
+// the state of the request streaming on it
+struct ripple_backend_conn {
+    const struct ripple_backend* backend;
+    CURL* curl;
+    char url[256];
+    char model[64];               // replaces the request's model when set
+    long connect_timeout_ms;
+    struct ollama_buf request;
+    struct ollama_buf line;       // partial line of a server-sent event stream
+    struct ollama_scanner scanner;
+    struct ollama_response* resp;
+    ripple_backend_token_fn on_token;
+    void* ctx;
+    volatile int cancelled;
+    int parse_error;
+    long chunks;
+    double start;
+    double first;
+    double last;
+    struct ripple_backend_metrics metrics;
+    char error[256];
+};
+
+// One backend's showing in ripple_backend_bench
+struct ripple_backend_score {
+    const struct ripple_backend* backend;
+    char url[256];
+    char model[64];
+    int runs;                     // prompts answered
+    int failures;
+    double warmup_ms;             // first request, model load included
+    double ttft_ms;               // medians over the prompt set
+    double tokens_per_s;
+    int ttft_rank;
+    int rate_rank;
+    char error[256];              // why the last failure failed
+};
+
+// Results of ripple_backend_stream
+enum {
+    RIPPLE_BACKEND_OK,
+    RIPPLE_BACKEND_PARTIAL,       // timed out or cancelled after some text
+    RIPPLE_BACKEND_UNREACHABLE,   // nothing came back from the server
+    RIPPLE_BACKEND_FAILED
+};
+
+// Function declarations
+int ripple_backend_count(void);
+const struct ripple_backend* ripple_backend_at(int i);
+const struct ripple_backend* ripple_backend_find(const char* name);
+void ripple_backend_settings(const struct ripple_backend* be, const struct ollama_config* cfg, const char** url,
+                             const char** model);
+int ripple_backend_configured(const struct ripple_backend* be, const struct ollama_config* cfg);
+int ripple_backend_connect(struct ripple_backend_conn* c, const struct ripple_backend* be, const char* url,
+                           const char* model, long connect_timeout_ms);
+int ripple_backend_stream(struct ripple_backend_conn* c, const struct ollama_request* req, long timeout_ms,
+                          ripple_backend_token_fn on_token, void* ctx, struct ollama_response* resp);
+void ripple_backend_cancel(struct ripple_backend_conn* c);
+void ripple_backend_get_metrics(const struct ripple_backend_conn* c, struct ripple_backend_metrics* out);
+void ripple_backend_close(struct ripple_backend_conn* c);
+int ripple_backend_bench(const struct ollama_config* cfg, const char* only, int rounds, ripple_backend_token_fn on_token,
+                         void* ctx, struct ripple_backend_score* out, int max);
+
+// Constants
+#define RIPPLE_BACKEND_DEFAULT "ollama"
+#define RIPPLE_BACKEND_MAX 8
+#define RIPPLE_BACKEND_BENCH_ROUNDS 2     // passes over the prompt set per backend
+
+#endif // RIPPLE_BACKEND_H
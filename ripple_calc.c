@@ -0,0 +1,1008 @@
+#include "ripple_calc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+
+// Instructions are one byte, followed by a 2-byte little-endian operand for
+// the ones that name a constant, variable, column or function
+enum {
+    OP_CONST,
+    OP_VAR,
+    OP_COL,
+    OP_CALL1,
+    OP_CALL2,
+    OP_NEG,
+    OP_SQR,                       // x^2, strength-reduced from OP_POW
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_POW,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE
+};
+
+static const char *const op_names[] = {
+    "const", "var", "col", "call", "call", "neg", "sqr", "add", "sub", "mul", "div", "mod", "pow",
+    "lt", "le", "gt", "ge", "eq", "ne"
+};
+
+#define HAS_OPERAND(op) ((op) <= OP_CALL2)
+
+// Tokens other than these are the operator character itself
+enum {
+    T_END = 256,
+    T_NUM,
+    T_NAME,
+    T_COL,
+    T_POW,                        // ** (same as ^)
+    T_LE,
+    T_GE,
+    T_EQ,
+    T_NE
+};
+
+struct calc_fn {
+    const char *name;
+    int arity;
+    double (*f1)(double);
+    double (*f2)(double, double);
+};
+
+static double calc_min(double a, double b) {
+    return a < b ? a : b;
+}
+
+static double calc_max(double a, double b) {
+    return a > b ? a : b;
+}
+
+static const struct calc_fn fns[] = {
+    { "sin", 1, sin, NULL },     { "cos", 1, cos, NULL },     { "tan", 1, tan, NULL },
+    { "asin", 1, asin, NULL },   { "acos", 1, acos, NULL },   { "atan", 1, atan, NULL },
+    { "sinh", 1, sinh, NULL },   { "cosh", 1, cosh, NULL },   { "tanh", 1, tanh, NULL },
+    { "exp", 1, exp, NULL },     { "log", 1, log, NULL },     { "ln", 1, log, NULL },
+    { "log2", 1, log2, NULL },   { "log10", 1, log10, NULL }, { "sqrt", 1, sqrt, NULL },
+    { "cbrt", 1, cbrt, NULL },   { "abs", 1, fabs, NULL },    { "floor", 1, floor, NULL },
+    { "ceil", 1, ceil, NULL },   { "round", 1, round, NULL }, { "trunc", 1, trunc, NULL },
+    { "atan2", 2, NULL, atan2 }, { "pow", 2, NULL, pow },     { "hypot", 2, NULL, hypot },
+    { "fmod", 2, NULL, fmod },   { "min", 2, NULL, calc_min }, { "max", 2, NULL, calc_max },
+};
+
+#define NUM_FNS ((int)(sizeof(fns) / sizeof(fns[0])))
+
+static struct {
+    char name[32];
+    double value;
+} vars[RIPPLE_CALC_VARS];
+static int num_vars;
+
+// What the parser knows about each value it has compiled so far: where its
+// code starts, and its value if that code is a single constant
+struct operand {
+    size_t start;
+    int is_const;
+    double value;
+};
+
+struct parser {
+    const char *p;
+    const char *tok_start;
+    struct ripple_calc_prog *prog;
+    struct operand stack[RIPPLE_CALC_MAX_DEPTH];
+    int sp;
+    int nesting;
+    int failed;
+    char *err;
+    size_t errsize;
+    int tok;
+    double num;
+    int column;
+    char name[32];
+};
+
+static int find_fn(const char *name) {
+    for (int i = 0; i < NUM_FNS; i++) {
+        if (strcmp(fns[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int constant(const char *name, double *value) {
+    if (strcmp(name, "pi") == 0) {
+        *value = M_PI;
+    } else if (strcmp(name, "e") == 0) {
+        *value = M_E;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int var_index(const char *name, int create) {
+    for (int i = 0; i < num_vars; i++) {
+        if (strcmp(vars[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if (!create || num_vars == RIPPLE_CALC_VARS) {
+        return -1;
+    }
+    snprintf(vars[num_vars].name, sizeof(vars[num_vars].name), "%s", name);
+    vars[num_vars].value = 0;
+    return num_vars++;
+}
+
+// Set a variable for later expressions, creating it if need be
+int ripple_calc_set(const char *name, double value) {
+    int i = var_index(name, 1);
+    if (i < 0) {
+        return -1;
+    }
+    vars[i].value = value;
+    return 0;
+}
+
+static void fail(struct parser *ps, const char *what) {
+    if (ps->failed) {
+        return;
+    }
+    ps->failed = 1;
+    if (ps->tok == T_END) {
+        snprintf(ps->err, ps->errsize, "%s at the end", what);
+    } else {
+        snprintf(ps->err, ps->errsize, "%s at '%.12s'", what, ps->tok_start);
+    }
+}
+
+static void next(struct parser *ps) {
+    const char *p = ps->p;
+    // Quotes are blanks here, so calc "2 * (3 + 4)" works unquoted by the shell
+    while (*p == ' ' || *p == '\t' || *p == '"' || *p == '\'') {
+        p++;
+    }
+    ps->tok_start = p;
+    if (*p == '\0') {
+        ps->tok = T_END;
+    } else if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+        char *end;
+        ps->num = strtod(p, &end);
+        ps->tok = T_NUM;
+        p = end;
+    } else if (isalpha((unsigned char)*p) || *p == '_') {
+        size_t len = 0;
+        while (isalnum((unsigned char)p[len]) || p[len] == '_') {
+            len++;
+        }
+        if (len >= sizeof(ps->name)) {
+            ps->p = p + len;
+            fail(ps, "name too long");
+            return;
+        }
+        memcpy(ps->name, p, len);
+        ps->name[len] = '\0';
+        ps->tok = T_NAME;
+        p += len;
+    } else if (*p == '$' && isdigit((unsigned char)p[1])) {
+        char *end;
+        long column = strtol(p + 1, &end, 10);
+        ps->p = end;
+        if (column < 1 || column > RIPPLE_CALC_MAX_COLUMNS) {
+            fail(ps, "column out of range");
+            return;
+        }
+        ps->column = (int)column;
+        ps->tok = T_COL;
+        p = end;
+    } else if (p[0] == '*' && p[1] == '*') {
+        ps->tok = T_POW;
+        p += 2;
+    } else if ((p[0] == '<' || p[0] == '>' || p[0] == '=' || p[0] == '!') && p[1] == '=') {
+        ps->tok = p[0] == '<' ? T_LE : p[0] == '>' ? T_GE : p[0] == '=' ? T_EQ : T_NE;
+        p += 2;
+    } else if (strchr("+-*/%^(),<>", *p)) {
+        ps->tok = *p++;
+    } else {
+        ps->tok = *p;
+        fail(ps, "unexpected character");
+        return;
+    }
+    ps->p = p;
+}
+
+static void emit(struct parser *ps, int op, int arg) {
+    struct ripple_calc_prog *prog = ps->prog;
+    if (prog->len + 3 > prog->cap) {
+        size_t cap = prog->cap ? prog->cap * 2 : 64;
+        unsigned char *code = realloc(prog->code, cap);
+        if (!code) {
+            fail(ps, "out of memory");
+            return;
+        }
+        prog->code = code;
+        prog->cap = cap;
+    }
+    prog->code[prog->len++] = (unsigned char)op;
+    if (HAS_OPERAND(op)) {
+        prog->code[prog->len++] = (unsigned char)(arg & 0xff);
+        prog->code[prog->len++] = (unsigned char)(arg >> 8);
+    }
+}
+
+static int add_const(struct parser *ps, double value) {
+    struct ripple_calc_prog *prog = ps->prog;
+    for (int i = 0; i < prog->num_consts; i++) {
+        if (memcmp(&prog->consts[i], &value, sizeof(value)) == 0) {
+            return i;
+        }
+    }
+    if (prog->num_consts == prog->consts_cap) {
+        int cap = prog->consts_cap ? prog->consts_cap * 2 : 8;
+        double *consts = cap <= 0x10000 ? realloc(prog->consts, sizeof(double) * cap) : NULL;
+        if (!consts) {
+            fail(ps, "too many constants");
+            return 0;
+        }
+        prog->consts = consts;
+        prog->consts_cap = cap;
+    }
+    prog->consts[prog->num_consts] = value;
+    return prog->num_consts++;
+}
+
+static void push(struct parser *ps, size_t start, int is_const, double value) {
+    if (ps->sp == RIPPLE_CALC_MAX_DEPTH) {
+        fail(ps, "expression too deep");
+        return;
+    }
+    ps->stack[ps->sp].start = start;
+    ps->stack[ps->sp].is_const = is_const;
+    ps->stack[ps->sp].value = value;
+    ps->sp++;
+    if (ps->sp > ps->prog->depth) {
+        ps->prog->depth = ps->sp;
+    }
+}
+
+static void push_const(struct parser *ps, double value) {
+    size_t start = ps->prog->len;
+    emit(ps, OP_CONST, add_const(ps, value));
+    push(ps, start, 1, value);
+}
+
+// One application of op, for folding constants at compile time
+static double apply_scalar(int op, int fn, double a, double b) {
+    switch (op) {
+        case OP_CALL1: return fns[fn].f1(a);
+        case OP_CALL2: return fns[fn].f2(a, b);
+        case OP_NEG: return -a;
+        case OP_SQR: return a * a;
+        case OP_ADD: return a + b;
+        case OP_SUB: return a - b;
+        case OP_MUL: return a * b;
+        case OP_DIV: return a / b;
+        case OP_MOD: return fmod(a, b);
+        case OP_POW: return pow(a, b);
+        case OP_LT: return a < b;
+        case OP_LE: return a <= b;
+        case OP_GT: return a > b;
+        case OP_GE: return a >= b;
+        case OP_EQ: return a == b;
+        default: return a != b;
+    }
+}
+
+// Apply op to the top nargs values: folded when they are all constants,
+// otherwise emitted
+static void apply(struct parser *ps, int op, int nargs, int fn) {
+    if (ps->failed || ps->sp < nargs) {
+        return;
+    }
+    struct operand *args = &ps->stack[ps->sp - nargs];
+    int all_const = 1;
+    for (int i = 0; i < nargs; i++) {
+        all_const &= args[i].is_const;
+    }
+    size_t start = args[0].start;
+    // A division by a constant zero stays in the code, to be counted when it runs
+    if (all_const && (op == OP_DIV || op == OP_MOD) && args[1].value == 0) {
+        all_const = 0;
+    }
+    if (all_const) {
+        double value = apply_scalar(op, fn, args[0].value, nargs > 1 ? args[1].value : 0);
+        ps->sp -= nargs;
+        ps->prog->len = start;
+        push_const(ps, value);
+        return;
+    }
+    if (op == OP_POW && args[1].is_const && args[1].value == 2) {
+        ps->prog->len = args[1].start;
+        op = OP_SQR;
+    }
+    emit(ps, op, fn);
+    ps->sp -= nargs;
+    push(ps, start, 0, 0);
+}
+
+static void parse_expr(struct parser *ps, int min_bp);
+
+// Left binding power of an infix operator, and the instruction it compiles to
+static int infix(int tok, int *op) {
+    switch (tok) {
+        case T_EQ: *op = OP_EQ; return 3;
+        case T_NE: *op = OP_NE; return 3;
+        case '<': *op = OP_LT; return 4;
+        case '>': *op = OP_GT; return 4;
+        case T_LE: *op = OP_LE; return 4;
+        case T_GE: *op = OP_GE; return 4;
+        case '+': *op = OP_ADD; return 10;
+        case '-': *op = OP_SUB; return 10;
+        case '*': *op = OP_MUL; return 20;
+        case '/': *op = OP_DIV; return 20;
+        case '%': *op = OP_MOD; return 20;
+        case '^':
+        case T_POW: *op = OP_POW; return 40;
+        default: return 0;
+    }
+}
+
+#define PREFIX_BP 30                  // unary minus: -2^2 is -4, -2*3 is -6
+
+static void parse_name(struct parser *ps) {
+    char name[sizeof(ps->name)];
+    memcpy(name, ps->name, sizeof(name));
+    next(ps);
+
+    if (ps->tok == '(') {
+        int fn = find_fn(name), nargs = 0;
+        if (fn < 0) {
+            fail(ps, "unknown function");
+            return;
+        }
+        next(ps);
+        while (!ps->failed && ps->tok != ')') {
+            if (nargs > 0) {
+                if (ps->tok != ',') {
+                    fail(ps, "expected ',' or ')'");
+                    return;
+                }
+                next(ps);
+            }
+            parse_expr(ps, 0);
+            nargs++;
+        }
+        if (ps->failed) {
+            return;
+        }
+        if (nargs != fns[fn].arity) {
+            snprintf(ps->err, ps->errsize, "%s takes %d argument%s", name, fns[fn].arity,
+                     fns[fn].arity == 1 ? "" : "s");
+            ps->failed = 1;
+            return;
+        }
+        next(ps);
+        apply(ps, nargs == 1 ? OP_CALL1 : OP_CALL2, nargs, fn);
+        return;
+    }
+
+    double value;
+    if (constant(name, &value)) {
+        push_const(ps, value);
+        return;
+    }
+    int var = var_index(name, 0);
+    if (var < 0) {
+        snprintf(ps->err, ps->errsize, "unknown variable '%s'", name);
+        ps->failed = 1;
+        return;
+    }
+    size_t start = ps->prog->len;
+    emit(ps, OP_VAR, var);
+    push(ps, start, 0, 0);
+}
+
+static void parse_prefix(struct parser *ps) {
+    switch (ps->tok) {
+        case T_NUM:
+            push_const(ps, ps->num);
+            next(ps);
+            break;
+        case T_COL: {
+            size_t start = ps->prog->len;
+            emit(ps, OP_COL, ps->column - 1);
+            push(ps, start, 0, 0);
+            if (ps->column > ps->prog->columns) {
+                ps->prog->columns = ps->column;
+            }
+            next(ps);
+            break;
+        }
+        case T_NAME:
+            parse_name(ps);
+            break;
+        case '(':
+            next(ps);
+            parse_expr(ps, 0);
+            if (!ps->failed && ps->tok != ')') {
+                fail(ps, "expected ')'");
+                return;
+            }
+            next(ps);
+            break;
+        case '-':
+            next(ps);
+            parse_expr(ps, PREFIX_BP);
+            apply(ps, OP_NEG, 1, 0);
+            break;
+        case '+':
+            next(ps);
+            parse_expr(ps, PREFIX_BP);
+            break;
+        default:
+            fail(ps, "expected a value");
+            break;
+    }
+}
+
+static void parse_expr(struct parser *ps, int min_bp) {
+    if (++ps->nesting > 256) {
+        fail(ps, "expression too deep");
+        return;
+    }
+    parse_prefix(ps);
+    while (!ps->failed) {
+        int op = 0, bp = infix(ps->tok, &op);
+        if (bp <= min_bp) {
+            break;
+        }
+        next(ps);
+        // ^ is right associative: 2^3^2 is 2^9
+        parse_expr(ps, op == OP_POW ? bp - 1 : bp);
+        apply(ps, op, 2, 0);
+    }
+    ps->nesting--;
+}
+
+// Compile expr, or "name = expr" to assign it. Returns 0, or -1 with a
+// message in err.
+int ripple_calc_compile(const char *expr, struct ripple_calc_prog *prog, char *err, size_t errsize) {
+    struct parser ps;
+    char target[32] = "";
+    const char *p = expr;
+
+    memset(prog, 0, sizeof(*prog));
+    prog->target = -1;
+    memset(&ps, 0, sizeof(ps));
+    ps.prog = prog;
+    ps.err = err;
+    ps.errsize = errsize;
+
+    while (*p == ' ' || *p == '\t' || *p == '"' || *p == '\'') {
+        p++;
+    }
+    if (isalpha((unsigned char)*p) || *p == '_') {
+        const char *q = p;
+        while (isalnum((unsigned char)*q) || *q == '_') {
+            q++;
+        }
+        const char *eq = q;
+        while (*eq == ' ' || *eq == '\t') {
+            eq++;
+        }
+        if (eq[0] == '=' && eq[1] != '=' && (size_t)(q - p) < sizeof(target)) {
+            memcpy(target, p, q - p);
+            target[q - p] = '\0';
+            p = eq + 1;
+        }
+    }
+    ps.p = p;
+    next(&ps);
+    if (!ps.failed && ps.tok == T_END) {
+        fail(&ps, "empty expression");
+    }
+    parse_expr(&ps, 0);
+    if (!ps.failed && ps.tok != T_END) {
+        fail(&ps, "unexpected input");
+    }
+
+    double unused;
+    if (!ps.failed && target[0]) {
+        if (find_fn(target) >= 0 || constant(target, &unused)) {
+            snprintf(err, errsize, "can not assign to '%s'", target);
+            ps.failed = 1;
+        } else if (prog->columns > 0) {
+            snprintf(err, errsize, "can not assign a column to '%s'", target);
+            ps.failed = 1;
+        } else if ((prog->target = var_index(target, 1)) < 0) {
+            snprintf(err, errsize, "too many variables");
+            ps.failed = 1;
+        }
+    }
+    if (!ps.failed) {
+        prog->stack = malloc(sizeof(double) * RIPPLE_CALC_BLOCK * (prog->depth ? prog->depth : 1));
+        if (!prog->stack) {
+            snprintf(err, errsize, "out of memory");
+            ps.failed = 1;
+        }
+    }
+    if (ps.failed) {
+        ripple_calc_free(prog);
+        return -1;
+    }
+    return 0;
+}
+
+void ripple_calc_free(struct ripple_calc_prog *prog) {
+    free(prog->code);
+    free(prog->consts);
+    free(prog->stack);
+    memset(prog, 0, sizeof(*prog));
+    prog->target = -1;
+}
+
+#define UNARY(expr)                                                            \
+    do {                                                                       \
+        double *restrict a = base + (sp - 1) * RIPPLE_CALC_BLOCK;              \
+        for (int i = 0; i < n; i++) {                                          \
+            a[i] = (expr);                                                     \
+        }                                                                      \
+    } while (0)
+
+#define BINARY(expr)                                                           \
+    do {                                                                       \
+        double *restrict a = base + (sp - 2) * RIPPLE_CALC_BLOCK;              \
+        const double *restrict b = a + RIPPLE_CALC_BLOCK;                      \
+        for (int i = 0; i < n; i++) {                                          \
+            a[i] = (expr);                                                     \
+        }                                                                      \
+        sp--;                                                                  \
+    } while (0)
+
+// Count the zeros in the divisor block on top of the stack
+static void count_zero_divisors(struct ripple_calc_prog *prog, const double *b, int n) {
+    long zeros = 0;
+    for (int i = 0; i < n; i++) {
+        zeros += b[i] == 0;
+    }
+    prog->zero_divisions += zeros;
+}
+
+// Run the program over n rows (n at most RIPPLE_CALC_BLOCK). cols holds
+// one block of RIPPLE_CALC_BLOCK values per column the program uses.
+void ripple_calc_eval(struct ripple_calc_prog *prog, const double *cols, int n, double *out) {
+    double *base = prog->stack;
+    const unsigned char *code = prog->code;
+    int sp = 0;
+
+    for (size_t pc = 0; pc < prog->len;) {
+        int op = code[pc++];
+        int arg = 0;
+        if (HAS_OPERAND(op)) {
+            arg = code[pc] | code[pc + 1] << 8;
+            pc += 2;
+        }
+        switch (op) {
+            case OP_CONST:
+            case OP_VAR: {
+                double value = op == OP_CONST ? prog->consts[arg] : vars[arg].value;
+                double *restrict a = base + sp * RIPPLE_CALC_BLOCK;
+                for (int i = 0; i < n; i++) {
+                    a[i] = value;
+                }
+                sp++;
+                break;
+            }
+            case OP_COL:
+                memcpy(base + sp * RIPPLE_CALC_BLOCK, cols + arg * RIPPLE_CALC_BLOCK, sizeof(double) * n);
+                sp++;
+                break;
+            case OP_CALL1: {
+                double (*f)(double) = fns[arg].f1;
+                UNARY(f(a[i]));
+                break;
+            }
+            case OP_CALL2: {
+                double (*f)(double, double) = fns[arg].f2;
+                BINARY(f(a[i], b[i]));
+                break;
+            }
+            case OP_NEG: UNARY(-a[i]); break;
+            case OP_SQR: UNARY(a[i] * a[i]); break;
+            case OP_ADD: BINARY(a[i] + b[i]); break;
+            case OP_SUB: BINARY(a[i] - b[i]); break;
+            case OP_MUL: BINARY(a[i] * b[i]); break;
+            case OP_DIV:
+                count_zero_divisors(prog, base + (sp - 1) * RIPPLE_CALC_BLOCK, n);
+                BINARY(a[i] / b[i]);
+                break;
+            case OP_MOD:
+                count_zero_divisors(prog, base + (sp - 1) * RIPPLE_CALC_BLOCK, n);
+                BINARY(fmod(a[i], b[i]));
+                break;
+            case OP_POW: BINARY(pow(a[i], b[i])); break;
+            case OP_LT: BINARY(a[i] < b[i]); break;
+            case OP_LE: BINARY(a[i] <= b[i]); break;
+            case OP_GT: BINARY(a[i] > b[i]); break;
+            case OP_GE: BINARY(a[i] >= b[i]); break;
+            case OP_EQ: BINARY(a[i] == b[i]); break;
+            case OP_NE: BINARY(a[i] != b[i]); break;
+        }
+    }
+    memcpy(out, base, sizeof(double) * n);
+}
+
+// Evaluate a program without columns once, assigning its target if it has
+// one. A division by zero leaves the target alone; the caller finds it in
+// zero_divisions.
+double ripple_calc_value(struct ripple_calc_prog *prog) {
+    double value;
+    prog->zero_divisions = 0;
+    ripple_calc_eval(prog, NULL, 1, &value);
+    if (prog->target >= 0 && prog->zero_divisions == 0) {
+        vars[prog->target].value = value;
+    }
+    return value;
+}
+
+void ripple_calc_dump(const struct ripple_calc_prog *prog, FILE *out) {
+    for (size_t pc = 0; pc < prog->len;) {
+        int op = prog->code[pc];
+        fprintf(out, "%4zu  %-6s", pc, op_names[op]);
+        if (HAS_OPERAND(op)) {
+            int arg = prog->code[pc + 1] | prog->code[pc + 2] << 8;
+            switch (op) {
+                case OP_CONST: fprintf(out, "%.17g", prog->consts[arg]); break;
+                case OP_VAR: fprintf(out, "%s", vars[arg].name); break;
+                case OP_COL: fprintf(out, "$%d", arg + 1); break;
+                default: fprintf(out, "%s", fns[arg].name); break;
+            }
+            pc += 3;
+        } else {
+            pc++;
+        }
+        fputc('\n', out);
+    }
+    if (prog->target >= 0) {
+        fprintf(out, "      -> %s\n", vars[prog->target].name);
+    }
+}
+
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Fixed notation with the 15 significant digits of %.15g, for the range
+// where %g does not switch to an exponent. Returns -1 for snprintf to do
+// the rest.
+static int format_fixed(double value, char *out) {
+    double a = fabs(value);
+    if (!(a >= 1e-4 && a < 1e15)) {
+        return -1;
+    }
+    int shift = 14 - (int)floor(log10(a));
+    double scaled = a * pow10_exact[shift];
+    if (scaled >= 1e15 && shift > 0) {
+        scaled = a * pow10_exact[--shift];
+    } else if (scaled < 1e14 && shift < 22) {
+        scaled = a * pow10_exact[++shift];
+    }
+    double whole = floor(scaled), frac = scaled - whole;
+    if (scaled < 1e14 || scaled >= 1e15) {
+        return -1;
+    }
+    // Near a half, the product's rounding error decides; fma recovers it
+    // exactly. A true tie is left to printf's rounding rule.
+    double above_half = frac - 0.5;
+    if (fabs(above_half) < 0.07) {
+        above_half += fma(a, pow10_exact[shift], -scaled);
+        if (above_half == 0) {
+            return -1;
+        }
+    }
+    uint64_t d = (uint64_t)whole + (above_half > 0);
+    if (d >= 1000000000000000ULL) {
+        return -1;
+    }
+
+    char digits[15];
+    for (int i = 14; i >= 0; i--) {
+        digits[i] = (char)('0' + d % 10);
+        d /= 10;
+    }
+    int int_digits = 15 - shift, last = 14, len = 0;
+    while (last >= 0 && last >= int_digits && digits[last] == '0') {
+        last--;
+    }
+    if (value < 0) {
+        out[len++] = '-';
+    }
+    if (int_digits <= 0) {
+        out[len++] = '0';
+        out[len++] = '.';
+        for (int i = int_digits; i < 0; i++) {
+            out[len++] = '0';
+        }
+        memcpy(out + len, digits, last + 1);
+        len += last + 1;
+    } else {
+        memcpy(out + len, digits, int_digits);
+        len += int_digits;
+        if (last >= int_digits) {
+            out[len++] = '.';
+            memcpy(out + len, digits + int_digits, last + 1 - int_digits);
+            len += last + 1 - int_digits;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Print value as %.15g would, which shows 0.1 + 0.2 as 0.3, mostly without
+// going through printf. Returns the length written.
+int ripple_calc_format(double value, char *out, size_t size) {
+    if (fabs(value) < 1e15 && value == (double)(long long)value && size >= 18) {
+        char digits[20];
+        long long v = (long long)value;
+        unsigned long long u = v < 0 ? -(unsigned long long)v : (unsigned long long)v;
+        int n = 0, len = 0;
+        do {
+            digits[n++] = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0) {
+            out[len++] = '-';
+        }
+        while (n) {
+            out[len++] = digits[--n];
+        }
+        out[len] = '\0';
+        return len;
+    }
+    if (size >= 32) {
+        int len = format_fixed(value, out);
+        if (len >= 0) {
+            return len;
+        }
+    }
+    return snprintf(out, size, "%.15g", value);
+}
+
+
+// Parse a decimal number in [p, end). Up to 2^53 of mantissa and 10^22 of
+// scale, one multiply or divide of two exact doubles rounds correctly;
+// anything else goes to strtod. Returns the end of the number, or NULL.
+static const char *parse_number(const char *p, const char *end, double *out) {
+    const char *s = p;
+    uint64_t mant = 0;
+    int digits = 0, exp10 = 0, any = 0, neg = 0;
+
+    if (s < end && (*s == '-' || *s == '+')) {
+        neg = *s == '-';
+        s++;
+    }
+    for (; s < end && (unsigned)(*s - '0') < 10; s++, any = 1) {
+        if (digits < 19) {
+            mant = mant * 10 + (unsigned)(*s - '0');
+            digits += mant != 0;
+        } else {
+            exp10++;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && (unsigned)(*s - '0') < 10; s++, any = 1) {
+            if (digits < 19) {
+                mant = mant * 10 + (unsigned)(*s - '0');
+                digits += mant != 0;
+                exp10--;
+            }
+        }
+    }
+    if (!any) {
+        return NULL;
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        int eneg = 0, ev = 0;
+        if (e < end && (*e == '-' || *e == '+')) {
+            eneg = *e == '-';
+            e++;
+        }
+        if (e < end && (unsigned)(*e - '0') < 10) {
+            for (; e < end && (unsigned)(*e - '0') < 10; e++) {
+                if (ev < 100000) {
+                    ev = ev * 10 + (*e - '0');
+                }
+            }
+            exp10 += eneg ? -ev : ev;
+            s = e;
+        }
+    }
+    if (mant > (1ULL << 53) || exp10 < -22 || exp10 > 22) {
+        char copy[64];
+        if (s - p >= (long)sizeof(copy)) {
+            return NULL;
+        }
+        memcpy(copy, p, s - p);
+        copy[s - p] = '\0';
+        *out = strtod(copy, NULL);
+        return s;
+    }
+    double value = (double)mant;
+    value = exp10 < 0 ? value / pow10_exact[-exp10] : value * pow10_exact[exp10];
+    *out = neg ? -value : value;
+    return s;
+}
+
+static int is_separator(char c, char delim) {
+    return delim ? c == delim : c == ' ' || c == '\t' || c == ',';
+}
+
+// Parse the first k fields of the line [p, end) into column slot row.
+// Returns 1 for a row, 0 for a blank line, -1 when a field is missing or
+// not a number.
+static int parse_row(const char *p, const char *end, char delim, int k, double *cols, int row) {
+    if (end > p && end[-1] == '\r') {
+        end--;
+    }
+    const char *q = p;
+    while (q < end && (*q == ' ' || *q == '\t')) {
+        q++;
+    }
+    if (q == end) {
+        return 0;
+    }
+    for (int c = 0; c < k; c++) {
+        while (p < end && (*p == ' ' || *p == '\t' || (!delim && *p == ','))) {
+            p++;
+        }
+        p = parse_number(p, end, &cols[c * RIPPLE_CALC_BLOCK + row]);
+        if (!p) {
+            return -1;
+        }
+        // Blanks may pad a field; without -d they also separate fields
+        const char *after = p;
+        while (p < end && (*p == ' ' || *p == '\t') && delim != ' ' && delim != '\t') {
+            p++;
+        }
+        if (p < end && !is_separator(*p, delim) && (delim || p == after)) {
+            return -1;
+        }
+        if (c < k - 1) {
+            if (p == end) {
+                return -1;
+            }
+            if (delim) {
+                p++;
+            }
+        }
+    }
+    return 1;
+}
+
+struct stream_out {
+    FILE *out;
+    char buf[65536];
+    size_t len;
+};
+
+static void flush_block(struct ripple_calc_prog *prog, const double *cols, int n, const struct ripple_calc_stream_opts *opts,
+                        struct stream_out *so, struct ripple_calc_stream_stats *stats) {
+    double results[RIPPLE_CALC_BLOCK];
+    ripple_calc_eval(prog, cols, n, results);
+    for (int i = 0; i < n; i++) {
+        double v = results[i];
+        stats->sum += v;
+        if (v < stats->min) {
+            stats->min = v;
+        }
+        if (v > stats->max) {
+            stats->max = v;
+        }
+    }
+    stats->rows += n;
+    if (opts->summary) {
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        if (so->len > sizeof(so->buf) - 64) {
+            fwrite(so->buf, 1, so->len, so->out);
+            so->len = 0;
+        }
+        so->len += ripple_calc_format(results[i], so->buf + so->len, 64);
+        so->buf[so->len++] = '\n';
+    }
+}
+
+// Evaluate prog for every row read from fd, printing one result per row
+// (or nothing, with opts->summary; stats has the totals either way). Rows
+// whose fields are not numbers, such as a CSV header, are skipped and
+// counted. Returns 0, or -1 on a read error.
+int ripple_calc_stream(int fd, struct ripple_calc_prog *prog, const struct ripple_calc_stream_opts *opts, FILE *out,
+                       struct ripple_calc_stream_stats *stats) {
+    int k = prog->columns > 0 ? prog->columns : 1;
+    size_t cap = RIPPLE_CALC_READ, len = 0;
+    char *buf = malloc(cap);
+    double *cols = malloc(sizeof(double) * RIPPLE_CALC_BLOCK * k);
+    struct stream_out *so = malloc(sizeof(*so));
+    int rows = 0, rc = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->min = INFINITY;
+    stats->max = -INFINITY;
+    if (!buf || !cols || !so) {
+        free(buf);
+        free(cols);
+        free(so);
+        errno = ENOMEM;
+        return -1;
+    }
+    so->out = out;
+    so->len = 0;
+
+    for (;;) {
+        if (len == cap) {
+            // A line longer than a whole read
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                errno = ENOMEM;
+                rc = -1;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            rc = -1;
+            break;
+        }
+        len += (size_t)n;
+
+        const char *p = buf, *end = buf + len;
+        while (p < end) {
+            const char *nl = memchr(p, '\n', end - p);
+            if (!nl) {
+                if (n > 0) {
+                    break;
+                }
+                nl = end;         // last line, without a newline
+            }
+            int got = parse_row(p, nl, opts->delim, k, cols, rows);
+            if (got > 0 && ++rows == RIPPLE_CALC_BLOCK) {
+                flush_block(prog, cols, rows, opts, so, stats);
+                rows = 0;
+            } else if (got < 0) {
+                stats->skipped++;
+            }
+            p = nl < end ? nl + 1 : end;
+        }
+        if (n == 0) {
+            break;
+        }
+        len = (size_t)(end - p);
+        memmove(buf, p, len);
+    }
+    if (rows > 0) {
+        flush_block(prog, cols, rows, opts, so, stats);
+    }
+    fwrite(so->buf, 1, so->len, out);
+    free(buf);
+    free(cols);
+    free(so);
+    return rc;
+}
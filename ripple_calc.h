@@ -0,0 +1,61 @@
+#ifndef RIPPLE_CALC_H
+#define RIPPLE_CALC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Expression engine for the calc builtin. A Pratt parser compiles an
+// expression to a small stack bytecode, folding constant subexpressions as
+// it goes. Programs run a block of rows at a time: every instruction loops
+// over the whole block, so dispatch is paid once per block and the
+// arithmetic loops vectorize. $1, $2, ... name the columns of a row; a
+// program that uses them is run over a stream of rows, where a division by
+// zero gives inf or nan for that row. Divisions by zero are counted so a
+// single value can be reported as an error instead.
+
+struct ripple_calc_prog {
+    unsigned char* code;
+    size_t len;
+    size_t cap;
+    double* consts;
+    int num_consts;
+    int consts_cap;
+    int depth;                    // deepest the value stack gets
+    int columns;                  // highest $N used, 0 if none
+    int target;                   // variable assigned by "name = ...", or -1
+    double* stack;                // depth blocks of RIPPLE_CALC_BLOCK values
+    long zero_divisions;          // / and % by zero since the last ripple_calc_value
+};
+
+struct ripple_calc_stream_opts {
+    char delim;                   // field separator; 0 for blanks and commas
+    int summary;                  // print count/sum/min/max/mean, not each row
+};
+
+struct ripple_calc_stream_stats {
+    long rows;
+    long skipped;                 // rows whose fields were not all numbers
+    double sum;
+    double min;
+    double max;
+};
+
+// Function declarations
+int ripple_calc_compile(const char* expr, struct ripple_calc_prog* prog, char* err, size_t errsize);
+void ripple_calc_free(struct ripple_calc_prog* prog);
+void ripple_calc_eval(struct ripple_calc_prog* prog, const double* cols, int n, double* out);
+double ripple_calc_value(struct ripple_calc_prog* prog);
+int ripple_calc_stream(int fd, struct ripple_calc_prog* prog, const struct ripple_calc_stream_opts* opts, FILE* out,
+                       struct ripple_calc_stream_stats* stats);
+void ripple_calc_dump(const struct ripple_calc_prog* prog, FILE* out);
+int ripple_calc_set(const char* name, double value);
+int ripple_calc_format(double value, char* out, size_t size);
+
+// Constants
+#define RIPPLE_CALC_BLOCK 256             // rows evaluated per instruction dispatch
+#define RIPPLE_CALC_MAX_DEPTH 64
+#define RIPPLE_CALC_MAX_COLUMNS 64
+#define RIPPLE_CALC_VARS 64
+#define RIPPLE_CALC_READ (1 << 20)        // bytes read from a stream at a time
+
+#endif // RIPPLE_CALC_H
@@ -0,0 +1,155 @@
+#include "ripple_client.h"
+#include "ollama_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// One connection to the daemon, used from the shell's main thread only
+static struct {
+    int enabled;
+    int fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    double last_attempt;
+    struct rp_msg msg;
+} client = { .fd = -1 };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Use the daemon at socket_path (NULL for the default) from now on
+void ripple_client_enable(const char *socket_path) {
+    snprintf(client.path, sizeof(client.path), "%s", socket_path ? socket_path : ripple_daemon_socket_path());
+    client.enabled = 1;
+    client.last_attempt = 0;
+}
+
+int ripple_client_enabled(void) {
+    return client.enabled;
+}
+
+const char *ripple_client_socket(void) {
+    return client.path;
+}
+
+static void drop_connection(void) {
+    if (client.fd >= 0) {
+        close(client.fd);
+        client.fd = -1;
+    }
+    client.last_attempt = now_ms();
+}
+
+// Connect unless we tried recently; only a socket we own is trusted
+static int ensure_connected(void) {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (client.fd >= 0) {
+        return 0;
+    }
+    double now = now_ms();
+    if (client.last_attempt > 0 && now - client.last_attempt < RIPPLE_CLIENT_RETRY_MS) {
+        return -1;
+    }
+    client.last_attempt = now;
+    if (lstat(client.path, &st) != 0 || !S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC); // commands the shell runs must not inherit it
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, client.path, sizeof(addr.sun_path));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    client.fd = fd;
+    return 0;
+}
+
+int ripple_client_connected(void) {
+    return client.enabled && ensure_connected() == 0;
+}
+
+// Send a request and wait for the reply. Returns the reply type, -1 if the
+// daemon is gone (connection dropped) or -2 if it did not answer in time.
+static int transact(int type, long timeout_ms) {
+    int reply;
+
+    if (rp_send(client.fd, type, &client.msg) != 0) {
+        drop_connection();
+        return -1;
+    }
+    int rc = rp_recv(client.fd, &reply, &client.msg, timeout_ms);
+    if (rc != 0) {
+        drop_connection();
+        return rc;
+    }
+    return reply;
+}
+
+// Ask the daemon for suggestions. Returns what get_ollama_suggestions would,
+// or RIPPLE_CLIENT_UNAVAILABLE when there is no daemon to ask.
+int ripple_client_suggest(const char *prompt, struct ollama_suggestion *out, int max, char **raw) {
+    struct ollama_config cfg;
+    int flags;
+
+    *raw = NULL;
+    if (!client.enabled || ensure_connected() != 0) {
+        return RIPPLE_CLIENT_UNAVAILABLE;
+    }
+    ollama_config_get(&cfg);
+
+    rp_reset(&client.msg);
+    rp_put_u8(&client.msg, (uint8_t)max);
+    rp_put_str(&client.msg, prompt, strlen(prompt));
+    int type = transact(RP_SUGGEST, cfg.timeout_ms + RIPPLE_CLIENT_SLACK_MS);
+    if (type == -2) {
+        return -1; // The daemon is stuck; asking again here would double the wait
+    }
+    if (type != RP_SUGGEST_REPLY) {
+        return RIPPLE_CLIENT_UNAVAILABLE;
+    }
+    int result = rp_get_suggestions(&client.msg, &flags, out, max, raw);
+    if (client.msg.error) {
+        drop_connection();
+        return RIPPLE_CLIENT_UNAVAILABLE;
+    }
+    return result;
+}
+
+// Counters and diagnostics text from the daemon; -1 if there is none
+int ripple_client_stats(struct rp_stats *stats, char *text, size_t size) {
+    if (!client.enabled || ensure_connected() != 0) {
+        return -1;
+    }
+    rp_reset(&client.msg);
+    if (transact(RP_STATS, 2000) != RP_STATS_REPLY) {
+        return -1;
+    }
+    stats->sessions = rp_get_u32(&client.msg);
+    stats->requests = rp_get_u32(&client.msg);
+    stats->cache_hits = rp_get_u32(&client.msg);
+    stats->shared = rp_get_u32(&client.msg);
+    stats->sent = rp_get_u32(&client.msg);
+    rp_get_str(&client.msg, text, size);
+    return client.msg.error ? -1 : 0;
+}
@@ -0,0 +1,25 @@
+#ifndef RIPPLE_CLIENT_H
+#define RIPPLE_CLIENT_H
+
+#include <stddef.h>
+#include "ollama_codec.h"
+#include "ripple_proto.h"
+
+// Shell side of ripple-daemon. Once enabled, suggestion requests go to the
+// daemon when one is listening; when it is not (or goes away), callers get
+// RIPPLE_CLIENT_UNAVAILABLE and do the work in-process instead.
+
+// Function declarations
+void ripple_client_enable(const char* socket_path);
+int ripple_client_enabled(void);
+int ripple_client_connected(void);
+int ripple_client_suggest(const char* prompt, struct ollama_suggestion* out, int max, char** raw);
+int ripple_client_stats(struct rp_stats* stats, char* text, size_t size);
+const char* ripple_client_socket(void);
+
+// Constants
+#define RIPPLE_CLIENT_UNAVAILABLE -2
+#define RIPPLE_CLIENT_RETRY_MS 5000     // how often to look for a daemon again
+#define RIPPLE_CLIENT_SLACK_MS 2000     // extra wait on top of the request deadline
+
+#endif // RIPPLE_CLIENT_H
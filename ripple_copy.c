@@ -0,0 +1,405 @@
+#ifdef __linux__
+#define _GNU_SOURCE // For copy_file_range
+#endif
+#include "ripple_copy.h"
+#include "ripple_walk.h"
+#include "ripple_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h> // For FICLONE
+#endif
+
+#ifdef __APPLE__
+#define ST_ATIM st_atimespec
+#define ST_MTIM st_mtimespec
+#else
+#define ST_ATIM st_atim
+#define ST_MTIM st_mtim
+#endif
+
+struct copy_job {
+    char *src;
+    char *dst;
+};
+
+// A directory created by the copy, given its mode and times at the end
+struct dir_fixup {
+    char *path;
+    struct stat st;
+};
+
+struct copy_ctx {
+    const struct ripple_copy_opts *opts;
+    struct ripple_copy_stats *stats; // updated atomically by the workers
+    struct ripple_pool *pool;
+    char **buffers;                  // one per worker, the last for the caller
+    int num_buffers;
+    const char *src_root;            // the tree being walked and its copy
+    size_t src_len;
+    const char *dst_root;
+    struct dir_fixup *dirs;
+    size_t num_dirs;
+    size_t dirs_cap;
+    int copying;                     // cleared to stop the progress thread
+};
+
+static void add_stat(long *counter, long n) {
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+static void report(struct copy_ctx *ctx, const char *path, int errnum) {
+    fprintf(stderr, "ripple: cp: %s: %s\n", path, strerror(errnum));
+    add_stat(&ctx->stats->errors, 1);
+}
+
+// Move the contents of in to out: as a reflink if the filesystem can, else
+// inside the kernel, else through buf. The last loop runs regardless, to
+// pick up anything past size (files that grew, or report a size of 0).
+static int copy_data(int in, int out, off_t size, char *buf, int *cloned) {
+    *cloned = 0;
+#ifdef FICLONE
+    if (size > 0 && ioctl(out, FICLONE, in) == 0) {
+        *cloned = 1;
+        return 0;
+    }
+#endif
+#ifdef __linux__
+    off_t done = 0;
+    while (done < size) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, (size_t)(size - done), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && done == 0 &&
+            (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EPERM)) {
+            break; // not between these files; copy by hand
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+#else
+    (void)size;
+#endif
+    for (;;) {
+        ssize_t n = read(in, buf, RIPPLE_COPY_BUFSIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return (int)n;
+        }
+        for (ssize_t written = 0; written < n;) {
+            ssize_t w = write(out, buf + written, (size_t)(n - written));
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w < 0) {
+                return -1;
+            }
+            written += w;
+        }
+    }
+}
+
+static void copy_file(struct copy_ctx *ctx, const char *src, const char *dst, char *buf) {
+    struct stat st;
+    int cloned;
+    int in = open(src, O_RDONLY);
+
+    if (in < 0 || fstat(in, &st) != 0) {
+        report(ctx, src, errno);
+        if (in >= 0) {
+            close(in);
+        }
+        return;
+    }
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, (st.st_mode & 0777) | S_IWUSR);
+    if (out < 0) {
+        report(ctx, dst, errno);
+        close(in);
+        return;
+    }
+    if (copy_data(in, out, st.st_size, buf, &cloned) != 0) {
+        report(ctx, dst, errno);
+    } else {
+        struct timespec times[2] = { st.ST_ATIM, st.ST_MTIM };
+        fchmod(out, st.st_mode & 07777);
+        futimens(out, times);
+        add_stat(&ctx->stats->files, 1);
+        add_stat(&ctx->stats->bytes, st.st_size);
+        add_stat(&ctx->stats->cloned, cloned);
+    }
+    close(in);
+    if (close(out) != 0) {
+        report(ctx, dst, errno);
+    }
+}
+
+static char *worker_buffer(struct copy_ctx *ctx, int worker) {
+    if (!ctx->buffers[worker]) {
+        ctx->buffers[worker] = malloc(RIPPLE_COPY_BUFSIZE);
+    }
+    return ctx->buffers[worker];
+}
+
+static void run_job(void *arg, int worker, void *ctx_arg) {
+    struct copy_job *job = arg;
+    struct copy_ctx *ctx = ctx_arg;
+    char *buf = worker_buffer(ctx, worker);
+
+    if (buf) {
+        copy_file(ctx, job->src, job->dst, buf);
+    } else {
+        report(ctx, job->src, ENOMEM);
+    }
+    free(job->src);
+    free(job->dst);
+    free(job);
+}
+
+// Hand a file to the pool, or copy it here if the pool cannot take it
+static void submit(struct copy_ctx *ctx, const char *src, const char *dst) {
+    struct copy_job *job = malloc(sizeof(*job));
+    if (job) {
+        job->src = strdup(src);
+        job->dst = strdup(dst);
+    }
+    if (!job || !job->src || !job->dst) {
+        if (job) {
+            free(job->src);
+            free(job->dst);
+            free(job);
+        }
+        report(ctx, src, ENOMEM);
+        return;
+    }
+    if (!ctx->pool || ripple_pool_submit(ctx->pool, job) != 0) {
+        run_job(job, ctx->num_buffers - 1, ctx);
+    }
+}
+
+// Returns 0 once dst is a directory, or -1 after reporting why it is not
+static int make_dir(struct copy_ctx *ctx, const char *src, const char *dst) {
+    struct stat st, existing;
+    if (stat(src, &st) != 0) {
+        report(ctx, src, errno);
+        return -1;
+    }
+    // Writable for now, so the copy can fill it; the real mode comes last
+    if (mkdir(dst, (st.st_mode & 0777) | S_IRWXU) != 0 &&
+        (errno != EEXIST || stat(dst, &existing) != 0 || !S_ISDIR(existing.st_mode))) {
+        report(ctx, dst, errno == EEXIST ? ENOTDIR : errno);
+        return -1;
+    }
+    add_stat(&ctx->stats->dirs, 1);
+    if (ctx->num_dirs == ctx->dirs_cap) {
+        size_t cap = ctx->dirs_cap ? ctx->dirs_cap * 2 : 64;
+        struct dir_fixup *grown = realloc(ctx->dirs, cap * sizeof(*grown));
+        if (!grown) {
+            return 0;
+        }
+        ctx->dirs = grown;
+        ctx->dirs_cap = cap;
+    }
+    ctx->dirs[ctx->num_dirs].path = strdup(dst);
+    ctx->dirs[ctx->num_dirs++].st = st;
+    return 0;
+}
+
+static void copy_link(struct copy_ctx *ctx, const char *src, const char *dst) {
+    char target[4096];
+    ssize_t n = readlink(src, target, sizeof(target) - 1);
+    if (n < 0) {
+        report(ctx, src, errno);
+        return;
+    }
+    target[n] = '\0';
+    if (symlink(target, dst) != 0) {
+        report(ctx, dst, errno);
+        return;
+    }
+    add_stat(&ctx->stats->links, 1);
+}
+
+static void copy_entry(struct copy_ctx *ctx, const char *src, const char *dst, int type) {
+    struct stat st;
+    if (type == RIPPLE_WALK_DIR) {
+        make_dir(ctx, src, dst);
+    } else if (type == RIPPLE_WALK_FILE) {
+        submit(ctx, src, dst);
+    } else if (lstat(src, &st) == 0 && S_ISLNK(st.st_mode)) {
+        copy_link(ctx, src, dst);
+    } else {
+        fprintf(stderr, "ripple: cp: %s: skipping special file\n", src);
+    }
+}
+
+static void visit_entry(const char *path, const char *name, int type, void *arg) {
+    struct copy_ctx *ctx = arg;
+    char dst[4096];
+    (void)name;
+    if (snprintf(dst, sizeof(dst), "%s%s", ctx->dst_root, path + ctx->src_len) >= (int)sizeof(dst)) {
+        report(ctx, path, ENAMETOOLONG);
+        return;
+    }
+    copy_entry(ctx, path, dst, type);
+}
+
+// True if dst would land inside the directory src, which would make a
+// recursive copy chase its own output
+static int inside(const char *src, const char *dst) {
+    char real_src[4096], real_parent[4096], parent[4096];
+    const char *slash = strrchr(dst, '/');
+
+    snprintf(parent, sizeof(parent), "%.*s", slash ? (int)(slash - dst) + 1 : 1, slash ? dst : ".");
+    if (!realpath(src, real_src) || !realpath(parent, real_parent)) {
+        return 0;
+    }
+    size_t len = strlen(real_src);
+    return strncmp(real_parent, real_src, len) == 0 && (real_parent[len] == '/' || real_parent[len] == '\0');
+}
+
+static void copy_source(struct copy_ctx *ctx, const char *src, const char *dst) {
+    struct stat st, target;
+    // Operands are followed if they are symlinks, as cp does without -r
+    int found = ctx->opts->recursive ? lstat(src, &st) : stat(src, &st);
+
+    if (found != 0) {
+        report(ctx, src, errno);
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        if (!ctx->opts->recursive) {
+            fprintf(stderr, "ripple: cp: -r not specified; omitting directory '%s'\n", src);
+            add_stat(&ctx->stats->errors, 1);
+            return;
+        }
+        if (inside(src, dst)) {
+            fprintf(stderr, "ripple: cp: cannot copy '%s' into itself\n", src);
+            add_stat(&ctx->stats->errors, 1);
+            return;
+        }
+        // Nothing below can be copied without the top directory
+        if (make_dir(ctx, src, dst) != 0) {
+            return;
+        }
+        ctx->src_root = src;
+        ctx->src_len = strlen(src);
+        ctx->dst_root = dst;
+        ripple_walk(src, visit_entry, ctx);
+        return;
+    }
+    if (stat(dst, &target) == 0 && target.st_dev == st.st_dev && target.st_ino == st.st_ino) {
+        fprintf(stderr, "ripple: cp: '%s' and '%s' are the same file\n", src, dst);
+        add_stat(&ctx->stats->errors, 1);
+        return;
+    }
+    copy_entry(ctx, src, dst, S_ISREG(st.st_mode) ? RIPPLE_WALK_FILE : RIPPLE_WALK_OTHER);
+}
+
+static void *progress_main(void *arg) {
+    struct copy_ctx *ctx = arg;
+    struct timespec interval = { 0, RIPPLE_COPY_PROGRESS_MS * 1000000L };
+
+    while (__atomic_load_n(&ctx->copying, __ATOMIC_ACQUIRE)) {
+        nanosleep(&interval, NULL);
+        fprintf(stderr, "\r%ld files, %.1f MB", __atomic_load_n(&ctx->stats->files, __ATOMIC_RELAXED),
+                __atomic_load_n(&ctx->stats->bytes, __ATOMIC_RELAXED) / 1048576.0);
+    }
+    fprintf(stderr, "\r\033[K");
+    return NULL;
+}
+
+// The last path component of src, ignoring trailing slashes
+static void base_name(const char *src, char *out, size_t size) {
+    size_t len = strlen(src);
+    while (len > 1 && src[len - 1] == '/') {
+        len--;
+    }
+    size_t start = len;
+    while (start > 0 && src[start - 1] != '/') {
+        start--;
+    }
+    snprintf(out, size, "%.*s", (int)(len - start), src + start);
+}
+
+// Copy each source to dest, or into dest when it is a directory. Returns
+// 0, or -1 if anything failed (each failure is reported on stderr).
+int ripple_copy(char **sources, int num_sources, const char *dest, const struct ripple_copy_opts *opts,
+                struct ripple_copy_stats *stats) {
+    struct copy_ctx ctx;
+    struct stat st;
+    pthread_t progress;
+    int dest_is_dir = stat(dest, &st) == 0 && S_ISDIR(st.st_mode);
+
+    memset(stats, 0, sizeof(*stats));
+    if (num_sources > 1 && !dest_is_dir) {
+        fprintf(stderr, "ripple: cp: target '%s' is not a directory\n", dest);
+        return -1;
+    }
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.opts = opts;
+    ctx.stats = stats;
+    ctx.pool = ripple_pool_create(opts->threads, run_job, &ctx);
+    ctx.num_buffers = (ctx.pool ? ripple_pool_threads(ctx.pool) : 0) + 1;
+    ctx.buffers = calloc(ctx.num_buffers, sizeof(char *));
+    if (!ctx.buffers) {
+        if (ctx.pool) {
+            ripple_pool_finish(ctx.pool);
+        }
+        fprintf(stderr, "ripple: allocation error\n");
+        return -1;
+    }
+    ctx.copying = 1;
+    int show_progress = opts->verbose && isatty(STDERR_FILENO) &&
+                        pthread_create(&progress, NULL, progress_main, &ctx) == 0;
+
+    for (int i = 0; i < num_sources; i++) {
+        char dst[4096], name[1024];
+        if (dest_is_dir) {
+            base_name(sources[i], name, sizeof(name));
+            snprintf(dst, sizeof(dst), "%s/%s", dest, name);
+        } else {
+            snprintf(dst, sizeof(dst), "%s", dest);
+        }
+        copy_source(&ctx, sources[i], dst);
+    }
+    if (ctx.pool) {
+        ripple_pool_finish(ctx.pool);
+    }
+    __atomic_store_n(&ctx.copying, 0, __ATOMIC_RELEASE);
+    if (show_progress) {
+        pthread_join(progress, NULL);
+    }
+
+    // Deepest first, so setting a parent read-only cannot block its children
+    for (size_t i = ctx.num_dirs; i-- > 0;) {
+        struct dir_fixup *d = &ctx.dirs[i];
+        struct timespec times[2] = { d->st.ST_ATIM, d->st.ST_MTIM };
+        if (d->path) {
+            chmod(d->path, d->st.st_mode & 07777);
+            utimensat(AT_FDCWD, d->path, times, 0);
+        }
+        free(d->path);
+    }
+    for (int i = 0; i < ctx.num_buffers; i++) {
+        free(ctx.buffers[i]);
+    }
+    free(ctx.buffers);
+    free(ctx.dirs);
+    return stats->errors ? -1 : 0;
+}
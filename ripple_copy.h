@@ -0,0 +1,36 @@
+#ifndef RIPPLE_COPY_H
+#define RIPPLE_COPY_H
+
+// File and tree copying for the cp builtin. The source tree is walked with
+// ripple_walk on the calling thread, which creates directories and
+// symlinks as it goes, while regular files are copied by a ripple_pool of
+// threads. Each file is first offered to the filesystem as a reflink
+// (FICLONE: a copy-on-write clone sharing the blocks), then copied inside
+// the kernel with copy_file_range, and only then through a buffer. Mode
+// and timestamps are carried over; directories get theirs last, once
+// nothing more is written into them.
+
+struct ripple_copy_opts {
+    int recursive;                // -r: copy directories
+    int verbose;                  // -v: progress while copying, throughput after
+    int threads;                  // -j: 0 picks one per CPU
+};
+
+struct ripple_copy_stats {
+    long files;
+    long dirs;
+    long links;
+    long bytes;
+    long cloned;                  // files copied as reflinks
+    long errors;
+};
+
+// Function declarations
+int ripple_copy(char** sources, int num_sources, const char* dest, const struct ripple_copy_opts* opts,
+                struct ripple_copy_stats* stats);
+
+// Constants
+#define RIPPLE_COPY_BUFSIZE (256 << 10)  // read/write fallback block
+#define RIPPLE_COPY_PROGRESS_MS 250      // -v progress line interval
+
+#endif // RIPPLE_COPY_H
@@ -0,0 +1,452 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "ollama_integration.h"
+#include "ollama_config.h"
+#include "ollama_gate.h"
+#include "ripple_index.h"
+#include "ripple_proto.h"
+
+// ripple-daemon: one process per user that answers suggestion requests for
+// every shell over a Unix socket. The shells then share one retrieval index
+// mapping, one answer cache, one set of warm Ollama connections and one
+// request gate, instead of each building its own.
+//
+// Usage: ripple-daemon [-s socket] [-q]
+
+#define CACHE_SLOTS 1024          // power of two
+#define CACHE_PROBE 8             // slots looked at per prompt
+#define CACHE_TTL_MS (300 * 1000)
+#define REPEAT_MS 10000           // same window as a repeated TAB in the shell
+#define RELOAD_CHECK_MS 2000      // how often the index and config files are checked
+
+struct cache_entry {
+    uint64_t hash;
+    char *prompt;                 // NULL when the slot is free
+    int count;
+    struct ollama_suggestion out[RIPPLE_MAX_SUGGESTIONS];
+    char *raw;
+    double stored_at;
+    double used_at;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    unsigned long generation;     // config generation the entries were made under
+    struct cache_entry slots[CACHE_SLOTS];
+} cache = { PTHREAD_MUTEX_INITIALIZER };
+
+static struct {
+    pthread_mutex_t lock;
+    unsigned long sessions;
+    unsigned long requests;
+    unsigned long cache_hits;
+} counters = { PTHREAD_MUTEX_INITIALIZER };
+
+static volatile sig_atomic_t stopping = 0;
+static int quiet = 0;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static uint64_t hash_prompt(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; s++) {
+        h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// Caller holds cache.lock
+static void free_entry(struct cache_entry *e) {
+    free(e->prompt);
+    free(e->raw);
+    memset(e, 0, sizeof(*e));
+}
+
+static void cache_flush(void) {
+    pthread_mutex_lock(&cache.lock);
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        if (cache.slots[i].prompt) {
+            free_entry(&cache.slots[i]);
+        }
+    }
+    pthread_mutex_unlock(&cache.lock);
+}
+
+// Caller holds cache.lock; answers made under other settings are dropped
+static void check_generation(void) {
+    unsigned long generation = ollama_config_generation();
+    if (cache.generation != generation) {
+        for (int i = 0; i < CACHE_SLOTS; i++) {
+            if (cache.slots[i].prompt) {
+                free_entry(&cache.slots[i]);
+            }
+        }
+        cache.generation = generation;
+    }
+}
+
+// Copy a fresh cached answer for prompt into out; returns its count or -1
+static int cache_lookup(const char *prompt, struct ollama_suggestion *out, int max, char **raw) {
+    uint64_t h = hash_prompt(prompt);
+    double now = now_ms();
+    int result = -1;
+
+    *raw = NULL;
+    pthread_mutex_lock(&cache.lock);
+    check_generation();
+    for (int i = 0; i < CACHE_PROBE; i++) {
+        struct cache_entry *e = &cache.slots[(h + i) & (CACHE_SLOTS - 1)];
+        if (!e->prompt || e->hash != h || strcmp(e->prompt, prompt) != 0) {
+            continue;
+        }
+        if (now - e->stored_at > CACHE_TTL_MS) {
+            free_entry(e);
+            break;
+        }
+        result = e->count < max ? e->count : max;
+        memcpy(out, e->out, result * sizeof(*out));
+        *raw = e->raw ? strdup(e->raw) : NULL;
+        e->used_at = now;
+        break;
+    }
+    pthread_mutex_unlock(&cache.lock);
+    return result;
+}
+
+// Keep a complete answer; replaces an older one for the same prompt, else
+// the least recently used of the probed slots
+static void cache_store(const char *prompt, const struct ollama_suggestion *out, int count, const char *raw) {
+    uint64_t h = hash_prompt(prompt);
+    double now = now_ms();
+    struct cache_entry *victim = NULL;
+
+    pthread_mutex_lock(&cache.lock);
+    check_generation();
+    for (int i = 0; i < CACHE_PROBE; i++) {
+        struct cache_entry *e = &cache.slots[(h + i) & (CACHE_SLOTS - 1)];
+        if (e->prompt && e->hash == h && strcmp(e->prompt, prompt) == 0) {
+            victim = e;
+            break;
+        }
+        if (!victim || (victim->prompt && (!e->prompt || e->used_at < victim->used_at))) {
+            victim = e;
+        }
+    }
+    if (victim->prompt) {
+        free_entry(victim);
+    }
+    victim->hash = h;
+    victim->prompt = strdup(prompt);
+    victim->count = count;
+    memcpy(victim->out, out, count * sizeof(*out));
+    victim->raw = raw ? strdup(raw) : NULL;
+    victim->stored_at = now;
+    victim->used_at = now;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+static void count_request(int hit) {
+    pthread_mutex_lock(&counters.lock);
+    counters.requests++;
+    if (hit) {
+        counters.cache_hits++;
+    }
+    pthread_mutex_unlock(&counters.lock);
+}
+
+static void reply_error(int fd, struct rp_msg *msg, const char *text) {
+    rp_reset(msg);
+    rp_put_str(msg, text, strlen(text));
+    rp_send(fd, RP_ERROR, msg);
+}
+
+// Per connection: the prompt of the last request, so a repeated TAB skips
+// the cache and reaches the large model the way it would in-process
+struct session {
+    int fd;
+    char last_prompt[RIPPLE_RL_BUFSIZE];
+    double last_time;
+};
+
+static int handle_suggest(struct session *s, struct rp_msg *msg) {
+    struct ollama_suggestion out[RIPPLE_MAX_SUGGESTIONS];
+    char prompt[RIPPLE_RL_BUFSIZE];
+    char *raw = NULL;
+    int flags = 0;
+
+    int max = rp_get_u8(msg);
+    rp_get_str(msg, prompt, sizeof(prompt));
+    if (msg->error) {
+        reply_error(s->fd, msg, "malformed request");
+        return -1;
+    }
+    if (max > RIPPLE_MAX_SUGGESTIONS) {
+        max = RIPPLE_MAX_SUGGESTIONS;
+    }
+
+    double now = now_ms();
+    int repeated = strcmp(prompt, s->last_prompt) == 0 && now - s->last_time < REPEAT_MS;
+    snprintf(s->last_prompt, sizeof(s->last_prompt), "%s", prompt);
+    s->last_time = now;
+
+    int result = repeated ? -1 : cache_lookup(prompt, out, max, &raw);
+    if (result >= 0) {
+        flags |= RP_FLAG_CACHED;
+    } else {
+        result = get_ollama_suggestions(prompt, out, max, &raw);
+        // Cut-off and failed answers are worth asking for again
+        if (result > 0 && !(raw && strstr(raw, OLLAMA_PARTIAL_NOTE + 1))) {
+            cache_store(prompt, out, result, raw);
+        }
+    }
+    count_request(flags & RP_FLAG_CACHED);
+
+    rp_reset(msg);
+    rp_put_suggestions(msg, result, flags, out, result, raw);
+    free(raw);
+    return rp_send(s->fd, RP_SUGGEST_REPLY, msg);
+}
+
+static int handle_stats(struct session *s, struct rp_msg *msg) {
+    struct ollama_gate_stats gs;
+    char *text = NULL;
+    size_t len = 0;
+
+    FILE *out = open_memstream(&text, &len);
+    if (out) {
+        ollama_write_diagnostics(out);
+        fclose(out);
+    }
+    ollama_gate_get_stats(&gs);
+
+    rp_reset(msg);
+    pthread_mutex_lock(&counters.lock);
+    rp_put_u32(msg, counters.sessions);
+    rp_put_u32(msg, counters.requests);
+    rp_put_u32(msg, counters.cache_hits);
+    pthread_mutex_unlock(&counters.lock);
+    rp_put_u32(msg, gs.coalesced);
+    rp_put_u32(msg, gs.admitted);
+    rp_put_str(msg, text ? text : "", text ? len : 0);
+    free(text);
+    return rp_send(s->fd, RP_STATS_REPLY, msg);
+}
+
+static void *session_thread(void *arg) {
+    struct session *s = arg;
+    struct rp_msg *msg = malloc(sizeof(*msg));
+    int type;
+
+    pthread_mutex_lock(&counters.lock);
+    counters.sessions++;
+    pthread_mutex_unlock(&counters.lock);
+
+    while (msg && rp_recv(s->fd, &type, msg, -1) == 0) {
+        int rc = 0;
+        switch (type) {
+            case RP_PING:
+                rp_reset(msg);
+                rc = rp_send(s->fd, RP_PONG, msg);
+                break;
+            case RP_SUGGEST:
+                rc = handle_suggest(s, msg);
+                break;
+            case RP_STATS:
+                rc = handle_stats(s, msg);
+                break;
+            default:
+                reply_error(s->fd, msg, "unknown request");
+                break;
+        }
+        if (rc != 0) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&counters.lock);
+    counters.sessions--;
+    pthread_mutex_unlock(&counters.lock);
+    close(s->fd);
+    free(msg);
+    free(s);
+    return NULL;
+}
+
+static time_t file_mtime(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_mtime : 0;
+}
+
+// Pick up a rebuilt index or an edited config without a restart
+static void *reload_thread(void *arg) {
+    char index_path[1024], config_path[1024];
+    snprintf(index_path, sizeof(index_path), "%s", ripple_index_path());
+    snprintf(config_path, sizeof(config_path), "%s", ollama_config_path());
+    time_t index_mtime = file_mtime(index_path), config_mtime = file_mtime(config_path);
+
+    while (!stopping) {
+        usleep(RELOAD_CHECK_MS * 1000);
+        time_t m = file_mtime(config_path);
+        if (m != config_mtime) {
+            config_mtime = m;
+            ollama_config_load(config_path);
+            if (!quiet) {
+                printf("ripple-daemon: reloaded %s\n", config_path);
+                fflush(stdout);
+            }
+        }
+        m = file_mtime(index_path);
+        if (m != index_mtime) {
+            index_mtime = m;
+            ripple_index_open(index_path);
+            cache_flush();
+            if (!quiet) {
+                printf("ripple-daemon: reloaded %s (%zu entries)\n", index_path, ripple_index_count());
+                fflush(stdout);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void handle_stop(int sig) {
+    stopping = 1;
+}
+
+// Bind the socket, refusing to start twice. A socket file nobody answers on
+// is left over from a crash and is replaced, but only if it is ours.
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ripple-daemon: socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("ripple-daemon: socket");
+        return -1;
+    }
+    if (lstat(path, &st) == 0) {
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            fprintf(stderr, "ripple-daemon: already running on %s\n", path);
+            close(fd);
+            return -1;
+        }
+        if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+            fprintf(stderr, "ripple-daemon: %s exists and is not our socket\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+        close(fd);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    }
+
+    mode_t old_mask = umask(077); // nobody else may connect
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("ripple-daemon: bind");
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int opt;
+
+    snprintf(path, sizeof(path), "%s", ripple_daemon_socket_path());
+    while ((opt = getopt(argc, argv, "s:q")) != -1) {
+        switch (opt) {
+            case 's': snprintf(path, sizeof(path), "%s", optarg); break;
+            case 'q': quiet = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s socket] [-q]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop; // no SA_RESTART, so poll() returns
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int server = listen_on(path);
+    if (server < 0) {
+        return 1;
+    }
+
+    ollama_config_load(NULL);
+    ripple_index_open(ripple_index_path());
+    ollama_warmup_async();
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, reload_thread, NULL) == 0) {
+        pthread_detach(tid);
+    }
+    if (!quiet) {
+        printf("ripple-daemon listening on %s\n", path);
+        fflush(stdout);
+    }
+
+    while (!stopping) {
+        struct pollfd pfd = { server, POLLIN, 0 };
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        struct session *s = calloc(1, sizeof(*s));
+        if (!s) {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        if (pthread_create(&tid, NULL, session_thread, s) == 0) {
+            pthread_detach(tid);
+        } else {
+            close(fd);
+            free(s);
+        }
+    }
+
+    unlink(path);
+    close(server);
+    if (!quiet) {
+        pthread_mutex_lock(&counters.lock);
+        printf("ripple-daemon: %lu requests, %lu answered from the cache\n",
+               counters.requests, counters.cache_hits);
+        pthread_mutex_unlock(&counters.lock);
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include "ripple_dirs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+// On-disk layout: a 64-byte header, then RIPPLE_DIRS_CAPACITY fixed 256-byte
+// entries. The whole file is mapped shared and updated in place under an
+// flock, so a visit costs one scan of the table and no I/O calls.
+#define DIRS_MAGIC "RPLDIR1"
+#define DIRS_MAX_AGE 9000.0   // total rank at which all ranks are aged
+#define DIRS_AGE_FACTOR 0.99
+#define MAX_TERMS 8
+
+struct dirs_header {
+    char magic[8];
+    uint32_t count;
+    uint32_t capacity;
+    double total_rank;
+    char reserved[40];
+};
+
+struct dirs_entry {
+    char path[240];
+    float rank;
+    uint32_t visits;
+    int64_t last;             // time of the last visit
+};
+
+static struct {
+    void *map;
+    size_t size;
+    int fd;                   // -1 for a private in-memory table
+    struct dirs_header *header;
+    struct dirs_entry *entries;
+} dirs = { .fd = -1 };
+
+const char *ripple_dirs_path(void) {
+    static char path[1024];
+    const char *home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", home ? home : ".", RIPPLE_DIRS_FILE);
+    return path;
+}
+
+void ripple_dirs_close(void) {
+    if (dirs.map) {
+        munmap(dirs.map, dirs.size);
+    }
+    if (dirs.fd >= 0) {
+        close(dirs.fd);
+    }
+    memset(&dirs, 0, sizeof(dirs));
+    dirs.fd = -1;
+}
+
+static void init_header(struct dirs_header *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, DIRS_MAGIC, 8);
+    h->capacity = RIPPLE_DIRS_CAPACITY;
+}
+
+// Map the database, creating it if needed. If the file can't be used the
+// table lives in memory for this session; returns -1 in that case.
+int ripple_dirs_open(const char *path) {
+    size_t size = sizeof(struct dirs_header) + sizeof(struct dirs_entry) * RIPPLE_DIRS_CAPACITY;
+    struct stat st;
+    int result = 0;
+
+    ripple_dirs_close();
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    void *map = MAP_FAILED;
+    if (fd >= 0 && flock(fd, LOCK_EX) == 0) {
+        if (fstat(fd, &st) == 0 && ((size_t)st.st_size == size || ftruncate(fd, size) == 0)) {
+            map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (map != MAP_FAILED) {
+            struct dirs_header *h = map;
+            if ((size_t)st.st_size != size || memcmp(h->magic, DIRS_MAGIC, 8) != 0 ||
+                h->capacity != RIPPLE_DIRS_CAPACITY || h->count > h->capacity) {
+                if (st.st_size != 0) {
+                    fprintf(stderr, "ripple: %s: not a valid directory database, starting over\n", path);
+                }
+                memset(map, 0, size);
+                init_header(h);
+            }
+        }
+        flock(fd, LOCK_UN);
+    }
+    if (map == MAP_FAILED) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            return -1;
+        }
+        init_header(map);
+        result = -1;
+    }
+
+    dirs.map = map;
+    dirs.size = size;
+    dirs.fd = fd;
+    dirs.header = map;
+    dirs.entries = (struct dirs_entry *)((char *)map + sizeof(struct dirs_header));
+    return result;
+}
+
+unsigned ripple_dirs_count(void) {
+    return dirs.header ? dirs.header->count : 0;
+}
+
+// Rank weighted by recency, as z does it
+static double frecency(const struct dirs_entry *e, time_t now) {
+    double age = difftime(now, (time_t)e->last);
+    if (age < 3600) {
+        return e->rank * 4;
+    } else if (age < 86400) {
+        return e->rank * 2;
+    } else if (age < 604800) {
+        return e->rank / 2;
+    }
+    return e->rank / 4;
+}
+
+// Scale every rank down and forget directories that fall below one visit
+static void age_entries(void) {
+    struct dirs_header *h = dirs.header;
+    uint32_t kept = 0;
+
+    h->total_rank = 0;
+    for (uint32_t i = 0; i < h->count; i++) {
+        struct dirs_entry *e = &dirs.entries[i];
+        e->rank *= DIRS_AGE_FACTOR;
+        if (e->rank >= 1) {
+            h->total_rank += e->rank;
+            if (kept != i) {
+                dirs.entries[kept] = *e;
+            }
+            kept++;
+        }
+    }
+    memset(&dirs.entries[kept], 0, sizeof(struct dirs_entry) * (h->count - kept));
+    h->count = kept;
+}
+
+void ripple_dirs_visit(const char *dir) {
+    size_t len = strlen(dir);
+    time_t now = time(NULL);
+
+    if (!dirs.header || len == 0 || len >= sizeof(dirs.entries[0].path)) {
+        return;
+    }
+    if (dirs.fd >= 0) {
+        flock(dirs.fd, LOCK_EX);
+    }
+
+    struct dirs_header *h = dirs.header;
+    struct dirs_entry *e = NULL;
+    for (uint32_t i = 0; i < h->count; i++) {
+        if (strcmp(dirs.entries[i].path, dir) == 0) {
+            e = &dirs.entries[i];
+            break;
+        }
+    }
+    if (!e) {
+        if (h->count < h->capacity) {
+            e = &dirs.entries[h->count++];
+        } else {
+            // Full: the least frecent directory makes room
+            e = &dirs.entries[0];
+            for (uint32_t i = 1; i < h->count; i++) {
+                if (frecency(&dirs.entries[i], now) < frecency(e, now)) {
+                    e = &dirs.entries[i];
+                }
+            }
+            h->total_rank -= e->rank;
+        }
+        memset(e, 0, sizeof(*e));
+        memcpy(e->path, dir, len + 1);
+    }
+    e->rank += 1;
+    e->visits++;
+    e->last = now;
+    h->total_rank += 1;
+    if (h->total_rank > DIRS_MAX_AGE) {
+        age_entries();
+    }
+
+    if (dirs.fd >= 0) {
+        flock(dirs.fd, LOCK_UN);
+    }
+}
+
+static const char *find_term(const char *haystack, const char *term, int fold) {
+    if (!fold) {
+        return strstr(haystack, term);
+    }
+    for (; *haystack; haystack++) {
+        size_t i = 0;
+        while (term[i] && tolower((unsigned char)haystack[i]) == tolower((unsigned char)term[i])) {
+            i++;
+        }
+        if (term[i] == '\0') {
+            return haystack;
+        }
+    }
+    return NULL;
+}
+
+// Every term must appear in order, and the last one must end in the last
+// path segment: "src rip" matches ~/src/ripple but not ~/src/ripple/docs.
+static int matches(const char *path, char **terms, int num_terms, int fold) {
+    const char *p = path;
+    for (int i = 0; i < num_terms; i++) {
+        const char *hit = find_term(p, terms[i], fold);
+        if (!hit) {
+            return 0;
+        }
+        p = hit + strlen(terms[i]);
+    }
+    return num_terms == 0 || strchr(p, '/') == NULL;
+}
+
+static int collect(char **terms, int num_terms, int fold, const char *exclude,
+                   struct ripple_dir *out, int max, time_t now) {
+    int found = 0;
+    struct stat st;
+
+    for (uint32_t i = 0; i < dirs.header->count; i++) {
+        const struct dirs_entry *e = &dirs.entries[i];
+        if (!matches(e->path, terms, num_terms, fold) || (exclude && strcmp(e->path, exclude) == 0)) {
+            continue;
+        }
+        double score = frecency(e, now);
+        if (found == max && score <= out[max - 1].score) {
+            continue;
+        }
+        // Only directories that would be listed pay for a stat
+        if (stat(e->path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        int j = found < max ? found++ : max - 1;
+        while (j > 0 && out[j - 1].score < score) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        memcpy(out[j].path, e->path, sizeof(out[j].path));
+        out[j].score = score;
+        out[j].visits = e->visits;
+    }
+    return found;
+}
+
+// Directories matching the space-separated terms in query, best first. An
+// empty query lists the most frecent ones. Matching is case-sensitive
+// unless that finds nothing. exclude (optional) is left out, usually the
+// current directory.
+int ripple_dirs_query(const char *query, const char *exclude, struct ripple_dir *out, int max) {
+    char buf[512];
+    char *terms[MAX_TERMS];
+    int num_terms = 0;
+    char *save = NULL;
+    time_t now = time(NULL);
+
+    if (!dirs.header || max <= 0) {
+        return 0;
+    }
+    snprintf(buf, sizeof(buf), "%s", query ? query : "");
+    for (char *t = strtok_r(buf, " \t", &save); t && num_terms < MAX_TERMS; t = strtok_r(NULL, " \t", &save)) {
+        terms[num_terms++] = t;
+    }
+
+    if (dirs.fd >= 0) {
+        flock(dirs.fd, LOCK_SH);
+    }
+    int found = collect(terms, num_terms, 0, exclude, out, max, now);
+    if (found == 0 && num_terms > 0) {
+        found = collect(terms, num_terms, 1, exclude, out, max, now);
+    }
+    if (dirs.fd >= 0) {
+        flock(dirs.fd, LOCK_UN);
+    }
+    return found;
+}
@@ -0,0 +1,27 @@
+#ifndef RIPPLE_DIRS_H
+#define RIPPLE_DIRS_H
+
+// Frecency database of visited directories, z-style: every successful cd
+// bumps a directory's rank, and ranks are weighted by how recently it was
+// visited. The file is a fixed-size table mmap'd shared, so other shells
+// see updates at once.
+
+struct ripple_dir {
+    char path[240];
+    double score;         // frecency: rank weighted by time since last visit
+    unsigned visits;
+};
+
+// Function declarations
+int ripple_dirs_open(const char* path);
+void ripple_dirs_close(void);
+void ripple_dirs_visit(const char* dir);
+int ripple_dirs_query(const char* query, const char* exclude, struct ripple_dir* out, int max);
+const char* ripple_dirs_path(void);
+unsigned ripple_dirs_count(void);
+
+// Constants
+#define RIPPLE_DIRS_FILE ".ripple_dirs"
+#define RIPPLE_DIRS_CAPACITY 1024
+
+#endif // RIPPLE_DIRS_H
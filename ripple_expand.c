@@ -0,0 +1,467 @@
+#ifdef __linux__
+#define _GNU_SOURCE // For memfd_create
+#endif
+#include "ripple_expand.h"
+#include "ollama_integration.h"
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pwd.h>
+#include <ctype.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Exit status of the last command, used for $?
+int ripple_last_status = 0;
+
+// Growable string used while expanding a single token
+struct StrBuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+// Growable argument vector for the expanded result
+struct ArgVec {
+    char **argv;
+    int argc;
+    int cap;
+};
+
+// Builtins that change shell state must not run inside the shell for $(...)
+static const char *stateful_builtins[] = { "cd", "exit", "bg", NULL };
+
+static int sb_append(struct StrBuf *sb, const char *s, size_t n) {
+    if (sb->len + n + 1 > sb->cap) {
+        size_t cap = sb->cap ? sb->cap : 64;
+        while (cap < sb->len + n + 1) {
+            cap *= 2;
+        }
+        char *tmp = realloc(sb->data, cap);
+        if (!tmp) {
+            return -1;
+        }
+        sb->data = tmp;
+        sb->cap = cap;
+    }
+    memcpy(sb->data + sb->len, s, n);
+    sb->len += n;
+    sb->data[sb->len] = '\0';
+    return 0;
+}
+
+static int av_push(struct ArgVec *av, char *arg) {
+    if (av->argc + 1 >= av->cap) {
+        int cap = av->cap ? av->cap * 2 : RIPPLE_TOK_BUFSIZE;
+        char **tmp = realloc(av->argv, cap * sizeof(char *));
+        if (!tmp) {
+            return -1;
+        }
+        av->argv = tmp;
+        av->cap = cap;
+    }
+    av->argv[av->argc++] = arg;
+    av->argv[av->argc] = NULL;
+    return 0;
+}
+
+// Find the ')' that closes a "$(" starting at s (s points just past the '(')
+static const char *find_subst_end(const char *s) {
+    int depth = 1;
+    for (; *s; s++) {
+        if (s[0] == '$' && s[1] == '(') {
+            depth++;
+            s++;
+        } else if (*s == ')') {
+            if (--depth == 0) {
+                return s;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int is_stateful_builtin(const char *name) {
+    for (int i = 0; stateful_builtins[i] != NULL; i++) {
+        if (strcmp(name, stateful_builtins[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Read everything from fd into a freshly allocated buffer
+static char *read_all(int fd, size_t *out_len) {
+    struct StrBuf sb = { NULL, 0, 0 };
+    char chunk[4096];
+    ssize_t n;
+
+    if (sb_append(&sb, "", 0) != 0) {
+        return NULL;
+    }
+    while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (sb_append(&sb, chunk, (size_t)n) != 0) {
+            free(sb.data);
+            return NULL;
+        }
+    }
+    *out_len = sb.len;
+    return sb.data;
+}
+
+// Run a builtin in-process with fd 1 pointed at an in-memory file
+static char *capture_builtin(int index, char **argv, size_t *out_len) {
+    int memfd;
+    FILE *tmp = NULL;
+
+#ifdef __linux__
+    memfd = memfd_create("ripple-subst", MFD_CLOEXEC);
+#else
+    memfd = -1;
+#endif
+    if (memfd < 0) {
+        tmp = tmpfile();
+        if (!tmp) {
+            return NULL;
+        }
+        memfd = fileno(tmp);
+    }
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    if (saved < 0) {
+        if (tmp) fclose(tmp); else close(memfd);
+        return NULL;
+    }
+    dup2(memfd, STDOUT_FILENO);
+
+    // As for a command line: the builtin sets a failure status itself
+    ripple_last_status = 0;
+    (*builtin_func[index])(argv);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    char *out = NULL;
+    if (lseek(memfd, 0, SEEK_SET) == 0) {
+        out = read_all(memfd, out_len);
+    }
+    if (tmp) fclose(tmp); else close(memfd);
+    return out;
+}
+
+// Fork a child for external commands (and stateful builtins) and read its
+// stdout. With piped set argv holds the unexpanded tokens of a pipeline,
+// which the child runs as the shell would.
+static char *capture_child(int index, char **argv, int piped, size_t *out_len) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("ripple: pipe");
+        return NULL;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        if (piped) {
+            ripple_run_line(argv);
+            fflush(stdout);
+            _exit(ripple_last_status);
+        }
+        if (index >= 0) {
+            ripple_last_status = 0;
+            (*builtin_func[index])(argv);
+            fflush(stdout);
+            _exit(ripple_last_status);
+        }
+        execvp(argv[0], argv);
+        if (errno == ENOENT) {
+            fprintf(stderr, "ripple: command not found: %s\n", argv[0]);
+            _exit(127);
+        }
+        perror("ripple");
+        _exit(126);
+    } else if (pid < 0) {
+        perror("ripple: fork");
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+
+    close(fds[1]);
+    char *out = read_all(fds[0], out_len);
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    ripple_last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return out;
+}
+
+// Run a command line and return its stdout with trailing newlines removed.
+// Builtins run without forking; everything else goes through a pipe. A
+// pipeline runs whole in a child, split on its own "|" tokens before any
+// expansion as at the prompt.
+char *ripple_command_subst(const char *cmd, size_t *out_len) {
+    char *line = strdup(cmd);
+    if (!line) {
+        return NULL;
+    }
+    char **args = ripple_split_line(line);
+    if (!args) {
+        free(line);
+        return NULL;
+    }
+
+    int piped = 0;
+    for (int i = 0; args[i]; i++) {
+        piped |= strcmp(args[i], "|") == 0;
+    }
+
+    size_t len = 0;
+    char *out;
+    if (piped) {
+        out = capture_child(-1, args, 1, &len);
+        free(args);
+    } else {
+        char **expanded = ripple_expand_args(args);
+        free(args);
+        if (!expanded) {
+            free(line);
+            return NULL;
+        }
+        if (expanded[0] == NULL) {
+            out = strdup("");
+        } else {
+            int index = ripple_builtin_index(expanded[0]);
+            if (index >= 0 && !is_stateful_builtin(expanded[0])) {
+                out = capture_builtin(index, expanded, &len);
+            } else {
+                out = capture_child(index, expanded, 0, &len);
+            }
+        }
+        ripple_free_args(expanded);
+    }
+    free(line);
+
+    if (out) {
+        while (len > 0 && out[len - 1] == '\n') {
+            out[--len] = '\0';
+        }
+        if (out_len) {
+            *out_len = len;
+        }
+    }
+    return out;
+}
+
+// Expand a leading ~ or ~user in place of the token prefix; returns chars consumed
+static size_t expand_tilde(const char *tok, struct StrBuf *sb) {
+    size_t n = 1;
+    while (tok[n] && tok[n] != '/') {
+        n++;
+    }
+
+    const char *home = NULL;
+    if (n == 1) {
+        home = getenv("HOME");
+        if (!home) {
+            struct passwd *pw = getpwuid(getuid());
+            home = pw ? pw->pw_dir : NULL;
+        }
+    } else {
+        char user[256];
+        if (n - 1 < sizeof(user)) {
+            memcpy(user, tok + 1, n - 1);
+            user[n - 1] = '\0';
+            struct passwd *pw = getpwnam(user);
+            home = pw ? pw->pw_dir : NULL;
+        }
+    }
+
+    if (!home) {
+        return 0; // Leave unknown users untouched
+    }
+    sb_append(sb, home, strlen(home));
+    return n;
+}
+
+// Split an expanded value on whitespace into the argument vector.
+// The first field joins the word being built, the last one stays open.
+static int split_into(struct ArgVec *av, struct StrBuf *word, int *have_word,
+                      const char *val, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (isspace((unsigned char)val[i])) {
+            if (*have_word) {
+                if (av_push(av, word->data) != 0) {
+                    return -1;
+                }
+                word->data = NULL;
+                word->len = word->cap = 0;
+                *have_word = 0;
+            }
+            while (i < len && isspace((unsigned char)val[i])) {
+                i++;
+            }
+            continue;
+        }
+        size_t start = i;
+        while (i < len && !isspace((unsigned char)val[i])) {
+            i++;
+        }
+        if (sb_append(word, val + start, i - start) != 0) {
+            return -1;
+        }
+        *have_word = 1;
+    }
+    return 0;
+}
+
+// Expand one token into zero or more arguments
+static int expand_token(const char *tok, struct ArgVec *av) {
+    struct StrBuf word = { NULL, 0, 0 };
+    int have_word = 0;
+    const char *p = tok;
+
+    if (*p == '~') {
+        size_t used = expand_tilde(p, &word);
+        if (used > 0) {
+            p += used;
+            have_word = 1;
+        }
+    }
+
+    while (*p) {
+        if (p[0] == '\\' && p[1] == '$') {
+            sb_append(&word, "$", 1);
+            have_word = 1;
+            p += 2;
+        } else if (p[0] == '$' && p[1] == '(') {
+            const char *end = find_subst_end(p + 2);
+            if (!end) {
+                fprintf(stderr, "ripple: unterminated $( in '%s'\n", tok);
+                free(word.data);
+                return -1;
+            }
+            char *inner = strndup(p + 2, end - (p + 2));
+            size_t len = 0;
+            char *out = inner ? ripple_command_subst(inner, &len) : NULL;
+            free(inner);
+            if (out) {
+                split_into(av, &word, &have_word, out, len);
+                free(out);
+            }
+            p = end + 1;
+        } else if (p[0] == '$' && p[1] == '?') {
+            char num[16];
+            snprintf(num, sizeof(num), "%d", ripple_last_status);
+            sb_append(&word, num, strlen(num));
+            have_word = 1;
+            p += 2;
+        } else if (p[0] == '$' && p[1] == '$') {
+            char num[16];
+            snprintf(num, sizeof(num), "%d", (int)getpid());
+            sb_append(&word, num, strlen(num));
+            have_word = 1;
+            p += 2;
+        } else if (p[0] == '$' && (p[1] == '_' || isalpha((unsigned char)p[1]) || p[1] == '{')) {
+            const char *name = p + 1;
+            size_t n = 0;
+            int braced = (*name == '{');
+            if (braced) {
+                name++;
+            }
+            while (name[n] == '_' || isalnum((unsigned char)name[n])) {
+                n++;
+            }
+            if (braced && name[n] != '}') {
+                fprintf(stderr, "ripple: bad substitution in '%s'\n", tok);
+                free(word.data);
+                return -1;
+            }
+
+            char var[256];
+            const char *val = NULL;
+            if (n < sizeof(var)) {
+                memcpy(var, name, n);
+                var[n] = '\0';
+                val = getenv(var);
+            }
+            if (val) {
+                split_into(av, &word, &have_word, val, strlen(val));
+            }
+            p = name + n + (braced ? 1 : 0);
+        } else {
+            const char *start = p;
+            while (*p && *p != '$' && *p != '\\') {
+                p++;
+            }
+            if (p == start) {
+                p++; // Lone '$' or '\'
+            }
+            sb_append(&word, start, p - start);
+            have_word = 1;
+        }
+    }
+
+    if (have_word) {
+        if (!word.data) {
+            word.data = strdup("");
+        }
+        if (!word.data || av_push(av, word.data) != 0) {
+            free(word.data);
+            return -1;
+        }
+    } else {
+        free(word.data);
+    }
+    return 0;
+}
+
+// Expand $VAR, ${VAR}, $?, $$, ~ and $(...) in a tokenized command line.
+// Returns a NULL-terminated vector of allocated strings, or NULL on error.
+char **ripple_expand_args(char **args) {
+    struct ArgVec av = { NULL, 0, 0 };
+
+    if (av_push(&av, NULL) != 0) {
+        fprintf(stderr, "ripple: allocation error\n");
+        return NULL;
+    }
+    av.argc = 0;
+
+    for (int i = 0; args[i] != NULL; i++) {
+        if (expand_token(args[i], &av) != 0) {
+            ripple_free_args(av.argv);
+            return NULL;
+        }
+    }
+    return av.argv;
+}
+
+// Free a vector returned by ripple_expand_args
+void ripple_free_args(char **args) {
+    if (!args) {
+        return;
+    }
+    for (int i = 0; args[i] != NULL; i++) {
+        free(args[i]);
+    }
+    free(args);
+}
@@ -0,0 +1,14 @@
+#ifndef RIPPLE_EXPAND_H
+#define RIPPLE_EXPAND_H
+
+#include <stddef.h>
+
+// Function declarations
+char** ripple_expand_args(char** args);
+void ripple_free_args(char** args);
+char* ripple_command_subst(const char* cmd, size_t* out_len);
+
+// Shared with the shell core
+extern int ripple_last_status;
+
+#endif // RIPPLE_EXPAND_H
@@ -0,0 +1,781 @@
+#ifdef __linux__
+#define _GNU_SOURCE // For O_NOFOLLOW with O_DIRECTORY, utimensat
+#endif
+#include "ripple_fsops.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#define TOUCH_FLAGS (O_WRONLY | O_CREAT | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)
+
+enum { OP_UNLINK, OP_RMDIR, OP_MKDIR, OP_OPEN, OP_CLOSE };
+
+struct fs_op {
+    int type;
+    int dirfd;
+    char *path;                   // owned, for messages; the op uses name
+    const char *name;             // inside path, relative to dirfd
+    int arg;                      // mode for mkdir and open, fd for close
+    int *failed;                  // set when the op fails, for the caller
+    int result;                   // >= 0, or -errno
+};
+
+#ifdef HAVE_IO_URING
+struct uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    void *cq_map;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+};
+#endif
+
+// Used when io_uring is not: workers and the caller take ops by index
+struct fs_pool {
+    pthread_t threads[RIPPLE_FS_THREADS];
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t start;         // a batch is ready, or quit
+    pthread_cond_t done;          // a worker went idle
+    struct fs_op *ops;
+    int count;
+    uint64_t next;                // generation << 32 | next op to claim
+    int finished;
+    int active;                   // workers inside a batch
+    unsigned generation;
+    int quit;
+};
+
+// One command's worth of operations
+struct fs_batch {
+    const char *cmd;              // for messages
+    int force;                    // rm -f: missing files are not errors
+    int parents;                  // mkdir -p: existing directories are not errors
+    int serial;                   // every op runs on the calling thread, in order
+    struct ripple_fs_result *result;
+    struct fs_op ops[RIPPLE_FS_BATCH];
+    int count;
+#ifdef HAVE_IO_URING
+    struct uring ring;
+#endif
+    int use_ring;
+    struct fs_pool pool;
+};
+
+static const char *backend = "none";
+
+// Name of the backend the last command ran on
+const char *ripple_fs_backend(void) {
+    return backend;
+}
+
+static void run_op(struct fs_op *op) {
+    int rc;
+    switch (op->type) {
+        case OP_UNLINK: rc = unlinkat(op->dirfd, op->name, 0); break;
+        case OP_RMDIR: rc = unlinkat(op->dirfd, op->name, AT_REMOVEDIR); break;
+        case OP_MKDIR: rc = mkdirat(op->dirfd, op->name, op->arg); break;
+        case OP_OPEN: rc = openat(op->dirfd, op->name, TOUCH_FLAGS, op->arg); break;
+        default: rc = close(op->arg); break;
+    }
+    op->result = rc < 0 ? -errno : rc;
+}
+
+#ifdef HAVE_IO_URING
+static int ring_supports(int fd) {
+    static const int needed[] = { IORING_OP_UNLINKAT, IORING_OP_MKDIRAT, IORING_OP_OPENAT, IORING_OP_CLOSE };
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    int ok = probe && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        ok = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+static int uring_open(struct uring *r) {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, RIPPLE_FS_BATCH, &p);
+    if (r->fd < 0) {
+        return -1;
+    }
+    if (!ring_supports(r->fd) || p.sq_entries < RIPPLE_FS_BATCH) {
+        close(r->fd);
+        return -1;
+    }
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->sq_len = r->cq_len = r->sq_len > r->cq_len ? r->sq_len : r->cq_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        close(r->fd);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                         IORING_OFF_CQ_RING);
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        if (r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) {
+            munmap(r->cq_map, r->cq_len);
+        }
+        munmap(r->sq_map, r->sq_len);
+        close(r->fd);
+        return -1;
+    }
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_close(struct uring *r) {
+    munmap(r->sqes, r->sqes_len);
+    if (r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_len);
+    }
+    munmap(r->sq_map, r->sq_len);
+    close(r->fd);
+}
+
+// Submit every op at once and wait for all of them; the kernel runs the
+// blocking ones on its own worker threads
+static void uring_run(struct uring *r, struct fs_op *ops, int count) {
+    unsigned tail = *r->sq_tail, mask = *r->sq_mask;
+
+    for (int i = 0; i < count; i++) {
+        unsigned slot = (tail + i) & mask;
+        struct io_uring_sqe *sqe = &r->sqes[slot];
+        struct fs_op *op = &ops[i];
+
+        memset(sqe, 0, sizeof(*sqe));
+        op->result = INT_MIN;
+        sqe->user_data = (uint64_t)i;
+        sqe->fd = op->dirfd;
+        sqe->addr = (uint64_t)(uintptr_t)op->name;
+        switch (op->type) {
+            case OP_UNLINK: sqe->opcode = IORING_OP_UNLINKAT; break;
+            case OP_RMDIR:
+                sqe->opcode = IORING_OP_UNLINKAT;
+                sqe->unlink_flags = AT_REMOVEDIR;
+                break;
+            case OP_MKDIR:
+                sqe->opcode = IORING_OP_MKDIRAT;
+                sqe->len = op->arg;
+                break;
+            case OP_OPEN:
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->len = op->arg;
+                sqe->open_flags = TOUCH_FLAGS;
+                break;
+            default:
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->fd = op->arg;
+                sqe->addr = 0;
+                break;
+        }
+        r->sq_array[slot] = slot;
+    }
+    __atomic_store_n(r->sq_tail, tail + count, __ATOMIC_RELEASE);
+
+    // pending: entries still in the submission ring, not yet taken by the kernel
+    int pending = count, completed = 0;
+    while (completed < count) {
+        int rc = (int)syscall(__NR_io_uring_enter, r->fd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        pending = count - (int)(__atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) - tail);
+        if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            if (pending > 0) {
+                // Take back what the kernel never saw, so a later enter cannot
+                // submit it again, and run it here instead
+                __atomic_store_n(r->sq_tail, tail + count - pending, __ATOMIC_RELEASE);
+                for (int i = count - pending; i < count; i++) {
+                    run_op(&ops[i]);
+                }
+                completed += pending;
+                pending = 0;
+            } else {
+                // Ops in flight still read their paths; nothing is freed
+                // until every one of them has completed
+                usleep(1000);
+            }
+        }
+
+        unsigned head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            ops[cqe->user_data].result = cqe->res;
+            head++;
+            completed++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+#endif
+
+// Claims carry the generation they were made for, so a worker that wakes
+// late for one batch can never take an op from the next
+static void pool_work(struct fs_pool *p, unsigned generation, struct fs_op *ops, int count) {
+    uint64_t cur = __atomic_load_n(&p->next, __ATOMIC_RELAXED);
+    for (;;) {
+        if ((unsigned)(cur >> 32) != generation || (int)(uint32_t)cur >= count) {
+            break;
+        }
+        if (!__atomic_compare_exchange_n(&p->next, &cur, cur + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        run_op(&ops[(uint32_t)cur]);
+        __atomic_add_fetch(&p->finished, 1, __ATOMIC_ACQ_REL);
+        cur++;
+    }
+}
+
+static void *pool_main(void *arg) {
+    struct fs_pool *p = arg;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->quit && p->generation == seen) {
+            pthread_cond_wait(&p->start, &p->lock);
+        }
+        if (p->quit) {
+            break;
+        }
+        seen = p->generation;
+        struct fs_op *ops = p->ops;
+        int count = p->count;
+        p->active++;
+        pthread_mutex_unlock(&p->lock);
+        pool_work(p, seen, ops, count);
+        pthread_mutex_lock(&p->lock);
+        p->active--;
+        pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void pool_run(struct fs_pool *p, struct fs_op *ops, int count) {
+    for (; p->started < RIPPLE_FS_THREADS; p->started++) {
+        if (pthread_create(&p->threads[p->started], NULL, pool_main, p) != 0) {
+            break;
+        }
+    }
+    pthread_mutex_lock(&p->lock);
+    p->ops = ops;
+    p->count = count;
+    p->finished = 0;
+    unsigned generation = ++p->generation;
+    __atomic_store_n(&p->next, (uint64_t)generation << 32, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+
+    pool_work(p, generation, ops, count);
+
+    // Nobody may still be reading this batch when the next one is set up
+    pthread_mutex_lock(&p->lock);
+    while (__atomic_load_n(&p->finished, __ATOMIC_ACQUIRE) < count || p->active > 0) {
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+// serial: run every op in order on the calling thread, with no ring or pool
+static void batch_open(struct fs_batch *b, const char *cmd, int serial, struct ripple_fs_result *result) {
+    memset(b, 0, sizeof(*b));
+    memset(result, 0, sizeof(*result));
+    b->cmd = cmd;
+    b->serial = serial;
+    b->result = result;
+    pthread_mutex_init(&b->pool.lock, NULL);
+    pthread_cond_init(&b->pool.start, NULL);
+    pthread_cond_init(&b->pool.done, NULL);
+#ifdef HAVE_IO_URING
+    const char *off = getenv("RIPPLE_NO_URING");
+    b->use_ring = !serial && !(off && *off) && uring_open(&b->ring) == 0;
+#endif
+    backend = serial ? "serial" : b->use_ring ? "io_uring" : "threads";
+}
+
+// Run what is queued; results are left in the ops
+static void batch_run(struct fs_batch *b) {
+#ifdef HAVE_IO_URING
+    if (b->use_ring) {
+        uring_run(&b->ring, b->ops, b->count);
+        return;
+    }
+#endif
+    if (b->serial || b->count <= RIPPLE_FS_INLINE) {
+        for (int i = 0; i < b->count; i++) {
+            run_op(&b->ops[i]);
+        }
+    } else {
+        pool_run(&b->pool, b->ops, b->count);
+    }
+}
+
+static int is_dir(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Run what is queued, report failures and count what was done
+static void batch_flush(struct fs_batch *b) {
+    batch_run(b);
+    for (int i = 0; i < b->count; i++) {
+        struct fs_op *op = &b->ops[i];
+        int err = op->result < 0 ? -op->result : 0;
+
+        if (err == ENOENT && b->force) {
+            err = 0;
+        } else if (err == EEXIST && op->type == OP_MKDIR && b->parents && is_dir(op->path)) {
+            err = 0;
+        } else if (err) {
+            fprintf(stderr, "ripple: %s: %s: %s\n", b->cmd, op->path, strerror(err));
+            b->result->errors++;
+            if (op->failed) {
+                *op->failed = 1;
+            }
+        } else if (op->type == OP_UNLINK) {
+            b->result->files++;
+        } else {
+            b->result->dirs++;
+        }
+        free(op->path);
+    }
+    b->count = 0;
+}
+
+static void batch_close(struct fs_batch *b) {
+    batch_flush(b);
+#ifdef HAVE_IO_URING
+    if (b->use_ring) {
+        uring_close(&b->ring);
+    }
+#endif
+    pthread_mutex_lock(&b->pool.lock);
+    b->pool.quit = 1;
+    pthread_cond_broadcast(&b->pool.start);
+    pthread_mutex_unlock(&b->pool.lock);
+    for (int i = 0; i < b->pool.started; i++) {
+        pthread_join(b->pool.threads[i], NULL);
+    }
+    pthread_mutex_destroy(&b->pool.lock);
+    pthread_cond_destroy(&b->pool.start);
+    pthread_cond_destroy(&b->pool.done);
+}
+
+// Queue an op on name inside dir_path (NULL: name is the whole path);
+// takes ownership of nothing, the path is copied
+static struct fs_op *batch_add(struct fs_batch *b, int type, int dirfd, const char *dir_path, const char *name,
+                               int *failed) {
+    if (b->count == RIPPLE_FS_BATCH) {
+        batch_flush(b);
+    }
+    size_t dir_len = dir_path ? strlen(dir_path) + 1 : 0;
+    char *path = malloc(dir_len + strlen(name) + 1);
+    if (!path) {
+        fprintf(stderr, "ripple: allocation error\n");
+        b->result->errors++;
+        return NULL;
+    }
+    if (dir_path) {
+        memcpy(path, dir_path, dir_len - 1);
+        path[dir_len - 1] = '/';
+    }
+    strcpy(path + dir_len, name);
+
+    struct fs_op *op = &b->ops[b->count++];
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    op->dirfd = dirfd;
+    op->path = path;
+    op->name = path + dir_len;
+    op->failed = failed;
+    return op;
+}
+
+struct entry {
+    char *name;
+    int is_dir;
+};
+
+// Everything in the directory, read before any of it is removed
+static struct entry *read_entries(int fd, int *count) {
+    int copy = dup(fd);
+    DIR *d = copy >= 0 ? fdopendir(copy) : NULL;
+    struct entry *entries = NULL;
+    struct dirent *e;
+    int cap = 0;
+
+    *count = 0;
+    if (!d) {
+        if (copy >= 0) {
+            close(copy);
+        }
+        return NULL;
+    }
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
+            continue;
+        }
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 64;
+            struct entry *grown = realloc(entries, cap * sizeof(*grown));
+            if (!grown) {
+                break;
+            }
+            entries = grown;
+        }
+        struct entry *entry = &entries[*count];
+        int is_dir;
+#ifdef DT_UNKNOWN
+        if (e->d_type != DT_UNKNOWN) {
+            is_dir = e->d_type == DT_DIR;
+        } else
+#endif
+        {
+            struct stat st;
+            is_dir = fstatat(fd, e->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        if ((entry->name = strdup(e->d_name)) != NULL) {
+            entry->is_dir = is_dir;
+            (*count)++;
+        }
+    }
+    closedir(d);
+    return entries;
+}
+
+// Remove the directory name in parent_fd and everything under it. Its
+// subdirectories go first, then its files, then, once they are
+// all gone, the directory itself is queued. A failure anywhere below marks
+// the parent as failed, so it is left in place without a second error.
+static void remove_tree(struct fs_batch *b, int parent_fd, const char *parent_path, const char *name,
+                        const char *path, dev_t dev, int *parent_failed) {
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    int failed = 0, count;
+
+    if (fd < 0) {
+        if (errno == ENOTDIR || errno == ELOOP) {
+            // Replaced by a file or symlink since it was read; remove that
+            batch_add(b, OP_UNLINK, parent_fd, parent_path, name, parent_failed);
+            return;
+        }
+        fprintf(stderr, "ripple: %s: %s: %s\n", b->cmd, path, strerror(errno));
+        b->result->errors++;
+        *parent_failed = 1;
+        return;
+    }
+    if (fstat(fd, &st) != 0 || st.st_dev != dev) {
+        // Like rm --one-file-system: a mount inside the tree is left alone
+        fprintf(stderr, "ripple: %s: skipping %s, it is on a different filesystem\n", b->cmd, path);
+        b->result->errors++;
+        *parent_failed = 1;
+        close(fd);
+        return;
+    }
+
+    struct entry *entries = read_entries(fd, &count);
+    for (int i = 0; i < count; i++) {
+        if (entries[i].is_dir) {
+            size_t len = strlen(path) + strlen(entries[i].name) + 2;
+            char *child = malloc(len);
+            if (child) {
+                snprintf(child, len, "%s/%s", path, entries[i].name);
+                remove_tree(b, fd, path, entries[i].name, child, dev, &failed);
+                free(child);
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (!entries[i].is_dir) {
+            batch_add(b, OP_UNLINK, fd, path, entries[i].name, &failed);
+        }
+        free(entries[i].name);
+    }
+    free(entries);
+
+    // The fd must outlive every op queued against it
+    batch_flush(b);
+    close(fd);
+    if (failed) {
+        *parent_failed = 1;
+    } else {
+        batch_add(b, OP_RMDIR, parent_fd, parent_path, name, parent_failed);
+    }
+}
+
+// Operands rm will not touch: . and .., the root and the home directory
+static const char *refuse_reason(const char *path) {
+    char resolved[PATH_MAX], home[PATH_MAX];
+    const char *end = path + strlen(path), *base;
+
+    while (end > path + 1 && end[-1] == '/') {
+        end--;
+    }
+    for (base = end; base > path && base[-1] != '/'; base--) {
+    }
+    if ((end - base == 1 && base[0] == '.') || (end - base == 2 && base[0] == '.' && base[1] == '.')) {
+        return "'.' and '..' are never removed";
+    }
+    if (realpath(path, resolved) == NULL) {
+        return NULL;
+    }
+    if (strcmp(resolved, "/") == 0) {
+        return "it is the root directory";
+    }
+    const char *env = getenv("HOME");
+    if (env && realpath(env, home) != NULL && strcmp(resolved, home) == 0) {
+        return "it is your home directory";
+    }
+    return NULL;
+}
+
+// rm: files, and with RIPPLE_RM_RECURSIVE whole directory trees. Returns
+// the number of errors, each already reported. Unlinks run in order on this
+// thread: entries of one directory serialize on its lock in the kernel, and
+// measured against rm -rf, handing them to the ring or the pool only added
+// overhead.
+int ripple_fs_remove(char **paths, int num_paths, int flags, struct ripple_fs_result *result) {
+    struct fs_batch *b = malloc(sizeof(*b));
+    if (!b) {
+        fprintf(stderr, "ripple: allocation error\n");
+        return 1;
+    }
+    batch_open(b, "rm", 1, result);
+    b->force = (flags & RIPPLE_RM_FORCE) != 0;
+
+    // A top-level rmdir can still be queued at batch_close, so the flag it
+    // points at lives until then; nothing reads it afterwards
+    int failed = 0;
+    for (int i = 0; i < num_paths; i++) {
+        const char *path = paths[i];
+        const char *reason = refuse_reason(path);
+        struct stat st;
+
+        if (reason) {
+            fprintf(stderr, "ripple: rm: refusing to remove %s: %s\n", path, reason);
+            result->errors++;
+        } else if (lstat(path, &st) != 0) {
+            if (!(errno == ENOENT && b->force)) {
+                fprintf(stderr, "ripple: rm: %s: %s\n", path, strerror(errno));
+                result->errors++;
+            }
+        } else if (!S_ISDIR(st.st_mode)) {
+            batch_add(b, OP_UNLINK, AT_FDCWD, NULL, path, NULL);
+        } else if (!(flags & RIPPLE_RM_RECURSIVE)) {
+            fprintf(stderr, "ripple: rm: %s: %s (use rm -r)\n", path, strerror(EISDIR));
+            result->errors++;
+        } else {
+            remove_tree(b, AT_FDCWD, NULL, path, path, st.st_dev, &failed);
+        }
+    }
+    batch_close(b);
+    free(b);
+    return (int)result->errors;
+}
+
+// Length of the first n components of path (with any leading slashes), or
+// 0 when it has fewer
+static size_t prefix_len(const char *path, int n) {
+    const char *p = path;
+    while (*p == '/') {
+        p++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (*p == '\0') {
+            return 0;
+        }
+        while (*p && *p != '/') {
+            p++;
+        }
+        if (i < n - 1) {
+            while (*p == '/') {
+                p++;
+            }
+        }
+    }
+    return (size_t)(p - path);
+}
+
+// Whether path names something below dir, going by the text
+static int is_inside(const char *path, const char *dir) {
+    size_t len = strlen(dir);
+    while (len > 1 && dir[len - 1] == '/') {
+        len--;
+    }
+    return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+// mkdir, with parents one level of all the paths at a time, so a batch
+// never holds a directory whose parent is still being made
+int ripple_fs_mkdir(char **paths, int num_paths, int parents, struct ripple_fs_result *result) {
+    struct fs_batch *b = malloc(sizeof(*b));
+    int *failed = calloc(num_paths > 0 ? num_paths : 1, sizeof(int));
+    int *owner = malloc(sizeof(int) * (num_paths > 0 ? num_paths : 1));
+    if (!b || !failed || !owner) {
+        fprintf(stderr, "ripple: allocation error\n");
+        free(b);
+        free(failed);
+        free(owner);
+        return 1;
+    }
+    batch_open(b, "mkdir", 0, result);
+    b->parents = parents;
+
+    if (!parents) {
+        for (int i = 0; i < num_paths; i++) {
+            // mkdir a a/b: a/b waits until a has been made
+            for (int j = 0; j < b->count; j++) {
+                if (is_inside(paths[i], b->ops[j].path)) {
+                    batch_flush(b);
+                    break;
+                }
+            }
+            struct fs_op *op = batch_add(b, OP_MKDIR, AT_FDCWD, NULL, paths[i], NULL);
+            if (op) {
+                op->arg = 0755;
+            }
+        }
+    }
+    for (int level = 1; parents; level++) {
+        char prefix[PATH_MAX], previous[PATH_MAX] = "";
+        int queued = 0, made_by = -1;
+
+        for (int i = 0; i < num_paths; i++) {
+            size_t len = prefix_len(paths[i], level);
+            owner[i] = -1;
+            if (failed[i] || len == 0 || len >= sizeof(prefix)) {
+                continue;
+            }
+            memcpy(prefix, paths[i], len);
+            prefix[len] = '\0';
+            queued++;
+            // Paths sharing a parent are usually next to each other
+            if (strcmp(prefix, previous) == 0) {
+                owner[i] = made_by;
+                continue;
+            }
+            strcpy(previous, prefix);
+            made_by = i;
+            struct fs_op *op = batch_add(b, OP_MKDIR, AT_FDCWD, NULL, prefix, &failed[i]);
+            if (op) {
+                op->arg = 0755;
+            }
+        }
+        batch_flush(b);
+        // A prefix that could not be made fails every path under it
+        for (int i = 0; i < num_paths; i++) {
+            if (owner[i] >= 0 && failed[owner[i]]) {
+                failed[i] = 1;
+            }
+        }
+        if (queued == 0) {
+            break;
+        }
+    }
+    batch_close(b);
+    free(b);
+    free(failed);
+    free(owner);
+    return (int)result->errors;
+}
+
+// touch: create missing files and set times to now, opening a batch of
+// files at once and closing them the same way
+int ripple_fs_touch(char **paths, int num_paths, struct ripple_fs_result *result) {
+    struct fs_batch *b = malloc(sizeof(*b));
+    if (!b) {
+        fprintf(stderr, "ripple: allocation error\n");
+        return 1;
+    }
+    batch_open(b, "touch", 0, result);
+
+    for (int start = 0; start < num_paths; start += RIPPLE_FS_BATCH) {
+        int end = start + RIPPLE_FS_BATCH < num_paths ? start + RIPPLE_FS_BATCH : num_paths;
+        int opened[RIPPLE_FS_BATCH], num_open = 0;
+
+        for (int i = start; i < end; i++) {
+            struct fs_op *op = batch_add(b, OP_OPEN, AT_FDCWD, NULL, paths[i], NULL);
+            if (op) {
+                op->arg = 0666;
+            }
+        }
+        batch_run(b);
+        for (int i = 0; i < b->count; i++) {
+            struct fs_op *op = &b->ops[i];
+            if (op->result >= 0) {
+                futimens(op->result, NULL);
+                opened[num_open++] = op->result;
+                result->files++;
+            } else if (utimensat(AT_FDCWD, op->path, NULL, 0) == 0) {
+                // A directory, or a file we may not write but own
+                result->files++;
+            } else {
+                fprintf(stderr, "ripple: touch: %s: %s\n", op->path, strerror(-op->result));
+                result->errors++;
+            }
+            free(op->path);
+        }
+        b->count = 0;
+
+        for (int i = 0; i < num_open; i++) {
+            struct fs_op *op = &b->ops[b->count++];
+            memset(op, 0, sizeof(*op));
+            op->type = OP_CLOSE;
+            op->arg = opened[i];
+            op->name = "";
+        }
+        batch_run(b);
+        b->count = 0;
+    }
+    batch_close(b);
+    free(b);
+    return (int)result->errors;
+}
@@ -0,0 +1,32 @@
+#ifndef RIPPLE_FSOPS_H
+#define RIPPLE_FSOPS_H
+
+// Bulk filesystem operations for rm, mkdir and touch. mkdir and touch
+// queue operations and run a batch at a time: submitted together through
+// io_uring on Linux kernels that support mkdirat/openat there, otherwise
+// spread over a small thread pool. rm runs in process and in order; rm -r
+// opens each directory once and removes its entries relative to that fd,
+// so a deep tree costs no path lookups from the root.
+
+struct ripple_fs_result {
+    long files;                   // removed or touched
+    long dirs;                    // removed or created
+    long errors;
+};
+
+// Flags for ripple_fs_remove
+#define RIPPLE_RM_RECURSIVE 1     // -r: directories and their contents
+#define RIPPLE_RM_FORCE 2         // -f: no error for missing operands
+
+// Function declarations
+int ripple_fs_remove(char** paths, int num_paths, int flags, struct ripple_fs_result* result);
+int ripple_fs_mkdir(char** paths, int num_paths, int parents, struct ripple_fs_result* result);
+int ripple_fs_touch(char** paths, int num_paths, struct ripple_fs_result* result);
+const char* ripple_fs_backend(void);
+
+// Constants
+#define RIPPLE_FS_BATCH 256       // operations in flight at once
+#define RIPPLE_FS_THREADS 8       // pool size when io_uring is unavailable
+#define RIPPLE_FS_INLINE 8        // batches this small run on the calling thread
+
+#endif // RIPPLE_FSOPS_H
@@ -0,0 +1,293 @@
+#include "ripple_ghost.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_NODES (1u << 22)   // stop growing the trie past this many nodes
+#define MAX_LINE 1024
+
+struct ghost_line {
+    char *text;
+    size_t len;
+    uint32_t count;
+    uint32_t seq;             // when it was last added
+};
+
+// Trie edge: (parent node, byte) -> child node, in an open-addressing table
+struct ghost_edge {
+    uint64_t key;             // 0 when empty
+    uint32_t child;
+};
+
+static struct {
+    struct ghost_line *lines;
+    size_t num_lines;
+    size_t lines_cap;
+    uint32_t *line_table;     // line id + 1, 0 when empty
+    size_t line_table_cap;
+    uint32_t *best;           // per node: best line id + 1, 0 for none
+    size_t num_nodes;
+    size_t nodes_cap;
+    struct ghost_edge *edges;
+    size_t num_edges;
+    size_t edges_cap;
+    uint32_t seq;
+} ghost;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint32_t hash_bytes(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint64_t edge_key(uint32_t parent, unsigned char byte) {
+    return ((uint64_t)parent << 8 | byte) | (1ULL << 63);
+}
+
+static int edges_grow(void) {
+    size_t cap = ghost.edges_cap ? ghost.edges_cap * 2 : 4096;
+    struct ghost_edge *edges = calloc(cap, sizeof(*edges));
+    if (!edges) {
+        return -1;
+    }
+    for (size_t i = 0; i < ghost.edges_cap; i++) {
+        if (ghost.edges[i].key) {
+            size_t slot = mix64(ghost.edges[i].key) & (cap - 1);
+            while (edges[slot].key) {
+                slot = (slot + 1) & (cap - 1);
+            }
+            edges[slot] = ghost.edges[i];
+        }
+    }
+    free(ghost.edges);
+    ghost.edges = edges;
+    ghost.edges_cap = cap;
+    return 0;
+}
+
+// Child of node for byte; 0 if there is none (the root is never a child)
+static uint32_t child_of(uint32_t node, unsigned char byte) {
+    if (!ghost.edges_cap) {
+        return 0;
+    }
+    uint64_t key = edge_key(node, byte);
+    size_t slot = mix64(key) & (ghost.edges_cap - 1);
+    while (ghost.edges[slot].key) {
+        if (ghost.edges[slot].key == key) {
+            return ghost.edges[slot].child;
+        }
+        slot = (slot + 1) & (ghost.edges_cap - 1);
+    }
+    return 0;
+}
+
+static uint32_t add_child(uint32_t node, unsigned char byte) {
+    if (ghost.num_nodes >= MAX_NODES) {
+        return 0;
+    }
+    if (ghost.num_nodes == ghost.nodes_cap) {
+        size_t cap = ghost.nodes_cap * 2;
+        uint32_t *best = realloc(ghost.best, cap * sizeof(uint32_t));
+        if (!best) {
+            return 0;
+        }
+        ghost.best = best;
+        ghost.nodes_cap = cap;
+    }
+    if ((ghost.num_edges + 1) * 2 > ghost.edges_cap && edges_grow() != 0) {
+        return 0;
+    }
+
+    uint32_t child = (uint32_t)ghost.num_nodes++;
+    ghost.best[child] = 0;
+    uint64_t key = edge_key(node, byte);
+    size_t slot = mix64(key) & (ghost.edges_cap - 1);
+    while (ghost.edges[slot].key) {
+        slot = (slot + 1) & (ghost.edges_cap - 1);
+    }
+    ghost.edges[slot].key = key;
+    ghost.edges[slot].child = child;
+    ghost.num_edges++;
+    return child;
+}
+
+static int line_table_grow(void) {
+    size_t cap = ghost.line_table_cap ? ghost.line_table_cap * 2 : 1024;
+    uint32_t *table = calloc(cap, sizeof(uint32_t));
+    if (!table) {
+        return -1;
+    }
+    for (size_t id = 0; id < ghost.num_lines; id++) {
+        size_t slot = hash_bytes(ghost.lines[id].text, ghost.lines[id].len) & (cap - 1);
+        while (table[slot]) {
+            slot = (slot + 1) & (cap - 1);
+        }
+        table[slot] = (uint32_t)id + 1;
+    }
+    free(ghost.line_table);
+    ghost.line_table = table;
+    ghost.line_table_cap = cap;
+    return 0;
+}
+
+// Id of a line, adding it if new; -1 on allocation failure
+static long line_id(const char *text, size_t len) {
+    if ((ghost.num_lines + 1) * 2 > ghost.line_table_cap && line_table_grow() != 0) {
+        return -1;
+    }
+    size_t slot = hash_bytes(text, len) & (ghost.line_table_cap - 1);
+    while (ghost.line_table[slot]) {
+        struct ghost_line *l = &ghost.lines[ghost.line_table[slot] - 1];
+        if (l->len == len && memcmp(l->text, text, len) == 0) {
+            return ghost.line_table[slot] - 1;
+        }
+        slot = (slot + 1) & (ghost.line_table_cap - 1);
+    }
+
+    if (ghost.num_lines == ghost.lines_cap) {
+        size_t cap = ghost.lines_cap ? ghost.lines_cap * 2 : 256;
+        struct ghost_line *lines = realloc(ghost.lines, cap * sizeof(*lines));
+        if (!lines) {
+            return -1;
+        }
+        ghost.lines = lines;
+        ghost.lines_cap = cap;
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        return -1;
+    }
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    struct ghost_line *l = &ghost.lines[ghost.num_lines];
+    l->text = copy;
+    l->len = len;
+    l->count = 0;
+    l->seq = 0;
+    ghost.line_table[slot] = (uint32_t)ghost.num_lines + 1;
+    return (long)ghost.num_lines++;
+}
+
+static int better(uint32_t a, uint32_t b) {
+    const struct ghost_line *x = &ghost.lines[a], *y = &ghost.lines[b];
+    return x->count > y->count || (x->count == y->count && x->seq > y->seq);
+}
+
+// Add a command line. Only its own score goes up, so only the nodes on its
+// path can change their best line.
+void ripple_ghost_add(const char *line) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        len--;
+    }
+    if (len == 0 || len > MAX_LINE) {
+        return;
+    }
+    if (!ghost.best) {
+        ghost.best = calloc(4096, sizeof(uint32_t));
+        if (!ghost.best) {
+            return;
+        }
+        ghost.nodes_cap = 4096;
+        ghost.num_nodes = 1; // root
+    }
+
+    long id = line_id(line, len);
+    if (id < 0) {
+        return;
+    }
+    ghost.lines[id].count++;
+    ghost.lines[id].seq = ++ghost.seq;
+
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t child = child_of(node, (unsigned char)line[i]);
+        if (!child && !(child = add_child(node, (unsigned char)line[i]))) {
+            return;
+        }
+        node = child;
+        if (ghost.best[node] == 0 || better((uint32_t)id, ghost.best[node] - 1)) {
+            ghost.best[node] = (uint32_t)id + 1;
+        }
+    }
+}
+
+// Best history line that extends prefix, or NULL
+const char *ripple_ghost_lookup(const char *prefix, size_t len) {
+    uint32_t node = 0;
+
+    if (len == 0 || !ghost.best) {
+        return NULL;
+    }
+    for (size_t i = 0; i < len; i++) {
+        node = child_of(node, (unsigned char)prefix[i]);
+        if (!node) {
+            return NULL;
+        }
+    }
+    if (ghost.best[node] == 0) {
+        return NULL;
+    }
+    const struct ghost_line *l = &ghost.lines[ghost.best[node] - 1];
+    return l->len > len ? l->text : NULL;
+}
+
+void ripple_ghost_reset(void) {
+    for (size_t i = 0; i < ghost.num_lines; i++) {
+        free(ghost.lines[i].text);
+    }
+    free(ghost.lines);
+    free(ghost.line_table);
+    free(ghost.best);
+    free(ghost.edges);
+    memset(&ghost, 0, sizeof(ghost));
+}
+
+void ripple_ghost_stats(size_t *lines, size_t *nodes) {
+    *lines = ghost.num_lines;
+    *nodes = ghost.num_nodes;
+}
+
+// Path of the history file: ~/.ripple_history
+const char *ripple_history_path(void) {
+    static char path[1024];
+    const char *home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", home ? home : ".", RIPPLE_HISTORY_FILE);
+    return path;
+}
+
+// Index every line of a history file; returns the number read or -1
+int ripple_ghost_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[MAX_LINE + 2];
+    int count = 0;
+
+    if (!file) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        ripple_ghost_add(line);
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+int ripple_history_append(const char *path, const char *line) {
+    FILE *file = fopen(path, "a");
+    if (!file) {
+        return -1;
+    }
+    fprintf(file, "%s\n", line);
+    return fclose(file);
+}
@@ -0,0 +1,22 @@
+#ifndef RIPPLE_GHOST_H
+#define RIPPLE_GHOST_H
+
+#include <stddef.h>
+
+// Prefix index over history for inline autosuggestions. Every trie node
+// remembers the best line passing through it (most used, then most
+// recent), so a lookup is one walk down the typed prefix.
+
+// Function declarations
+void ripple_ghost_add(const char* line);
+const char* ripple_ghost_lookup(const char* prefix, size_t len);
+void ripple_ghost_reset(void);
+int ripple_ghost_load(const char* path);
+int ripple_history_append(const char* path, const char* line);
+const char* ripple_history_path(void);
+void ripple_ghost_stats(size_t* lines, size_t* nodes);
+
+// Constants
+#define RIPPLE_HISTORY_FILE ".ripple_history"
+
+#endif // RIPPLE_GHOST_H
@@ -0,0 +1,737 @@
+#include "ripple_grep.h"
+#include "ripple_walk.h"
+#include "ripple_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <regex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// A string every match must contain. Its first and last bytes are what the
+// scan compares: (byte | mask) == value, so with -i one compare matches a
+// letter in either case.
+struct literal {
+    unsigned char *text;          // lowercased with -i
+    size_t len;
+    unsigned char first_value, first_mask;
+    unsigned char last_value, last_mask;
+};
+
+// What the workers share, read-only once the search starts
+struct matcher {
+    const char *pattern;
+    int cflags;                   // for each worker's own regex_t
+    int have_re;                  // 0: a literal hit is a match (-F)
+    int scan_re;                  // no literal: the regex searches whole buffers
+    int icase;
+    int invert;
+    struct literal lits[RIPPLE_GREP_MAX_LITERALS];
+    int num_lits;                 // 0: no prefilter, every line is a candidate
+    size_t max_len;
+    int use_memchr;               // one case-sensitive literal with an uncommon byte
+    size_t rare_offset;           // where that byte is in it
+    unsigned char first[256];     // bytes a literal can start with, for the scalar scan
+};
+
+struct out_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+struct grep_job {
+    char *path;
+    size_t path_len;
+    struct out_buf out;           // everything to print for the file
+    long matches;
+    int error;                    // errno from opening or reading it
+    int binary;
+    int done;                     // searched; set by the pool thread
+};
+
+// Scratch space of one pool thread
+struct worker {
+    struct grep_pool *pool;
+    regex_t re;                   // glibc serializes regexec calls on one regex_t
+    unsigned char *buf;           // small files are read here
+    size_t buf_cap;
+};
+
+struct grep_pool {
+    const struct ripple_grep_opts *opts;
+    struct matcher m;
+    int with_filename;
+    struct ripple_pool *threads;
+    struct worker *workers;       // one per pool thread
+    int num_workers;
+    // Ordered output, main thread only
+    struct grep_job **order;
+    size_t num_jobs;
+    size_t order_cap;
+    size_t next_out;
+    FILE *out;
+    long matches;
+};
+
+static void out_append(struct out_buf *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->len + len) {
+            cap *= 2;
+        }
+        char *grown = realloc(b->data, cap);
+        if (!grown) {
+            return;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+// n and then sep; snprintf would be most of the cost of a matching line
+static void out_append_long(struct out_buf *b, long n, char sep) {
+    char num[32], *p = num + sizeof(num);
+    unsigned long v = n < 0 ? -(unsigned long)n : (unsigned long)n;
+
+    *--p = sep;
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (n < 0) {
+        *--p = '-';
+    }
+    out_append(b, p, num + sizeof(num) - p);
+}
+
+// The most frequent bytes in C, headers and Python, most frequent first
+static const char common_bytes[] = " et_nsiroa\ncldSpfEu*T)(hmINOL,CRAP/kgyb0-xvD.;M#";
+
+// Position of the literal's least common byte and how common it is (its
+// place in common_bytes). A single literal with an uncommon byte is found
+// by memchr on that byte, which skips text far faster than testing each
+// offset; one made only of common bytes stops memchr too often.
+static size_t rarest_byte(const struct literal *lit, long *rank_out) {
+    size_t best = 0;
+    long best_rank = -1;
+    for (size_t i = 0; i < lit->len; i++) {
+        const char *common = lit->text[i] ? strchr(common_bytes, lit->text[i]) : NULL;
+        long rank = common ? common - common_bytes : (long)sizeof(common_bytes);
+        if (rank > best_rank) {
+            best = i;
+            best_rank = rank;
+        }
+    }
+    *rank_out = best_rank;
+    return best;
+}
+
+static void fold_byte(unsigned char c, int icase, unsigned char *value, unsigned char *mask) {
+    if (icase && isalpha(c)) {
+        *value = (unsigned char)tolower(c) | 0x20;
+        *mask = 0x20;
+    } else {
+        *value = c;
+        *mask = 0;
+    }
+}
+
+static void add_literal(struct matcher *m, const char *text, size_t len) {
+    struct literal *lit = &m->lits[m->num_lits];
+    if (!(lit->text = malloc(len))) {
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        lit->text[i] = m->icase ? (unsigned char)tolower((unsigned char)text[i]) : (unsigned char)text[i];
+    }
+    lit->len = len;
+    fold_byte(lit->text[0], m->icase, &lit->first_value, &lit->first_mask);
+    fold_byte(lit->text[len - 1], m->icase, &lit->last_value, &lit->last_mask);
+    m->first[lit->text[0]] = 1;
+    m->first[toupper(lit->text[0])] |= m->icase;
+    if (len > m->max_len) {
+        m->max_len = len;
+    }
+    m->num_lits++;
+
+    long rank;
+    m->rare_offset = rarest_byte(&m->lits[0], &rank);
+    m->use_memchr = m->num_lits == 1 && !m->icase && rank >= RIPPLE_GREP_COMMON_BYTES;
+}
+
+static void free_literals(struct matcher *m) {
+    for (int i = 0; i < m->num_lits; i++) {
+        free(m->lits[i].text);
+    }
+    m->num_lits = 0;
+    m->max_len = 0;
+    memset(m->first, 0, sizeof(m->first));
+}
+
+// Keep the longer of the current run and the best so far, then start over
+static void end_run(const char *run, size_t *run_len, char *best, size_t *best_len) {
+    if (*run_len > *best_len) {
+        memcpy(best, run, *run_len);
+        *best_len = *run_len;
+    }
+    *run_len = 0;
+}
+
+// The byte after a bracket expression starting at p
+static const char *skip_bracket(const char *p) {
+    p++;
+    if (*p == '^') {
+        p++;
+    }
+    if (*p == ']') {
+        p++;
+    }
+    while (*p && *p != ']') {
+        if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            char close = p[1];
+            for (p += 2; *p && !(*p == close && p[1] == ']'); p++) {
+            }
+            p += *p ? 2 : 0;
+        } else {
+            p++;
+        }
+    }
+    return *p ? p + 1 : p;
+}
+
+// For each top-level alternative of the pattern, the longest run of plain
+// characters any match of it must contain. Groups, classes and anything a
+// quantifier applies to are left out, so the runs are never wrong, only
+// sometimes shorter than they could be. Leaves no literals when some
+// alternative has none.
+static void extract_literals(struct matcher *m, const char *p, int extended) {
+    size_t cap = strlen(p) + 1;
+    char *run = malloc(cap), *best = malloc(cap);
+    size_t run_len = 0, best_len = 0;
+    int depth = 0, ok = run && best;
+
+    while (ok) {
+        char c = *p, next = c ? p[1] : '\0';
+        if (c == '\0' || (depth == 0 && (extended ? c == '|' : (c == '\\' && next == '|')))) {
+            end_run(run, &run_len, best, &best_len);
+            if (best_len == 0 || m->num_lits == RIPPLE_GREP_MAX_LITERALS) {
+                ok = 0;
+                break;
+            }
+            add_literal(m, best, best_len);
+            best_len = 0;
+            if (c == '\0') {
+                break;
+            }
+            p += extended ? 1 : 2;
+            continue;
+        }
+
+        int escaped = c == '\\';
+        char e = escaped ? next : c;
+        if (escaped && e == '\0') {
+            ok = 0;
+            break;
+        }
+        int open = extended ? (!escaped && c == '(') : (escaped && e == '(');
+        int close = extended ? (!escaped && c == ')') : (escaped && e == ')');
+        int quantifier = (!escaped && c == '*') ||
+                         (extended ? (!escaped && (c == '+' || c == '?' || c == '{'))
+                                   : (escaped && (e == '+' || e == '?' || e == '{')));
+        p += escaped ? 2 : 1;
+
+        if (open || close) {
+            end_run(run, &run_len, best, &best_len);
+            depth += open ? 1 : -1;
+            ok = depth >= 0;
+        } else if (!escaped && c == '[') {
+            end_run(run, &run_len, best, &best_len);
+            p = skip_bracket(p - 1);
+        } else if (depth > 0) {
+            continue;
+        } else if (quantifier) {
+            // The character before may be absent or repeated
+            if (run_len > 0) {
+                run_len--;
+            }
+            end_run(run, &run_len, best, &best_len);
+            if (e == '{') {
+                for (; *p && *p != '}'; p++) {
+                }
+                p += *p ? 1 : 0;
+            }
+        } else if ((!escaped && (c == '.' || c == '^' || c == '$')) ||
+                   (escaped && (isalnum((unsigned char)e) || strchr("<>`'", e)))) {
+            // Wildcards, anchors, backreferences and GNU escapes like \w
+            end_run(run, &run_len, best, &best_len);
+        } else {
+            run[run_len++] = e;
+        }
+    }
+    if (!ok) {
+        free_literals(m);
+    }
+    free(run);
+    free(best);
+}
+
+static int literal_at(const struct matcher *m, const unsigned char *p, const unsigned char *end) {
+    for (int k = 0; k < m->num_lits; k++) {
+        const struct literal *lit = &m->lits[k];
+        size_t i = 0;
+        if ((size_t)(end - p) < lit->len) {
+            continue;
+        }
+        if (!m->icase) {
+            if (memcmp(p, lit->text, lit->len) == 0) {
+                return 1;
+            }
+            continue;
+        }
+        while (i < lit->len && tolower(p[i]) == lit->text[i]) {
+            i++;
+        }
+        if (i == lit->len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Where the first literal occurs in [p, end), or NULL. One case-sensitive
+// literal is looked for by its rarest byte with memchr. Otherwise, with
+// SSE2, 16 positions at a time are tested against every literal's first
+// and last byte, and only positions passing both are compared in full.
+static const unsigned char *find_literal(const struct matcher *m, const unsigned char *p,
+                                         const unsigned char *end) {
+    if (m->use_memchr) {
+        const unsigned char *rare = p + m->rare_offset;
+        unsigned char byte = m->lits[0].text[m->rare_offset];
+        while (rare < end && (rare = memchr(rare, byte, end - rare)) != NULL) {
+            if (literal_at(m, rare - m->rare_offset, end)) {
+                return rare - m->rare_offset;
+            }
+            rare++;
+        }
+        return NULL;
+    }
+#ifdef __SSE2__
+    __m128i first_value[RIPPLE_GREP_MAX_LITERALS], first_mask[RIPPLE_GREP_MAX_LITERALS];
+    __m128i last_value[RIPPLE_GREP_MAX_LITERALS], last_mask[RIPPLE_GREP_MAX_LITERALS];
+
+    for (int k = 0; k < m->num_lits; k++) {
+        first_value[k] = _mm_set1_epi8((char)m->lits[k].first_value);
+        first_mask[k] = _mm_set1_epi8((char)m->lits[k].first_mask);
+        last_value[k] = _mm_set1_epi8((char)m->lits[k].last_value);
+        last_mask[k] = _mm_set1_epi8((char)m->lits[k].last_mask);
+    }
+    while ((size_t)(end - p) >= m->max_len + 15) {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        __m128i hits = _mm_setzero_si128();
+        for (int k = 0; k < m->num_lits; k++) {
+            __m128i tail = _mm_loadu_si128((const __m128i *)(p + m->lits[k].len - 1));
+            __m128i a = _mm_cmpeq_epi8(_mm_or_si128(block, first_mask[k]), first_value[k]);
+            __m128i b = _mm_cmpeq_epi8(_mm_or_si128(tail, last_mask[k]), last_value[k]);
+            hits = _mm_or_si128(hits, _mm_and_si128(a, b));
+        }
+        unsigned bits = (unsigned)_mm_movemask_epi8(hits);
+        while (bits) {
+            const unsigned char *candidate = p + __builtin_ctz(bits);
+            if (literal_at(m, candidate, end)) {
+                return candidate;
+            }
+            bits &= bits - 1;
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if (m->first[*p] && literal_at(m, p, end)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int line_matches(const struct matcher *m, regex_t *re, const unsigned char *line, size_t len) {
+    if (!m->have_re) {
+        return m->num_lits == 0 || find_literal(m, line, line + len) != NULL;
+    }
+#ifdef REG_STARTEND
+    regmatch_t range;
+    range.rm_so = 0;
+    range.rm_eo = (regoff_t)len;
+    return regexec(re, (const char *)line, 1, &range, REG_STARTEND) == 0;
+#else
+    static __thread char *copy;
+    static __thread size_t copy_cap;
+    if (len + 1 > copy_cap) {
+        char *grown = realloc(copy, len + 1);
+        if (!grown) {
+            return 0;
+        }
+        copy = grown;
+        copy_cap = len + 1;
+    }
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    return regexec(re, copy, 0, NULL, 0) == 0;
+#endif
+}
+
+// Start of the first match in [p, end), or NULL; one call covers many
+// lines, where line_matches would cost one per line
+static const unsigned char *find_regex(regex_t *re, const unsigned char *p, const unsigned char *end) {
+#ifdef REG_STARTEND
+    regmatch_t match;
+    match.rm_so = 0;
+    match.rm_eo = (regoff_t)(end - p);
+    return regexec(re, (const char *)p, 1, &match, REG_STARTEND) == 0 ? p + match.rm_so : NULL;
+#else
+    (void)re;
+    (void)end;
+    return p;
+#endif
+}
+
+static long count_newlines(const unsigned char *p, const unsigned char *end) {
+    long n = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        n += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+    }
+#endif
+    for (; p < end; p++) {
+        n += *p == '\n';
+    }
+    return n;
+}
+
+// Search one file's contents. Without -v, the scan jumps from one literal
+// (or regex) hit to the next and only the lines around them are looked at.
+static void scan_buffer(struct worker *w, struct grep_job *job, const unsigned char *buf, size_t size) {
+    const struct grep_pool *pool = w->pool;
+    const struct matcher *m = &pool->m;
+    const struct ripple_grep_opts *opts = pool->opts;
+    const unsigned char *p = buf, *end = buf + size, *counted = buf;
+    int quiet = job->binary || opts->count_only || opts->files_only;
+    int prefilter = m->num_lits > 0 && !m->invert;
+    long lineno = 1;
+
+    while (p < end) {
+        const unsigned char *line = p, *from = p;
+        int match = -1;
+        if (prefilter) {
+            if ((from = find_literal(m, p, end)) == NULL) {
+                break;
+            }
+            match = m->have_re ? -1 : 1;
+        } else if (m->scan_re) {
+            if ((from = find_regex(&w->re, p, end)) == NULL) {
+                break;
+            }
+            match = 1;
+        }
+        for (line = from; line > p && line[-1] != '\n'; line--) {
+        }
+        const unsigned char *eol = memchr(from, '\n', end - from);
+        if (!eol) {
+            eol = end;
+        }
+        if (match < 0) {
+            match = line_matches(m, &w->re, line, eol - line);
+        }
+        if (match != m->invert) {
+            job->matches++;
+            if (opts->files_only) {
+                break;
+            }
+            if (!quiet) {
+                if (pool->with_filename) {
+                    out_append(&job->out, job->path, job->path_len);
+                    out_append(&job->out, ":", 1);
+                }
+                if (opts->line_numbers) {
+                    lineno += count_newlines(counted, line);
+                    counted = line;
+                    out_append_long(&job->out, lineno, ':');
+                }
+                out_append(&job->out, line, eol - line);
+                out_append(&job->out, "\n", 1);
+            }
+        }
+        p = eol < end ? eol + 1 : end;
+    }
+}
+
+// Read into buf from offset got up to want bytes; what it has then, or -1
+static ssize_t read_range(int fd, unsigned char *buf, size_t got, size_t want) {
+    while (got < want) {
+        ssize_t n = read(fd, buf + got, want - got);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += n;
+    }
+    return (ssize_t)got;
+}
+
+static void search_file(struct worker *w, struct grep_job *job) {
+    int fd = open(job->path, O_RDONLY);
+    struct stat st;
+    void *map = NULL;
+    const unsigned char *buf = NULL;
+    size_t size = 0;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        job->error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        job->error = EISDIR;
+    } else if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size = (size_t)st.st_size;
+        if (size >= RIPPLE_GREP_MMAP_MIN &&
+            (map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(map, size, MADV_SEQUENTIAL);
+#endif
+            buf = map;
+        } else {
+            map = NULL;
+            if (size > w->buf_cap) {
+                unsigned char *grown = realloc(w->buf, size);
+                if (grown) {
+                    w->buf = grown;
+                    w->buf_cap = size;
+                }
+            }
+            // With -I, a binary file is given up on after its first block
+            size_t want = size < w->buf_cap ? size : w->buf_cap;
+            size_t first = w->pool->opts->skip_binary && want > RIPPLE_GREP_BINARY_PROBE ? RIPPLE_GREP_BINARY_PROBE : want;
+            ssize_t got = read_range(fd, w->buf, 0, first);
+            if (got == (ssize_t)first && first < want && !memchr(w->buf, '\0', first)) {
+                got = read_range(fd, w->buf, first, want);
+            }
+            if (got < 0) {
+                job->error = errno;
+            }
+            buf = w->buf;
+            size = got < 0 ? 0 : (size_t)got;
+        }
+    }
+    close(fd);
+
+    if (buf && size > 0 && !job->error) {
+        size_t probe = size < RIPPLE_GREP_BINARY_PROBE ? size : RIPPLE_GREP_BINARY_PROBE;
+        job->binary = memchr(buf, '\0', probe) != NULL;
+        if (!job->binary || !w->pool->opts->skip_binary) {
+            scan_buffer(w, job, buf, size);
+        }
+    }
+    if (map) {
+        munmap(map, size);
+    }
+    if (job->error) {
+        return;
+    }
+
+    const struct ripple_grep_opts *opts = w->pool->opts;
+    if (opts->count_only) {
+        if (w->pool->with_filename) {
+            out_append(&job->out, job->path, job->path_len);
+            out_append(&job->out, ":", 1);
+        }
+        out_append_long(&job->out, job->matches, '\n');
+    } else if (opts->files_only) {
+        if (job->matches) {
+            out_append(&job->out, job->path, job->path_len);
+            out_append(&job->out, "\n", 1);
+        }
+    } else if (job->binary && job->matches) {
+        out_append(&job->out, "Binary file ", 12);
+        out_append(&job->out, job->path, job->path_len);
+        out_append(&job->out, " matches\n", 9);
+    }
+}
+
+// Runs on a pool thread; the main thread prints the job once it is done
+static void run_job(void *arg, int worker, void *ctx) {
+    struct grep_pool *pool = ctx;
+    struct grep_job *job = arg;
+
+    search_file(&pool->workers[worker], job);
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+}
+
+// Print finished files in the order they were found, up to the first one
+// still being searched
+static void flush_jobs(struct grep_pool *pool) {
+    while (pool->next_out < pool->num_jobs) {
+        struct grep_job *job = pool->order[pool->next_out];
+        if (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+        if (job->error) {
+            fprintf(stderr, "ripple: grep: %s: %s\n", job->path, strerror(job->error));
+        } else if (job->out.len > 0) {
+            fwrite(job->out.data, 1, job->out.len, pool->out);
+        }
+        pool->matches += job->matches;
+        free(job->out.data);
+        free(job->path);
+        free(job);
+        pool->order[pool->next_out++] = NULL;
+    }
+}
+
+static void submit(struct grep_pool *pool, const char *path) {
+    struct grep_job *job = calloc(1, sizeof(*job));
+    if (!job || !(job->path = strdup(path))) {
+        free(job);
+        return;
+    }
+    job->path_len = strlen(path);
+    if (pool->num_jobs == pool->order_cap) {
+        size_t cap = pool->order_cap ? pool->order_cap * 2 : 1024;
+        struct grep_job **grown = realloc(pool->order, cap * sizeof(*grown));
+        if (!grown) {
+            free(job->path);
+            free(job);
+            return;
+        }
+        pool->order = grown;
+        pool->order_cap = cap;
+    }
+    pool->order[pool->num_jobs++] = job;
+
+    if (ripple_pool_submit(pool->threads, job) != 0) {
+        job->error = ENOMEM;
+        job->done = 1;
+    }
+    flush_jobs(pool);
+}
+
+static void visit_entry(const char *path, const char *name, int type, void *ctx) {
+    (void)name;
+    if (type == RIPPLE_WALK_FILE) {
+        submit(ctx, path);
+    }
+}
+
+// Literal prefilter and regex flags for the pattern; -1 if it does not compile
+static int build_matcher(struct matcher *m, const char *pattern, const struct ripple_grep_opts *opts) {
+    const char *special = opts->extended ? ".[]()*+?{}|^$\\" : ".[]*^$\\";
+    regex_t re;
+
+    m->pattern = pattern;
+    m->icase = opts->ignore_case;
+    m->invert = opts->invert;
+    m->cflags = REG_NEWLINE | REG_NOSUB | (opts->extended ? REG_EXTENDED : 0) | (opts->ignore_case ? REG_ICASE : 0);
+    if (opts->fixed || strpbrk(pattern, special) == NULL) {
+        // The whole pattern is the literal and a hit is a match
+        m->have_re = 0;
+        if (*pattern) {
+            add_literal(m, pattern, strlen(pattern));
+        }
+        return 0;
+    }
+
+    int rc = regcomp(&re, pattern, m->cflags);
+    if (rc != 0) {
+        char msg[256];
+        regerror(rc, &re, msg, sizeof(msg));
+        fprintf(stderr, "ripple: grep: %s\n", msg);
+        return -1;
+    }
+    regfree(&re);
+    m->have_re = 1;
+    extract_literals(m, pattern, opts->extended);
+#ifdef REG_STARTEND
+    if (m->num_lits == 0 && !m->invert) {
+        // Needs the match position to find the line
+        m->scan_re = 1;
+        m->cflags &= ~REG_NOSUB;
+    }
+#endif
+    return 0;
+}
+
+// Search files and directories (recursively) for lines matching pattern,
+// printing them to out. *matches gets the number of matching lines. -1 if
+// the pattern is invalid.
+int ripple_grep_search(const char *pattern, char **paths, int num_paths, const struct ripple_grep_opts *opts,
+                       FILE *out, long *matches) {
+    struct grep_pool pool;
+    struct stat st;
+
+    memset(&pool, 0, sizeof(pool));
+    *matches = 0;
+    if (build_matcher(&pool.m, pattern, opts) != 0) {
+        return -1;
+    }
+    pool.opts = opts;
+    pool.out = out;
+    pool.with_filename = num_paths > 1 || (num_paths == 1 && stat(paths[0], &st) == 0 && S_ISDIR(st.st_mode));
+
+    // Each thread's regex and read buffer are ready before it gets a file
+    pool.threads = ripple_pool_create(opts->threads, run_job, &pool);
+    if (pool.threads) {
+        pool.num_workers = ripple_pool_threads(pool.threads);
+        pool.workers = calloc(pool.num_workers, sizeof(*pool.workers));
+    }
+    if (!pool.workers) {
+        perror("ripple: grep");
+    } else {
+        for (int i = 0; i < pool.num_workers; i++) {
+            pool.workers[i].pool = &pool;
+            if (pool.m.have_re) {
+                regcomp(&pool.workers[i].re, pattern, pool.m.cflags);
+            }
+        }
+        for (int i = 0; i < num_paths; i++) {
+            if (stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+                ripple_walk(paths[i], visit_entry, &pool);
+            } else {
+                submit(&pool, paths[i]);
+            }
+        }
+    }
+
+    // Whatever is still queued runs before the pool is gone, so then every
+    // job is done
+    if (pool.threads) {
+        ripple_pool_finish(pool.threads);
+    }
+    flush_jobs(&pool);
+    fflush(out);
+
+    for (int i = 0; pool.workers && i < pool.num_workers; i++) {
+        if (pool.m.have_re) {
+            regfree(&pool.workers[i].re);
+        }
+        free(pool.workers[i].buf);
+    }
+    free(pool.workers);
+    free(pool.order);
+    free_literals(&pool.m);
+    *matches = pool.matches;
+    return 0;
+}
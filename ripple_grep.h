@@ -0,0 +1,35 @@
+#ifndef RIPPLE_GREP_H
+#define RIPPLE_GREP_H
+
+#include <stdio.h>
+
+// Content search for the grep builtin. Files found by ripple_walk are
+// searched on a ripple_pool, whose threads steal work from each other.
+// Each file is scanned for the literals every match must contain, 16 bytes
+// at a time where SSE2 is available, and only lines holding one are given
+// to the regex engine. Output is buffered per file and written in
+// traversal order, so it reads the same as a single-threaded search.
+
+struct ripple_grep_opts {
+    int ignore_case;              // -i
+    int line_numbers;             // -n
+    int count_only;               // -c: matching lines per file
+    int files_only;               // -l: names of files with a match
+    int invert;                   // -v: lines that do not match
+    int fixed;                    // -F: the pattern is a plain string
+    int extended;                 // -E: POSIX extended regex, else basic
+    int skip_binary;              // -I: leave out files with a NUL near the start
+    int threads;                  // -j: 0 picks one per CPU
+};
+
+// Function declarations
+int ripple_grep_search(const char* pattern, char** paths, int num_paths, const struct ripple_grep_opts* opts,
+                       FILE* out, long* matches);
+
+// Constants
+#define RIPPLE_GREP_MAX_LITERALS 8      // alternatives prefiltered; more scan every line
+#define RIPPLE_GREP_MMAP_MIN (16 << 20) // smaller files are read into a per-thread buffer
+#define RIPPLE_GREP_BINARY_PROBE 8192   // a NUL in this much of a file makes it binary
+#define RIPPLE_GREP_COMMON_BYTES 16     // bytes too frequent for a memchr scan
+
+#endif // RIPPLE_GREP_H
@@ -0,0 +1,645 @@
+#include "ripple_index.h"
+#include "ollama_integration.h"
+#include "ollama_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+// On-disk layout: header, then one float scale per entry, then count
+// vectors of stride int8s (zero padded to a multiple of STRIDE_ALIGN), then
+// count+1 offsets into the text block, then "cmd\0desc\0" per entry.
+// Vectors are quantized to int8 so a scan reads a quarter of the bytes.
+#define INDEX_MAGIC "RPLIDX2"
+#define STRIDE_ALIGN 16
+#define EMBED_BATCH 32
+#define MAX_HITS 16
+#define MAX_ENTRIES 8000
+#define MAX_SHELL_HISTORY 2000
+
+struct index_header {
+    char magic[8];
+    uint32_t dim;
+    uint32_t count;
+    uint32_t stride;          // dim rounded up to STRIDE_ALIGN
+    uint32_t reserved;
+    uint64_t scales;
+    uint64_t vectors;
+    uint64_t offsets;
+    uint64_t text;
+    char model[64];
+};
+
+static struct {
+    void *map;
+    size_t size;
+    const struct index_header *header;
+    const float *scales;
+    const int8_t *vectors;
+    const uint32_t *offsets;
+    const char *text;
+} index_map;
+
+// Shell threads and daemon sessions search while a reload may swap the map
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Dot product; vectors are unit length so this is the cosine similarity
+float ripple_dot(const float *a, const float *b, int n) {
+    int i = 0;
+    float sum;
+#if defined(__aarch64__)
+    float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        s0 = vfmaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+        s1 = vfmaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    sum = vaddvq_f32(vaddq_f32(s0, s1));
+#elif defined(__SSE2__) || defined(__x86_64__)
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(s0, s1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    sum = 0.0f;
+#endif
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// The query is widened once per search where that saves work in the loop
+#if defined(__aarch64__)
+typedef int8_t query_elem;
+#else
+typedef int16_t query_elem;
+#endif
+
+// Integer dot product of the query with one int8 vector; n is a multiple
+// of STRIDE_ALIGN
+static int32_t dot_query(const query_elem *q, const int8_t *v, int n) {
+    int i = 0;
+#if defined(__aarch64__)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (; i < n; i += 16) {
+        int8x16_t x = vld1q_s8(q + i), y = vld1q_s8(v + i);
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(x), vget_low_s8(y)));
+        acc = vpadalq_s16(acc, vmull_high_s8(x, y));
+    }
+    return vaddvq_s32(acc);
+#elif defined(__SSE2__) || defined(__x86_64__)
+    __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+    for (; i < n; i += 16) {
+        // Sign-extend 16 vector bytes to 16 bits, then multiply and add pairs
+        __m128i y = _mm_loadu_si128((const __m128i *)(v + i));
+        __m128i y_lo = _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8);
+        __m128i y_hi = _mm_srai_epi16(_mm_unpackhi_epi8(y, y), 8);
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(q + i)), y_lo));
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(q + i + 8)), y_hi));
+    }
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi32(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    int32_t sum = 0;
+    for (; i < n; i++) {
+        sum += q[i] * v[i];
+    }
+    return sum;
+#endif
+}
+
+// Quantize to int8 with one scale per vector; returns the scale
+static float quantize(const float *v, int dim, int8_t *out, int stride) {
+    float max = 0.0f;
+    for (int i = 0; i < dim; i++) {
+        float a = fabsf(v[i]);
+        if (a > max) {
+            max = a;
+        }
+    }
+    float scale = max > 0.0f ? max / 127.0f : 1.0f;
+    for (int i = 0; i < dim; i++) {
+        out[i] = (int8_t)lrintf(v[i] / scale);
+    }
+    memset(out + dim, 0, stride - dim);
+    return scale;
+}
+
+static void normalize(float *v, int n) {
+    float norm = sqrtf(ripple_dot(v, v, n));
+    if (norm > 0.0f) {
+        for (int i = 0; i < n; i++) {
+            v[i] /= norm;
+        }
+    }
+}
+
+// Path of the index file: ~/.ripple_index
+const char *ripple_index_path(void) {
+    static char path[1024];
+    const char *home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", home ? home : ".", RIPPLE_INDEX_FILE);
+    return path;
+}
+
+// Callers hold index_lock for writing
+static void unmap_index(void) {
+    if (index_map.map) {
+        munmap(index_map.map, index_map.size);
+    }
+    memset(&index_map, 0, sizeof(index_map));
+}
+
+void ripple_index_close(void) {
+    pthread_rwlock_wrlock(&index_lock);
+    unmap_index();
+    pthread_rwlock_unlock(&index_lock);
+}
+
+// Map an index file and check its layout
+static int map_index(const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    unmap_index();
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct index_header)) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const struct index_header *h = map;
+    size_t size = st.st_size;
+    if (memcmp(h->magic, INDEX_MAGIC, 8) != 0 || h->dim == 0 || h->dim > RIPPLE_INDEX_MAX_DIM ||
+        h->stride < h->dim || h->stride > RIPPLE_INDEX_MAX_DIM || h->stride % STRIDE_ALIGN != 0 ||
+        h->scales % sizeof(float) != 0 || h->offsets % sizeof(uint32_t) != 0 ||
+        h->scales + (uint64_t)h->count * sizeof(float) > size ||
+        h->vectors + (uint64_t)h->count * h->stride > size ||
+        h->offsets + ((uint64_t)h->count + 1) * sizeof(uint32_t) > size || h->text > size) {
+        fprintf(stderr, "ripple: %s: not a valid index\n", path);
+        munmap(map, size);
+        return -1;
+    }
+
+    index_map.map = map;
+    index_map.size = size;
+    index_map.header = h;
+    index_map.scales = (const float *)((const char *)map + h->scales);
+    index_map.vectors = (const int8_t *)((const char *)map + h->vectors);
+    index_map.offsets = (const uint32_t *)((const char *)map + h->offsets);
+    index_map.text = (const char *)map + h->text;
+    if (h->text + index_map.offsets[h->count] > size) {
+        fprintf(stderr, "ripple: %s: truncated index\n", path);
+        unmap_index();
+        return -1;
+    }
+    // Every entry is "cmd\0desc\0" and starts where the last one ended
+    for (uint32_t i = 0; i < h->count; i++) {
+        uint32_t start = index_map.offsets[i], end = index_map.offsets[i + 1];
+        if ((i == 0 && start != 0) || end < start + 2 || index_map.text[end - 1] != '\0' ||
+            memchr(index_map.text + start, '\0', end - start - 1) == NULL) {
+            fprintf(stderr, "ripple: %s: corrupt index text\n", path);
+            unmap_index();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Map an index file; returns 0 on success, -1 if it is missing or invalid
+int ripple_index_open(const char *path) {
+    pthread_rwlock_wrlock(&index_lock);
+    int rc = map_index(path);
+    pthread_rwlock_unlock(&index_lock);
+    return rc;
+}
+
+size_t ripple_index_count(void) {
+    pthread_rwlock_rdlock(&index_lock);
+    size_t count = index_map.header ? index_map.header->count : 0;
+    pthread_rwlock_unlock(&index_lock);
+    return count;
+}
+
+int ripple_index_dim(void) {
+    pthread_rwlock_rdlock(&index_lock);
+    int dim = index_map.header ? (int)index_map.header->dim : 0;
+    pthread_rwlock_unlock(&index_lock);
+    return dim;
+}
+
+// Embedding model the index was built with; a per-thread copy
+const char *ripple_index_model(void) {
+    static __thread char model[sizeof(((struct index_header *)0)->model)];
+
+    pthread_rwlock_rdlock(&index_lock);
+    snprintf(model, sizeof(model), "%.*s", (int)sizeof(model) - 1, index_map.header ? index_map.header->model : "");
+    pthread_rwlock_unlock(&index_lock);
+    return model;
+}
+
+// Copy at most RIPPLE_HIT_TEXT - 1 bytes of text, which ends before limit
+static int copy_hit_text(char *dst, const char *text, const char *limit) {
+    int len = 0;
+    while (text + len < limit && text[len] && len < RIPPLE_HIT_TEXT - 1) {
+        len++;
+    }
+    memcpy(dst, text, len);
+    dst[len] = '\0';
+    return len;
+}
+
+// Top-k scan over every vector; hits come back best first. Callers hold
+// index_lock for reading.
+static int search_locked(const float *query, int dim, struct ripple_hit *hits, int k) {
+    const struct index_header *h = index_map.header;
+    int8_t q[RIPPLE_INDEX_MAX_DIM];
+    float best[MAX_HITS];
+    int32_t raw[MAX_HITS];
+    uint32_t ids[MAX_HITS];
+    int found = 0;
+
+    if (!h || dim != (int)h->dim || k <= 0) {
+        return 0;
+    }
+    if (k > MAX_HITS) {
+        k = MAX_HITS;
+    }
+    int stride = h->stride;
+    float qscale = quantize(query, dim, q, stride);
+    query_elem wide[RIPPLE_INDEX_MAX_DIM];
+    for (int i = 0; i < stride; i++) {
+        wide[i] = q[i];
+    }
+
+    const int8_t *v = index_map.vectors;
+    const float *scales = index_map.scales;
+    for (uint32_t i = 0; i < h->count; i++, v += stride) {
+        int32_t d = dot_query(wide, v, stride);
+        float score = d * scales[i];
+        if (found == k && score <= best[k - 1]) {
+            continue;
+        }
+        // Insert into the small sorted list
+        int j = found < k ? found++ : k - 1;
+        while (j > 0 && best[j - 1] < score) {
+            best[j] = best[j - 1];
+            raw[j] = raw[j - 1];
+            ids[j] = ids[j - 1];
+            j--;
+        }
+        best[j] = score;
+        raw[j] = d;
+        ids[j] = i;
+    }
+
+    for (int i = 0; i < found; i++) {
+        const char *cmd = index_map.text + index_map.offsets[ids[i]];
+        const char *end = index_map.text + index_map.offsets[ids[i] + 1];
+        hits[i].score = raw[i] * scales[ids[i]] * qscale;
+        hits[i].cmd_len = copy_hit_text(hits[i].cmd, cmd, end);
+        cmd += strnlen(cmd, end - cmd) + 1;
+        hits[i].desc_len = copy_hit_text(hits[i].desc, cmd, end);
+    }
+    return found;
+}
+
+int ripple_index_search(const float *query, int dim, struct ripple_hit *hits, int k) {
+    pthread_rwlock_rdlock(&index_lock);
+    int n = search_locked(query, dim, hits, k);
+    pthread_rwlock_unlock(&index_lock);
+    return n;
+}
+
+// Embed text with the configured model and search the index. Returns the
+// number of hits, or -1 if there is no usable index or the embedding failed.
+// The index lock is only taken for the scan, not while embedding.
+int ripple_index_query(const char *text, struct ripple_hit *hits, int k, double *scan_ms) {
+    float query[RIPPLE_INDEX_MAX_DIM];
+    struct ollama_config cfg;
+
+    int dim = ripple_index_dim();
+    if (dim == 0) {
+        return -1;
+    }
+    ollama_config_get(&cfg);
+    if (strcmp(cfg.embed_model, ripple_index_model()) != 0) {
+        return -1; // Vectors from another model are not comparable
+    }
+    if (ollama_embed(&text, 1, query, RIPPLE_INDEX_MAX_DIM, 1) != dim) {
+        return -1;
+    }
+    normalize(query, dim);
+
+    // A reload with another dimension in between finds nothing
+    double t0 = now_ms();
+    int n = ripple_index_search(query, dim, hits, k);
+    if (scan_ms) {
+        *scan_ms = now_ms() - t0;
+    }
+    return n;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Write entries and their unit-length vectors to path, replacing it
+// atomically. Returns 0 on success.
+int ripple_index_write(const char *path, const char *model, const struct ripple_index_entry *entries,
+                       const float *vectors, int count, int dim) {
+    struct index_header header;
+
+    // Text block and offsets
+    uint32_t *offsets = malloc(sizeof(uint32_t) * ((size_t)count + 1));
+    size_t text_len = 0;
+    if (!offsets) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        offsets[i] = (uint32_t)text_len;
+        text_len += strlen(entries[i].cmd) + strlen(entries[i].desc) + 2;
+    }
+    offsets[count] = (uint32_t)text_len;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.dim = dim;
+    header.count = count;
+    header.stride = (dim + STRIDE_ALIGN - 1) / STRIDE_ALIGN * STRIDE_ALIGN;
+    header.scales = sizeof(header);
+    header.vectors = (header.scales + sizeof(float) * (uint64_t)count + 63) & ~(uint64_t)63;
+    header.offsets = header.vectors + (uint64_t)count * header.stride;
+    header.text = header.offsets + sizeof(uint32_t) * ((uint64_t)count + 1);
+    snprintf(header.model, sizeof(header.model), "%s", model);
+
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("ripple: index");
+        free(offsets);
+        return -1;
+    }
+    // Quantize every vector up front; the scales precede the vectors
+    int8_t *quantized = malloc((size_t)count * header.stride);
+    float *scales = malloc(sizeof(float) * ((size_t)count + 1));
+    if (!quantized || !scales) {
+        free(quantized);
+        free(scales);
+        free(offsets);
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        scales[i] = quantize(vectors + (size_t)i * dim, dim, quantized + (size_t)i * header.stride,
+                             header.stride);
+    }
+
+    static const char pad[64];
+    int rc = write_all(fd, &header, sizeof(header));
+    rc |= write_all(fd, scales, sizeof(float) * (size_t)count);
+    rc |= write_all(fd, pad, header.vectors - header.scales - sizeof(float) * (size_t)count);
+    rc |= write_all(fd, quantized, (size_t)count * header.stride);
+    free(quantized);
+    free(scales);
+    rc |= write_all(fd, offsets, sizeof(uint32_t) * ((size_t)count + 1));
+    for (int i = 0; i < count && rc == 0; i++) {
+        rc |= write_all(fd, entries[i].cmd, strlen(entries[i].cmd) + 1);
+        rc |= write_all(fd, entries[i].desc, strlen(entries[i].desc) + 1);
+    }
+    rc |= close(fd);
+    free(offsets);
+
+    if (rc != 0 || rename(tmp, path) != 0) {
+        perror("ripple: index");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Embed every entry and write a new index to path, replacing it atomically.
+// Returns the number of entries written, or -1 on failure.
+int ripple_index_build(const char *path, const struct ripple_index_entry *entries, int count) {
+    struct ollama_config cfg;
+    float *batch = malloc(sizeof(float) * EMBED_BATCH * RIPPLE_INDEX_MAX_DIM);
+    float *vectors = NULL;
+    char **texts = calloc(EMBED_BATCH, sizeof(char *));
+    int dim = 0;
+
+    if (!batch || !texts || count <= 0) {
+        free(batch);
+        free(texts);
+        return -1;
+    }
+    ollama_config_get(&cfg);
+
+    for (int start = 0; start < count; start += EMBED_BATCH) {
+        int n = count - start < EMBED_BATCH ? count - start : EMBED_BATCH;
+        for (int i = 0; i < n; i++) {
+            const struct ripple_index_entry *e = &entries[start + i];
+            size_t len = strlen(e->cmd) + strlen(e->desc) + 4;
+            texts[i] = malloc(len);
+            snprintf(texts[i], len, e->desc[0] ? "%s - %s" : "%s", e->cmd, e->desc);
+        }
+        int got = ollama_embed((const char *const *)texts, n, batch, RIPPLE_INDEX_MAX_DIM, 0);
+        for (int i = 0; i < n; i++) {
+            free(texts[i]);
+        }
+        if (got <= 0 || (dim && got != dim)) {
+            fprintf(stderr, "\nripple: embedding with '%s' failed\n", cfg.embed_model);
+            free(batch);
+            free(texts);
+            free(vectors);
+            return -1;
+        }
+        if (!dim) {
+            dim = got;
+            vectors = malloc(sizeof(float) * (size_t)count * dim);
+            if (!vectors) {
+                free(batch);
+                free(texts);
+                return -1;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            float *v = vectors + (size_t)(start + i) * dim;
+            memcpy(v, batch + (size_t)i * RIPPLE_INDEX_MAX_DIM, sizeof(float) * dim);
+            normalize(v, dim);
+        }
+        printf("\rEmbedding %d/%d", start + n, count);
+        fflush(stdout);
+    }
+    printf("\n");
+    free(batch);
+    free(texts);
+
+    int rc = ripple_index_write(path, cfg.embed_model, entries, vectors, count, dim);
+    free(vectors);
+    return rc == 0 && ripple_index_open(path) == 0 ? count : -1;
+}
+
+static int add_entry(struct ripple_index_entry *entries, int count, const char *cmd, const char *desc) {
+    int len = strlen(cmd);
+    while (len > 0 && (cmd[len - 1] == ' ' || cmd[len - 1] == '\t')) {
+        len--;
+    }
+    if (count >= MAX_ENTRIES || len == 0) {
+        return count;
+    }
+    entries[count].cmd = strndup(cmd, len);
+    entries[count].desc = strdup(desc);
+    return count + 1;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    const struct ripple_index_entry *x = a, *y = b;
+    int c = strcmp(x->cmd, y->cmd);
+    return c ? c : strcmp(x->desc, y->desc);
+}
+
+// Last lines of the user's shell history file
+static int collect_history_file(struct ripple_index_entry *entries, int count) {
+    char path[1024];
+    const char *histfile = getenv("HISTFILE");
+    const char *home = getenv("HOME");
+
+    if (histfile && *histfile) {
+        snprintf(path, sizeof(path), "%s", histfile);
+    } else {
+        snprintf(path, sizeof(path), "%s/.bash_history", home ? home : ".");
+    }
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return count;
+    }
+
+    // Keep a ring of the most recent lines
+    char **lines = calloc(MAX_SHELL_HISTORY, sizeof(char *));
+    char line[1024];
+    int total = 0;
+    while (lines && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') {
+            continue; // bash timestamps
+        }
+        free(lines[total % MAX_SHELL_HISTORY]);
+        lines[total % MAX_SHELL_HISTORY] = strdup(line);
+        total++;
+    }
+    fclose(file);
+    for (int i = 0; lines && i < MAX_SHELL_HISTORY; i++) {
+        if (lines[i]) {
+            count = add_entry(entries, count, lines[i], "");
+            free(lines[i]);
+        }
+    }
+    free(lines);
+    return count;
+}
+
+// One-line summaries of section 1 man pages, from the whatis database
+static int collect_man_summaries(struct ripple_index_entry *entries, int count) {
+    FILE *pipe = popen("apropos -s 1 . 2>/dev/null", "r");
+    char line[1024];
+
+    if (!pipe) {
+        return count;
+    }
+    while (fgets(line, sizeof(line), pipe)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        // "name (1) - summary", possibly "name, other(1) - summary" on macOS
+        char *dash = strstr(line, " - ");
+        if (!dash) {
+            continue;
+        }
+        size_t name_len = strcspn(line, " ,(");
+        if (name_len == 0 || line + name_len > dash) {
+            continue;
+        }
+        line[name_len] = '\0';
+        count = add_entry(entries, count, line, dash + 3);
+    }
+    pclose(pipe);
+    return count;
+}
+
+// Gather what to index: the given history, the shell history file and man
+// page summaries, without duplicates. Free with ripple_index_free_entries.
+int ripple_index_collect(struct ripple_index_entry **out, const char *const *history, int num_history) {
+    struct ripple_index_entry *entries = malloc(sizeof(*entries) * MAX_ENTRIES);
+    int count = 0;
+
+    *out = NULL;
+    if (!entries) {
+        return -1;
+    }
+    for (int i = 0; i < num_history; i++) {
+        count = add_entry(entries, count, history[i], "");
+    }
+    count = collect_history_file(entries, count);
+    count = collect_man_summaries(entries, count);
+
+    qsort(entries, count, sizeof(*entries), entry_cmp);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique > 0 && entry_cmp(&entries[unique - 1], &entries[i]) == 0) {
+            free((char *)entries[i].cmd);
+            free((char *)entries[i].desc);
+            continue;
+        }
+        entries[unique++] = entries[i];
+    }
+    *out = entries;
+    return unique;
+}
+
+void ripple_index_free_entries(struct ripple_index_entry *entries, int count) {
+    for (int i = 0; i < count; i++) {
+        free((char *)entries[i].cmd);
+        free((char *)entries[i].desc);
+    }
+    free(entries);
+}
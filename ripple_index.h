@@ -0,0 +1,48 @@
+#ifndef RIPPLE_INDEX_H
+#define RIPPLE_INDEX_H
+
+#include <stddef.h>
+
+// Retrieval index over history entries and man-page summaries. Each entry
+// is a command plus a short description and a unit-length embedding stored
+// as int8; the file is mmap'd and searched with a dot-product scan.
+
+#define RIPPLE_HIT_TEXT 256   // longest cmd or desc a hit keeps
+
+// One search result. The text is copied out of the mapped file, so a hit
+// stays valid when the index is reopened under it.
+struct ripple_hit {
+    float score;          // cosine similarity, -1..1
+    char cmd[RIPPLE_HIT_TEXT];
+    int cmd_len;
+    char desc[RIPPLE_HIT_TEXT];
+    int desc_len;
+};
+
+// One entry to index; desc may be empty
+struct ripple_index_entry {
+    const char *cmd;
+    const char *desc;
+};
+
+// Function declarations
+int ripple_index_open(const char* path);
+void ripple_index_close(void);
+int ripple_index_collect(struct ripple_index_entry** out, const char* const* history, int num_history);
+void ripple_index_free_entries(struct ripple_index_entry* entries, int count);
+int ripple_index_build(const char* path, const struct ripple_index_entry* entries, int count);
+int ripple_index_write(const char* path, const char* model, const struct ripple_index_entry* entries,
+                       const float* vectors, int count, int dim);
+int ripple_index_search(const float* query, int dim, struct ripple_hit* hits, int k);
+int ripple_index_query(const char* text, struct ripple_hit* hits, int k, double* scan_ms);
+float ripple_dot(const float* a, const float* b, int n);
+const char* ripple_index_path(void);
+const char* ripple_index_model(void);
+size_t ripple_index_count(void);
+int ripple_index_dim(void);
+
+// Constants
+#define RIPPLE_INDEX_FILE ".ripple_index"
+#define RIPPLE_INDEX_MAX_DIM 4096
+
+#endif // RIPPLE_INDEX_H
@@ -0,0 +1,219 @@
+#include "ripple_metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+
+struct histogram {
+    uint64_t counts[RIPPLE_METRICS_BUCKETS]; // per bucket, not cumulative
+    uint64_t count;
+    uint64_t errors;
+    double sum;
+    double max;
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} metric_info[RIPPLE_NUM_METRICS] = {
+    { "ripple_command", "External commands run by the shell, fork to exit" },
+    { "ripple_builtin", "Built-in commands" },
+    { "ripple_ai_completion", "Ollama completion calls, including time queued" },
+    { "ripple_ai_suggest", "TAB suggestion lookups from the index, daemon or model" },
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct histogram h[RIPPLE_NUM_METRICS];
+} metrics = { PTHREAD_MUTEX_INITIALIZER };
+
+static double bucket_bound(int i) {
+    return RIPPLE_METRICS_BASE * (double)(1UL << i);
+}
+
+static int bucket_for(double seconds) {
+    int i = 0;
+    while (i < RIPPLE_METRICS_BUCKETS - 1 && seconds > bucket_bound(i)) {
+        i++;
+    }
+    return i;
+}
+
+// Record one call; failed ones are also counted as errors
+void ripple_metrics_observe(int metric, double seconds, int failed) {
+    if (metric < 0 || metric >= RIPPLE_NUM_METRICS) {
+        return;
+    }
+    if (seconds < 0) {
+        seconds = 0;
+    }
+    int b = bucket_for(seconds);
+    pthread_mutex_lock(&metrics.lock);
+    struct histogram *h = &metrics.h[metric];
+    h->counts[b]++;
+    h->count++;
+    h->sum += seconds;
+    if (seconds > h->max) {
+        h->max = seconds;
+    }
+    if (failed) {
+        h->errors++;
+    }
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+void ripple_metrics_reset(void) {
+    pthread_mutex_lock(&metrics.lock);
+    memset(metrics.h, 0, sizeof(metrics.h));
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+static void snapshot(struct histogram *out) {
+    pthread_mutex_lock(&metrics.lock);
+    memcpy(out, metrics.h, sizeof(metrics.h));
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+// Upper bound of the bucket holding quantile q; the slowest call for the
+// overflow bucket
+static double quantile(const struct histogram *h, double q) {
+    uint64_t rank = (uint64_t)(q * h->count + 0.5), seen = 0;
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (int i = 0; i < RIPPLE_METRICS_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            double bound = i < RIPPLE_METRICS_BUCKETS - 1 ? bucket_bound(i) : h->max;
+            return bound < h->max ? bound : h->max;
+        }
+    }
+    return h->max;
+}
+
+static void print_duration(FILE *out, double seconds) {
+    if (seconds < 1) {
+        fprintf(out, "%9.2f ms", seconds * 1000);
+    } else {
+        fprintf(out, "%9.2f s ", seconds);
+    }
+}
+
+// Human-readable table for the stats builtin
+void ripple_metrics_print(FILE *out) {
+    struct histogram h[RIPPLE_NUM_METRICS];
+    snapshot(h);
+
+    fprintf(out, "%-22s %7s %6s %12s %12s %12s %12s\n", "", "count", "errors", "mean", "p50", "p95", "max");
+    for (int m = 0; m < RIPPLE_NUM_METRICS; m++) {
+        fprintf(out, "%-22s %7llu %6llu ", metric_info[m].name + 7, (unsigned long long)h[m].count,
+                (unsigned long long)h[m].errors);
+        if (h[m].count == 0) {
+            fprintf(out, "%12s %12s %12s %12s\n", "-", "-", "-", "-");
+            continue;
+        }
+        print_duration(out, h[m].sum / h[m].count);
+        fputs(" ", out);
+        print_duration(out, quantile(&h[m], 0.50));
+        fputs(" ", out);
+        print_duration(out, quantile(&h[m], 0.95));
+        fputs(" ", out);
+        print_duration(out, h[m].max);
+        fputs("\n", out);
+    }
+    fprintf(out, "(p50 and p95 are bucket upper bounds)\n");
+}
+
+static void write_prometheus(FILE *out, const struct histogram *h) {
+    for (int m = 0; m < RIPPLE_NUM_METRICS; m++) {
+        const char *name = metric_info[m].name;
+        uint64_t cumulative = 0;
+
+        fprintf(out, "# HELP %s_seconds %s\n", name, metric_info[m].help);
+        fprintf(out, "# TYPE %s_seconds histogram\n", name);
+        for (int i = 0; i < RIPPLE_METRICS_BUCKETS - 1; i++) {
+            cumulative += h[m].counts[i];
+            fprintf(out, "%s_seconds_bucket{le=\"%g\"} %llu\n", name, bucket_bound(i),
+                    (unsigned long long)cumulative);
+        }
+        fprintf(out, "%s_seconds_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h[m].count);
+        fprintf(out, "%s_seconds_sum %.6f\n", name, h[m].sum);
+        fprintf(out, "%s_seconds_count %llu\n", name, (unsigned long long)h[m].count);
+        fprintf(out, "# HELP %s_errors_total Calls that failed\n", name);
+        fprintf(out, "# TYPE %s_errors_total counter\n", name);
+        fprintf(out, "%s_errors_total %llu\n", name, (unsigned long long)h[m].errors);
+    }
+}
+
+static void write_json(FILE *out, const struct histogram *h) {
+    fprintf(out, "{\"pid\": %d", (int)getpid());
+    for (int m = 0; m < RIPPLE_NUM_METRICS; m++) {
+        uint64_t cumulative = 0;
+        fprintf(out, ", \"%s\": {\"count\": %llu, \"errors\": %llu, \"sum\": %.6f, \"max\": %.6f",
+                metric_info[m].name, (unsigned long long)h[m].count, (unsigned long long)h[m].errors,
+                h[m].sum, h[m].max);
+        if (h[m].count > 0) {
+            fprintf(out, ", \"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f", quantile(&h[m], 0.50),
+                    quantile(&h[m], 0.95), quantile(&h[m], 0.99));
+        }
+        fprintf(out, ", \"buckets\": [");
+        for (int i = 0; i < RIPPLE_METRICS_BUCKETS - 1; i++) {
+            cumulative += h[m].counts[i];
+            fprintf(out, "%s{\"le\": %g, \"count\": %llu}", i ? ", " : "", bucket_bound(i),
+                    (unsigned long long)cumulative);
+        }
+        fprintf(out, ", {\"le\": \"+Inf\", \"count\": %llu}]}", (unsigned long long)h[m].count);
+    }
+    fprintf(out, "}\n");
+}
+
+int ripple_metrics_write(FILE *out, int format) {
+    struct histogram h[RIPPLE_NUM_METRICS];
+    snapshot(h);
+    if (format == RIPPLE_METRICS_JSON) {
+        write_json(out, h);
+    } else {
+        write_prometheus(out, h);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+// JSON for *.json, Prometheus text format for anything else
+int ripple_metrics_format_for(const char *path) {
+    size_t len = strlen(path);
+    return len >= 5 && strcmp(path + len - 5, ".json") == 0 ? RIPPLE_METRICS_JSON : RIPPLE_METRICS_PROMETHEUS;
+}
+
+// Write to a temporary file and rename it into place, so a collector
+// polling the file never reads half of it
+int ripple_metrics_export(const char *path, int format) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        return -1;
+    }
+    int rc = ripple_metrics_write(f, format);
+    if (fclose(f) != 0 || rc != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// $RIPPLE_METRICS_FILE, else ~/.ripple_metrics.prom
+const char *ripple_metrics_path(void) {
+    static char path[4096];
+    const char *env = getenv("RIPPLE_METRICS_FILE");
+    const char *home = getenv("HOME");
+
+    if (env && *env) {
+        snprintf(path, sizeof(path), "%s", env);
+    } else {
+        snprintf(path, sizeof(path), "%s/%s", home ? home : ".", RIPPLE_METRICS_FILE);
+    }
+    return path;
+}
@@ -0,0 +1,35 @@
+#ifndef RIPPLE_METRICS_H
+#define RIPPLE_METRICS_H
+
+#include <stdio.h>
+
+// Latency histograms for commands and AI calls. Buckets are fixed powers of
+// two from 100 us up, so observing is a few instructions under a lock and
+// the export maps directly onto Prometheus cumulative buckets.
+
+// Histograms kept by the shell
+enum {
+    RIPPLE_METRIC_COMMAND,        // external commands, fork to exit
+    RIPPLE_METRIC_BUILTIN,        // built-in commands
+    RIPPLE_METRIC_COMPLETION,     // get_ollama_completion
+    RIPPLE_METRIC_SUGGEST,        // TAB suggestions from the index, daemon or model
+    RIPPLE_NUM_METRICS
+};
+
+// Function declarations
+void ripple_metrics_observe(int metric, double seconds, int failed);
+void ripple_metrics_print(FILE* out);
+int ripple_metrics_write(FILE* out, int format);
+int ripple_metrics_export(const char* path, int format);
+int ripple_metrics_format_for(const char* path);
+void ripple_metrics_reset(void);
+const char* ripple_metrics_path(void);
+
+// Constants
+#define RIPPLE_METRICS_BUCKETS 22     // 100 us * 2^0..2^20, then +Inf
+#define RIPPLE_METRICS_BASE 0.0001    // upper bound of the first bucket, seconds
+#define RIPPLE_METRICS_FILE ".ripple_metrics.prom"
+#define RIPPLE_METRICS_PROMETHEUS 0
+#define RIPPLE_METRICS_JSON 1
+
+#endif // RIPPLE_METRICS_H
@@ -0,0 +1,185 @@
+#include "ripple_pool.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+struct deque {
+    pthread_mutex_t lock;
+    void **jobs;                  // ring buffer
+    size_t head;
+    size_t count;
+    size_t cap;
+};
+
+struct worker {
+    struct ripple_pool *pool;
+    pthread_t thread;
+    int id;
+};
+
+struct ripple_pool {
+    ripple_pool_fn run;
+    void *ctx;
+    struct deque *deques;
+    struct worker *workers;
+    int num_workers;
+    int started;
+    unsigned next_deque;
+    long queued;                  // jobs sitting in deques
+    int idle;
+    int closed;                   // no more submissions
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+};
+
+// Own queue from the front, then the others' from the back
+static void *take_job(struct ripple_pool *pool, int self) {
+    for (int k = 0; k < pool->num_workers; k++) {
+        struct deque *d = &pool->deques[(self + k) % pool->num_workers];
+        void *job = NULL;
+
+        if (__atomic_load_n(&d->count, __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&d->lock);
+        if (d->count > 0) {
+            if (k == 0) {
+                job = d->jobs[d->head];
+                d->head = (d->head + 1) % d->cap;
+            } else {
+                job = d->jobs[(d->head + d->count - 1) % d->cap];
+            }
+            __atomic_store_n(&d->count, d->count - 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&d->lock);
+        if (job) {
+            __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    struct ripple_pool *pool = w->pool;
+
+    for (;;) {
+        void *job = take_job(pool, w->id);
+        if (job) {
+            pool->run(job, w->id, pool->ctx);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0 && !pool->closed) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        int stop = pool->closed && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+            return NULL;
+        }
+    }
+}
+
+// Start threads workers (0: one per CPU); NULL if none could be started
+struct ripple_pool *ripple_pool_create(int threads, ripple_pool_fn run, void *ctx) {
+    struct ripple_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    pool->num_workers = threads < 1 ? 1 : threads > RIPPLE_POOL_MAX_THREADS ? RIPPLE_POOL_MAX_THREADS : threads;
+    pool->run = run;
+    pool->ctx = ctx;
+    pool->deques = calloc(pool->num_workers, sizeof(*pool->deques));
+    pool->workers = calloc(pool->num_workers, sizeof(*pool->workers));
+    if (!pool->deques || !pool->workers) {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+    }
+    for (; pool->started < pool->num_workers; pool->started++) {
+        struct worker *w = &pool->workers[pool->started];
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            break;
+        }
+    }
+    if (pool->started == 0) {
+        ripple_pool_finish(pool);
+        return NULL;
+    }
+    // Queues of workers that failed to start are only ever stolen from
+    return pool;
+}
+
+int ripple_pool_threads(const struct ripple_pool *pool) {
+    return pool->num_workers;
+}
+
+// Queue a job; -1 if there was no memory for it, in which case it was
+// not run
+int ripple_pool_submit(struct ripple_pool *pool, void *job) {
+    struct deque *d = &pool->deques[pool->next_deque++ % pool->num_workers];
+
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        void **jobs = malloc(cap * sizeof(*jobs));
+        if (!jobs) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < d->count; i++) {
+            jobs[i] = d->jobs[(d->head + i) % d->cap];
+        }
+        free(d->jobs);
+        d->jobs = jobs;
+        d->head = 0;
+        d->cap = cap;
+    }
+    d->jobs[(d->head + d->count) % d->cap] = job;
+    __atomic_store_n(&d->count, d->count + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&d->lock);
+
+    // Idle workers are woken a batch at a time rather than per job
+    long queued = __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+    if (queued >= RIPPLE_POOL_WAKE_BATCH && __atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return 0;
+}
+
+// Run everything queued, then stop the threads and free the pool
+void ripple_pool_finish(struct ripple_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->closed = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].jobs);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
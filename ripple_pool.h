@@ -0,0 +1,26 @@
+#ifndef RIPPLE_POOL_H
+#define RIPPLE_POOL_H
+
+// A fixed set of threads running jobs handed out by one producer. Every
+// worker has its own queue, filled round-robin; a worker that runs dry
+// steals from the back of the others', so a few large jobs stuck behind
+// each other on one queue do not hold the rest up. Jobs run in no
+// particular order; a caller that needs one, like grep's output, keeps it
+// in its jobs.
+
+struct ripple_pool;
+
+// Runs one job; worker is 0..threads-1, for per-thread scratch space
+typedef void (*ripple_pool_fn)(void* job, int worker, void* ctx);
+
+// Function declarations
+struct ripple_pool* ripple_pool_create(int threads, ripple_pool_fn run, void* ctx);
+int ripple_pool_threads(const struct ripple_pool* pool);
+int ripple_pool_submit(struct ripple_pool* pool, void* job);
+void ripple_pool_finish(struct ripple_pool* pool);
+
+// Constants
+#define RIPPLE_POOL_MAX_THREADS 16
+#define RIPPLE_POOL_WAKE_BATCH 16      // jobs queued before an idle worker is woken
+
+#endif // RIPPLE_POOL_H
@@ -0,0 +1,475 @@
+#include "ripple_predict.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// Sizes are fixed so the whole model is a few hundred KB and never rehashes
+#define MAX_STRINGS 32768      // interned command lines, tokens and directories
+#define STRING_TABLE 65536     // id lookup, power of two
+#define CONTEXT_SLOTS 16384    // n-gram contexts, power of two
+#define CANDIDATES 4           // successors kept per context
+#define MAX_PROBE 16
+#define MAX_LINE 255
+#define MAX_CANDIDATES 32
+#define NO_ID UINT32_MAX
+#define START 0                // id of "", for the start of a line or session
+#define PREDICT_MAGIC "RPLPRD1\n"
+
+// What a context is keyed on
+enum { CTX_CWD_PREV = 1, CTX_PREV, CTX_CWD, CTX_TOKEN };
+
+// Weights when backing off from the most specific context
+#define WEIGHT_CWD_PREV 4.0f
+#define WEIGHT_PREV 2.0f
+#define WEIGHT_CWD 1.0f
+#define WEIGHT_TOKEN 3.0f
+
+// Successor counts for one context
+struct context_slot {
+    uint64_t key;              // 0 when empty
+    uint32_t next[CANDIDATES];
+    uint16_t count[CANDIDATES];
+};
+
+static struct {
+    char *arena;
+    size_t arena_len;
+    size_t arena_cap;
+    uint32_t offsets[MAX_STRINGS];
+    uint32_t num_strings;
+    uint32_t lookup[STRING_TABLE];   // id + 1, 0 when empty
+    struct context_slot slots[CONTEXT_SLOTS];
+    unsigned contexts;
+    uint32_t prev;                   // last command line observed
+    unsigned long observed;
+} model;
+
+static uint32_t hash_bytes(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static const char *string_at(uint32_t id) {
+    return model.arena + model.offsets[id];
+}
+
+// Id of a string, adding it when create is set; NO_ID if unknown or full
+static uint32_t intern(const char *s, size_t len, int create) {
+    uint32_t h = hash_bytes(s, len) & (STRING_TABLE - 1);
+
+    for (uint32_t probe = 0; probe < STRING_TABLE; probe++) {
+        uint32_t slot = (h + probe) & (STRING_TABLE - 1);
+        uint32_t entry = model.lookup[slot];
+        if (entry == 0) {
+            if (!create || model.num_strings >= MAX_STRINGS) {
+                return NO_ID;
+            }
+            if (model.arena_len + len + 1 > model.arena_cap) {
+                size_t cap = model.arena_cap ? model.arena_cap * 2 : 65536;
+                while (cap < model.arena_len + len + 1) {
+                    cap *= 2;
+                }
+                char *arena = realloc(model.arena, cap);
+                if (!arena) {
+                    return NO_ID;
+                }
+                model.arena = arena;
+                model.arena_cap = cap;
+            }
+            uint32_t id = model.num_strings++;
+            model.offsets[id] = (uint32_t)model.arena_len;
+            memcpy(model.arena + model.arena_len, s, len);
+            model.arena[model.arena_len + len] = '\0';
+            model.arena_len += len + 1;
+            model.lookup[slot] = id + 1;
+            return id;
+        }
+        const char *existing = string_at(entry - 1);
+        if (strncmp(existing, s, len) == 0 && existing[len] == '\0') {
+            return entry - 1;
+        }
+    }
+    return NO_ID;
+}
+
+static void ensure_init(void) {
+    if (model.num_strings == 0) {
+        intern("", 0, 1); // START
+    }
+}
+
+static uint64_t context_key(int kind, uint32_t a, uint32_t b) {
+    return ((uint64_t)kind << 60) | ((uint64_t)a << 30) | b;
+}
+
+// Slot for a context; when creating and the probe run is full, the home
+// slot is recycled
+static struct context_slot *find_context(uint64_t key, int create) {
+    uint32_t h = (uint32_t)mix64(key) & (CONTEXT_SLOTS - 1);
+
+    for (int probe = 0; probe < MAX_PROBE; probe++) {
+        struct context_slot *slot = &model.slots[(h + probe) & (CONTEXT_SLOTS - 1)];
+        if (slot->key == key) {
+            return slot;
+        }
+        if (slot->key == 0) {
+            if (!create) {
+                return NULL;
+            }
+            slot->key = key;
+            model.contexts++;
+            return slot;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    struct context_slot *slot = &model.slots[h];
+    memset(slot, 0, sizeof(*slot));
+    slot->key = key;
+    return slot;
+}
+
+// Count one more occurrence of next after the context
+static void bump(int kind, uint32_t a, uint32_t b, uint32_t next) {
+    struct context_slot *slot = find_context(context_key(kind, a, b), 1);
+    int lowest = 0;
+
+    for (int i = 0; i < CANDIDATES; i++) {
+        if (slot->count[i] > 0 && slot->next[i] == next) {
+            if (slot->count[i] == UINT16_MAX) {
+                for (int j = 0; j < CANDIDATES; j++) {
+                    slot->count[j] /= 2;
+                }
+            }
+            slot->count[i]++;
+            return;
+        }
+        if (slot->count[i] < slot->count[lowest]) {
+            lowest = i;
+        }
+    }
+    // New successor replaces an empty or the least frequent one
+    slot->next[lowest] = next;
+    slot->count[lowest] = 1;
+}
+
+// Record a command line typed in cwd
+void ripple_predict_observe(const char *cwd, const char *line) {
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '\n')) {
+        len--;
+    }
+    if (len == 0 || len > MAX_LINE) {
+        return;
+    }
+
+    ensure_init();
+    uint32_t line_id = intern(line, len, 1);
+    uint32_t cwd_id = intern(cwd, strlen(cwd), 1);
+    if (line_id == NO_ID || cwd_id == NO_ID) {
+        return;
+    }
+
+    bump(CTX_CWD_PREV, cwd_id, model.prev, line_id);
+    bump(CTX_PREV, START, model.prev, line_id);
+    bump(CTX_CWD, cwd_id, START, line_id);
+
+    // Each token given the two before it
+    uint32_t t2 = START, t1 = START;
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && line[i] == ' ') {
+            i++;
+        }
+        size_t start = i;
+        while (i < len && line[i] != ' ') {
+            i++;
+        }
+        if (i == start) {
+            break;
+        }
+        uint32_t tok = intern(line + start, i - start, 1);
+        if (tok == NO_ID) {
+            break;
+        }
+        bump(CTX_TOKEN, t2, t1, tok);
+        t2 = t1;
+        t1 = tok;
+    }
+
+    model.prev = line_id;
+    model.observed++;
+}
+
+struct candidate {
+    char text[256];
+    float score;
+};
+
+static void add_candidate(struct candidate *cands, int *count, const char *text, float score) {
+    for (int i = 0; i < *count; i++) {
+        if (strcmp(cands[i].text, text) == 0) {
+            cands[i].score += score;
+            return;
+        }
+    }
+    if (*count < MAX_CANDIDATES) {
+        snprintf(cands[*count].text, sizeof(cands[*count].text), "%s", text);
+        cands[*count].score = score;
+        (*count)++;
+    }
+}
+
+// Whole command lines that followed this context and start with typed
+static float add_lines(struct candidate *cands, int *count, uint64_t key, float weight,
+                       const char *typed, size_t typed_len) {
+    const struct context_slot *slot = find_context(key, 0);
+    unsigned total = 0;
+
+    if (!slot) {
+        return 0.0f;
+    }
+    for (int i = 0; i < CANDIDATES; i++) {
+        total += slot->count[i];
+    }
+    for (int i = 0; i < CANDIDATES; i++) {
+        if (slot->count[i] == 0) {
+            continue;
+        }
+        const char *line = string_at(slot->next[i]);
+        if (strncmp(line, typed, typed_len) == 0 && line[typed_len] != '\0') {
+            add_candidate(cands, count, line, weight * slot->count[i] / total);
+        }
+    }
+    return weight;
+}
+
+// Next argument after the complete tokens of typed, matching its partial token
+static float add_tokens(struct candidate *cands, int *count, const char *typed) {
+    uint32_t t2 = START, t1 = START;
+    const char *p = typed;
+    const char *partial = typed;
+
+    // Walk the complete tokens; the last one is partial unless typed ends in a space
+    while (*p) {
+        while (*p == ' ') {
+            p++;
+        }
+        const char *start = p;
+        while (*p && *p != ' ') {
+            p++;
+        }
+        if (p == start) {
+            break;
+        }
+        if (*p == '\0') {
+            partial = start;
+            break;
+        }
+        uint32_t tok = intern(start, p - start, 0);
+        if (tok == NO_ID) {
+            return 0.0f;
+        }
+        t2 = t1;
+        t1 = tok;
+        partial = p + 1;
+    }
+    if (*partial == ' ') {
+        partial += strspn(partial, " ");
+    }
+
+    const struct context_slot *slot = find_context(context_key(CTX_TOKEN, t2, t1), 0);
+    if (!slot) {
+        return 0.0f;
+    }
+    size_t partial_len = strlen(partial);
+    unsigned total = 0;
+    for (int i = 0; i < CANDIDATES; i++) {
+        total += slot->count[i];
+    }
+    for (int i = 0; i < CANDIDATES; i++) {
+        if (slot->count[i] == 0) {
+            continue;
+        }
+        const char *tok = string_at(slot->next[i]);
+        if (strncmp(tok, partial, partial_len) == 0 && tok[partial_len] != '\0') {
+            char text[256];
+            snprintf(text, sizeof(text), "%.*s%s", (int)(partial - typed), typed, tok);
+            add_candidate(cands, count, text, WEIGHT_TOKEN * slot->count[i] / total);
+        }
+    }
+    return WEIGHT_TOKEN;
+}
+
+static int candidate_cmp(const void *a, const void *b) {
+    const struct candidate *x = a, *y = b;
+    return (x->score < y->score) - (x->score > y->score);
+}
+
+// Most likely completions of typed (the next command when it is empty),
+// best first. Returns how many were stored in out.
+int ripple_predict(const char *cwd, const char *typed, struct ripple_prediction *out, int max) {
+    struct candidate cands[MAX_CANDIDATES];
+    int count = 0;
+    float weights = 0.0f;
+
+    if (model.num_strings == 0) {
+        return 0;
+    }
+    while (*typed == ' ') {
+        typed++;
+    }
+    size_t typed_len = strlen(typed);
+    uint32_t cwd_id = intern(cwd, strlen(cwd), 0);
+
+    if (cwd_id != NO_ID) {
+        weights += add_lines(cands, &count, context_key(CTX_CWD_PREV, cwd_id, model.prev),
+                             WEIGHT_CWD_PREV, typed, typed_len);
+    }
+    weights += add_lines(cands, &count, context_key(CTX_PREV, START, model.prev), WEIGHT_PREV, typed, typed_len);
+    if (cwd_id != NO_ID) {
+        weights += add_lines(cands, &count, context_key(CTX_CWD, cwd_id, START), WEIGHT_CWD, typed, typed_len);
+    }
+    if (typed_len > 0) {
+        weights += add_tokens(cands, &count, typed);
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    qsort(cands, count, sizeof(cands[0]), candidate_cmp);
+    if (count > max) {
+        count = max;
+    }
+    for (int i = 0; i < count; i++) {
+        memcpy(out[i].text, cands[i].text, sizeof(out[i].text));
+        out[i].score = cands[i].score / weights;
+    }
+    return count;
+}
+
+void ripple_predict_reset(void) {
+    free(model.arena);
+    memset(&model, 0, sizeof(model));
+}
+
+void ripple_predict_stats(unsigned *strings, unsigned *contexts, unsigned long *observed) {
+    *strings = model.num_strings;
+    *contexts = model.contexts;
+    *observed = model.observed;
+}
+
+// Path of the model file: ~/.ripple_predict
+const char *ripple_predict_path(void) {
+    static char path[1024];
+    const char *home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", home ? home : ".", RIPPLE_PREDICT_FILE);
+    return path;
+}
+
+// File: magic, string count, previous line, observation count, the string
+// arena in id order, then every used context slot
+int ripple_predict_save(const char *path) {
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    uint32_t header[2] = { model.num_strings, model.prev };
+    uint64_t observed = model.observed;
+    uint32_t arena_len = (uint32_t)model.arena_len;
+    uint32_t used = 0;
+    for (int i = 0; i < CONTEXT_SLOTS; i++) {
+        used += model.slots[i].key != 0;
+    }
+
+    fwrite(PREDICT_MAGIC, 1, 8, file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(&observed, sizeof(observed), 1, file);
+    fwrite(&arena_len, sizeof(arena_len), 1, file);
+    fwrite(model.arena, 1, model.arena_len, file);
+    fwrite(&used, sizeof(used), 1, file);
+    for (int i = 0; i < CONTEXT_SLOTS; i++) {
+        if (model.slots[i].key != 0) {
+            fwrite(&model.slots[i], sizeof(model.slots[i]), 1, file);
+        }
+    }
+
+    int failed = ferror(file);
+    failed |= fclose(file);
+    if (failed || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Replace the model with the one in path; returns 0 on success, -1 if the
+// file is missing or damaged (the model is then empty)
+int ripple_predict_load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    char magic[8];
+    uint32_t header[2], arena_len, used;
+    uint64_t observed;
+
+    ripple_predict_reset();
+    if (!file) {
+        return -1;
+    }
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, PREDICT_MAGIC, 8) != 0 ||
+        fread(header, sizeof(header), 1, file) != 1 || fread(&observed, sizeof(observed), 1, file) != 1 ||
+        fread(&arena_len, sizeof(arena_len), 1, file) != 1 || header[0] > MAX_STRINGS) {
+        fclose(file);
+        return -1;
+    }
+
+    // Re-intern the strings in order so their ids come out the same
+    char *arena = malloc(arena_len + 1);
+    int ok = arena && fread(arena, 1, arena_len, file) == arena_len;
+    size_t pos = 0;
+    for (uint32_t id = 0; ok && id < header[0]; id++) {
+        size_t len = strnlen(arena + pos, arena_len - pos);
+        ok = pos + len < arena_len && intern(arena + pos, len, 1) == id;
+        pos += len + 1;
+    }
+    free(arena);
+
+    ok = ok && fread(&used, sizeof(used), 1, file) == 1 && used <= CONTEXT_SLOTS;
+    for (uint32_t i = 0; ok && i < used; i++) {
+        struct context_slot slot;
+        ok = fread(&slot, sizeof(slot), 1, file) == 1 && slot.key != 0;
+        for (int j = 0; ok && j < CANDIDATES; j++) {
+            ok = slot.count[j] == 0 || slot.next[j] < header[0];
+        }
+        if (ok) {
+            *find_context(slot.key, 1) = slot;
+        }
+    }
+    fclose(file);
+
+    if (!ok || header[1] >= model.num_strings) {
+        ripple_predict_reset();
+        return -1;
+    }
+    model.prev = header[1];
+    model.observed = observed;
+    return 0;
+}
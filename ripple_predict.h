@@ -0,0 +1,25 @@
+#ifndef RIPPLE_PREDICT_H
+#define RIPPLE_PREDICT_H
+
+// Offline next-command predictor: counts of which command followed which,
+// per working directory, plus which argument token followed the previous
+// two. Updated from the history and kept in ~/.ripple_predict.
+
+struct ripple_prediction {
+    char text[256];
+    float score;      // 0..1, share of the weighted counts
+};
+
+// Function declarations
+void ripple_predict_observe(const char* cwd, const char* line);
+int ripple_predict(const char* cwd, const char* typed, struct ripple_prediction* out, int max);
+void ripple_predict_reset(void);
+int ripple_predict_load(const char* path);
+int ripple_predict_save(const char* path);
+const char* ripple_predict_path(void);
+void ripple_predict_stats(unsigned* strings, unsigned* contexts, unsigned long* observed);
+
+// Constants
+#define RIPPLE_PREDICT_FILE ".ripple_predict"
+
+#endif // RIPPLE_PREDICT_H
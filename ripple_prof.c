@@ -0,0 +1,154 @@
+#include "ripple_prof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+struct prof_span {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// One per thread that has recorded; only that thread writes spans and
+// bumps head, readers take head with acquire and copy behind it
+struct prof_ring {
+    struct prof_span spans[RIPPLE_PROF_RING];
+    uint64_t head;                // spans ever written
+    int tid;                      // small id for the trace viewer
+    int in_use;                   // owner thread still alive
+    struct prof_ring *next;
+};
+
+int ripple_prof_enabled = 0;
+
+static struct {
+    pthread_mutex_t lock;         // ring list and start/stop, never taken while recording
+    pthread_key_t key;
+    pthread_once_t once;
+    struct prof_ring *rings;
+    int next_tid;
+    uint64_t started_ns;
+} prof = { PTHREAD_MUTEX_INITIALIZER, 0, PTHREAD_ONCE_INIT };
+
+static __thread struct prof_ring *my_ring;
+
+uint64_t ripple_prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// A finished thread's ring can be handed to the next new thread
+static void release_ring(void *arg) {
+    struct prof_ring *ring = arg;
+    pthread_mutex_lock(&prof.lock);
+    ring->in_use = 0;
+    pthread_mutex_unlock(&prof.lock);
+}
+
+static void make_key(void) {
+    pthread_key_create(&prof.key, release_ring);
+}
+
+static struct prof_ring *attach_ring(void) {
+    struct prof_ring *ring;
+
+    pthread_once(&prof.once, make_key);
+    pthread_mutex_lock(&prof.lock);
+    for (ring = prof.rings; ring && ring->in_use; ring = ring->next) {
+    }
+    if (ring) {
+        __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+    } else if ((ring = calloc(1, sizeof(*ring))) != NULL) {
+        ring->next = prof.rings;
+        prof.rings = ring;
+    }
+    if (ring) {
+        ring->in_use = 1;
+        ring->tid = ++prof.next_tid;
+    }
+    pthread_mutex_unlock(&prof.lock);
+    if (ring) {
+        pthread_setspecific(prof.key, ring);
+    }
+    return ring;
+}
+
+// Finish a span begun at start_ns
+void ripple_prof_record(const char *name, uint64_t start_ns) {
+    uint64_t end = ripple_prof_now();
+    struct prof_ring *ring = my_ring;
+
+    if (!ring && (ring = my_ring = attach_ring()) == NULL) {
+        return;
+    }
+    uint64_t head = ring->head;
+    struct prof_span *s = &ring->spans[head % RIPPLE_PROF_RING];
+    s->name = name;
+    s->start_ns = start_ns;
+    s->end_ns = end;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void ripple_prof_start(void) {
+    pthread_mutex_lock(&prof.lock);
+    prof.started_ns = ripple_prof_now();
+    pthread_mutex_unlock(&prof.lock);
+    __atomic_store_n(&ripple_prof_enabled, 1, __ATOMIC_RELEASE);
+}
+
+int ripple_prof_active(void) {
+    return __atomic_load_n(&ripple_prof_enabled, __ATOMIC_ACQUIRE);
+}
+
+// JSON string for a span name; names are identifiers in practice
+static void write_name(FILE *f, const char *name) {
+    fputc('"', f);
+    for (; *name; name++) {
+        if (*name == '"' || *name == '\\') {
+            fputc('\\', f);
+        }
+        fputc((unsigned char)*name < 0x20 ? '?' : *name, f);
+    }
+    fputc('"', f);
+}
+
+// Stop recording and write the spans since ripple_prof_start to path as
+// Chrome trace events. *events gets how many were written.
+int ripple_prof_stop(const char *path, long *events) {
+    __atomic_store_n(&ripple_prof_enabled, 0, __ATOMIC_RELEASE);
+    *events = 0;
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"ripple\"}}", pid);
+
+    pthread_mutex_lock(&prof.lock);
+    uint64_t since = prof.started_ns;
+    for (struct prof_ring *ring = prof.rings; ring; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t first = head > RIPPLE_PROF_RING ? head - RIPPLE_PROF_RING : 0;
+        for (uint64_t i = first; i < head; i++) {
+            const struct prof_span *s = &ring->spans[i % RIPPLE_PROF_RING];
+            if (s->start_ns < since) {
+                continue;
+            }
+            fprintf(f, ",\n{\"name\": ");
+            write_name(f, s->name);
+            fprintf(f, ", \"cat\": \"ripple\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+                    (s->start_ns - since) / 1000.0, (s->end_ns - s->start_ns) / 1000.0, pid, ring->tid);
+            (*events)++;
+        }
+    }
+    pthread_mutex_unlock(&prof.lock);
+
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,47 @@
+#ifndef RIPPLE_PROF_H
+#define RIPPLE_PROF_H
+
+#include <stdint.h>
+
+// Span profiler for the shell's hot paths. A span is a begin timestamp and
+// an end call naming it; while profiling is off, begin is one load and a
+// branch and end is a branch. Spans go into a per-thread ring that only
+// its thread writes, so recording takes no lock, and 'profile stop' dumps
+// them as Chrome trace_event JSON (chrome://tracing, Perfetto).
+//
+//   uint64_t t = ripple_prof_begin();
+//   ...
+//   ripple_prof_end(t, "split_line");
+//
+// Names must be string literals or otherwise outlive the profile.
+// Building with -DRIPPLE_NO_PROFILE compiles the spans out.
+
+extern int ripple_prof_enabled;
+
+// Function declarations
+uint64_t ripple_prof_now(void);
+void ripple_prof_record(const char* name, uint64_t start_ns);
+void ripple_prof_start(void);
+int ripple_prof_stop(const char* path, long* events);
+int ripple_prof_active(void);
+
+#ifdef RIPPLE_NO_PROFILE
+static inline uint64_t ripple_prof_begin(void) { return 0; }
+static inline void ripple_prof_end(uint64_t start, const char* name) { (void)start; (void)name; }
+#else
+static inline uint64_t ripple_prof_begin(void) {
+    return __builtin_expect(ripple_prof_enabled, 0) ? ripple_prof_now() : 0;
+}
+
+static inline void ripple_prof_end(uint64_t start, const char* name) {
+    if (__builtin_expect(start != 0, 0)) {
+        ripple_prof_record(name, start);
+    }
+}
+#endif
+
+// Constants
+#define RIPPLE_PROF_RING 16384          // spans kept per thread; older ones are overwritten
+#define RIPPLE_PROF_FILE "ripple-profile.json"
+
+#endif // RIPPLE_PROF_H
@@ -0,0 +1,402 @@
+#include "ripple_prompt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+// What was last learned about one repository, and the index and HEAD
+// mtimes it was learned at
+struct git_entry {
+    char gitdir[PATH_MAX];
+    struct timespec index_mtime;
+    struct timespec head_mtime;
+    double checked;
+    double used;
+    char text[RIPPLE_PROMPT_SEGMENT];
+};
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int notify[2];                // worker -> line editor, one byte per result
+    char *cwd;
+    struct git_entry cache[RIPPLE_PROMPT_GIT_CACHE];
+    int queued;                   // a job waits in job_*
+    int busy;                     // the worker is running git
+    int unread;                   // results not yet drained by the shell
+    char job_gitdir[PATH_MAX];
+    char job_worktree[PATH_MAX];
+} prompt = { .once = PTHREAD_ONCE_INIT, .lock = PTHREAD_MUTEX_INITIALIZER,
+             .wake = PTHREAD_COND_INITIALIZER, .notify = { -1, -1 } };
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct timespec mtime_of(const char *dir, const char *name) {
+    char path[PATH_MAX + 16];
+    struct stat sb;
+    struct timespec none = { 0, 0 };
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (stat(path, &sb) != 0) {
+        return none;
+    }
+#ifdef __APPLE__
+    return sb.st_mtimespec;
+#else
+    return sb.st_mtim;
+#endif
+}
+
+static int same_time(struct timespec a, struct timespec b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Walk up from dir to the nearest .git. A .git file (worktrees, submodules)
+// names the real git directory. Returns 1 when dir is inside a repository.
+static int find_repo(const char *dir, char *worktree, char *gitdir) {
+    char path[PATH_MAX];
+    struct stat sb;
+
+    snprintf(worktree, PATH_MAX, "%s", dir);
+    for (;;) {
+        int len = snprintf(path, sizeof(path), "%s/.git", strcmp(worktree, "/") == 0 ? "" : worktree);
+        if (len < (int)sizeof(path) && stat(path, &sb) == 0) {
+            if (S_ISDIR(sb.st_mode)) {
+                memcpy(gitdir, path, len + 1);
+                return 1;
+            }
+            FILE *f = fopen(path, "r");
+            char line[PATH_MAX + 16];
+            if (f && fgets(line, sizeof(line), f) && strncmp(line, "gitdir: ", 8) == 0) {
+                fclose(f);
+                line[strcspn(line, "\r\n")] = '\0';
+                if (line[8] == '/') {
+                    len = snprintf(gitdir, PATH_MAX, "%s", line + 8);
+                } else {
+                    len = snprintf(gitdir, PATH_MAX, "%s/%s", worktree, line + 8);
+                }
+                return len < PATH_MAX;
+            }
+            if (f) {
+                fclose(f);
+            }
+        }
+        char *slash = strrchr(worktree, '/');
+        if (!slash || slash == worktree) {
+            if (strcmp(worktree, "/") == 0 || !slash) {
+                return 0;
+            }
+            worktree[1] = '\0';
+        } else {
+            *slash = '\0';
+        }
+    }
+}
+
+// Branch name from HEAD, or the abbreviated commit when it is detached
+static void read_branch(const char *gitdir, char *out, size_t size) {
+    char path[PATH_MAX + 8], head[256] = "";
+    snprintf(path, sizeof(path), "%s/HEAD", gitdir);
+    FILE *f = fopen(path, "r");
+    out[0] = '\0';
+    if (!f) {
+        return;
+    }
+    if (fgets(head, sizeof(head), f)) {
+        const char *name = head;
+        size_t len = strcspn(head, "\r\n");
+        if (strncmp(head, "ref: refs/heads/", 16) == 0) {
+            name += 16;
+            len -= 16;
+        } else if (strncmp(head, "ref: ", 5) == 0) {
+            name += 5;
+            len -= 5;
+        } else if (len > 7) {
+            len = 7;
+        }
+        if (len >= size) {
+            len = size - 1;
+        }
+        memcpy(out, name, len);
+        out[len] = '\0';
+    }
+    fclose(f);
+}
+
+// git status --porcelain, which is the expensive part: '*' if anything
+// tracked changed, '?' if there are untracked files. Optional locks are off
+// so the status does not rewrite the index and move the cache key.
+static void read_dirty(const char *worktree, char *flags) {
+    char *argv[] = { "git", "--no-optional-locks", "-C", (char *)worktree, "status", "--porcelain",
+                     "--ignore-submodules=dirty", NULL };
+    posix_spawn_file_actions_t actions;
+    int out[2];
+    pid_t pid;
+    int changed = 0, untracked = 0;
+
+    flags[0] = '\0';
+    if (pipe(out) != 0) {
+        return;
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addclose(&actions, out[0]);
+    int rc = posix_spawnp(&pid, "git", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(out[1]);
+    if (rc != 0) {
+        close(out[0]);
+        return;
+    }
+
+    // Each line starts with two status letters; only the starts matter
+    char buf[8192];
+    int at_line_start = 1;
+    ssize_t n;
+    while ((n = read(out[0], buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (at_line_start) {
+                if (buf[i] == '?') {
+                    untracked = 1;
+                } else {
+                    changed = 1;
+                }
+            }
+            at_line_start = buf[i] == '\n';
+        }
+    }
+    close(out[0]);
+    // ECHILD if something else in the shell reaped it first; the output is
+    // what counts
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    snprintf(flags, 3, "%s%s", changed ? "*" : "", untracked ? "?" : "");
+}
+
+// Compute the git segment for dir synchronously. Returns 1 inside a
+// repository, 0 (and an empty segment) outside one.
+int ripple_prompt_git(const char *dir, char *out, size_t size) {
+    char worktree[PATH_MAX], gitdir[PATH_MAX], branch[RIPPLE_PROMPT_SEGMENT - 2], flags[3];
+    out[0] = '\0';
+    if (!find_repo(dir, worktree, gitdir)) {
+        return 0;
+    }
+    read_branch(gitdir, branch, sizeof(branch));
+    read_dirty(worktree, flags);
+    snprintf(out, size, "%s%s", branch, flags);
+    return 1;
+}
+
+static struct git_entry *find_entry(const char *gitdir) {
+    for (int i = 0; i < RIPPLE_PROMPT_GIT_CACHE; i++) {
+        if (strcmp(prompt.cache[i].gitdir, gitdir) == 0) {
+            return &prompt.cache[i];
+        }
+    }
+    return NULL;
+}
+
+// The entry for gitdir, reusing the least recently shown one; lock held
+static struct git_entry *claim_entry(const char *gitdir) {
+    struct git_entry *entry = find_entry(gitdir);
+    if (entry) {
+        return entry;
+    }
+    entry = &prompt.cache[0];
+    for (int i = 1; i < RIPPLE_PROMPT_GIT_CACHE; i++) {
+        if (prompt.cache[i].used < entry->used) {
+            entry = &prompt.cache[i];
+        }
+    }
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->gitdir, sizeof(entry->gitdir), "%s", gitdir);
+    return entry;
+}
+
+// Runs one job at a time; a newer request replaces one not yet started
+static void *git_worker(void *arg) {
+    char gitdir[PATH_MAX], worktree[PATH_MAX], branch[RIPPLE_PROMPT_SEGMENT - 2], flags[3];
+    (void)arg;
+    pthread_mutex_lock(&prompt.lock);
+    for (;;) {
+        while (!prompt.queued) {
+            pthread_cond_wait(&prompt.wake, &prompt.lock);
+        }
+        memcpy(gitdir, prompt.job_gitdir, sizeof(gitdir));
+        memcpy(worktree, prompt.job_worktree, sizeof(worktree));
+        prompt.queued = 0;
+        prompt.busy = 1;
+        pthread_mutex_unlock(&prompt.lock);
+
+        // Key first: a change to the index during the status shows up as a
+        // stale key on the next prompt rather than being lost
+        struct timespec index_mtime = mtime_of(gitdir, "index");
+        struct timespec head_mtime = mtime_of(gitdir, "HEAD");
+        read_branch(gitdir, branch, sizeof(branch));
+        read_dirty(worktree, flags);
+
+        pthread_mutex_lock(&prompt.lock);
+        struct git_entry *entry = claim_entry(gitdir);
+        entry->index_mtime = index_mtime;
+        entry->head_mtime = head_mtime;
+        entry->checked = now_seconds();
+        snprintf(entry->text, sizeof(entry->text), "%s%s", branch, flags);
+        prompt.busy = 0;
+        prompt.unread = 1;
+        if (write(prompt.notify[1], "", 1) < 0) {
+            // Full pipe: the shell has a wakeup waiting already
+        }
+    }
+    return NULL;
+}
+
+static void start(void) {
+    pthread_t thread;
+    if (pipe(prompt.notify) != 0) {
+        prompt.notify[0] = prompt.notify[1] = -1;
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(prompt.notify[i], F_SETFL, O_NONBLOCK);
+        fcntl(prompt.notify[i], F_SETFD, FD_CLOEXEC);
+    }
+    if (pthread_create(&thread, NULL, git_worker, NULL) != 0) {
+        close(prompt.notify[0]);
+        close(prompt.notify[1]);
+        prompt.notify[0] = prompt.notify[1] = -1;
+        return;
+    }
+    pthread_detach(thread);
+}
+
+// Last known git segment for the repository holding dir; queues a refresh
+// when the index or HEAD moved or the status is older than the TTL
+static void git_segment(const char *dir, char *out, size_t size) {
+    char worktree[PATH_MAX], gitdir[PATH_MAX];
+    out[0] = '\0';
+    if (!find_repo(dir, worktree, gitdir)) {
+        return;
+    }
+    pthread_once(&prompt.once, start);
+    struct timespec index_mtime = mtime_of(gitdir, "index");
+    struct timespec head_mtime = mtime_of(gitdir, "HEAD");
+    double now = now_seconds();
+
+    pthread_mutex_lock(&prompt.lock);
+    struct git_entry *entry = find_entry(gitdir);
+    int fresh = 0;
+    if (entry) {
+        snprintf(out, size, "%s", entry->text);
+        entry->used = now;
+        fresh = same_time(entry->index_mtime, index_mtime) && same_time(entry->head_mtime, head_mtime) &&
+                now - entry->checked < RIPPLE_PROMPT_GIT_TTL;
+    }
+    int running = (prompt.queued || prompt.busy) && strcmp(prompt.job_gitdir, gitdir) == 0;
+    if (!fresh && !running && prompt.notify[1] >= 0) {
+        snprintf(prompt.job_gitdir, sizeof(prompt.job_gitdir), "%s", gitdir);
+        snprintf(prompt.job_worktree, sizeof(prompt.job_worktree), "%s", worktree);
+        prompt.queued = 1;
+        pthread_cond_signal(&prompt.wake);
+    }
+    pthread_mutex_unlock(&prompt.lock);
+}
+
+// The shell's working directory, cached between directory changes
+const char *ripple_prompt_cwd(void) {
+    if (!prompt.cwd) {
+        return ripple_prompt_cwd_changed();
+    }
+    return prompt.cwd;
+}
+
+// Re-read the working directory after a chdir. getcwd sizes the buffer,
+// so deep paths are not cut short.
+const char *ripple_prompt_cwd_changed(void) {
+    char *cwd = getcwd(NULL, 0);
+    if (cwd) {
+        free(prompt.cwd);
+        prompt.cwd = cwd;
+    } else if (!prompt.cwd) {
+        prompt.cwd = strdup("");
+    }
+    return prompt.cwd;
+}
+
+// Terminal columns taken by s: escapes excluded, UTF-8 counted per character
+static int visible_width(const char *s) {
+    int width = 0;
+    for (; *s; s++) {
+        if (*s == '\033') {
+            while (*s && !(*s >= 'A' && *s <= 'Z') && !(*s >= 'a' && *s <= 'z')) {
+                s++;
+            }
+            if (!*s) {
+                break;
+            }
+        } else if (((unsigned char)*s & 0xc0) != 0x80) {
+            width++;
+        }
+    }
+    return width;
+}
+
+// Build the prompt from its segments into out; returns its visible width
+int ripple_prompt_render(char *out, size_t size) {
+    const char *cwd = ripple_prompt_cwd();
+    char git[RIPPLE_PROMPT_SEGMENT];
+
+    if (cwd[0] == '\0') {
+        snprintf(out, size, "> ");
+        return 2;
+    }
+    git_segment(cwd, git, sizeof(git));
+    if (git[0]) {
+        snprintf(out, size, "\033[1;32m%s\033[0m \033[1;35m(%s)\033[0m > ", cwd, git);
+    } else {
+        snprintf(out, size, "\033[1;32m%s\033[0m > ", cwd);
+    }
+    return visible_width(out);
+}
+
+// Whether a segment may still change the prompt on screen
+int ripple_prompt_pending(void) {
+    pthread_mutex_lock(&prompt.lock);
+    int pending = prompt.queued || prompt.busy || prompt.unread;
+    pthread_mutex_unlock(&prompt.lock);
+    return pending;
+}
+
+int ripple_prompt_notify_fd(void) {
+    return prompt.notify[0];
+}
+
+void ripple_prompt_drain(void) {
+    char buf[64];
+    pthread_mutex_lock(&prompt.lock);
+    prompt.unread = 0;
+    pthread_mutex_unlock(&prompt.lock);
+    while (prompt.notify[0] >= 0 && read(prompt.notify[0], buf, sizeof(buf)) > 0) {
+    }
+}
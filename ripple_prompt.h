@@ -0,0 +1,28 @@
+#ifndef RIPPLE_PROMPT_H
+#define RIPPLE_PROMPT_H
+
+#include <stddef.h>
+
+// Prompt rendering from segments. The cwd segment is cached and refreshed
+// only when the shell changes directory. The git segment (branch, and
+// whether the tree is dirty) costs a git status, so it is computed on a
+// background thread: the prompt prints at once with the last value known
+// for the repository, and the notify fd turns readable when a fresher one
+// is ready, for the line editor to redraw in place.
+
+// Function declarations
+const char* ripple_prompt_cwd(void);
+const char* ripple_prompt_cwd_changed(void);
+int ripple_prompt_render(char* out, size_t size);
+int ripple_prompt_pending(void);
+int ripple_prompt_notify_fd(void);
+void ripple_prompt_drain(void);
+int ripple_prompt_git(const char* dir, char* out, size_t size);
+
+// Constants
+#define RIPPLE_PROMPT_SIZE 4352           // rendered prompt, escapes included
+#define RIPPLE_PROMPT_SEGMENT 128
+#define RIPPLE_PROMPT_GIT_CACHE 8         // repositories remembered
+#define RIPPLE_PROMPT_GIT_TTL 2.0         // seconds a status is trusted while the index is unchanged
+
+#endif // RIPPLE_PROMPT_H
@@ -0,0 +1,233 @@
+#include "ripple_proto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL // a closed peer must not kill the shell
+#else
+#define SEND_FLAGS 0            // macOS: SO_NOSIGPIPE is set on the socket
+#endif
+
+void rp_reset(struct rp_msg *m) {
+    m->len = 0;
+    m->pos = 0;
+    m->error = 0;
+}
+
+static void put_bytes(struct rp_msg *m, const void *p, size_t n) {
+    if (m->len + n > sizeof(m->data)) {
+        m->error = 1;
+        return;
+    }
+    memcpy(m->data + m->len, p, n);
+    m->len += n;
+}
+
+void rp_put_u8(struct rp_msg *m, uint8_t v) {
+    put_bytes(m, &v, 1);
+}
+
+void rp_put_u32(struct rp_msg *m, uint32_t v) {
+    put_bytes(m, &v, 4);
+}
+
+// Strings longer than a u16 length are cut
+void rp_put_str(struct rp_msg *m, const char *s, size_t len) {
+    uint16_t n = len > 0xffff ? 0xffff : (uint16_t)len;
+    put_bytes(m, &n, 2);
+    put_bytes(m, s, n);
+}
+
+static int get_bytes(struct rp_msg *m, void *p, size_t n) {
+    if (m->pos + n > m->len) {
+        m->error = 1;
+        memset(p, 0, n);
+        return -1;
+    }
+    memcpy(p, m->data + m->pos, n);
+    m->pos += n;
+    return 0;
+}
+
+uint8_t rp_get_u8(struct rp_msg *m) {
+    uint8_t v;
+    get_bytes(m, &v, 1);
+    return v;
+}
+
+uint32_t rp_get_u32(struct rp_msg *m) {
+    uint32_t v;
+    get_bytes(m, &v, 4);
+    return v;
+}
+
+// Copy a string into out (cut to fit, always terminated); returns its
+// length on the wire
+size_t rp_get_str(struct rp_msg *m, char *out, size_t size) {
+    uint16_t n;
+    if (get_bytes(m, &n, 2) != 0 || m->pos + n > m->len) {
+        m->error = 1;
+        if (size > 0) {
+            out[0] = '\0';
+        }
+        return 0;
+    }
+    if (size > 0) {
+        size_t copy = n < size ? n : size - 1;
+        memcpy(out, m->data + m->pos, copy);
+        out[copy] = '\0';
+    }
+    m->pos += n;
+    return n;
+}
+
+// Send one message; returns 0, or -1 if the peer is gone
+int rp_send(int fd, int type, const struct rp_msg *m) {
+    struct rp_header h = { RIPPLE_PROTO_MAGIC, RIPPLE_PROTO_VERSION, (uint8_t)type, (uint32_t)m->len };
+    struct iovec iov[2] = { { &h, sizeof(h) }, { (void *)m->data, m->len } };
+    struct msghdr msg;
+    size_t total = sizeof(h) + m->len, sent = 0;
+
+    if (m->error) {
+        return -1;
+    }
+    while (sent < total) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        ssize_t n = sendmsg(fd, &msg, SEND_FLAGS);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        sent += n;
+        // Skip what went out; short writes are rare on a local socket
+        for (int i = 0; i < 2; i++) {
+            size_t used = (size_t)n < iov[i].iov_len ? (size_t)n : iov[i].iov_len;
+            iov[i].iov_base = (char *)iov[i].iov_base + used;
+            iov[i].iov_len -= used;
+            n -= used;
+        }
+    }
+    return 0;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Read exactly n bytes before the deadline (no deadline if negative).
+// Returns 0, -1 on EOF or error, -2 on timeout.
+static int read_full(int fd, void *buf, size_t n, double deadline) {
+    size_t got = 0;
+    while (got < n) {
+        if (deadline >= 0) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int wait = (int)(deadline - now_ms());
+            if (wait <= 0 || poll(&pfd, 1, wait) == 0) {
+                return -2;
+            }
+        }
+        ssize_t r = read(fd, (char *)buf + got, n - got);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        got += r;
+    }
+    return 0;
+}
+
+// Receive one message within timeout_ms (or wait forever if negative).
+// Returns 0, -1 on EOF or a malformed header, -2 on timeout.
+int rp_recv(int fd, int *type, struct rp_msg *m, long timeout_ms) {
+    struct rp_header h;
+    double deadline = timeout_ms < 0 ? -1 : now_ms() + timeout_ms;
+    int rc;
+
+    rp_reset(m);
+    if ((rc = read_full(fd, &h, sizeof(h), deadline)) != 0) {
+        return rc;
+    }
+    if (h.magic != RIPPLE_PROTO_MAGIC || h.version != RIPPLE_PROTO_VERSION || h.length > sizeof(m->data)) {
+        return -1;
+    }
+    if ((rc = read_full(fd, m->data, h.length, deadline)) != 0) {
+        return rc;
+    }
+    m->len = h.length;
+    *type = h.type;
+    return 0;
+}
+
+void rp_put_suggestions(struct rp_msg *m, int result, int flags, const struct ollama_suggestion *out,
+                        int count, const char *raw) {
+    rp_put_u8(m, (uint8_t)(int8_t)result);
+    rp_put_u8(m, (uint8_t)flags);
+    rp_put_u8(m, (uint8_t)(count > 0 ? count : 0));
+    for (int i = 0; i < count; i++) {
+        rp_put_str(m, out[i].cmd, strlen(out[i].cmd));
+        rp_put_str(m, out[i].desc, strlen(out[i].desc));
+    }
+    rp_put_str(m, raw ? raw : "", raw ? strlen(raw) : 0);
+}
+
+// Decode a suggestion reply into out; *raw gets a malloc'd copy of the
+// model's text or NULL. Returns the result the daemon got, or -1 if the
+// message is malformed.
+int rp_get_suggestions(struct rp_msg *m, int *flags, struct ollama_suggestion *out, int max, char **raw) {
+    int result = (int8_t)rp_get_u8(m);
+    *flags = rp_get_u8(m);
+    int count = rp_get_u8(m);
+    struct ollama_suggestion skip;
+
+    *raw = NULL;
+    for (int i = 0; i < count; i++) {
+        struct ollama_suggestion *s = i < max ? &out[i] : &skip;
+        rp_get_str(m, s->cmd, sizeof(s->cmd));
+        rp_get_str(m, s->desc, sizeof(s->desc));
+    }
+    size_t raw_pos = m->pos + 2;
+    size_t raw_len = rp_get_str(m, NULL, 0);
+    if (m->error) {
+        return -1;
+    }
+    if (raw_len > 0 && (*raw = malloc(raw_len + 1)) != NULL) {
+        memcpy(*raw, m->data + raw_pos, raw_len);
+        (*raw)[raw_len] = '\0';
+    }
+    if (result < 0) {
+        return result;
+    }
+    return count < max ? count : max;
+}
+
+// $RIPPLE_DAEMON_SOCKET, else $XDG_RUNTIME_DIR/ripple.sock, else
+// /tmp/ripple-<uid>.sock
+const char *ripple_daemon_socket_path(void) {
+    static char path[108]; // sun_path size on Linux
+    const char *env = getenv("RIPPLE_DAEMON_SOCKET");
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+
+    if (env && *env) {
+        snprintf(path, sizeof(path), "%s", env);
+    } else if (runtime && *runtime) {
+        snprintf(path, sizeof(path), "%s/%s", runtime, RIPPLE_DAEMON_SOCKET);
+    } else {
+        snprintf(path, sizeof(path), "/tmp/ripple-%d.sock", (int)getuid());
+    }
+    return path;
+}
@@ -0,0 +1,82 @@
+#ifndef RIPPLE_PROTO_H
+#define RIPPLE_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ollama_codec.h"
+
+// Binary protocol between shells and ripple-daemon over a Unix socket.
+// Every message is an 8-byte header (magic, version, type, payload length,
+// native byte order since both ends share the host) and a payload built
+// from u8/u32 fields and strings with a u16 length prefix.
+//
+//   SUGGEST  u8 max, str prompt
+//     reply  i8 result, u8 flags, u8 count, count x (str cmd, str desc),
+//            str raw (empty when there is none)
+//   STATS    (empty)
+//     reply  u32 sessions, u32 requests, u32 cache hits, u32 shared,
+//            u32 sent to Ollama, str diagnostics
+//   PING     (empty)
+//     reply  PONG (empty)
+//   Any request may be answered with ERROR: str message.
+
+#define RIPPLE_PROTO_MAX 32768      // largest payload
+
+struct rp_header {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint32_t length;
+};
+
+// Message under construction or being read; pos is the read cursor
+struct rp_msg {
+    uint8_t data[RIPPLE_PROTO_MAX];
+    size_t len;
+    size_t pos;
+    int error;            // set on overflow or a short read
+};
+
+struct rp_stats {
+    uint32_t sessions;
+    uint32_t requests;
+    uint32_t cache_hits;
+    uint32_t shared;
+    uint32_t sent;
+};
+
+// Function declarations
+void rp_reset(struct rp_msg* m);
+void rp_put_u8(struct rp_msg* m, uint8_t v);
+void rp_put_u32(struct rp_msg* m, uint32_t v);
+void rp_put_str(struct rp_msg* m, const char* s, size_t len);
+uint8_t rp_get_u8(struct rp_msg* m);
+uint32_t rp_get_u32(struct rp_msg* m);
+size_t rp_get_str(struct rp_msg* m, char* out, size_t size);
+int rp_send(int fd, int type, const struct rp_msg* m);
+int rp_recv(int fd, int* type, struct rp_msg* m, long timeout_ms);
+void rp_put_suggestions(struct rp_msg* m, int result, int flags, const struct ollama_suggestion* out,
+                        int count, const char* raw);
+int rp_get_suggestions(struct rp_msg* m, int* flags, struct ollama_suggestion* out, int max, char** raw);
+const char* ripple_daemon_socket_path(void);
+
+// Constants
+#define RIPPLE_PROTO_MAGIC 0x5052   // "RP"
+#define RIPPLE_PROTO_VERSION 1
+#define RIPPLE_DAEMON_SOCKET "ripple.sock"
+
+// Message types; replies have the high bit set
+enum {
+    RP_PING = 1,
+    RP_SUGGEST = 2,
+    RP_STATS = 3,
+    RP_PONG = 0x81,
+    RP_SUGGEST_REPLY = 0x82,
+    RP_STATS_REPLY = 0x83,
+    RP_ERROR = 0xff
+};
+
+// Flags on a suggestion reply
+#define RP_FLAG_CACHED 1
+
+#endif // RIPPLE_PROTO_H
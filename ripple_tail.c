@@ -0,0 +1,412 @@
+#include "ripple_tail.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// pread until len bytes or EOF; returns the count, or -1 on error
+static ssize_t read_at(int fd, char *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + (off_t)done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+// The last '\n' in p[0..n), or NULL; 16 bytes at a time from the end
+static const char *last_newline(const char *p, size_t n) {
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (n >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + n - 16));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+        if (mask) {
+            return p + n - 16 + (31 - __builtin_clz(mask));
+        }
+        n -= 16;
+    }
+#endif
+    while (n > 0) {
+        if (p[--n] == '\n') {
+            return p + n;
+        }
+    }
+    return NULL;
+}
+
+// Offset of the first of the last count lines in buf. A newline ending the
+// data closes the last line rather than starting an empty one.
+static size_t tail_start_mem(const char *buf, size_t len, long count) {
+    size_t n = len;
+    if (count == 0) {
+        return len;
+    }
+    if (n > 0 && buf[n - 1] == '\n') {
+        n--;
+    }
+    const char *p;
+    while ((p = last_newline(buf, n)) != NULL) {
+        if (--count == 0) {
+            return (size_t)(p - buf) + 1;
+        }
+        n = (size_t)(p - buf);
+    }
+    return 0;
+}
+
+// As tail_start_mem for a file of size bytes, reading one block at a time
+// backwards from the end until enough newlines have been seen
+static off_t tail_start_file(int fd, off_t size, long count, char *buf) {
+    off_t pos = size;
+    if (count == 0) {
+        return size;
+    }
+    while (pos > 0) {
+        off_t start = pos > RIPPLE_TAIL_BLOCK ? pos - RIPPLE_TAIL_BLOCK : 0;
+        size_t n = (size_t)(pos - start);
+        if (read_at(fd, buf, n, start) != (ssize_t)n) {
+            return -1;
+        }
+        if (pos == size && buf[n - 1] == '\n') {
+            n--;
+        }
+        const char *p;
+        while ((p = last_newline(buf, n)) != NULL) {
+            if (--count == 0) {
+                return start + (p - buf) + 1;
+            }
+            n = (size_t)(p - buf);
+        }
+        pos = start;
+    }
+    return 0;
+}
+
+// Copy [from, to) of fd to out; returns the offset reached
+static off_t copy_range(int fd, off_t from, off_t to, FILE *out, char *buf) {
+    while (from < to) {
+        size_t want = to - from > RIPPLE_TAIL_BLOCK ? RIPPLE_TAIL_BLOCK : (size_t)(to - from);
+        ssize_t n = read_at(fd, buf, want, from);
+        if (n <= 0) {
+            break;
+        }
+        fwrite(buf, 1, (size_t)n, out);
+        from += n;
+    }
+    return from;
+}
+
+// Print the first count lines (or bytes) of fd, reading no further than
+// the block that holds the last of them
+int ripple_head_fd(int fd, long count, int bytes, FILE *out) {
+    char *buf = malloc(RIPPLE_TAIL_BLOCK);
+    int rc = 0;
+
+    if (!buf) {
+        return -1;
+    }
+    while (count > 0) {
+        size_t want = bytes && count < RIPPLE_TAIL_BLOCK ? (size_t)count : RIPPLE_TAIL_BLOCK;
+        ssize_t n = read(fd, buf, want);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = -1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        size_t keep = (size_t)n;
+        if (bytes) {
+            count -= n;
+        } else {
+            const char *p = buf, *end = buf + n;
+            while (count > 0 && (p = memchr(p, '\n', end - p)) != NULL) {
+                p++;
+                count--;
+            }
+            if (count == 0) {
+                keep = (size_t)(p - buf);
+            }
+        }
+        fwrite(buf, 1, keep, out);
+    }
+    free(buf);
+    return rc;
+}
+
+// Tail of something that cannot seek: keep reading, dropping what can no
+// longer be in the last count lines once the buffer has doubled
+static int tail_stream(int fd, long count, int bytes, FILE *out) {
+    size_t cap = RIPPLE_TAIL_BLOCK * 4, len = 0, trim_at = cap;
+    char *buf = malloc(cap);
+
+    if (!buf) {
+        return -1;
+    }
+    for (;;) {
+        if (cap - len < RIPPLE_TAIL_BLOCK) {
+            char *tmp = realloc(buf, cap * 2);
+            if (!tmp) {
+                free(buf);
+                return -1;
+            }
+            buf = tmp;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, RIPPLE_TAIL_BLOCK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+        if (len >= trim_at) {
+            size_t start = bytes ? (len > (size_t)count ? len - (size_t)count : 0) : tail_start_mem(buf, len, count);
+            memmove(buf, buf + start, len - start);
+            len -= start;
+            trim_at = len * 2 > RIPPLE_TAIL_BLOCK * 4 ? len * 2 : RIPPLE_TAIL_BLOCK * 4;
+        }
+    }
+    size_t start = bytes ? (len > (size_t)count ? len - (size_t)count : 0) : tail_start_mem(buf, len, count);
+    fwrite(buf + start, 1, len - start, out);
+    free(buf);
+    return 0;
+}
+
+// Print the last count lines (or bytes) of fd. For a regular file *end is
+// set to the offset printed up to, where following continues; -1 otherwise.
+int ripple_tail_fd(int fd, long count, int bytes, FILE *out, off_t *end) {
+    struct stat sb;
+    *end = -1;
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || lseek(fd, 0, SEEK_CUR) < 0) {
+        return tail_stream(fd, count, bytes, out);
+    }
+
+    char *buf = malloc(RIPPLE_TAIL_BLOCK);
+    if (!buf) {
+        return -1;
+    }
+    off_t start;
+    if (bytes) {
+        start = sb.st_size > count ? sb.st_size - count : 0;
+    } else {
+        start = tail_start_file(fd, sb.st_size, count, buf);
+    }
+    if (start < 0) {
+        free(buf);
+        return -1;
+    }
+    *end = copy_range(fd, start, sb.st_size, out, buf);
+    free(buf);
+    return 0;
+}
+
+// Print fd from line (or byte) first on, counting from 1, as tail -n +N
+// does. Everything before it is read and dropped, except that a regular
+// file skips bytes with a seek. *end is set as by ripple_tail_fd.
+int ripple_tail_from_fd(int fd, long first, int bytes, FILE *out, off_t *end) {
+    struct stat sb;
+    int regular = fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && lseek(fd, 0, SEEK_CUR) >= 0;
+    long skip = first > 1 ? first - 1 : 0;
+    char *buf = malloc(RIPPLE_TAIL_BLOCK);
+    int rc = 0;
+
+    *end = -1;
+    if (!buf) {
+        return -1;
+    }
+    if (bytes && regular && skip > 0) {
+        lseek(fd, skip, SEEK_CUR);
+        skip = 0;
+    }
+    for (;;) {
+        ssize_t n = read(fd, buf, RIPPLE_TAIL_BLOCK);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = -1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        const char *p = buf, *stop = buf + n;
+        if (bytes) {
+            long drop = skip < n ? skip : (long)n;
+            p += drop;
+            skip -= drop;
+        } else {
+            const char *q;
+            while (skip > 0 && (q = memchr(p, '\n', stop - p)) != NULL) {
+                p = q + 1;
+                skip--;
+            }
+            if (skip > 0) {
+                continue; // still inside the lines being skipped
+            }
+        }
+        fwrite(p, 1, (size_t)(stop - p), out);
+    }
+    if (rc == 0 && regular) {
+        *end = lseek(fd, 0, SEEK_CUR);
+    }
+    free(buf);
+    return rc;
+}
+
+// Print whatever was appended to fd past *offset. A file now shorter than
+// what was printed was truncated, and is printed again from the start.
+static void drain(const char *path, int fd, off_t *offset, FILE *out, char *buf) {
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        return;
+    }
+    if (sb.st_size < *offset) {
+        fprintf(stderr, "ripple: tail: %s: file truncated\n", path);
+        *offset = 0;
+    }
+    *offset = copy_range(fd, *offset, sb.st_size, out, buf);
+    fflush(out);
+}
+
+// Switch to a new file created under the followed name
+static int reopen(const char *path, int *fd, off_t *offset, FILE *out, char *buf) {
+    int next = open(path, O_RDONLY);
+    if (next < 0) {
+        return -1;
+    }
+    drain(path, *fd, offset, out, buf);
+    close(*fd);
+    *fd = next;
+    *offset = 0;
+    fprintf(stderr, "ripple: tail: %s has been replaced; following new file\n", path);
+    drain(path, *fd, offset, out, buf);
+    return 0;
+}
+
+// True once stop_fd has EOF, Ctrl-C or q: with the terminal in raw mode
+// Ctrl-C arrives as a byte rather than a signal
+static int stop_requested(int stop_fd) {
+    char c;
+    ssize_t n = read(stop_fd, &c, 1);
+    return n == 0 || (n == 1 && (c == 3 || c == 'q'));
+}
+
+// Keep printing what is appended to path (open as fd, printed up to
+// offset) until stop_fd asks to stop. Takes ownership of fd.
+int ripple_tail_follow(const char *path, int fd, off_t offset, FILE *out, int stop_fd) {
+    char *buf = malloc(RIPPLE_TAIL_BLOCK);
+    struct pollfd fds[2];
+    int nfds = 0, ino = -1;
+
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    fflush(out);
+#ifdef __linux__
+    // The file's own watch sees appends and truncation; the directory's
+    // sees a new file appear under the name after a rotation
+    char dir[4096];
+    const char *base = strrchr(path, '/');
+    if (base) {
+        size_t dlen = base == path ? 1 : (size_t)(base - path);
+        snprintf(dir, sizeof(dir), "%.*s", (int)dlen, path);
+        base++;
+    } else {
+        strcpy(dir, ".");
+        base = path;
+    }
+    const uint32_t file_events = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+    int wd_file = -1, wd_dir = -1;
+    ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (ino >= 0) {
+        wd_file = inotify_add_watch(ino, path, file_events);
+        wd_dir = inotify_add_watch(ino, dir, IN_CREATE | IN_MOVED_TO);
+        if (wd_file < 0 || wd_dir < 0) {
+            close(ino);
+            ino = -1;
+        }
+    }
+    if (ino >= 0) {
+        fds[nfds].fd = ino;
+        fds[nfds++].events = POLLIN;
+    }
+#endif
+    int stop_index = nfds;
+    if (stop_fd >= 0) {
+        fds[nfds].fd = stop_fd;
+        fds[nfds++].events = POLLIN;
+    }
+
+    for (;;) {
+        int ready = poll(fds, nfds, ino >= 0 ? -1 : RIPPLE_TAIL_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (stop_fd >= 0 && (fds[stop_index].revents & (POLLIN | POLLHUP)) && stop_requested(stop_fd)) {
+            break;
+        }
+#ifdef __linux__
+        if (ino >= 0) {
+            char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            int replaced = 0;
+            ssize_t n;
+            while ((n = read(ino, events, sizeof(events))) > 0) {
+                for (char *p = events; p < events + n;) {
+                    struct inotify_event *ev = (struct inotify_event *)p;
+                    if (ev->wd == wd_dir && ev->len > 0 && strcmp(ev->name, base) == 0) {
+                        replaced = 1;
+                    }
+                    p += sizeof(struct inotify_event) + ev->len;
+                }
+            }
+            if (replaced && reopen(path, &fd, &offset, out, buf) == 0) {
+                inotify_rm_watch(ino, wd_file);
+                wd_file = inotify_add_watch(ino, path, file_events);
+            } else {
+                drain(path, fd, &offset, out, buf);
+            }
+            continue;
+        }
+#endif
+        // No inotify: compare the name's inode with the open file's
+        struct stat named, opened;
+        if (stat(path, &named) == 0 && fstat(fd, &opened) == 0 &&
+            (named.st_ino != opened.st_ino || named.st_dev != opened.st_dev)) {
+            reopen(path, &fd, &offset, out, buf);
+        } else {
+            drain(path, fd, &offset, out, buf);
+        }
+    }
+    if (ino >= 0) {
+        close(ino);
+    }
+    close(fd);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef RIPPLE_TAIL_H
+#define RIPPLE_TAIL_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+// head and tail for the builtins of the same name. head reads only as far
+// as the last line it prints. tail on a regular file seeks to the end and
+// scans backwards a block at a time for newlines, so its cost depends on
+// the lines asked for and not on the size of the file; only pipes are read
+// from the start. tail -n +N counts from the start instead, so it reads
+// forwards. Following a file waits on inotify for appends, truncation
+// and rotation (the name being moved away and recreated).
+
+// Function declarations
+int ripple_head_fd(int fd, long count, int bytes, FILE* out);
+int ripple_tail_fd(int fd, long count, int bytes, FILE* out, off_t* end);
+int ripple_tail_from_fd(int fd, long first, int bytes, FILE* out, off_t* end);
+int ripple_tail_follow(const char* path, int fd, off_t offset, FILE* out, int stop_fd);
+
+// Constants
+#define RIPPLE_TAIL_BLOCK (64 << 10)   // bytes read per step, forwards or backwards
+#define RIPPLE_TAIL_POLL_MS 250        // follow interval where inotify is unavailable
+
+#endif // RIPPLE_TAIL_H
@@ -0,0 +1,256 @@
+#include "ripple_trace.h"
+#include "ollama_integration.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+// One recorded answer; replayed in order for the same prompt
+struct trace_answer {
+    char *prompt;
+    int result;
+    int count;
+    struct ollama_suggestion out[RIPPLE_MAX_SUGGESTIONS];
+    char *raw;
+    double duration_ms;
+    int used;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    FILE *out;                    // recording
+    double start;
+    struct trace_answer *answers; // replaying
+    int num_answers;
+    int replaying;
+    int fast;                     // answer at once instead of after the recorded time
+} trace = { PTHREAD_MUTEX_INITIALIZER };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(double ms) {
+    struct timespec ts = { (time_t)(ms / 1000), (long)((ms - (time_t)(ms / 1000) * 1000) * 1e6) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static void write_escaped(FILE *f, const char *s) {
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '\\') {
+            fputs("\\\\", f);
+        } else if (c == '\n') {
+            fputs("\\n", f);
+        } else if (c == '\t') {
+            fputs("\\t", f);
+        } else if (c < 0x20 || c == 0x7f) {
+            fprintf(f, "\\x%02x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+}
+
+// Undo write_escaped in place, stopping at a tab or the end of the line;
+// returns where parsing stopped
+static char *unescape(char *s) {
+    char *w = s;
+    while (*s && *s != '\t' && *s != '\n') {
+        if (*s != '\\' || !s[1]) {
+            *w++ = *s++;
+            continue;
+        }
+        s++;
+        switch (*s) {
+            case 'n': *w++ = '\n'; s++; break;
+            case 't': *w++ = '\t'; s++; break;
+            case 'x': {
+                unsigned v = 0;
+                sscanf(s + 1, "%2x", &v);
+                *w++ = (char)v;
+                s += s[1] && s[2] ? 3 : strlen(s);
+                break;
+            }
+            default: *w++ = *s++; break;
+        }
+    }
+    char *stop = s;
+    *w = '\0';
+    return stop;
+}
+
+// Start logging keys and answers to path (truncated)
+int ripple_trace_record(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    pthread_mutex_lock(&trace.lock);
+    trace.out = f;
+    trace.start = now_ms();
+    fprintf(f, "%s\n", RIPPLE_TRACE_HEADER);
+    fflush(f);
+    pthread_mutex_unlock(&trace.lock);
+    return 0;
+}
+
+void ripple_trace_key(int c) {
+    if (!trace.out) {
+        return;
+    }
+    pthread_mutex_lock(&trace.lock);
+    fprintf(trace.out, "K %.3f %d\n", now_ms() - trace.start, c);
+    fflush(trace.out); // a crashed session should still leave its keys behind
+    pthread_mutex_unlock(&trace.lock);
+}
+
+void ripple_trace_suggestions(const char *prompt, int result, const struct ollama_suggestion *out,
+                              const char *raw, double duration_ms) {
+    if (!trace.out) {
+        return;
+    }
+    int count = result > 0 ? result : 0;
+    pthread_mutex_lock(&trace.lock);
+    fprintf(trace.out, "A %.3f %.3f %d %d ", now_ms() - trace.start, duration_ms, result, count);
+    write_escaped(trace.out, prompt);
+    fputc('\n', trace.out);
+    for (int i = 0; i < count; i++) {
+        fputs("S ", trace.out);
+        write_escaped(trace.out, out[i].cmd);
+        fputc('\t', trace.out);
+        write_escaped(trace.out, out[i].desc);
+        fputc('\n', trace.out);
+    }
+    if (raw) {
+        fputs("R ", trace.out);
+        write_escaped(trace.out, raw);
+        fputc('\n', trace.out);
+    }
+    fflush(trace.out);
+    pthread_mutex_unlock(&trace.lock);
+}
+
+// Serve suggestion answers from the trace at path from now on
+int ripple_trace_replay(const char *path, int fast) {
+    FILE *f = fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    int cap_answers = 0;
+    struct trace_answer *a = NULL;
+
+    if (!f) {
+        return -1;
+    }
+    pthread_mutex_lock(&trace.lock);
+    while (getline(&line, &cap, f) > 0) {
+        if (line[0] == 'A' && line[1] == ' ') {
+            if (trace.num_answers == cap_answers) {
+                cap_answers = cap_answers ? cap_answers * 2 : 16;
+                trace.answers = realloc(trace.answers, cap_answers * sizeof(*trace.answers));
+            }
+            a = &trace.answers[trace.num_answers++];
+            memset(a, 0, sizeof(*a));
+            int prompt_at = 0;
+            double t;
+            // Exactly one space before the prompt, which may start with one
+            if (sscanf(line + 2, "%lf %lf %d %d%n", &t, &a->duration_ms, &a->result, &a->count, &prompt_at) < 4 ||
+                line[2 + prompt_at] != ' ') {
+                trace.num_answers--;
+                a = NULL;
+                continue;
+            }
+            char *prompt = line + 3 + prompt_at;
+            unescape(prompt);
+            a->prompt = strdup(prompt);
+            a->count = 0;
+        } else if (a && line[0] == 'S' && line[1] == ' ' && a->count < RIPPLE_MAX_SUGGESTIONS) {
+            struct ollama_suggestion *s = &a->out[a->count++];
+            char *tab = unescape(line + 2);
+            snprintf(s->cmd, sizeof(s->cmd), "%s", line + 2);
+            if (*tab == '\t') {
+                unescape(tab + 1);
+                snprintf(s->desc, sizeof(s->desc), "%s", tab + 1);
+            }
+        } else if (a && line[0] == 'R' && line[1] == ' ') {
+            unescape(line + 2);
+            a->raw = strdup(line + 2);
+        }
+    }
+    trace.replaying = 1;
+    trace.fast = fast;
+    pthread_mutex_unlock(&trace.lock);
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+// The recorded answer for prompt: the first one not replayed yet, else the
+// last one. Returns its result (-1 if nothing was recorded for the prompt),
+// or RIPPLE_TRACE_MISS when not replaying.
+int ripple_trace_lookup(const char *prompt, struct ollama_suggestion *out, int max, char **raw) {
+    struct trace_answer *found = NULL;
+
+    *raw = NULL;
+    if (!trace.replaying) {
+        return RIPPLE_TRACE_MISS;
+    }
+    pthread_mutex_lock(&trace.lock);
+    for (int i = 0; i < trace.num_answers; i++) {
+        struct trace_answer *a = &trace.answers[i];
+        if (strcmp(a->prompt, prompt) == 0) {
+            found = a;
+            if (!a->used) {
+                break;
+            }
+        }
+    }
+    int result = -1, count = 0;
+    double delay = 0;
+    if (found) {
+        found->used = 1;
+        count = found->count < max ? found->count : max;
+        memcpy(out, found->out, count * sizeof(*out));
+        *raw = found->raw ? strdup(found->raw) : NULL;
+        result = found->result < 0 ? found->result : count;
+        delay = trace.fast ? 0 : found->duration_ms;
+    }
+    pthread_mutex_unlock(&trace.lock);
+    if (delay > 0) {
+        sleep_ms(delay);
+    }
+    return result;
+}
+
+// Keys recorded in the trace at path, in order; *keys is malloc'd.
+// Returns the count, or -1 if the file cannot be read.
+int ripple_trace_read_keys(const char *path, struct ripple_trace_key **keys) {
+    FILE *f = fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    int count = 0, cap_keys = 0;
+
+    *keys = NULL;
+    if (!f) {
+        return -1;
+    }
+    while (getline(&line, &cap, f) > 0) {
+        struct ripple_trace_key k;
+        if (line[0] != 'K' || sscanf(line + 1, "%lf %d", &k.t_ms, &k.c) != 2) {
+            continue;
+        }
+        if (count == cap_keys) {
+            cap_keys = cap_keys ? cap_keys * 2 : 256;
+            *keys = realloc(*keys, cap_keys * sizeof(**keys));
+        }
+        (*keys)[count++] = k;
+    }
+    free(line);
+    fclose(f);
+    return count;
+}
@@ -0,0 +1,35 @@
+#ifndef RIPPLE_TRACE_H
+#define RIPPLE_TRACE_H
+
+#include "ollama_codec.h"
+
+// Session traces for reproducing the interactive path. Recording logs every
+// key ripple_read_line reads and every suggestion answer with timestamps;
+// replaying serves the recorded answers instead of asking a model, while
+// replay_trace types the recorded keys into the shell through a pty.
+//
+// Trace format, one record per line (strings C-escaped):
+//   K <ms> <byte>                                  key read
+//   A <ms> <duration_ms> <result> <count> <prompt> suggestion answer
+//   S <cmd>\t<desc>                                count of these follow
+//   R <raw model text>                             optional
+
+struct ripple_trace_key {
+    double t_ms;                  // since recording started
+    int c;
+};
+
+// Function declarations
+int ripple_trace_record(const char* path);
+int ripple_trace_replay(const char* path, int fast);
+void ripple_trace_key(int c);
+void ripple_trace_suggestions(const char* prompt, int result, const struct ollama_suggestion* out,
+                              const char* raw, double duration_ms);
+int ripple_trace_lookup(const char* prompt, struct ollama_suggestion* out, int max, char** raw);
+int ripple_trace_read_keys(const char* path, struct ripple_trace_key** keys);
+
+// Constants
+#define RIPPLE_TRACE_MISS -3          // not replaying; ask the model
+#define RIPPLE_TRACE_HEADER "# ripple trace 1"
+
+#endif // RIPPLE_TRACE_H
@@ -0,0 +1,100 @@
+#include "ripple_walk.h"
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static int type_of_mode(mode_t mode) {
+    if (S_ISREG(mode)) {
+        return RIPPLE_WALK_FILE;
+    }
+    return S_ISDIR(mode) ? RIPPLE_WALK_DIR : RIPPLE_WALK_OTHER;
+}
+
+// Type of a path without following a final symlink; -1 if it does not exist
+int ripple_walk_type(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        return -1;
+    }
+    return type_of_mode(st.st_mode);
+}
+
+// Type of what a symlink points at; OTHER if it dangles
+static int target_type(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? type_of_mode(st.st_mode) : RIPPLE_WALK_OTHER;
+}
+
+static int entry_type(const struct dirent *entry, const char *path, int follow) {
+#ifdef DT_UNKNOWN
+    switch (entry->d_type) {
+        case DT_REG: return RIPPLE_WALK_FILE;
+        case DT_DIR: return RIPPLE_WALK_DIR;
+        case DT_LNK: return follow ? target_type(path) : RIPPLE_WALK_OTHER;
+        case DT_UNKNOWN: break;
+        default: return RIPPLE_WALK_OTHER;
+    }
+#endif
+    int type = ripple_walk_type(path);
+    if (type < 0) {
+        return RIPPLE_WALK_OTHER;
+    }
+    return type == RIPPLE_WALK_OTHER && follow ? target_type(path) : type;
+}
+
+// A directory being walked, and the one it was entered from, so a followed
+// symlink that leads back up the tree is not entered again
+struct ancestor {
+    dev_t dev;
+    ino_t ino;
+    const struct ancestor *up;
+};
+
+static void walk(const char *base_path, int follow, const struct ancestor *up, ripple_walk_fn visit, void *ctx) {
+    struct ancestor self = { 0, 0, up };
+    struct dirent *entry;
+
+    if (follow) {
+        struct stat st;
+        if (stat(base_path, &st) != 0) {
+            return;
+        }
+        for (const struct ancestor *a = up; a; a = a->up) {
+            if (a->dev == st.st_dev && a->ino == st.st_ino) {
+                return;
+            }
+        }
+        self.dev = st.st_dev;
+        self.ino = st.st_ino;
+    }
+    DIR *d = opendir(base_path);
+    if (!d) {
+        return;
+    }
+    while ((entry = readdir(d)) != NULL) {
+        // Skip . and ..
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char path[4096];
+        if (snprintf(path, sizeof(path), "%s/%s", base_path, entry->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        int type = entry_type(entry, path, follow);
+        visit(path, entry->d_name, type, ctx);
+        if (type == RIPPLE_WALK_DIR) {
+            walk(path, follow, &self, visit, ctx);
+        }
+    }
+    closedir(d);
+}
+
+void ripple_walk(const char *base_path, ripple_walk_fn visit, void *ctx) {
+    walk(base_path, 0, NULL, visit, ctx);
+}
+
+void ripple_walk_follow(const char *base_path, ripple_walk_fn visit, void *ctx) {
+    walk(base_path, 1, NULL, visit, ctx);
+}
@@ -0,0 +1,26 @@
+#ifndef RIPPLE_WALK_H
+#define RIPPLE_WALK_H
+
+// Recursive directory traversal shared by find, grep and cp. Entries are
+// visited depth first in directory order, a directory before its contents.
+// Types come from readdir where the filesystem provides them, so a walk
+// costs no stat per entry. ripple_walk does not follow symlinks to
+// directories; ripple_walk_follow does, as find always has, and reports a
+// symlink by the type of its target. It stats each directory it enters so
+// that a link back to one of the directories above it is not entered again.
+
+// What an entry is, as passed to the visit function
+enum {
+    RIPPLE_WALK_FILE,             // regular file
+    RIPPLE_WALK_DIR,
+    RIPPLE_WALK_OTHER,            // symlink (unless followed), device, fifo, socket
+};
+
+typedef void (*ripple_walk_fn)(const char* path, const char* name, int type, void* ctx);
+
+// Function declarations
+void ripple_walk(const char* base_path, ripple_walk_fn visit, void* ctx);
+void ripple_walk_follow(const char* base_path, ripple_walk_fn visit, void* ctx);
+int ripple_walk_type(const char* path);
+
+#endif // RIPPLE_WALK_H
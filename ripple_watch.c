@@ -0,0 +1,494 @@
+#include "ripple_watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <glob.h>
+#include <fnmatch.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// One watched directory and the name pattern that makes its events relevant
+struct watch_dir {
+    char path[PATH_MAX];
+    char base[NAME_MAX + 1];
+    int wd;
+};
+
+struct watch_state {
+    struct watch_dir dirs[RIPPLE_WATCH_MAX_DIRS];
+    int num_dirs;
+    int ino;                      // inotify fd, or -1 to rescan instead
+    uint64_t signature;           // rescan result, without inotify
+};
+
+struct capture {
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int has_glob(const char *s) {
+    return strpbrk(s, "*?[") != NULL;
+}
+
+static void add_dir(struct watch_state *ws, const char *path, const char *base) {
+    struct stat sb;
+    if (ws->num_dirs == RIPPLE_WATCH_MAX_DIRS || stat(path, &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+        return;
+    }
+    struct watch_dir *d = &ws->dirs[ws->num_dirs];
+    snprintf(d->path, sizeof(d->path), "%s", path);
+    snprintf(d->base, sizeof(d->base), "%s", base);
+    d->wd = -1;
+    ws->num_dirs++;
+}
+
+// "src/*.c" watches src for names matching *.c; "*/Makefile" every
+// directory matching *; a directory itself, everything in it
+static void add_pattern(struct watch_state *ws, const char *pattern) {
+    char dir[PATH_MAX];
+    const char *slash = strrchr(pattern, '/');
+    const char *base = slash ? slash + 1 : pattern;
+    struct stat sb;
+
+    if (!has_glob(pattern) && stat(pattern, &sb) == 0 && S_ISDIR(sb.st_mode)) {
+        add_dir(ws, pattern, "*");
+        return;
+    }
+    if (!slash) {
+        snprintf(dir, sizeof(dir), ".");
+    } else if (slash == pattern) {
+        snprintf(dir, sizeof(dir), "/");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - pattern), pattern);
+    }
+    if (*base == '\0') {
+        base = "*";
+    }
+    if (!has_glob(dir)) {
+        add_dir(ws, dir, base);
+        return;
+    }
+    glob_t g;
+    int flags = 0;
+#ifdef GLOB_ONLYDIR
+    flags |= GLOB_ONLYDIR;
+#endif
+    if (glob(dir, flags, NULL, &g) == 0) {
+        for (size_t i = 0; i < g.gl_pathc; i++) {
+            add_dir(ws, g.gl_pathv[i], base);
+        }
+    }
+    globfree(&g);
+}
+
+// Without inotify: a hash over the names, sizes and mtimes of every
+// matching file, compared between rescans
+static uint64_t scan(const struct watch_state *ws) {
+    uint64_t h = 1469598103934665603ULL;
+    char path[PATH_MAX + NAME_MAX + 2];
+    for (int i = 0; i < ws->num_dirs; i++) {
+        DIR *d = opendir(ws->dirs[i].path);
+        struct dirent *e;
+        if (!d) {
+            continue;
+        }
+        while ((e = readdir(d)) != NULL) {
+            struct stat sb;
+            if (fnmatch(ws->dirs[i].base, e->d_name, 0) != 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", ws->dirs[i].path, e->d_name);
+            if (stat(path, &sb) != 0) {
+                continue;
+            }
+            uint64_t v[3] = { (uint64_t)sb.st_mtime, (uint64_t)sb.st_size, (uint64_t)sb.st_ino };
+            for (const char *p = e->d_name; *p; p++) {
+                h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+            }
+            for (int j = 0; j < 3; j++) {
+                h = (h ^ v[j]) * 1099511628211ULL;
+            }
+        }
+        closedir(d);
+    }
+    return h;
+}
+
+static int start_watching(struct watch_state *ws) {
+    ws->ino = -1;
+#ifdef __linux__
+    // Writes, and names appearing, disappearing or being renamed over;
+    // not opens or reads, which the command itself would cause
+    const uint32_t events = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                            IN_MOVED_TO;
+    ws->ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (ws->ino >= 0) {
+        int watched = 0;
+        for (int i = 0; i < ws->num_dirs; i++) {
+            ws->dirs[i].wd = inotify_add_watch(ws->ino, ws->dirs[i].path, events);
+            watched += ws->dirs[i].wd >= 0;
+        }
+        if (watched == 0) {
+            close(ws->ino);
+            ws->ino = -1;
+        }
+    }
+#endif
+    if (ws->ino < 0) {
+        ws->signature = scan(ws);
+    }
+    return ws->num_dirs > 0 ? 0 : -1;
+}
+
+// Count the relevant events waiting on the inotify fd
+static int read_events(struct watch_state *ws) {
+    int relevant = 0;
+#ifdef __linux__
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(ws->ino, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + n;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            for (int i = 0; ev->len > 0 && i < ws->num_dirs; i++) {
+                if (ws->dirs[i].wd == ev->wd && fnmatch(ws->dirs[i].base, ev->name, 0) == 0) {
+                    relevant++;
+                    break;
+                }
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+#else
+    (void)ws;
+#endif
+    return relevant;
+}
+
+// True once stop_fd has EOF, Ctrl-C or q: with the terminal in raw mode
+// Ctrl-C arrives as a byte rather than a signal
+static int stop_requested(int stop_fd) {
+    char c;
+    ssize_t n = read(stop_fd, &c, 1);
+    return n == 0 || (n == 1 && (c == 3 || c == 'q'));
+}
+
+static void append(struct capture *cap, const char *data, size_t len) {
+    if (cap->len + len > RIPPLE_WATCH_MAX_OUTPUT) {
+        len = RIPPLE_WATCH_MAX_OUTPUT - cap->len;
+    }
+    if (cap->len + len > cap->cap) {
+        size_t size = cap->cap ? cap->cap : 16384;
+        while (size < cap->len + len) {
+            size *= 2;
+        }
+        char *buf = realloc(cap->buf, size);
+        if (!buf) {
+            return;
+        }
+        cap->buf = buf;
+        cap->cap = size;
+    }
+    memcpy(cap->buf + cap->len, data, len);
+    cap->len += len;
+}
+
+// Run cmd in a child with its output on a pipe, collecting it. A stop
+// request while it runs terminates it. Returns 1 if asked to stop.
+static int run_once(char **cmd, ripple_watch_exec_fn exec, int stop_fd, struct capture *cap, int *status) {
+    int out[2], stopped = 0;
+    cap->len = 0;
+    *status = -1;
+    if (pipe(out) != 0) {
+        const char *msg = "ripple: watch: pipe failed\n";
+        append(cap, msg, strlen(msg));
+        return 0;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDONLY);
+        if (null >= 0) {
+            dup2(null, STDIN_FILENO);
+        }
+        dup2(out[1], STDOUT_FILENO);
+        dup2(out[1], STDERR_FILENO);
+        close(out[0]);
+        close(out[1]);
+        exec(cmd);
+        _exit(127);
+    }
+    close(out[1]);
+    if (pid < 0) {
+        close(out[0]);
+        const char *msg = "ripple: watch: fork failed\n";
+        append(cap, msg, strlen(msg));
+        return 0;
+    }
+
+    struct pollfd fds[2] = { { out[0], POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+    char buf[16384];
+    for (;;) {
+        if (poll(fds, stop_fd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP) && stop_requested(stop_fd)) {
+            kill(pid, SIGTERM);
+            stopped = 1;
+            fds[1].fd = -1;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            ssize_t n = read(out[0], buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            append(cap, buf, (size_t)n);
+        }
+    }
+    close(out[0]);
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {
+    }
+    *status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+    return stopped;
+}
+
+// Append one screen line: tabs expanded, escapes kept but not counted,
+// cut at the terminal width so no line wraps and pushes the frame down
+static void frame_line(struct capture *frame, const char *line, size_t len, int cols) {
+    int col = 0;
+    for (size_t i = 0; i < len && col < cols; i++) {
+        char c = line[i];
+        if (c == '\033') {
+            size_t j = i + 1;
+            while (j < len && !((line[j] >= 'A' && line[j] <= 'Z') || (line[j] >= 'a' && line[j] <= 'z'))) {
+                j++;
+            }
+            append(frame, line + i, j < len ? j - i + 1 : len - i);
+            i = j;
+        } else if (c == '\t') {
+            do {
+                append(frame, " ", 1);
+            } while (++col % 8 && col < cols);
+        } else if (c == '\r') {
+            continue;
+        } else {
+            append(frame, &c, 1);
+            col += ((unsigned char)c & 0xc0) != 0x80;
+        }
+    }
+    append(frame, "\033[0m\033[K", 7);
+}
+
+// Draw header and output as one frame with a single write
+static void draw(int out_fd, int screen, const char *header, const struct capture *cap) {
+    struct capture frame = { NULL, 0, 0 };
+    struct winsize size;
+    int rows = 24, cols = 80;
+
+    if (!screen) {
+        // Not a terminal: plain runs, one after another
+        dprintf(out_fd, "--- %s\n", header);
+        for (size_t done = 0; done < cap->len;) {
+            ssize_t n = write(out_fd, cap->buf + done, cap->len - done);
+            if (n <= 0) {
+                break;
+            }
+            done += (size_t)n;
+        }
+        return;
+    }
+    if (ioctl(out_fd, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+        rows = size.ws_row;
+        cols = size.ws_col;
+    }
+    // Lines are separated, not terminated, so the last row never scrolls
+    append(&frame, "\033[H", 3);
+    frame_line(&frame, header, strlen(header), cols);
+    append(&frame, "\r\n", 2);
+    for (size_t start = 0, line = 2; start < cap->len && line <= (size_t)rows; line++) {
+        const char *nl = memchr(cap->buf + start, '\n', cap->len - start);
+        size_t end = nl ? (size_t)(nl - cap->buf) : cap->len;
+        append(&frame, "\r\n", line > 2 ? 2 : 0);
+        frame_line(&frame, cap->buf + start, end - start, cols);
+        start = end + 1;
+    }
+    append(&frame, "\033[J", 3);
+    for (size_t done = 0; done < frame.len;) {
+        ssize_t n = write(out_fd, frame.buf + done, frame.len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    free(frame.buf);
+}
+
+static void run_and_draw(char **cmd, const struct ripple_watch_opts *opts, ripple_watch_exec_fn exec, int stop_fd,
+                         int out_fd, int screen, struct capture *cap, struct ripple_watch_stats *stats, int *stop) {
+    char header[512], when[16];
+    int status, len = 0;
+    time_t t = time(NULL);
+
+    *stop = run_once(cmd, exec, stop_fd, cap, &status);
+    stats->runs++;
+    strftime(when, sizeof(when), "%H:%M:%S", localtime(&t));
+    if (opts->num_patterns > 0) {
+        len = snprintf(header, sizeof(header), "On change to %s%s:", opts->patterns[0],
+                       opts->num_patterns > 1 ? ", ..." : "");
+    } else {
+        len = snprintf(header, sizeof(header), "Every %.1fs:", opts->interval);
+    }
+    for (int i = 0; cmd[i] && len < (int)sizeof(header); i++) {
+        len += snprintf(header + len, sizeof(header) - len, " %s", cmd[i]);
+    }
+    if (len < (int)sizeof(header)) {
+        snprintf(header + len, sizeof(header) - len, "    %s  run %ld%s", when, stats->runs,
+                 status > 0 ? "  (failed)" : "");
+    }
+    draw(out_fd, screen, header, cap);
+}
+
+// Run cmd, then again on every interval or change, until stop_fd asks to
+// stop. Returns 0, or -1 with errno ENOENT if the patterns name nothing
+// that can be watched, or ENOMEM.
+int ripple_watch(char **cmd, const struct ripple_watch_opts *opts, ripple_watch_exec_fn exec, int stop_fd,
+                 int out_fd, struct ripple_watch_stats *stats) {
+    struct watch_state *ws = calloc(1, sizeof(*ws));
+    struct capture cap = { NULL, 0, 0 };
+    int screen = isatty(out_fd), stop = 0;
+    double interval_ms = (opts->interval > 0 ? opts->interval : RIPPLE_WATCH_INTERVAL) * 1000.0;
+    int debounce = opts->debounce_ms > 0 ? opts->debounce_ms : RIPPLE_WATCH_DEBOUNCE_MS;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!ws) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ws->ino = -1;
+    for (int i = 0; i < opts->num_patterns; i++) {
+        add_pattern(ws, opts->patterns[i]);
+    }
+    if (opts->num_patterns > 0 && start_watching(ws) != 0) {
+        free(ws);
+        errno = ENOENT;
+        return -1;
+    }
+    if (screen) {
+        // Alternate screen, cursor hidden; the shell's screen comes back after
+        dprintf(out_fd, "\033[?1049h\033[?25l\033[H\033[2J");
+    }
+
+    run_and_draw(cmd, opts, exec, stop_fd, out_fd, screen, &cap, stats, &stop);
+    double next_run = now_ms() + interval_ms;
+    double quiet_at = 0, due_at = 0, first_change = 0;
+    int pending = 0;
+    while (!stop) {
+        struct pollfd fds[2];
+        int nfds = 0, ino_index = -1, stop_index = -1;
+        double deadline;
+        if (opts->num_patterns == 0) {
+            deadline = next_run;
+        } else if (pending) {
+            deadline = quiet_at < due_at ? quiet_at : due_at;
+        } else if (ws->ino < 0) {
+            deadline = now_ms() + RIPPLE_WATCH_POLL_MS;
+        } else {
+            deadline = -1;        // nothing to do until a change or a key
+        }
+        if (ws->ino >= 0) {
+            ino_index = nfds;
+            fds[nfds].fd = ws->ino;
+            fds[nfds++].events = POLLIN;
+        }
+        if (stop_fd >= 0) {
+            stop_index = nfds;
+            fds[nfds].fd = stop_fd;
+            fds[nfds++].events = POLLIN;
+        }
+        int timeout = -1;
+        if (deadline >= 0) {
+            double left = deadline - now_ms();
+            timeout = left > 0 ? (int)(left + 0.999) : 0;
+        }
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+            break;
+        }
+        if (stop_index >= 0 && (fds[stop_index].revents & (POLLIN | POLLHUP)) && stop_requested(stop_fd)) {
+            break;
+        }
+
+        double now = now_ms();
+        int changes = 0;
+        if (ino_index >= 0 && (fds[ino_index].revents & POLLIN)) {
+            changes = read_events(ws);
+        } else if (opts->num_patterns > 0 && ws->ino < 0 && !pending) {
+            uint64_t signature = scan(ws);
+            changes = signature != ws->signature;
+            ws->signature = signature;
+        }
+        if (changes > 0) {
+            stats->events += changes;
+            if (!pending) {
+                pending = 1;
+                first_change = now;
+                due_at = now + RIPPLE_WATCH_MAX_DELAY_MS;
+            }
+            quiet_at = now + debounce;
+            continue;
+        }
+
+        if (opts->num_patterns == 0 && now >= next_run) {
+            run_and_draw(cmd, opts, exec, stop_fd, out_fd, screen, &cap, stats, &stop);
+            next_run += interval_ms;
+            if (next_run < now_ms()) {
+                next_run = now_ms() + interval_ms;
+            }
+        } else if (pending && (now >= quiet_at || now >= due_at)) {
+            pending = 0;
+            run_and_draw(cmd, opts, exec, stop_fd, out_fd, screen, &cap, stats, &stop);
+            stats->latency_ms = now_ms() - first_change;
+            if (ws->ino < 0) {
+                ws->signature = scan(ws);
+            }
+        }
+    }
+
+    if (screen) {
+        dprintf(out_fd, "\033[?25h\033[?1049l");
+    }
+    if (ws->ino >= 0) {
+        close(ws->ino);
+    }
+    free(ws);
+    free(cap.buf);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef RIPPLE_WATCH_H
+#define RIPPLE_WATCH_H
+
+// The watch builtin: rerun a command every few seconds, or only when files
+// matching some patterns change. Changes come from inotify on the
+// directories the patterns name, filtered by fnmatch, and a burst of them
+// (an editor's save, a checkout) is coalesced until it has been quiet for
+// the debounce time. Between runs the process sleeps in poll with nothing
+// to wake it. Each run's output is captured and drawn as one frame in a
+// single write: cursor home, every line cleared to its end, the rest of the
+// screen cleared, so nothing is blanked before it is redrawn.
+
+struct ripple_watch_opts {
+    double interval;              // seconds between runs when there are no patterns
+    char** patterns;              // rerun when files matching these change
+    int num_patterns;
+    int debounce_ms;              // quiet time that ends a burst of changes
+};
+
+struct ripple_watch_stats {
+    long runs;
+    long events;                  // relevant changes seen
+    double latency_ms;            // last change to the frame showing its run
+};
+
+// Runs argv in the forked child, stdout and stderr already redirected; never returns
+typedef void (*ripple_watch_exec_fn)(char** argv);
+
+// Function declarations
+int ripple_watch(char** cmd, const struct ripple_watch_opts* opts, ripple_watch_exec_fn exec, int stop_fd,
+                 int out_fd, struct ripple_watch_stats* stats);
+
+// Constants
+#define RIPPLE_WATCH_INTERVAL 2.0
+#define RIPPLE_WATCH_DEBOUNCE_MS 20
+#define RIPPLE_WATCH_MAX_DELAY_MS 250     // a burst that never goes quiet still reruns this often
+#define RIPPLE_WATCH_MAX_OUTPUT (1 << 20) // bytes of a run's output kept for drawing
+#define RIPPLE_WATCH_MAX_DIRS 64
+#define RIPPLE_WATCH_POLL_MS 250          // rescan interval where inotify is unavailable
+
+#endif // RIPPLE_WATCH_H
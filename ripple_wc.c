@@ -0,0 +1,419 @@
+#include "ripple_wc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WC_X86 1
+#endif
+
+// Whitespace as wc sees it in the C locale: space and \t \n \v \f \r.
+// A word starts at every non-space byte whose predecessor is a space, as
+// in BSD wc; GNU wc also skips unprintable bytes, so binary files differ.
+static inline int wc_space(unsigned char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= 4;
+}
+
+static void count_scalar(struct ripple_wc_state *st, const unsigned char *p, size_t n) {
+    long lines = 0, words = 0;
+    int in_word = st->in_word;
+
+    if (st->lines_only) {
+        const unsigned char *end = p + n;
+        while ((p = memchr(p, '\n', end - p)) != NULL) {
+            lines++;
+            p++;
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            int word = !wc_space(p[i]);
+            lines += p[i] == '\n';
+            words += word & !in_word;
+            in_word = word;
+        }
+    }
+    st->counts.lines += lines;
+    st->counts.words += words;
+    st->in_word = in_word;
+}
+
+#ifdef WC_X86
+// The byte counters below are 8 bits wide, so they are folded into the
+// totals every 255 blocks, before they can wrap.
+#define WC_FOLD 255
+
+static inline long sum_sse2(__m128i acc) {
+    __m128i s = _mm_sad_epu8(acc, _mm_setzero_si128());
+    return _mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4);
+}
+
+// Each block yields a mask of newlines and a mask of word starts (non-space
+// bytes not preceded by one); both are subtracted from byte-wide counters,
+// since a set mask byte is -1.
+__attribute__((target("sse2")))
+static void count_sse2(struct ripple_wc_state *st, const unsigned char *p, size_t n) {
+    const __m128i newline = _mm_set1_epi8('\n'), space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4), ones = _mm_set1_epi8(-1);
+    __m128i prev = st->in_word ? ones : _mm_setzero_si128();
+    long lines = 0, words = 0;
+    size_t i = 0;
+
+    while (n - i >= 16) {
+        __m128i line_acc = _mm_setzero_si128(), word_acc = _mm_setzero_si128();
+        for (int k = 0; k < WC_FOLD && n - i >= 16; k++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            line_acc = _mm_sub_epi8(line_acc, _mm_cmpeq_epi8(v, newline));
+            if (st->lines_only) {
+                continue;
+            }
+            // \t..\r is the range 0..4 after subtracting '\t'
+            __m128i t = _mm_sub_epi8(v, tab);
+            __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(t, four), t);
+            __m128i word = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), ctrl), ones);
+            __m128i before = _mm_or_si128(_mm_slli_si128(word, 1), _mm_srli_si128(prev, 15));
+            word_acc = _mm_sub_epi8(word_acc, _mm_andnot_si128(before, word));
+            prev = word;
+        }
+        lines += sum_sse2(line_acc);
+        words += sum_sse2(word_acc);
+    }
+    st->counts.lines += lines;
+    st->counts.words += words;
+    if (i > 0 && !st->lines_only) {
+        st->in_word = (_mm_movemask_epi8(prev) >> 15) & 1;
+    }
+    count_scalar(st, p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline long sum_avx2(__m256i acc) {
+    __m256i s = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    return _mm_cvtsi128_si32(half) + _mm_extract_epi16(half, 4);
+}
+
+// As count_sse2, 32 bytes at a time. The one-byte shift that lines each
+// byte up with its predecessor has to cross the 128-bit lanes, so the
+// previous block's high lane is brought in with a permute first.
+__attribute__((target("avx2")))
+static void count_avx2(struct ripple_wc_state *st, const unsigned char *p, size_t n) {
+    const __m256i newline = _mm256_set1_epi8('\n'), space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t'), four = _mm256_set1_epi8(4), ones = _mm256_set1_epi8(-1);
+    __m256i prev = st->in_word ? ones : _mm256_setzero_si256();
+    long lines = 0, words = 0;
+    size_t i = 0;
+
+    while (n - i >= 32) {
+        __m256i line_acc = _mm256_setzero_si256(), word_acc = _mm256_setzero_si256();
+        for (int k = 0; k < WC_FOLD && n - i >= 32; k++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+            line_acc = _mm256_sub_epi8(line_acc, _mm256_cmpeq_epi8(v, newline));
+            if (st->lines_only) {
+                continue;
+            }
+            __m256i t = _mm256_sub_epi8(v, tab);
+            __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t);
+            __m256i word = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), ctrl), ones);
+            __m256i carry = _mm256_permute2x128_si256(prev, word, 0x21);
+            __m256i before = _mm256_alignr_epi8(word, carry, 15);
+            word_acc = _mm256_sub_epi8(word_acc, _mm256_andnot_si256(before, word));
+            prev = word;
+        }
+        lines += sum_avx2(line_acc);
+        words += sum_avx2(word_acc);
+    }
+    st->counts.lines += lines;
+    st->counts.words += words;
+    if (i > 0 && !st->lines_only) {
+        st->in_word = ((unsigned)_mm256_movemask_epi8(prev) >> 31) & 1;
+    }
+    count_scalar(st, p + i, n - i);
+}
+#endif
+
+typedef void (*wc_kernel_fn)(struct ripple_wc_state *, const unsigned char *, size_t);
+
+static const struct {
+    const char *name;
+    wc_kernel_fn fn;
+} kernels[] = {
+#ifdef WC_X86
+    { "avx2", count_avx2 },
+    { "sse2", count_sse2 },
+#endif
+    { "scalar", count_scalar },
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static int kernel_index = -1;
+
+static int kernel_supported(int i) {
+#ifdef WC_X86
+    if (strcmp(kernels[i].name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(kernels[i].name, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return 1;
+}
+
+// The fastest kernel this CPU runs, chosen on first use
+static wc_kernel_fn kernel(void) {
+    if (kernel_index < 0) {
+        int i = 0;
+        while (!kernel_supported(i)) {
+            i++;
+        }
+        kernel_index = i;
+    }
+    return kernels[kernel_index].fn;
+}
+
+const char *ripple_wc_kernel(void) {
+    kernel();
+    return kernels[kernel_index].name;
+}
+
+// Force a kernel by name, for benchmarks; -1 if it is unknown or the CPU
+// lacks it
+int ripple_wc_use_kernel(const char *name) {
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (strcmp(kernels[i].name, name) == 0 && kernel_supported(i)) {
+            kernel_index = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void ripple_wc_feed(struct ripple_wc_state *state, const char *buf, size_t len) {
+    kernel()(state, (const unsigned char *)buf, len);
+    state->counts.bytes += len;
+}
+
+static char *alloc_buffer(void) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, 4096, RIPPLE_WC_BUFSIZE) != 0) {
+        return NULL;
+    }
+    return buf;
+}
+
+// Feed len bytes of fd from offset, or everything up to EOF when len is
+// negative (pipes, ttys, files that grow while being read)
+static int feed_range(int fd, off_t offset, off_t len, struct ripple_wc_state *st, char *buf) {
+    int positioned = len >= 0;
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (positioned) {
+        posix_fadvise(fd, offset, len, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+    while (!positioned || len > 0) {
+        size_t want = RIPPLE_WC_BUFSIZE;
+        if (positioned && (off_t)want > len) {
+            want = (size_t)len;
+        }
+        ssize_t got = positioned ? pread(fd, buf, want, offset) : read(fd, buf, want);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        ripple_wc_feed(st, buf, (size_t)got);
+        offset += got;
+        if (positioned) {
+            len -= got;
+        }
+    }
+    return 0;
+}
+
+int ripple_wc_fd(int fd, const struct ripple_wc_opts *opts, struct ripple_wc_counts *counts) {
+    struct ripple_wc_state st = { { 0, 0, 0 }, 0, !opts->words };
+    char *buf = alloc_buffer();
+    if (!buf) {
+        return -1;
+    }
+    int rc = feed_range(fd, 0, -1, &st, buf);
+    free(buf);
+    *counts = st.counts;
+    return rc;
+}
+
+// One unit of work: a whole file, or a chunk of a large one
+struct wc_item {
+    int path;                     // index into paths
+    off_t offset;
+    off_t len;                    // -1: read to EOF
+    struct ripple_wc_counts counts;
+    int starts_in_word;           // first byte is not whitespace
+    int ends_in_word;
+    int errnum;
+};
+
+struct wc_job {
+    char **paths;
+    struct wc_item *items;
+    int num_items;
+    int next;                     // next unclaimed item
+    int lines_only;
+};
+
+// Map a range of at least RIPPLE_WC_MMAP_MIN bytes and count it in place,
+// which saves copying it through a buffer; -1 leaves it to feed_range
+static int feed_mapped(int fd, off_t offset, off_t len, struct ripple_wc_state *st) {
+    if (len < RIPPLE_WC_MMAP_MIN) {
+        return -1;
+    }
+    char *map = mmap(NULL, (size_t)len, PROT_READ, MAP_PRIVATE, fd, offset);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(map, (size_t)len, MADV_SEQUENTIAL);
+#endif
+    ripple_wc_feed(st, map, (size_t)len);
+    munmap(map, (size_t)len);
+    return 0;
+}
+
+static void count_item(struct wc_job *job, struct wc_item *item, char *buf) {
+    struct ripple_wc_state st = { { 0, 0, 0 }, 0, job->lines_only };
+    int fd = open(job->paths[item->path], O_RDONLY);
+
+    if (fd < 0) {
+        item->errnum = errno;
+        return;
+    }
+    if (item->offset > 0 && pread(fd, buf, 1, item->offset) == 1) {
+        item->starts_in_word = !wc_space((unsigned char)buf[0]);
+    }
+    if (feed_mapped(fd, item->offset, item->len, &st) != 0 &&
+        feed_range(fd, item->offset, item->len, &st, buf) != 0) {
+        item->errnum = errno;
+    }
+    close(fd);
+    item->counts = st.counts;
+    item->ends_in_word = st.in_word;
+}
+
+static void *wc_worker(void *arg) {
+    struct wc_job *job = arg;
+    char *buf = alloc_buffer();
+    int i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->num_items) {
+        if (buf) {
+            count_item(job, &job->items[i], buf);
+        } else {
+            job->items[i].errnum = ENOMEM;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+// Count every path into counts[i]; errnums[i] is 0 or the errno that
+// stopped it. Returns how many paths failed.
+int ripple_wc_files(char **paths, int num_paths, const struct ripple_wc_opts *opts,
+                    struct ripple_wc_counts *counts, int *errnums) {
+    struct wc_job job = { paths, NULL, 0, 0, !opts->words };
+    int cap = num_paths, failed = 0;
+    int need_content = opts->lines || opts->words;
+
+    job.items = malloc(sizeof(struct wc_item) * (cap > 0 ? cap : 1));
+    if (!job.items) {
+        return num_paths;
+    }
+    for (int p = 0; p < num_paths; p++) {
+        struct stat sb;
+        memset(&counts[p], 0, sizeof(counts[p]));
+        errnums[p] = 0;
+        if (stat(paths[p], &sb) != 0) {
+            errnums[p] = errno;
+            continue;
+        }
+        if (S_ISDIR(sb.st_mode)) {
+            errnums[p] = EISDIR;
+            continue;
+        }
+        if (S_ISREG(sb.st_mode) && !need_content) {
+            counts[p].bytes = sb.st_size;
+            continue;
+        }
+        // Regular files are split so no thread is left with one huge file;
+        // anything else, and files claiming to be empty like those in /proc,
+        // is read to EOF in one piece
+        off_t size = S_ISREG(sb.st_mode) && sb.st_size > 0 ? sb.st_size : -1;
+        int pieces = size > RIPPLE_WC_CHUNK ? (int)((size + RIPPLE_WC_CHUNK - 1) / RIPPLE_WC_CHUNK) : 1;
+        if (job.num_items + pieces > cap) {
+            cap = (job.num_items + pieces) * 2;
+            struct wc_item *tmp = realloc(job.items, sizeof(struct wc_item) * cap);
+            if (!tmp) {
+                free(job.items);
+                return num_paths;
+            }
+            job.items = tmp;
+        }
+        for (int c = 0; c < pieces; c++) {
+            struct wc_item *item = &job.items[job.num_items++];
+            memset(item, 0, sizeof(*item));
+            item->path = p;
+            item->offset = (off_t)c * RIPPLE_WC_CHUNK;
+            item->len = c == pieces - 1 ? size - item->offset : RIPPLE_WC_CHUNK;
+        }
+    }
+
+    int threads = opts->threads > 0 ? opts->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > RIPPLE_WC_MAX_THREADS) {
+        threads = RIPPLE_WC_MAX_THREADS;
+    }
+    if (threads > job.num_items) {
+        threads = job.num_items;
+    }
+    pthread_t tids[RIPPLE_WC_MAX_THREADS];
+    int started = 0;
+    kernel(); // pick it before the workers race to
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[started], NULL, wc_worker, &job) == 0) {
+            started++;
+        }
+    }
+    wc_worker(&job);
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    // Chunks are in file order; a word running across a boundary was
+    // counted once on each side
+    for (int i = 0; i < job.num_items; i++) {
+        struct wc_item *item = &job.items[i];
+        struct ripple_wc_counts *c = &counts[item->path];
+        if (item->errnum && !errnums[item->path]) {
+            errnums[item->path] = item->errnum;
+        }
+        c->lines += item->counts.lines;
+        c->words += item->counts.words;
+        c->bytes += item->counts.bytes;
+        if (i > 0 && job.items[i - 1].path == item->path && job.items[i - 1].ends_in_word &&
+            item->starts_in_word && !job.lines_only) {
+            c->words--;
+        }
+    }
+    for (int p = 0; p < num_paths; p++) {
+        failed += errnums[p] != 0;
+    }
+    free(job.items);
+    return failed;
+}
@@ -0,0 +1,47 @@
+#ifndef RIPPLE_WC_H
+#define RIPPLE_WC_H
+
+#include <stddef.h>
+
+// Line, word and byte counting for the wc builtin. Newlines and word starts
+// are counted 32 or 16 bytes at a time with AVX2 or SSE2, picked at runtime
+// from what the CPU supports, with a scalar loop everywhere else. Files are
+// mapped, or read in large aligned blocks; big files are split into chunks
+// so several threads can count one file, and the chunk counts are stitched
+// back together where a word straddles a boundary.
+
+struct ripple_wc_counts {
+    long lines;
+    long words;
+    long bytes;
+};
+
+// Running count over a stream fed a block at a time
+struct ripple_wc_state {
+    struct ripple_wc_counts counts;
+    int in_word;                  // the last byte fed was not whitespace
+    int lines_only;               // skip word counting
+};
+
+struct ripple_wc_opts {
+    int lines;                    // -l
+    int words;                    // -w
+    int bytes;                    // -c: from the file size when nothing else is wanted
+    int threads;                  // -j: 0 picks one per CPU
+};
+
+// Function declarations
+void ripple_wc_feed(struct ripple_wc_state* state, const char* buf, size_t len);
+int ripple_wc_fd(int fd, const struct ripple_wc_opts* opts, struct ripple_wc_counts* counts);
+int ripple_wc_files(char** paths, int num_paths, const struct ripple_wc_opts* opts,
+                    struct ripple_wc_counts* counts, int* errnums);
+const char* ripple_wc_kernel(void);
+int ripple_wc_use_kernel(const char* name);
+
+// Constants
+#define RIPPLE_WC_MAX_THREADS 16
+#define RIPPLE_WC_BUFSIZE (1 << 20)    // bytes per read
+#define RIPPLE_WC_CHUNK (32 << 20)     // files larger than this are counted in parallel chunks
+#define RIPPLE_WC_MMAP_MIN (1 << 20)   // ranges this large are mapped instead of read
+
+#endif // RIPPLE_WC_H
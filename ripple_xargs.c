@@ -0,0 +1,258 @@
+#include "ripple_xargs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+struct xargs_state {
+    char **cmd;
+    int cmd_len;
+    const struct ripple_xargs_opts *opts;
+    ripple_xargs_builtin_fn builtin;
+    void *ctx;
+    struct ripple_xargs_stats *stats;
+    long limit;                   // bytes a command line's arguments may take
+    long max_arg;                 // bytes one argument may take, NUL included
+    char *arena;                  // the batch's argument strings, back to back
+    size_t used;
+    long cost;                    // strings plus argv pointers so far
+    size_t *offsets;              // start of each argument in arena
+    int count;
+    int offsets_cap;
+    char **argv;
+    pid_t pids[RIPPLE_XARGS_MAX_PROCS];
+    int running;
+    int status;                   // xargs' exit status so far
+    int stop;                     // a command could not run; launch no more
+};
+
+// Bytes the arguments of one command line may use: ARG_MAX less the
+// environment, the command itself and some headroom. Every argument costs
+// its string, its NUL and its argv pointer.
+long ripple_xargs_limit(char **cmd) {
+    long limit = sysconf(_SC_ARG_MAX);
+    if (limit <= 0) {
+        limit = 131072;
+    }
+    for (char **e = environ; *e; e++) {
+        limit -= (long)(strlen(*e) + 1 + sizeof(char *));
+    }
+    for (char **c = cmd; *c; c++) {
+        limit -= (long)(strlen(*c) + 1 + sizeof(char *));
+    }
+    limit -= RIPPLE_XARGS_HEADROOM + (long)sizeof(char *);
+    return limit;
+}
+
+// Fold a finished command's result into xargs' status, as GNU xargs does:
+// 123 if any command failed, and stop launching on 126, 127 and 255
+static void record(struct xargs_state *st, int wstatus) {
+    if (WIFSIGNALED(wstatus)) {
+        st->status = 125;
+        st->stop = 1;
+        return;
+    }
+    int code = WEXITSTATUS(wstatus);
+    if (code == 126 || code == 127) {
+        st->status = code;
+        st->stop = 1;
+    } else if (code == 255) {
+        st->status = 124;
+        st->stop = 1;
+    } else if (code != 0 && st->status == 0) {
+        st->status = 123;
+    }
+}
+
+// Wait for one of our children. Other children of the shell (bg jobs) may
+// be reaped here too; nothing else waits for them.
+static void reap_one(struct xargs_state *st) {
+    while (st->running > 0) {
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            st->running = 0;
+            return;
+        }
+        for (int i = 0; i < st->running; i++) {
+            if (st->pids[i] == pid) {
+                st->pids[i] = st->pids[--st->running];
+                record(st, wstatus);
+                return;
+            }
+        }
+    }
+}
+
+static void run_batch(struct xargs_state *st) {
+    if (st->count == 0 || st->stop) {
+        st->count = 0;
+        st->used = 0;
+        st->cost = 0;
+        return;
+    }
+    for (int i = 0; i < st->count; i++) {
+        st->argv[st->cmd_len + i] = st->arena + st->offsets[i];
+    }
+    st->argv[st->cmd_len + st->count] = NULL;
+    st->stats->commands++;
+
+    if (st->builtin) {
+        int rc = st->builtin(st->argv, st->ctx);
+        record(st, (rc & 0xff) << 8);
+    } else {
+        int max_procs = st->opts->max_procs > 0 ? st->opts->max_procs : 1;
+        if (max_procs > RIPPLE_XARGS_MAX_PROCS) {
+            max_procs = RIPPLE_XARGS_MAX_PROCS;
+        }
+        while (st->running >= max_procs) {
+            reap_one(st);
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            execvp(st->argv[0], st->argv);
+            if (errno == ENOENT) {
+                fprintf(stderr, "ripple: command not found: %s\n", st->argv[0]);
+                _exit(127);
+            }
+            perror("ripple: xargs");
+            _exit(126);
+        } else if (pid < 0) {
+            perror("ripple: xargs: fork");
+            st->status = 126;
+            st->stop = 1;
+        } else {
+            st->pids[st->running++] = pid;
+        }
+    }
+    st->count = 0;
+    st->used = 0;
+    st->cost = 0;
+}
+
+static void add_arg(struct xargs_state *st, const char *arg, size_t len) {
+    long cost = (long)(len + 1 + sizeof(char *));
+    if (cost > st->limit || (long)len + 1 > st->max_arg) {
+        fprintf(stderr, "ripple: xargs: argument of %zu bytes is too long for %s\n", len,
+                cost > st->limit ? "a command line" : "execve");
+        if (st->status == 0) {
+            st->status = 1;
+        }
+        return;
+    }
+    if (st->cost + cost > st->limit || (st->opts->max_args > 0 && st->count == st->opts->max_args) ||
+        st->count == st->offsets_cap) {
+        run_batch(st);
+    }
+    st->offsets[st->count++] = st->used;
+    memcpy(st->arena + st->used, arg, len);
+    st->arena[st->used + len] = '\0';
+    st->used += len + 1;
+    st->cost += cost;
+    st->stats->args++;
+}
+
+// Read arguments from fd and run cmd with as many of them as fit on each
+// command line. Returns the exit status xargs reports.
+int ripple_xargs(int fd, char **cmd, const struct ripple_xargs_opts *opts, ripple_xargs_builtin_fn builtin,
+                 void *ctx, struct ripple_xargs_stats *stats) {
+    struct xargs_state st;
+    size_t cap = RIPPLE_XARGS_READ, len = 0;
+    char *buf = malloc(cap);
+    const char delim = opts->nul ? '\0' : '\n';
+
+    memset(&st, 0, sizeof(st));
+    memset(stats, 0, sizeof(*stats));
+    st.cmd = cmd;
+    st.opts = opts;
+    st.builtin = builtin;
+    st.ctx = ctx;
+    st.stats = stats;
+    while (cmd[st.cmd_len]) {
+        st.cmd_len++;
+    }
+    st.limit = ripple_xargs_limit(cmd);
+    st.max_arg = st.limit;
+#ifdef __linux__
+    // execve fails with E2BIG on any single string this long; builtins
+    // are not exec'd and take what fits the batch
+    if (!builtin) {
+        st.max_arg = RIPPLE_XARGS_STRLEN_PAGES * sysconf(_SC_PAGESIZE);
+    }
+#endif
+    // Even an empty argument costs a pointer and a NUL, which bounds the count
+    st.offsets_cap = (int)(st.limit / (1 + (long)sizeof(char *))) + 1;
+    if (opts->max_args > 0 && opts->max_args < st.offsets_cap) {
+        st.offsets_cap = opts->max_args;
+    }
+    st.arena = malloc(st.limit > 0 ? (size_t)st.limit : 1);
+    st.offsets = malloc(sizeof(size_t) * st.offsets_cap);
+    st.argv = malloc(sizeof(char *) * (st.cmd_len + st.offsets_cap + 1));
+    if (!buf || st.limit <= 0 || !st.arena || !st.offsets || !st.argv) {
+        fprintf(stderr, "ripple: xargs: %s\n", st.limit <= 0 ? "environment too large" : "allocation error");
+        free(buf);
+        free(st.arena);
+        free(st.offsets);
+        free(st.argv);
+        return 1;
+    }
+    memcpy(st.argv, cmd, sizeof(char *) * st.cmd_len);
+
+    while (!st.stop) {
+        if (len == cap) {
+            // One argument longer than a whole read; it will be refused
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("ripple: xargs");
+            st.status = 1;
+            break;
+        }
+        len += (size_t)n;
+
+        char *p = buf, *end = buf + len, *q;
+        while (!st.stop && (q = memchr(p, delim, end - p)) != NULL) {
+            // Blank lines carry no argument; with -0 an empty one is kept
+            if (q > p || opts->nul) {
+                add_arg(&st, p, (size_t)(q - p));
+            }
+            p = q + 1;
+        }
+        if (n == 0) {
+            if (p < end && !st.stop) {
+                add_arg(&st, p, (size_t)(end - p));
+            }
+            break;
+        }
+        len = (size_t)(end - p);
+        memmove(buf, p, len);
+    }
+    run_batch(&st);
+    while (st.running > 0) {
+        reap_one(&st);
+    }
+
+    free(buf);
+    free(st.arena);
+    free(st.offsets);
+    free(st.argv);
+    return st.status;
+}
@@ -0,0 +1,41 @@
+#ifndef RIPPLE_XARGS_H
+#define RIPPLE_XARGS_H
+
+// Argument batching for the xargs builtin. Input is read in large blocks
+// and split at newlines (or NULs with -0), and arguments are packed into
+// each command line until the next one would pass what execve accepts:
+// ARG_MAX less the environment and some headroom. External commands are
+// forked, up to -P at a time; a builtin is handed each batch in-process.
+//
+// Each input line is one argument, as with GNU xargs -d '\n': blanks and
+// quotes are not special, so paths with spaces from find pass through
+// whole, but "a b c" on one line is a single argument, not three.
+// On Linux, an argument for an external command may also not exceed
+// MAX_ARG_STRLEN (32 pages); longer ones are reported and skipped.
+
+struct ripple_xargs_opts {
+    int nul;                      // -0: arguments end at NUL, not newline
+    int max_args;                 // -n: per command line, 0 for no limit
+    int max_procs;                // -P: commands running at once
+};
+
+struct ripple_xargs_stats {
+    long args;
+    long commands;                // command lines run
+};
+
+// Runs a batch in-process; argv[0] is the command. Returns its exit status.
+typedef int (*ripple_xargs_builtin_fn)(char** argv, void* ctx);
+
+// Function declarations
+int ripple_xargs(int fd, char** cmd, const struct ripple_xargs_opts* opts, ripple_xargs_builtin_fn builtin,
+                 void* ctx, struct ripple_xargs_stats* stats);
+long ripple_xargs_limit(char** cmd);
+
+// Constants
+#define RIPPLE_XARGS_READ (1 << 20)        // bytes read from input at a time
+#define RIPPLE_XARGS_HEADROOM 4096         // left free below ARG_MAX, as POSIX suggests
+#define RIPPLE_XARGS_MAX_PROCS 64
+#define RIPPLE_XARGS_STRLEN_PAGES 32       // Linux MAX_ARG_STRLEN, in pages
+
+#endif // RIPPLE_XARGS_H
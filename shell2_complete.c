@@ -5,14 +5,40 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>  // For head and tail
 #include <dirent.h> // For directory listing
 #include <time.h>   // For date/time functions
 #include <math.h>   // For calculator function
 #include <fnmatch.h> // For pattern matching
 #include <sys/stat.h> // For mkdir, touch
+#include <sys/resource.h> // For wait4 and getrusage
 #include <curl/curl.h> // For Ollama API calls
 #include <termios.h>  // For raw terminal mode
+#include <poll.h>     // For prompt redraws while reading keys
+#include <sys/ioctl.h> // For the terminal width
 #include "ollama_integration.h"
+#include "ripple_expand.h"
+#include "ollama_config.h"
+#include "ripple_backend.h"
+#include "ripple_index.h"
+#include "ripple_predict.h"
+#include "ripple_ghost.h"
+#include "ripple_dirs.h"
+#include "ripple_client.h"
+#include "ripple_trace.h"
+#include "ripple_metrics.h"
+#include "ripple_prof.h"
+#include "ripple_walk.h"
+#include "ripple_grep.h"
+#include "ripple_wc.h"
+#include "ripple_tail.h"
+#include "ripple_fsops.h"
+#include "ripple_copy.h"
+#include "ripple_xargs.h"
+#include "ripple_prompt.h"
+#include "ripple_calc.h"
+#include "ripple_watch.h"
 
 // Handle macOS json-c include path
 #ifdef __APPLE__
@@ -28,6 +54,13 @@
 #define RIPPLE_VERSION "1.0.0"
 #define OLLAMA_API_URL "http://localhost:11434/api/generate"
 
+// History predictions shown on TAB ahead of the model's, and how often
+// the predictor is written back to disk
+#define RIPPLE_PREDICTIONS 3
+#define RIPPLE_MAX_CHOICES (RIPPLE_PREDICTIONS + RIPPLE_MAX_SUGGESTIONS)
+#define PREDICT_SAVE_EVERY 8
+#define GHOST_OUT_SIZE 2048
+
 // Special key codes
 #define KEY_TAB 9
 #define KEY_BACKSPACE 127
@@ -55,11 +88,28 @@ int ripple_mkdir(char **args);
 int ripple_touch(char **args);
 int ripple_rm(char **args);
 int ripple_whoami(char **args);
+int ripple_aidiag(char **args);
+int ripple_aiconfig(char **args);
+int ripple_aiindex(char **args);
+int ripple_z(char **args);
+int ripple_time(char **args);
+int ripple_stats(char **args);
+int ripple_profile(char **args);
+int ripple_grep(char **args);
+int ripple_wc(char **args);
+int ripple_head(char **args);
+int ripple_tail(char **args);
+int ripple_cp(char **args);
+int ripple_xargs_builtin(char **args);
+int ripple_watch_builtin(char **args);
+int ripple_aibench(char **args);
 
 // Forward declarations for functions used by builtins
 char* strAppend(char* str1, char* str2);
 void add_to_hist(char **args);
 void print_tree(const char *basepath, const char *prefix, int is_last);
+static double monotonic_seconds(void);
+static void exec_stage(char **args);
 
 // Array of built-in command names, used to map user input to the right functions
 char *builtin_str[] = {
@@ -82,7 +132,22 @@ char *builtin_str[] = {
     "mkdir",
     "touch",
     "rm",
-    "whoami"
+    "whoami",
+    "aidiag",
+    "aiconfig",
+    "aiindex",
+    "z",
+    "time",
+    "stats",
+    "profile",
+    "grep",
+    "wc",
+    "head",
+    "tail",
+    "cp",
+    "xargs",
+    "watch",
+    "aibench"
 };
 
 
@@ -113,9 +178,34 @@ int (*builtin_func[])(char **) = {
     &ripple_mkdir,
     &ripple_touch,
     &ripple_rm,
-    &ripple_whoami
+    &ripple_whoami,
+    &ripple_aidiag,
+    &ripple_aiconfig,
+    &ripple_aiindex,
+    &ripple_z,
+    &ripple_time,
+    &ripple_stats,
+    &ripple_profile,
+    &ripple_grep,
+    &ripple_wc,
+    &ripple_head,
+    &ripple_tail,
+    &ripple_cp,
+    &ripple_xargs_builtin,
+    &ripple_watch_builtin,
+    &ripple_aibench
 };
 
+// Look up a built-in by name, returns its index or -1
+int ripple_builtin_index(const char *name) {
+    for (int i = 0; i < ripple_num_builtins(); i++) {
+        if (strcmp(name, builtin_str[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 // Struct for curl response
 struct MemoryStruct {
     char *memory;
@@ -202,10 +292,9 @@ int ripple_cd(char **args) {
             if (chdir(home_dir) != 0) {
                 perror("ripple");
             } else {
-                char cwd[1024];
-                if (getcwd(cwd, sizeof(cwd)) != NULL) {
-                    printf("Current directory: %s\n", cwd);
-                }
+                const char *cwd = ripple_prompt_cwd_changed();
+                ripple_dirs_visit(cwd);
+                printf("Current directory: %s\n", cwd);
             }
         } else {
             fprintf(stderr, "ripple: HOME environment variable not set\n");
@@ -214,10 +303,9 @@ int ripple_cd(char **args) {
         if (chdir(args[1]) != 0) {
             perror("ripple");
         } else {
-            char cwd[1024];
-            if (getcwd(cwd, sizeof(cwd)) != NULL) {
-                printf("Current directory: %s\n", cwd);
-            }
+            const char *cwd = ripple_prompt_cwd_changed();
+            ripple_dirs_visit(cwd);
+            printf("Current directory: %s\n", cwd);
         }
     }
     return 1; // Continue shell loop
@@ -274,8 +362,8 @@ int ripple_echo(char **args) {
 
 // Built-in: Print working directory
 int ripple_pwd(char **args) {
-    char cwd[1024];
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+    const char *cwd = ripple_prompt_cwd();
+    if (cwd[0]) {
         printf("%s\n", cwd);
     } else {
         perror("ripple: pwd");
@@ -315,52 +403,110 @@ int ripple_version(char **args) {
     return 1;
 }
 
-// Built-in: Simple calculator
+// Built-in: Calculator. Evaluates an expression, or with $1, $2, ... in
+// it, evaluates it for every row of a file or of stdin
 int ripple_calc(char **args) {
-    if (args[1] == NULL || args[2] == NULL || args[3] == NULL) {
-        printf("Usage: calc <number> <operator> <number>\n");
-        printf("Operators: + - * / %% ^\n");
+    int dump = 0;
+    const char *file = NULL;
+    struct ripple_calc_stream_opts opts = { 0, 0 };
+    struct ripple_calc_prog prog;
+    char expr[4096] = "", err[256];
+    size_t len = 0;
+    int i = 1;
+
+    // A lone letter after '-' is an option; "-3 + 4" is an expression
+    for (; args[i] && args[i][0] == '-' && strchr("scdf", args[i][1]) && args[i][1] && !args[i][2]; i++) {
+        char flag = args[i][1];
+        if (flag == 's') {
+            opts.summary = 1;
+        } else if (flag == 'c') {
+            dump = 1;
+        } else if (!args[i + 1]) {
+            fprintf(stderr, "ripple: calc: -%c needs an argument\n", flag);
+            ripple_last_status = 1;
+            return 1;
+        } else if (flag == 'd') {
+            opts.delim = strcmp(args[++i], "\\t") == 0 ? '\t' : args[i][0];
+        } else {
+            file = args[++i];
+        }
+    }
+    for (; args[i] != NULL && len < sizeof(expr); i++) {
+        len += snprintf(expr + len, sizeof(expr) - len, "%s%s", len ? " " : "", args[i]);
+    }
+    if (expr[0] == '\0') {
+        printf("Usage: calc [-c] <expression>        e.g. calc 2 * (3 + 4) ^ 2, calc r = sqrt(2)\n");
+        printf("       calc [-s] [-d sep] [-f file] <expression with $1, $2, ...>\n");
+        printf("Operators: + - * / %% ^ and comparisons; functions: sin cos tan exp log sqrt abs min max ...\n");
+        printf("With columns, every row of the file or of stdin is evaluated; -s prints totals instead\n");
+        ripple_last_status = 1;
         return 1;
     }
-    
-    double a = atof(args[1]);
-    double b = atof(args[3]);
-    char op = args[2][0];
-    double result = 0;
-    
-    switch (op) {
-        case '+':
-            result = a + b;
-            break;
-        case '-':
-            result = a - b;
-            break;
-        case '*':
-            result = a * b;
-            break;
-        case '/':
-            if (b == 0) {
-                printf("Error: Division by zero\n");
-                return 1;
-            }
-            result = a / b;
-            break;
-        case '%':
-            if (b == 0) {
-                printf("Error: Division by zero\n");
-                return 1;
-            }
-            result = fmod(a, b);
-            break;
-        case '^':
-            result = pow(a, b);
-            break;
-        default:
-            printf("Error: Unknown operator %c\n", op);
+    if (ripple_calc_compile(expr, &prog, err, sizeof(err)) != 0) {
+        fprintf(stderr, "ripple: calc: %s\n", err);
+        ripple_last_status = 1;
+        return 1;
+    }
+    if (dump) {
+        ripple_calc_dump(&prog, stdout);
+    }
+
+    if (prog.columns == 0) {
+        char out[64];
+        double result = ripple_calc_value(&prog);
+        if (prog.zero_divisions > 0) {
+            fprintf(stderr, "ripple: calc: division by zero\n");
+            ripple_last_status = 1;
+            ripple_calc_free(&prog);
             return 1;
+        }
+        ripple_calc_format(result, out, sizeof(out));
+        printf("%s\n", out);
+        ripple_calc_set("ans", result);
+        ripple_calc_free(&prog);
+        return 1;
     }
-    
-    printf("%.6g\n", result);
+
+    int fd = STDIN_FILENO;
+    if (file) {
+        fd = open(file, O_RDONLY);
+        if (fd < 0) {
+            perror("ripple: calc");
+            ripple_last_status = 1;
+            ripple_calc_free(&prog);
+            return 1;
+        }
+    } else if (isatty(STDIN_FILENO)) {
+        fprintf(stderr, "ripple: calc: $%d needs rows: use -f <file> or pipe them in\n", prog.columns);
+        ripple_last_status = 1;
+        ripple_calc_free(&prog);
+        return 1;
+    }
+
+    struct ripple_calc_stream_stats stats;
+    fflush(stdout);
+    if (ripple_calc_stream(fd, &prog, &opts, stdout, &stats) != 0) {
+        perror("ripple: calc");
+        ripple_last_status = 1;
+    }
+    if (opts.summary && stats.rows > 0) {
+        char sum[64], min[64], max[64], mean[64];
+        ripple_calc_format(stats.sum, sum, sizeof(sum));
+        ripple_calc_format(stats.min, min, sizeof(min));
+        ripple_calc_format(stats.max, max, sizeof(max));
+        ripple_calc_format(stats.sum / stats.rows, mean, sizeof(mean));
+        printf("rows %ld  sum %s  min %s  max %s  mean %s\n", stats.rows, sum, min, max, mean);
+        ripple_calc_set("ans", stats.sum);
+    }
+    fflush(stdout);
+    if (stats.skipped > 0) {
+        fprintf(stderr, "ripple: calc: skipped %ld row%s without %d number%s\n", stats.skipped,
+                stats.skipped == 1 ? "" : "s", prog.columns, prog.columns == 1 ? "" : "s");
+    }
+    if (file) {
+        close(fd);
+    }
+    ripple_calc_free(&prog);
     return 1;
 }
 
@@ -424,40 +570,25 @@ int ripple_count(char **args) {
 
 
 // Function to recursively find files
-void find_files(const char *base_path, const char *pattern, int *count) {
-    DIR *d;
-    struct dirent *dir;
-    
-    d = opendir(base_path);
-    if (!d) {
-        return;
-    }
-    
-    while ((dir = readdir(d)) != NULL) {
-        // Skip . and ..
-        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) {
-            continue;
-        }
-        
-        // Create path
-        char path[1024];
-        snprintf(path, sizeof(path), "%s/%s", base_path, dir->d_name);
-        
-        // Check if matches pattern
-        if (fnmatch(pattern, dir->d_name, 0) == 0) {
-            printf("%s\n", path);
-            (*count)++;
-        }
-        
-        // Recurse if it's a directory
-        DIR *subdir = opendir(path);
-        if (subdir) {
-            closedir(subdir);
-            find_files(path, pattern, count);
-        }
+struct find_ctx {
+    const char *pattern;
+    int count;
+};
+
+static void find_visit(const char *path, const char *name, int type, void *arg) {
+    struct find_ctx *ctx = arg;
+    (void)type;
+    // Check if matches pattern
+    if (fnmatch(ctx->pattern, name, 0) == 0) {
+        printf("%s\n", path);
+        ctx->count++;
     }
-    
-    closedir(d);
+}
+
+void find_files(const char *base_path, const char *pattern, int *count) {
+    struct find_ctx ctx = { pattern, 0 };
+    ripple_walk_follow(base_path, find_visit, &ctx);
+    *count += ctx.count;
 }
 
 // Built-in: Find files matching pattern
@@ -468,22 +599,176 @@ int ripple_find(char **args) {
         return 1;
     }
     
-    char cwd[1024];
-    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    const char *cwd = ripple_prompt_cwd();
+    if (cwd[0] == '\0') {
         perror("ripple: find");
         return 1;
     }
     
-    printf("Searching for files matching '%s'...\n", args[1]);
+    // Piped into xargs or wc the output is the paths alone
+    int chatty = isatty(STDOUT_FILENO);
+    if (chatty) {
+        printf("Searching for files matching '%s'...\n", args[1]);
+    }
     
     int count = 0;
     find_files(cwd, args[1], &count);
     
-    printf("Found %d matching items\n", count);
+    if (chatty) {
+        printf("Found %d matching items\n", count);
+    }
     
     return 1;
 }
 
+// Built-in: Search file contents, recursing into directories
+int ripple_grep(char **args) {
+    struct ripple_grep_opts opts = { 0 };
+    int i = 1;
+
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *flag = args[i] + 1; *flag; flag++) {
+            switch (*flag) {
+                case 'i': opts.ignore_case = 1; break;
+                case 'n': opts.line_numbers = 1; break;
+                case 'c': opts.count_only = 1; break;
+                case 'l': opts.files_only = 1; break;
+                case 'v': opts.invert = 1; break;
+                case 'F': opts.fixed = 1; break;
+                case 'E': opts.extended = 1; break;
+                case 'I': opts.skip_binary = 1; break;
+                case 'r':
+                case 'R':
+                    break; // always recursive; accepted so grep -rn habits work
+                case 'j':
+                    // -j4 or -j 4
+                    opts.threads = atoi(flag[1] ? flag + 1 : (args[i + 1] ? args[++i] : "0"));
+                    flag = "j"; // the rest of the argument was the count
+                    break;
+                default:
+                    fprintf(stderr, "ripple: grep: unknown option -%c\n", *flag);
+                    ripple_last_status = 2;
+                    return 1;
+            }
+        }
+    }
+    if (args[i] == NULL) {
+        printf("Usage: grep [-inclvFEIrR] [-j threads] <pattern> [path...]\n");
+        printf("Directories are searched recursively, the current one if no path is given\n");
+        ripple_last_status = 2;
+        return 1;
+    }
+
+    const char *pattern = args[i++];
+    char *here[] = { ".", NULL };
+    char **paths = args[i] ? &args[i] : here;
+    int num_paths = 0;
+    long matches;
+    while (paths[num_paths]) {
+        num_paths++;
+    }
+    if (ripple_grep_search(pattern, paths, num_paths, &opts, stdout, &matches) != 0) {
+        ripple_last_status = 2;
+        return 1;
+    }
+    ripple_last_status = matches > 0 ? 0 : 1;
+    return 1;
+}
+
+static void print_wc_counts(const struct ripple_wc_opts *opts, const struct ripple_wc_counts *c, const char *name) {
+    if (opts->lines) printf(" %7ld", c->lines);
+    if (opts->words) printf(" %7ld", c->words);
+    if (opts->bytes) printf(" %7ld", c->bytes);
+    if (name) printf(" %s", name);
+    printf("\n");
+}
+
+// Built-in: Count lines, words and bytes of files, or of stdin in a pipeline
+int ripple_wc(char **args) {
+    struct ripple_wc_opts opts = { 0 };
+    int i = 1;
+
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *flag = args[i] + 1; *flag; flag++) {
+            switch (*flag) {
+                case 'l': opts.lines = 1; break;
+                case 'w': opts.words = 1; break;
+                case 'c': opts.bytes = 1; break;
+                case 'j':
+                    opts.threads = atoi(flag[1] ? flag + 1 : (args[i + 1] ? args[++i] : "0"));
+                    flag = "j";
+                    break;
+                default:
+                    fprintf(stderr, "ripple: wc: unknown option -%c\n", *flag);
+                    ripple_last_status = 2;
+                    return 1;
+            }
+        }
+    }
+    if (!opts.lines && !opts.words && !opts.bytes) {
+        opts.lines = opts.words = opts.bytes = 1;
+    }
+
+    if (args[i] == NULL) {
+        struct ripple_wc_counts counts;
+        if (isatty(STDIN_FILENO)) {
+            printf("Usage: wc [-lwc] [-j threads] [file...]\n");
+            printf("Counts stdin when used after | in a pipeline\n");
+            ripple_last_status = 2;
+            return 1;
+        }
+        if (ripple_wc_fd(STDIN_FILENO, &opts, &counts) != 0) {
+            perror("ripple: wc");
+            ripple_last_status = 1;
+        }
+        print_wc_counts(&opts, &counts, NULL);
+        return 1;
+    }
+
+    int num_paths = 0;
+    while (args[i + num_paths]) {
+        num_paths++;
+    }
+    struct ripple_wc_counts *counts = calloc(num_paths, sizeof(*counts));
+    int *errnums = calloc(num_paths, sizeof(*errnums));
+    if (!counts || !errnums) {
+        fprintf(stderr, "ripple: allocation error\n");
+        free(counts);
+        free(errnums);
+        ripple_last_status = 1;
+        return 1;
+    }
+
+    struct ripple_wc_counts total = { 0, 0, 0 };
+    if (ripple_wc_files(&args[i], num_paths, &opts, counts, errnums) > 0) {
+        ripple_last_status = 1;
+    }
+    for (int p = 0; p < num_paths; p++) {
+        if (errnums[p]) {
+            fprintf(stderr, "ripple: wc: %s: %s\n", args[i + p], strerror(errnums[p]));
+            continue;
+        }
+        print_wc_counts(&opts, &counts[p], args[i + p]);
+        total.lines += counts[p].lines;
+        total.words += counts[p].words;
+        total.bytes += counts[p].bytes;
+    }
+    if (num_paths > 1) {
+        print_wc_counts(&opts, &total, "total");
+    }
+    free(counts);
+    free(errnums);
+    return 1;
+}
+
 // Built-in: Cat (display file contents)
 int ripple_cat(char **args) {
     if (args[1] == NULL) {
@@ -506,6 +791,128 @@ int ripple_cat(char **args) {
     return 1;
 }
 
+// Options shared by head and tail: -n N, -N, -c N and (tail only) -f and
+// -n +N / -c +N, which set *from_start to count from the first line.
+// Returns the index of the first operand, or -1 after reporting an error.
+static int parse_head_tail(char **args, const char *name, int is_tail, long *count, int *bytes, int *follow,
+                           int *from_start) {
+    int i = 1;
+    *count = 10;
+    *bytes = 0;
+    *follow = 0;
+    *from_start = 0;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        const char *arg = args[i];
+        if (strcmp(arg, "--") == 0) {
+            return i + 1;
+        }
+        if (isdigit((unsigned char)arg[1])) {
+            *count = atol(arg + 1);
+            continue;
+        }
+        for (const char *flag = arg + 1; *flag; flag++) {
+            if (*flag == 'n' || *flag == 'c') {
+                const char *value = flag[1] ? flag + 1 : args[i + 1];
+                int plus = value && value[0] == '+';
+                if (!value || !isdigit((unsigned char)value[plus])) {
+                    fprintf(stderr, "ripple: %s: -%c needs a count\n", name, *flag);
+                    return -1;
+                }
+                if (plus && !is_tail) {
+                    fprintf(stderr, "ripple: head: -%c +N is tail's; use -%c N\n", *flag, *flag);
+                    return -1;
+                }
+                if (!flag[1]) {
+                    i++;
+                }
+                *count = atol(value + plus);
+                *bytes = *flag == 'c';
+                *from_start = plus;
+                break;
+            } else if (*flag == 'f' && is_tail) {
+                *follow = 1;
+            } else {
+                fprintf(stderr, "ripple: %s: unknown option -%c\n", name, *flag);
+                return -1;
+            }
+        }
+    }
+    return i;
+}
+
+// head and tail over their operands, or stdin in a pipeline
+static int run_head_tail(char **args, int tail) {
+    const char *name = tail ? "tail" : "head";
+    long count;
+    int bytes, follow, from_start;
+    off_t end;
+
+    int i = parse_head_tail(args, name, tail, &count, &bytes, &follow, &from_start);
+    if (i < 0) {
+        ripple_last_status = 2;
+        return 1;
+    }
+    if (args[i] == NULL) {
+        if (isatty(STDIN_FILENO)) {
+            printf("Usage: %s [-n %slines | -c %sbytes]%s [file...]\n", name, tail ? "[+]" : "", tail ? "[+]" : "",
+                   tail ? " [-f]" : "");
+            printf("Reads stdin when used after | in a pipeline\n");
+            ripple_last_status = 2;
+            return 1;
+        }
+        fflush(stdout);
+        int rc = !tail ? ripple_head_fd(STDIN_FILENO, count, bytes, stdout)
+                 : from_start ? ripple_tail_from_fd(STDIN_FILENO, count, bytes, stdout, &end)
+                              : ripple_tail_fd(STDIN_FILENO, count, bytes, stdout, &end);
+        if (rc != 0) {
+            perror(tail ? "ripple: tail" : "ripple: head");
+            ripple_last_status = 1;
+        }
+        return 1;
+    }
+    if (follow && args[i + 1]) {
+        fprintf(stderr, "ripple: tail: -f follows a single file\n");
+        ripple_last_status = 2;
+        return 1;
+    }
+
+    for (int first = i; args[i]; i++) {
+        int fd = open(args[i], O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "ripple: %s: %s: %s\n", name, args[i], strerror(errno));
+            ripple_last_status = 1;
+            continue;
+        }
+        if (args[first + 1]) {
+            printf("%s==> %s <==\n", i > first ? "\n" : "", args[i]);
+        }
+        int rc = !tail ? ripple_head_fd(fd, count, bytes, stdout)
+                 : from_start ? ripple_tail_from_fd(fd, count, bytes, stdout, &end)
+                              : ripple_tail_fd(fd, count, bytes, stdout, &end);
+        if (rc != 0) {
+            fprintf(stderr, "ripple: %s: %s: %s\n", name, args[i], strerror(errno));
+            ripple_last_status = 1;
+        }
+        if (follow && rc == 0) {
+            // Ctrl-C or q ends it; with the terminal in raw mode both arrive on stdin
+            ripple_tail_follow(args[i], fd, end < 0 ? 0 : end, stdout, isatty(STDIN_FILENO) ? STDIN_FILENO : -1);
+        } else {
+            close(fd);
+        }
+    }
+    return 1;
+}
+
+// Built-in: Print the first lines of files
+int ripple_head(char **args) {
+    return run_head_tail(args, 0);
+}
+
+// Built-in: Print the last lines of files, optionally following appends
+int ripple_tail(char **args) {
+    return run_head_tail(args, 1);
+}
+
 // Helper function to print directory tree
 void print_tree(const char *basepath, const char *prefix, int is_last) {
     DIR *dir = opendir(basepath);
@@ -608,54 +1015,268 @@ int ripple_tree(char **args) {
     return 1;
 }
 
-// Built-in: Create directory
+// Built-in: Create directories, with -p their parents too
 int ripple_mkdir(char **args) {
-    if (args[1] == NULL) {
-        printf("Usage: mkdir <directory_name>\n");
-        return 1;
+    struct ripple_fs_result result;
+    int parents = 0, i = 1;
+
+    for (; args[i] && strcmp(args[i], "-p") == 0; i++) {
+        parents = 1;
     }
-    
-    // Create directory with permissions 0755 (rwxr-xr-x)
-    if (mkdir(args[1], 0755) != 0) {
-        perror("ripple: mkdir");
+    if (args[i] == NULL) {
+        printf("Usage: mkdir [-p] <directory_name>...\n");
         return 1;
     }
-    
-    printf("Directory created: %s\n", args[1]);
+
+    int count = 0;
+    while (args[i + count]) {
+        count++;
+    }
+    // Create directories with permissions 0755 (rwxr-xr-x)
+    ripple_last_status = ripple_fs_mkdir(&args[i], count, parents, &result) ? 1 : 0;
+    if (count == 1 && result.dirs == 1 && !parents) {
+        printf("Directory created: %s\n", args[i]);
+    } else if (result.dirs > 0) {
+        printf("Created %ld director%s\n", result.dirs, result.dirs == 1 ? "y" : "ies");
+    }
     return 1;
 }
 
-// Built-in: Create empty file
+// Built-in: Create empty files or update their times
 int ripple_touch(char **args) {
+    struct ripple_fs_result result;
+
     if (args[1] == NULL) {
-        printf("Usage: touch <filename>\n");
+        printf("Usage: touch <filename>...\n");
         return 1;
     }
-    
-    FILE *file = fopen(args[1], "a");
-    if (!file) {
-        perror("ripple: touch");
-        return 1;
+
+    int count = 0;
+    while (args[1 + count]) {
+        count++;
+    }
+    ripple_last_status = ripple_fs_touch(&args[1], count, &result) ? 1 : 0;
+    if (count == 1 && result.files == 1) {
+        printf("File created/updated: %s\n", args[1]);
+    } else if (result.files > 0) {
+        printf("%ld files created/updated\n", result.files);
     }
-    
-    fclose(file);
-    printf("File created/updated: %s\n", args[1]);
     return 1;
 }
 
-// Built-in: Remove file
+// Built-in: Remove files, with -r whole directory trees
 int ripple_rm(char **args) {
-    if (args[1] == NULL) {
-        printf("Usage: rm <filename>\n");
+    struct ripple_fs_result result;
+    int flags = 0, i = 1;
+
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *flag = args[i] + 1; *flag; flag++) {
+            if (*flag == 'r' || *flag == 'R') {
+                flags |= RIPPLE_RM_RECURSIVE;
+            } else if (*flag == 'f') {
+                flags |= RIPPLE_RM_FORCE;
+            } else {
+                fprintf(stderr, "ripple: rm: unknown option -%c\n", *flag);
+                ripple_last_status = 1;
+                return 1;
+            }
+        }
+    }
+    if (args[i] == NULL) {
+        printf("Usage: rm [-rf] <filename>...\n");
         return 1;
     }
-    
-    if (remove(args[1]) != 0) {
-        perror("ripple: rm");
+
+    int count = 0;
+    while (args[i + count]) {
+        count++;
+    }
+    ripple_last_status = ripple_fs_remove(&args[i], count, flags, &result) ? 1 : 0;
+    if (count == 1 && result.files == 1 && result.dirs == 0) {
+        printf("Removed: %s\n", args[i]);
+    } else if (result.files > 0 || result.dirs > 0) {
+        printf("Removed %ld file%s and %ld director%s\n", result.files, result.files == 1 ? "" : "s",
+               result.dirs, result.dirs == 1 ? "y" : "ies");
+    }
+    return 1;
+}
+
+// Built-in: Copy files, with -r whole directory trees
+int ripple_cp(char **args) {
+    struct ripple_copy_opts opts = { 0 };
+    struct ripple_copy_stats stats;
+    int i = 1;
+
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *flag = args[i] + 1; *flag; flag++) {
+            switch (*flag) {
+                case 'r':
+                case 'R': opts.recursive = 1; break;
+                case 'v': opts.verbose = 1; break;
+                case 'j':
+                    opts.threads = atoi(flag[1] ? flag + 1 : (args[i + 1] ? args[++i] : "0"));
+                    flag = "j";
+                    break;
+                default:
+                    fprintf(stderr, "ripple: cp: unknown option -%c\n", *flag);
+                    ripple_last_status = 1;
+                    return 1;
+            }
+        }
+    }
+    int count = 0;
+    while (args[i + count]) {
+        count++;
+    }
+    if (count < 2) {
+        printf("Usage: cp [-rv] [-j threads] <source>... <dest>\n");
+        printf("Mode and timestamps are kept; -v reports progress and throughput\n");
+        ripple_last_status = 1;
         return 1;
     }
-    
-    printf("Removed: %s\n", args[1]);
+
+    double start = monotonic_seconds();
+    ripple_last_status = ripple_copy(&args[i], count - 1, args[i + count - 1], &opts, &stats) ? 1 : 0;
+    double elapsed = monotonic_seconds() - start;
+    if (opts.verbose) {
+        printf("Copied %ld file%s (%ld reflinked), %ld director%s, %ld symlink%s: %.1f MB in %.2f s (%.1f MB/s)\n",
+               stats.files, stats.files == 1 ? "" : "s", stats.cloned, stats.dirs, stats.dirs == 1 ? "y" : "ies",
+               stats.links, stats.links == 1 ? "" : "s", stats.bytes / 1048576.0, elapsed,
+               elapsed > 0 ? stats.bytes / 1048576.0 / elapsed : 0.0);
+    }
+    return 1;
+}
+
+// Hands an xargs batch to a builtin without forking
+static int xargs_run_builtin(char **argv, void *ctx) {
+    int i = *(int *)ctx;
+    ripple_last_status = 0;
+    (*builtin_func[i])(argv);
+    fflush(stdout);
+    return ripple_last_status;
+}
+
+// Built-in: Build command lines from stdin, packing as many arguments
+// into each as the kernel accepts
+int ripple_xargs_builtin(char **args) {
+    struct ripple_xargs_opts opts = { 0, 0, 1 };
+    struct ripple_xargs_stats stats;
+    static char *echo_cmd[] = { "echo", NULL };
+    int i = 1;
+
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *flag = args[i] + 1; *flag; flag++) {
+            switch (*flag) {
+                case '0': opts.nul = 1; break;
+                case 'n':
+                case 'P': {
+                    int value = atoi(flag[1] ? flag + 1 : (args[i + 1] ? args[++i] : "0"));
+                    if (value <= 0) {
+                        fprintf(stderr, "ripple: xargs: -%c needs a positive number\n", *flag);
+                        ripple_last_status = 1;
+                        return 1;
+                    }
+                    if (*flag == 'n') {
+                        opts.max_args = value;
+                    } else {
+                        opts.max_procs = value;
+                    }
+                    flag = "n";
+                    break;
+                }
+                default:
+                    fprintf(stderr, "ripple: xargs: unknown option -%c\n", *flag);
+                    ripple_last_status = 1;
+                    return 1;
+            }
+        }
+    }
+    if (isatty(STDIN_FILENO)) {
+        printf("Usage: <command> | xargs [-0] [-n max_args] [-P max_procs] [command [arg]...]\n");
+        printf("Each input line (NUL-terminated string with -0) is one argument; blanks do not split\n");
+        printf("Builtins run in this shell; other commands are forked, -P at a time\n");
+        ripple_last_status = 1;
+        return 1;
+    }
+
+    char **cmd = args[i] ? &args[i] : echo_cmd;
+    int b = ripple_builtin_index(cmd[0]);
+    // exit, cd and bg act on the shell itself; run those like anything else
+    if (b >= 0 && (builtin_func[b] == ripple_exit || builtin_func[b] == ripple_cd ||
+                   builtin_func[b] == ripple_bg || builtin_func[b] == ripple_xargs_builtin)) {
+        b = -1;
+    }
+    fflush(stdout);
+    ripple_last_status = ripple_xargs(STDIN_FILENO, cmd, &opts, b >= 0 ? xargs_run_builtin : NULL, &b, &stats);
+    return 1;
+}
+
+// Built-in: Rerun a command every few seconds, or when matching files change
+int ripple_watch_builtin(char **args) {
+    struct ripple_watch_opts opts = { RIPPLE_WATCH_INTERVAL, NULL, 0, RIPPLE_WATCH_DEBOUNCE_MS };
+    struct ripple_watch_stats stats;
+    char *patterns[RIPPLE_WATCH_MAX_DIRS];
+    int i = 1;
+
+    opts.patterns = patterns;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        char flag = args[i][1];
+        char *value = args[i][2] ? args[i] + 2 : args[++i];
+        if (!value || !strchr("nfd", flag)) {
+            fprintf(stderr, "ripple: watch: unknown option -%c\n", flag);
+            ripple_last_status = 1;
+            return 1;
+        }
+        if (flag == 'n') {
+            opts.interval = atof(value);
+        } else if (flag == 'd') {
+            opts.debounce_ms = atoi(value);
+        } else if (opts.num_patterns < RIPPLE_WATCH_MAX_DIRS) {
+            patterns[opts.num_patterns++] = value;
+        }
+        if ((flag == 'n' && opts.interval < 0.1) || (flag == 'd' && opts.debounce_ms <= 0)) {
+            fprintf(stderr, "ripple: watch: -%c needs a positive number%s\n", flag, flag == 'n' ? " (0.1 or more)" : "");
+            ripple_last_status = 1;
+            return 1;
+        }
+    }
+    if (!args[i]) {
+        printf("Usage: watch [-n seconds] [-f pattern]... [-d ms] command [arg]...\n");
+        printf("Reruns every %.0f seconds, or with -f only when matching files change; q or Ctrl-C stops\n",
+               RIPPLE_WATCH_INTERVAL);
+        ripple_last_status = 1;
+        return 1;
+    }
+
+    // Keys come through stdin when it is the terminal; otherwise run until killed
+    fflush(stdout);
+    int stop_fd = isatty(STDIN_FILENO) ? STDIN_FILENO : -1;
+    if (ripple_watch(&args[i], &opts, exec_stage, stop_fd, STDOUT_FILENO, &stats) != 0) {
+        if (errno == ENOENT && opts.num_patterns > 0) {
+            fprintf(stderr, "ripple: watch: nothing to watch for %s\n", patterns[0]);
+        } else {
+            fprintf(stderr, "ripple: watch: %s\n", strerror(errno));
+        }
+        ripple_last_status = 1;
+        return 1;
+    }
+    ripple_last_status = 0;
     return 1;
 }
 
@@ -670,6 +1291,125 @@ int ripple_whoami(char **args) {
     return 1;
 }
 
+// Built-in: Show Ollama load/prompt-eval timings and context reuse
+int ripple_aidiag(char **args) {
+    struct rp_stats ds;
+    char text[RIPPLE_PROTO_MAX];
+
+    if (ripple_client_stats(&ds, text, sizeof(text)) == 0) {
+        printf("Daemon:            %s, %u sessions, %u requests (%u from its cache), %u shared, %u sent\n",
+               ripple_client_socket(), ds.sessions, ds.requests, ds.cache_hits, ds.shared, ds.sent);
+        fputs(text, stdout);
+        return 1;
+    }
+    if (ripple_client_enabled()) {
+        printf("Daemon:            not running (%s); answering in this shell\n", ripple_client_socket());
+    }
+    ollama_print_diagnostics();
+    return 1;
+}
+
+// Built-in: Show or change AI backend settings
+int ripple_aiconfig(char **args) {
+    if (args[1] == NULL) {
+        ollama_config_print();
+        return 1;
+    }
+
+    if (strcmp(args[1], "load") == 0 || strcmp(args[1], "save") == 0) {
+        const char *path = args[2] ? args[2] : ollama_config_path();
+        if (args[1][0] == 'l') {
+            ollama_config_load(path);
+            ollama_warmup_async();
+            printf("Loaded %s\n", path);
+        } else if (ollama_config_save(path) != 0) {
+            perror("ripple: aiconfig");
+        } else {
+            printf("Saved %s\n", path);
+        }
+        return 1;
+    }
+
+    if (args[2] == NULL) {
+        printf("Usage: aiconfig [<key> <value> | load [file] | save [file]]\n");
+        printf("Use \"\" as the value to clear a setting\n");
+        return 1;
+    }
+
+    const char *value = strcmp(args[2], "\"\"") == 0 ? "" : args[2];
+    if (ollama_config_set(args[1], value) != 0) {
+        fprintf(stderr, "ripple: aiconfig: bad setting %s=%s\n", args[1], value);
+        return 1;
+    }
+
+    // Re-evaluate the prompt prefixes against the new settings
+    ollama_warmup_async();
+    return 1;
+}
+
+// Stop the benchmark on q or Ctrl-C, checked as each piece of text arrives
+static int aibench_key(const char *text, size_t len, void *ctx) {
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    char c;
+    (void)text;
+    (void)len;
+    (void)ctx;
+    return isatty(STDIN_FILENO) && poll(&pfd, 1, 0) > 0 && read(STDIN_FILENO, &c, 1) == 1 && (c == 3 || c == 'q');
+}
+
+// Built-in: Rank the configured local backends by first token and generation speed
+int ripple_aibench(char **args) {
+    struct ollama_config cfg;
+    struct ripple_backend_score scores[RIPPLE_BACKEND_MAX];
+    int rounds = RIPPLE_BACKEND_BENCH_ROUNDS;
+    const char *only = NULL;
+
+    for (int i = 1; args[i]; i++) {
+        if (strcmp(args[i], "-n") == 0 && args[i + 1] && atoi(args[i + 1]) > 0) {
+            rounds = atoi(args[++i]);
+        } else if (args[i][0] != '-' && ripple_backend_find(args[i]) && !only) {
+            only = args[i];
+        } else {
+            printf("Usage: aibench [-n rounds] [backend]\n");
+            printf("Backends:");
+            for (int b = 0; b < ripple_backend_count(); b++) {
+                printf(" %s", ripple_backend_at(b)->name);
+            }
+            printf("; without one, every backend with an endpoint set\n");
+            ripple_last_status = 1;
+            return 1;
+        }
+    }
+
+    ollama_config_get(&cfg);
+    printf("Timing a fixed prompt set, %d round%s per backend; q or Ctrl-C stops\n", rounds, rounds == 1 ? "" : "s");
+    fflush(stdout);
+    int n = ripple_backend_bench(&cfg, only, rounds, aibench_key, NULL, scores, RIPPLE_BACKEND_MAX);
+
+    printf("%-4s %-26s %10s %8s %5s %10s %7s  %s\n", "rank", "backend", "first tok", "tok/s", "", "warm-up",
+           "runs", "url");
+    ripple_last_status = 1;
+    for (int i = 0; i < n; i++) {
+        struct ripple_backend_score *s = &scores[i];
+        if (s->runs == 0) {
+            printf("%-4s %-26s %s%s\n", "-", s->backend->label, s->error[0] ? "failed: " : "stopped",
+                   s->error);
+            continue;
+        }
+        ripple_last_status = 0;
+        printf("%-4d %-26s %7.1f ms %8.1f  (%d) %7.0f ms %3d/%-3d  %s\n", s->ttft_rank, s->backend->label, s->ttft_ms,
+               s->tokens_per_s, s->rate_rank, s->warmup_ms, s->runs, s->runs + s->failures, s->url);
+    }
+    for (int i = 0; i < n && ripple_last_status == 0; i++) {
+        if (scores[i].rate_rank == 1) {
+            printf("Fastest first token: %s; fastest generation: %s (current: %s)\n", scores[0].backend->name,
+                   scores[i].backend->name, cfg.backend);
+            break;
+        }
+    }
+    return 1;
+}
+
 struct Node {
     char *str;
     struct Node* next;
@@ -684,7 +1424,29 @@ char* strAppend(char* str1, char* str2)
   strcat(str3, str2);
 	return str3;
 }
+// Feed the whole command line to the offline predictor
+static void record_prediction(char **args) {
+    char line[1024] = "";
+    const char *cwd = ripple_prompt_cwd();
+    size_t len = 0;
+
+    for (int i = 0; args[i] != NULL && len < sizeof(line); i++) {
+        len += snprintf(line + len, sizeof(line) - len, "%s%s", i ? " " : "", args[i]);
+    }
+    ripple_predict_observe(cwd, line);
+    ripple_ghost_add(line);
+    ripple_history_append(ripple_history_path(), line);
+
+    unsigned strings, contexts;
+    unsigned long observed;
+    ripple_predict_stats(&strings, &contexts, &observed);
+    if (observed % PREDICT_SAVE_EVERY == 0) {
+        ripple_predict_save(ripple_predict_path());
+    }
+}
+
 void add_to_hist(char **args){
+  record_prediction(args);
   if(head==NULL){
     head = (struct Node *)malloc(sizeof(struct Node));
       head->str = (char *)malloc(0x1000);
@@ -728,6 +1490,108 @@ int ripple_history(char **args){
   return 1; 
   }
 
+// Built-in: Build, inspect or query the retrieval index used before the model
+int ripple_aiindex(char **args) {
+    struct ripple_hit hits[5];
+
+    if (args[1] == NULL) {
+        if (ripple_index_count() == 0) {
+            printf("No index at %s; run 'aiindex build'\n", ripple_index_path());
+        } else {
+            printf("%s: %zu entries, %d dims, model %s\n", ripple_index_path(),
+                   ripple_index_count(), ripple_index_dim(), ripple_index_model());
+        }
+        return 1;
+    }
+
+    if (strcmp(args[1], "build") == 0) {
+        int num_history = 0;
+        for (struct Node *ptr = head; ptr != NULL; ptr = ptr->next) {
+            num_history++;
+        }
+        const char **history = malloc(sizeof(char *) * (num_history + 1));
+        num_history = 0;
+        for (struct Node *ptr = head; ptr != NULL && history; ptr = ptr->next) {
+            history[num_history++] = ptr->str;
+        }
+
+        struct ripple_index_entry *entries;
+        int count = ripple_index_collect(&entries, history, num_history);
+        free(history);
+        if (count <= 0) {
+            printf("Nothing to index\n");
+            return 1;
+        }
+        if (ripple_index_build(ripple_index_path(), entries, count) < 0) {
+            fprintf(stderr, "ripple: aiindex: build failed\n");
+        } else {
+            printf("Indexed %d entries into %s\n", count, ripple_index_path());
+        }
+        ripple_index_free_entries(entries, count);
+        return 1;
+    }
+
+    if (strcmp(args[1], "query") == 0 && args[2] != NULL) {
+        char query[1024] = "";
+        for (int i = 2; args[i] != NULL; i++) {
+            snprintf(query + strlen(query), sizeof(query) - strlen(query), "%s%s", i > 2 ? " " : "", args[i]);
+        }
+        double scan_ms = 0;
+        int n = ripple_index_query(query, hits, 5, &scan_ms);
+        if (n < 0) {
+            fprintf(stderr, "ripple: aiindex: no usable index or embedding failed\n");
+            return 1;
+        }
+        for (int i = 0; i < n; i++) {
+            printf("  %.3f  %-32.*s %.*s\n", hits[i].score, hits[i].cmd_len, hits[i].cmd,
+                   hits[i].desc_len, hits[i].desc);
+        }
+        printf("(scanned %zu vectors in %.3f ms)\n", ripple_index_count(), scan_ms);
+        return 1;
+    }
+
+    printf("Usage: aiindex [build | query <text>]\n");
+    return 1;
+}
+
+// Built-in: Jump to the most frecent directory matching the given terms
+int ripple_z(char **args) {
+    struct ripple_dir found[10];
+    char query[512] = "";
+    const char *cwd = ripple_prompt_cwd();
+    int list = args[1] != NULL && strcmp(args[1], "-l") == 0;
+    size_t len = 0;
+
+    for (int i = list ? 2 : 1; args[i] != NULL && len < sizeof(query); i++) {
+        len += snprintf(query + len, sizeof(query) - len, "%s%s", len ? " " : "", args[i]);
+    }
+
+    // With no terms, or with -l, list instead of jumping
+    if (list || query[0] == '\0') {
+        int n = ripple_dirs_query(query, NULL, found, 10);
+        if (n == 0) {
+            printf("No matching directories (%u known)\n", ripple_dirs_count());
+        }
+        for (int i = 0; i < n; i++) {
+            printf("  %8.1f  %s\n", found[i].score, found[i].path);
+        }
+        return 1;
+    }
+
+    if (ripple_dirs_query(query, cwd, found, 1) == 0) {
+        fprintf(stderr, "ripple: z: no directory matches '%s'\n", query);
+        return 1;
+    }
+    if (chdir(found[0].path) != 0) {
+        perror("ripple: z");
+        return 1;
+    }
+    ripple_prompt_cwd_changed();
+    ripple_dirs_visit(found[0].path);
+    printf("Current directory: %s\n", found[0].path);
+    return 1;
+}
+
 // Background command execution
 int ripple_bg(char **args)
 {
@@ -753,16 +1617,23 @@ int ripple_bg(char **args)
 }
 
 // Launch an external command in the foreground
+// Resource usage of the last external command, for the time builtin
+static struct rusage last_child_usage;
+static int last_child_valid = 0;
+
 int ripple_launch(char **args) {
     pid_t pid;
     int status;
 
+    uint64_t span = ripple_prof_begin();
     pid = fork();
+    ripple_prof_end(span, "fork");
     if (pid == 0) {
         // Child process
         if (execvp(args[0], args) == -1) {
             if (errno == ENOENT) {
                 fprintf(stderr, "ripple: command not found: %s\n", args[0]);
+                exit(127);
             } else {
                 perror("ripple");
             }
@@ -771,83 +1642,486 @@ int ripple_launch(char **args) {
     } else if (pid < 0) {
         // Fork error
         perror("ripple");
+        ripple_last_status = 1;
     } else {
         // Parent process
-        waitpid(pid, &status, 0); // Simplified, no WUNTRACED
+        span = ripple_prof_begin();
+        wait4(pid, &status, 0, &last_child_usage); // Simplified, no WUNTRACED
+        ripple_prof_end(span, "wait");
+        last_child_valid = 1;
+        // Keep the exit status around for $?
+        if (WIFEXITED(status)) {
+            ripple_last_status = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            ripple_last_status = 128 + WTERMSIG(status);
+        }
     }
     return 1; // Continue shell loop
 }
 
 // Execute a command (built-in or external)
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run a builtin or an external command, timing it into the metrics
+static int run_command(char **args) {
+    double start = monotonic_seconds();
+    uint64_t span = ripple_prof_begin();
+    int status;
+
+    int i = ripple_builtin_index(args[0]);
+    if (i >= 0) {
+        ripple_last_status = 0;
+        status = (*builtin_func[i])(args);
+    } else {
+        status = ripple_launch(args);
+    }
+    // time observes the command it runs; counting itself too would double it
+    if (i < 0 || builtin_func[i] != ripple_time) {
+        ripple_metrics_observe(i >= 0 ? RIPPLE_METRIC_BUILTIN : RIPPLE_METRIC_COMMAND,
+                               monotonic_seconds() - start, ripple_last_status != 0);
+    }
+    ripple_prof_end(span, i >= 0 ? builtin_str[i] : "launch");
+    return status;
+}
+
+// Run one pipeline stage in a forked child; never returns
+static void exec_stage(char **args) {
+    int i = ripple_builtin_index(args[0]);
+    if (i >= 0) {
+        ripple_last_status = 0;
+        (*builtin_func[i])(args);
+        fflush(stdout);
+        _exit(ripple_last_status);
+    }
+    execvp(args[0], args);
+    if (errno == ENOENT) {
+        fprintf(stderr, "ripple: command not found: %s\n", args[0]);
+        _exit(127);
+    }
+    perror("ripple");
+    _exit(126);
+}
+
+// Run "a | b | c" from its already expanded stages. Every stage but the
+// last is forked, builtins included, with stdout on a pipe to the next
+// stage. The last stage runs through run_command with the shell's own
+// stdin moved onto the pipe, so a builtin there (wc, grep, ...) consumes
+// the stream in-process without a fork.
+static int run_pipeline(char ***stages, int num_stages) {
+    pid_t *pids = malloc(sizeof(pid_t) * num_stages);
+    int num_pids = 0, in_fd = -1, status = 1;
+
+    if (!pids) {
+        fprintf(stderr, "ripple: allocation error\n");
+        return 1;
+    }
+    for (int s = 0; s < num_stages; s++) {
+        char **stage = stages[s];
+        if (stage[0] == NULL) {
+            fprintf(stderr, "ripple: syntax error near '|'\n");
+            ripple_last_status = 2;
+            break;
+        }
+        if (s == num_stages - 1) {
+            int saved = dup(STDIN_FILENO);
+            dup2(in_fd, STDIN_FILENO);
+            close(in_fd);
+            in_fd = -1;
+            status = run_command(stage);
+            fflush(stdout);
+            dup2(saved, STDIN_FILENO);
+            close(saved);
+            break;
+        }
+
+        int fds[2];
+        if (pipe(fds) != 0) {
+            perror("ripple: pipe");
+            ripple_last_status = 1;
+            break;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (in_fd >= 0) {
+                dup2(in_fd, STDIN_FILENO);
+                close(in_fd);
+            }
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            exec_stage(stage);
+        }
+        close(fds[1]);
+        if (in_fd >= 0) {
+            close(in_fd);
+        }
+        in_fd = fds[0];
+        if (pid < 0) {
+            perror("ripple: fork");
+            ripple_last_status = 1;
+            break;
+        }
+        pids[num_pids++] = pid;
+    }
+
+    // Writers still blocked on a reader that stopped early get SIGPIPE
+    if (in_fd >= 0) {
+        close(in_fd);
+    }
+    for (int p = 0; p < num_pids; p++) {
+        while (waitpid(pids[p], NULL, 0) < 0 && errno == EINTR) {
+        }
+    }
+    free(pids);
+    return status;
+}
+
+// Run a line as split by ripple_split_line. Only a "|" token the user typed
+// separates stages; each stage is expanded on its own afterwards, so text
+// produced by $VAR or $(...) is always an argument, never an operator.
+int ripple_run_line(char **tokens) {
+    int num_stages = 1, status = 1;
+
+    for (int i = 0; tokens[i]; i++) {
+        num_stages += strcmp(tokens[i], "|") == 0;
+    }
+    char ***stages = calloc(num_stages, sizeof(char **));
+    if (!stages) {
+        fprintf(stderr, "ripple: allocation error\n");
+        ripple_last_status = 1;
+        return 1;
+    }
+
+    // Expand stage by stage, cutting the token vector at each "|" in turn
+    uint64_t span = ripple_prof_begin();
+    int s = 0, start = 0, ok = 1;
+    for (int i = 0; ok; i++) {
+        char *tok = tokens[i];
+        if (tok && strcmp(tok, "|") != 0) {
+            continue;
+        }
+        if (i == start && num_stages > 1) {
+            fprintf(stderr, "ripple: syntax error near '|'\n");
+            ripple_last_status = 2;
+            ok = 0;
+            break;
+        }
+        tokens[i] = NULL;
+        stages[s] = ripple_expand_args(&tokens[start]);
+        tokens[i] = tok;
+        if (!stages[s++]) {
+            ripple_last_status = 1;
+            ok = 0;
+        }
+        if (!tok) {
+            break;
+        }
+        start = i + 1;
+    }
+    ripple_prof_end(span, "expand");
+
+    if (ok && num_stages > 1) {
+        status = run_pipeline(stages, num_stages);
+    } else if (ok && stages[0][0] != NULL) {
+        status = run_command(stages[0]);
+    }
+    for (int i = 0; i < s; i++) {
+        ripple_free_args(stages[i]);
+    }
+    free(stages);
+    return status;
+}
+
 int ripple_execute(char **args) {
     if (args[0] == NULL) {
         // Empty command
         return 1;
     }
 
-    // Check for built-in commands
-    for (int i = 0; i < ripple_num_builtins(); i++) {
-        if (strcmp(args[0], builtin_str[i]) == 0) {
-            add_to_hist(args); // Add command to history before executing
-            return (*builtin_func[i])(args);
+    add_to_hist(args); // Add command to history before executing
+    return ripple_run_line(args);
+}
+
+static double timeval_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Built-in: Run a command and report wall, user and sys time and peak memory
+int ripple_time(char **args) {
+    struct rusage before, after;
+
+    if (args[1] == NULL) {
+        fprintf(stderr, "ripple: time: usage: time command [args...]\n");
+        return 1;
+    }
+    getrusage(RUSAGE_SELF, &before);
+    last_child_valid = 0;
+    double start = monotonic_seconds();
+    int status = run_command(args + 1);
+    double wall = monotonic_seconds() - start;
+    getrusage(RUSAGE_SELF, &after);
+
+    // An external command has its own usage from wait4; a builtin ran in
+    // the shell, so it is the shell's own usage over the call
+    double user, sys;
+    long maxrss;
+    if (last_child_valid) {
+        user = timeval_seconds(last_child_usage.ru_utime);
+        sys = timeval_seconds(last_child_usage.ru_stime);
+        maxrss = last_child_usage.ru_maxrss;
+    } else {
+        user = timeval_seconds(after.ru_utime) - timeval_seconds(before.ru_utime);
+        sys = timeval_seconds(after.ru_stime) - timeval_seconds(before.ru_stime);
+        maxrss = after.ru_maxrss;
+    }
+#ifdef __APPLE__
+    maxrss /= 1024; // bytes on macOS, kilobytes elsewhere
+#endif
+    fflush(stdout); // the report goes after the command's own output
+    fprintf(stderr, "\nreal   %.3fs\nuser   %.3fs\nsys    %.3fs\nmaxrss %ld KB\n", wall, user, sys, maxrss);
+    return status;
+}
+
+// Built-in: Show command and AI latency histograms, or export them
+int ripple_stats(char **args) {
+    if (args[1] == NULL) {
+        ripple_metrics_print(stdout);
+        return 1;
+    }
+    if (strcmp(args[1], "reset") == 0) {
+        ripple_metrics_reset();
+        return 1;
+    }
+    if (strcmp(args[1], "prom") == 0 || strcmp(args[1], "json") == 0) {
+        ripple_metrics_write(stdout, args[1][0] == 'j' ? RIPPLE_METRICS_JSON : RIPPLE_METRICS_PROMETHEUS);
+        return 1;
+    }
+    if (strcmp(args[1], "export") == 0) {
+        const char *path = args[2] ? args[2] : ripple_metrics_path();
+        if (ripple_metrics_export(path, ripple_metrics_format_for(path)) != 0) {
+            perror("ripple: stats");
+            return 1;
         }
+        printf("Metrics written to %s\n", path);
+        return 1;
     }
+    fprintf(stderr, "ripple: stats: usage: stats [reset | prom | json | export [file]]\n");
+    return 1;
+}
 
-    // External command
-    add_to_hist(args); // Add command to history before executing
-    return ripple_launch(args);
+// Built-in: Record hot-path spans and dump them as a Chrome trace
+int ripple_profile(char **args) {
+    if (args[1] != NULL && strcmp(args[1], "start") == 0) {
+        ripple_prof_start();
+        printf("Profiling; run 'profile stop [file]' to write the trace\n");
+        return 1;
+    }
+    if (args[1] != NULL && strcmp(args[1], "stop") == 0) {
+        const char *path = args[2] ? args[2] : RIPPLE_PROF_FILE;
+        long events;
+        if (!ripple_prof_active()) {
+            fprintf(stderr, "ripple: profile: not running\n");
+            return 1;
+        }
+        if (ripple_prof_stop(path, &events) != 0) {
+            perror("ripple: profile");
+            return 1;
+        }
+        printf("Wrote %ld spans to %s (open in chrome://tracing or ui.perfetto.dev)\n", events, path);
+        return 1;
+    }
+    if (args[1] == NULL) {
+        printf("Profiling is %s\n", ripple_prof_active() ? "on" : "off");
+        return 1;
+    }
+    fprintf(stderr, "ripple: profile: usage: profile [start | stop [file]]\n");
+    return 1;
 }
 
+// The prompt on the current line and its width, while the line editor may
+// still redraw it
+static char shown_prompt[RIPPLE_PROMPT_SIZE];
+static int shown_width;
+static int prompt_live;
+
 // Modify the main shell loop to use raw mode
 void ripple_loop(void) {
     char *line;
     char **args;
     int status;
-    char cwd[1024];
 
     // Enable raw mode at the start
     enable_raw_mode();
+    // Keys are read one at a time, so waiting for a prompt segment never
+    // holds back keys already in a stdio buffer
+    if (isatty(STDIN_FILENO)) {
+        setvbuf(stdin, NULL, _IONBF, 0);
+    }
 
     do {
-        if (getcwd(cwd, sizeof(cwd)) != NULL) {
-            printf("\033[1;32m%s\033[0m > ", cwd);
-            fflush(stdout);  // Ensure prompt is displayed immediately
-        } else {
-            printf("> ");
-            fflush(stdout);
-        }
+        uint64_t span = ripple_prof_begin();
+        shown_width = ripple_prompt_render(shown_prompt, sizeof(shown_prompt));
+        fputs(shown_prompt, stdout);
+        fflush(stdout);  // Ensure prompt is displayed immediately
+        prompt_live = 1;
+        ripple_prof_end(span, "prompt");
         
         line = ripple_read_line();
         if (!line) {
             break;
         }
+        span = ripple_prof_begin();
         args = ripple_split_line(line);
+        ripple_prof_end(span, "split_line");
         if (!args) {
             free(line);
             continue;
         }
+
+        // Variables, ~ and $(...) are expanded per pipeline stage
         status = ripple_execute(args);
 
         free(line);
         free(args);
     } while (status);
 
+    ripple_predict_save(ripple_predict_path());
+
+    // Leave this session's histograms where a metrics collector can pick them up
+    if (getenv("RIPPLE_METRICS_FILE")) {
+        const char *path = ripple_metrics_path();
+        if (ripple_metrics_export(path, ripple_metrics_format_for(path)) != 0) {
+            perror("ripple: RIPPLE_METRICS_FILE");
+        }
+    }
+
     // Disable raw mode before exiting
     disable_raw_mode();
 }
 
+// Echo an edit, then the dimmed rest of the best history line after the
+// cursor, in one write per keystroke. Returns the line being shown.
+static const char *show_ghost(const char *echo, const char *buffer, int position) {
+    uint64_t span = ripple_prof_begin();
+    const char *ghost = ripple_ghost_lookup(buffer, position);
+    char out[GHOST_OUT_SIZE];
+    int len = snprintf(out, sizeof(out), "%s\033[K", echo);
+
+    if (ghost) {
+        int rest = strlen(ghost + position);
+        if (rest > (int)sizeof(out) - len - 32) {
+            rest = sizeof(out) - len - 32;
+        }
+        len += snprintf(out + len, sizeof(out) - len, "\033[2m%.*s\033[0m\033[%dD",
+                        rest, ghost + position, rest);
+    }
+    fwrite(out, 1, len, stdout);
+    fflush(stdout);
+    ripple_prof_end(span, "ghost");
+    return ghost;
+}
+
+// Next key from the terminal, logged when a trace is being recorded
+static int read_key(void) {
+    int c = getchar();
+    if (c != EOF) {
+        ripple_trace_key(c);
+    }
+    return c;
+}
+
+// Redraw the prompt in place once a background segment has a fresher
+// value, keeping what has been typed. A line that wraps is left alone; the
+// next prompt shows the new value.
+static const char *redraw_prompt(const char *buffer, int position, const char *ghost) {
+    char fresh[RIPPLE_PROMPT_SIZE];
+    struct winsize ws;
+    int width = ripple_prompt_render(fresh, sizeof(fresh));
+
+    if (strcmp(fresh, shown_prompt) == 0) {
+        return ghost;
+    }
+    // A pty nobody sized reports 0 columns; assume the traditional 80
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0) {
+        ws.ws_col = 80;
+    }
+    if ((width > shown_width ? width : shown_width) + position >= ws.ws_col) {
+        return ghost;
+    }
+    printf("\r%s%.*s", fresh, position, buffer);
+    memcpy(shown_prompt, fresh, sizeof(shown_prompt));
+    shown_width = width;
+    return show_ghost("", buffer, position);
+}
+
+// Next key for the line editor. While a prompt segment is still being
+// computed, wait for it as well and redraw the prompt when it lands.
+static int read_line_key(const char *buffer, int position, const char **ghost, int ghosts) {
+    while (prompt_live && ghosts && ripple_prompt_pending()) {
+        struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { ripple_prompt_notify_fd(), POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            ripple_prompt_drain();
+            *ghost = redraw_prompt(buffer, position, *ghost);
+        }
+        if (fds[0].revents) {
+            break;
+        }
+    }
+    return read_key();
+}
+
 // Read a line of input
 char *ripple_read_line(void) {
     int bufsize = RIPPLE_RL_BUFSIZE;
     int position = 0;
     char *buffer = malloc(sizeof(char) * bufsize);
     int c;
+    // Suggestions from the last TAB; a digit right after picks one
+    struct ollama_suggestion suggestions[RIPPLE_MAX_CHOICES];
+    int num_suggestions = 0;
+    // History line shown dimmed after the cursor; right arrow accepts it
+    int ghosts = isatty(STDOUT_FILENO);
+    const char *ghost = NULL;
     if (!buffer) {
         fprintf(stderr, "ripple: allocation error\n");
         exit(EXIT_FAILURE);
     }
     while (1) {
-        c = getchar();
+        c = read_line_key(buffer, position, &ghost, ghosts);
+        if (num_suggestions > 0 && c >= '1' && c < '1' + num_suggestions) {
+            const char *cmd = suggestions[c - '1'].cmd;
+            int len = strlen(cmd);
+            if (len >= bufsize) {
+                bufsize = len + RIPPLE_RL_BUFSIZE;
+                buffer = realloc(buffer, bufsize);
+                if (!buffer) {
+                    fprintf(stderr, "ripple: allocation error\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            memcpy(buffer, cmd, len + 1);
+            position = len;
+            num_suggestions = 0;
+            ghost = NULL;
+            printf("\r\033[K%s%s", shown_prompt, buffer);
+            fflush(stdout);
+            prompt_live = 0;
+            continue;
+        }
+        if (c != '\t') {
+            num_suggestions = 0;
+        }
         if (c == EOF) {
             // Only return NULL if nothing has been typed (Ctrl+D at empty prompt)
             if (position == 0) {
@@ -856,22 +2130,86 @@ char *ripple_read_line(void) {
             } else {
                 continue; // Ignore spurious EOFs
             }
-        } else if (c == '\n') {
+        } else if (c == '\n' || c == '\r') { // raw mode leaves Enter as '\r'
             buffer[position] = '\0';
+            if (ghosts) {
+                fputs("\033[K\r\n", stdout);
+                fflush(stdout);
+            }
+            prompt_live = 0;
             return buffer;
+        } else if (c == 27) { // Escape sequence: right arrow accepts the ghost
+            int c1 = read_key();
+            int c2 = c1 == '[' ? read_key() : EOF;
+            while (c1 == '[' && c2 != EOF && !(c2 >= 0x40 && c2 <= 0x7e)) {
+                c2 = read_key();
+            }
+            if (c2 == 'C' && ghost) {
+                int len = strlen(ghost);
+                if (len >= bufsize) {
+                    bufsize = len + RIPPLE_RL_BUFSIZE;
+                    buffer = realloc(buffer, bufsize);
+                    if (!buffer) {
+                        fprintf(stderr, "ripple: allocation error\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                printf("%s", ghost + position);
+                fflush(stdout);
+                memcpy(buffer, ghost, len);
+                position = len;
+                ghost = NULL;
+            }
+            continue;
         } else if (c == '\t') {
             buffer[position] = '\0';
+            if (ghost) {
+                fputs("\033[K", stdout);
+                ghost = NULL;
+            }
+            uint64_t span = ripple_prof_begin();
             char *current_cmd = strdup(buffer);
-            suggest_command(current_cmd);
-            printf("\nripple> %s", buffer);
+            // The history predictor answers first and works without Ollama
+            struct ripple_prediction predictions[RIPPLE_PREDICTIONS];
+            const char *cwd = ripple_prompt_cwd();
+            // cd completes from visited directories; the model is only
+            // asked when none of them match
+            struct ripple_dir dirs[RIPPLE_MAX_CHOICES];
+            int num_dirs = 0;
+            if (strncmp(current_cmd, "cd", 2) == 0 && (current_cmd[2] == '\0' || current_cmd[2] == ' ')) {
+                num_dirs = ripple_dirs_query(current_cmd + 2, cwd, dirs, RIPPLE_MAX_CHOICES);
+            }
+            if (num_dirs > 0) {
+                for (int i = 0; i < num_dirs; i++) {
+                    snprintf(suggestions[i].cmd, sizeof(suggestions[i].cmd), "cd %s", dirs[i].path);
+                    snprintf(suggestions[i].desc, sizeof(suggestions[i].desc), "frecent (%u visit%s)",
+                             dirs[i].visits, dirs[i].visits == 1 ? "" : "s");
+                }
+                num_suggestions = suggest_command(current_cmd, suggestions, num_dirs, num_dirs);
+            } else {
+                int n = ripple_predict(cwd, current_cmd, predictions, RIPPLE_PREDICTIONS);
+                for (int i = 0; i < n; i++) {
+                    memcpy(suggestions[i].cmd, predictions[i].text, sizeof(suggestions[i].cmd));
+                    snprintf(suggestions[i].desc, sizeof(suggestions[i].desc), "history (%.0f%%)",
+                             predictions[i].score * 100);
+                }
+                num_suggestions = suggest_command(current_cmd, suggestions, n, RIPPLE_MAX_CHOICES);
+            }
+            printf("\n%s%s", shown_prompt, buffer);
             fflush(stdout);
+            prompt_live = 0;
             free(current_cmd);
+            ripple_prof_end(span, "tab");
             continue;
         } else if (c == 127 || c == '\b') { // Handle backspace
             if (position > 0) {
                 position--;
-                printf("\b \b");
-                fflush(stdout);
+                if (ghosts) {
+                    ghost = show_ghost("\b", buffer, position);
+                } else {
+                    printf("\b \b");
+                    fflush(stdout);
+                }
             }
         } else {
             if (position >= bufsize - 1) {
@@ -884,8 +2222,13 @@ char *ripple_read_line(void) {
             }
             buffer[position] = c;
             position++;
-            putchar(c);
-            fflush(stdout);
+            if (ghosts) {
+                char echo[2] = { c, '\0' };
+                ghost = show_ghost(echo, buffer, position);
+            } else {
+                putchar(c);
+                fflush(stdout);
+            }
         }
     }
 }
@@ -904,6 +2247,43 @@ int main(void) {
     printf("\033[1;33mMake sure Ollama is running with the tinyllama model\033[0m\n");
     printf("\033[1;36m========================================\033[0m\n\n");
     
+    // Backend settings from ~/.ripple_ai.conf
+    ollama_config_load(NULL);
+
+    // Offline next-command predictor from earlier sessions
+    ripple_predict_load(ripple_predict_path());
+
+    // History for inline suggestions as you type
+    ripple_ghost_load(ripple_history_path());
+
+    // Frecent directories for cd completion and z
+    ripple_dirs_open(ripple_dirs_path());
+
+    // Retrieval index from an earlier 'aiindex build', if there is one
+    ripple_index_open(ripple_index_path());
+
+    // RIPPLE_TRACE records this session; RIPPLE_REPLAY answers TABs from a
+    // recorded one (see replay_trace)
+    const char *trace_path = getenv("RIPPLE_TRACE");
+    if (trace_path && ripple_trace_record(trace_path) != 0) {
+        perror("ripple: RIPPLE_TRACE");
+    }
+    const char *replay_path = getenv("RIPPLE_REPLAY");
+    if (replay_path && ripple_trace_replay(replay_path, getenv("RIPPLE_REPLAY_FAST") != NULL) != 0) {
+        perror("ripple: RIPPLE_REPLAY");
+    }
+
+    // Share suggestions with other shells through ripple-daemon if it runs;
+    // then it keeps the model warm and this shell need not
+    if (!getenv("RIPPLE_NO_DAEMON") && !replay_path) {
+        ripple_client_enable(NULL);
+    }
+
+    // Load the model and its instruction prefixes while the user types
+    if (!replay_path && !ripple_client_connected()) {
+        ollama_warmup_async();
+    }
+
     // Run command loop
     ripple_loop();
     
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "ollama_integration.h"
+#include "ollama_config.h"
+#include "ollama_gate.h"
+#include "ripple_backend.h"
+#include "test_mock.h"
+
+// Runs completions through each backend against mock_ollama, which speaks
+// Ollama, llama.cpp server and OpenAI-compatible streams, and checks that
+// they all give the same suggestions, report timings, can be cancelled
+// mid-stream and turn server errors into failures.
+// Run from the source directory after building mock_ollama.
+
+// Cancels once three pieces of text have arrived
+static int stop_after_three(const char *text, size_t len, void *ctx) {
+    (void)text;
+    (void)len;
+    return ++*(int *)ctx >= 3;
+}
+
+int main(void) {
+    int port = 20000 + getpid() % 1000;
+    struct ollama_config cfg;
+    struct ollama_suggestion out[RIPPLE_MAX_SUGGESTIONS];
+    char what[128];
+
+    ollama_config_set("model", "small");
+    ollama_config_set("timeout_ms", "2000");
+    ollama_config_set("rate_limit", "0");
+    use_port(port);
+    pid_t mock = start_mock(port, "-d 1");
+
+    // Same suggestions whichever server answers, structured or not
+    for (int b = 0; b < ripple_backend_count(); b++) {
+        const struct ripple_backend *be = ripple_backend_at(b);
+        ollama_config_set("backend", be->name);
+        for (int structured = 1; structured >= 0; structured--) {
+            char prompt[32];
+            ollama_config_set("structured", structured ? "1" : "0");
+            snprintf(prompt, sizeof(prompt), "list %s %d", be->name, structured);
+            int n = get_ollama_suggestions(prompt, out, RIPPLE_MAX_SUGGESTIONS, NULL);
+            snprintf(what, sizeof(what), "%s gives the suggestions (%s)", be->name, structured ? "JSON" : "text");
+            check(n == 3 && strcmp(out[0].cmd, "ls -la") == 0 && strcmp(out[2].cmd, "find . -name '*.c'") == 0,
+                  what);
+        }
+    }
+    check(ollama_config_set("backend", "nonesuch") != 0, "an unknown backend is refused");
+
+    // Timings, and a cancel part way through the stream
+    ollama_config_get(&cfg);
+    for (int b = 0; b < ripple_backend_count(); b++) {
+        const struct ripple_backend *be = ripple_backend_at(b);
+        struct ripple_backend_conn conn = { 0 };
+        struct ripple_backend_metrics m;
+        struct ollama_response resp = { 0 };
+        struct ollama_request req = { 0 };
+        const char *url, *model;
+        int seen = 0;
+
+        req.model = "small";
+        req.prompt = "list files";
+        req.num_predict = 32;
+        req.stream = 1;
+        ripple_backend_settings(be, &cfg, &url, &model);
+        ripple_backend_connect(&conn, be, url, model, 1000);
+        int rc = ripple_backend_stream(&conn, &req, 2000, NULL, NULL, &resp);
+        ripple_backend_get_metrics(&conn, &m);
+        snprintf(what, sizeof(what), "%s streams the whole text with timings", be->name);
+        check(rc == RIPPLE_BACKEND_OK && resp.text.len > 0 && strncmp(resp.text.data, "1. ls -la", 9) == 0 &&
+              m.ttft_ms > 0 && m.ttft_ms <= m.total_ms && m.tokens > 10 && m.tokens_per_s > 0, what);
+
+        rc = ripple_backend_stream(&conn, &req, 2000, stop_after_three, &seen, &resp);
+        snprintf(what, sizeof(what), "%s stops when cancelled", be->name);
+        check(rc == RIPPLE_BACKEND_PARTIAL && seen == 3 && strcmp(resp.text.data, "1. ls -la ") == 0, what);
+        ripple_backend_close(&conn);
+        ollama_response_free(&resp);
+    }
+    stop_mock(mock);
+
+    // Server errors fail the request on every backend
+    port++;
+    use_port(port);
+    mock = start_mock(port, "-f 500");
+    for (int b = 0; b < ripple_backend_count(); b++) {
+        char prompt[32];
+        ollama_config_set("backend", ripple_backend_at(b)->name);
+        snprintf(prompt, sizeof(prompt), "cat %d", b);
+        char *text = get_ollama_completion(prompt);
+        snprintf(what, sizeof(what), "%s fails on a server error", ripple_backend_at(b)->name);
+        check(text == NULL, what);
+        free(text);
+    }
+    stop_mock(mock);
+
+    printf("%s\n", failures ? "Some tests failed" : "All tests passed");
+    return failures ? 1 : 0;
+}
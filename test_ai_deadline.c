@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "ollama_integration.h"
+#include "ollama_config.h"
+#include "test_mock.h"
+#include "bench_util.h"
+
+// Exercises model routing and request deadlines against mock_ollama.
+// Run from the source directory after building mock_ollama.
+
+int main(void) {
+    int port = 18000 + getpid() % 1000;
+    char *text;
+    double t0;
+
+    ollama_config_set("model", "small");
+    ollama_config_set("large_model", "big");
+    ollama_config_set("timeout_ms", "2000");
+    ollama_config_set("p95_budget_ms", "150");
+    ollama_config_set("cooldown_ms", "60000");
+
+    // Plain request, then a repeated TAB that escalates to the large model
+    pid_t mock = start_mock(port, "-d 1 -m big=400");
+    use_port(port);
+    text = get_ollama_completion("ls");
+    check(text && strstr(text, "ls -la"), "suggestions from the mock server");
+    check(strcmp(ollama_last_model(), "small") == 0, "first TAB uses the small model");
+    free(text);
+
+    text = get_ollama_completion("ls");
+    check(text != NULL, "repeated TAB gets suggestions");
+    check(strcmp(ollama_last_model(), "big") == 0, "repeated TAB escalates to the large model");
+    free(text);
+
+    // The large model took 400 ms against a 150 ms budget, so it is dropped
+    text = get_ollama_completion("ls");
+    check(strcmp(ollama_last_model(), "small") == 0, "over-budget large model falls back to small");
+    free(text);
+    stop_mock(mock);
+
+    // Slow token stream: the deadline returns what arrived so far
+    port++;
+    mock = start_mock(port, "-d 60");
+    use_port(port);
+    ollama_config_set("timeout_ms", "400");
+    t0 = now_ms();
+    text = get_ollama_completion("grep");
+    double elapsed = now_ms() - t0;
+    check(text && strstr(text, "partial"), "deadline returns partial suggestions");
+    check(elapsed < 700, "slow stream is cut off at the total deadline");
+    free(text);
+    stop_mock(mock);
+
+    // A server that accepts but never answers
+    port++;
+    mock = start_mock(port, "-f hang");
+    use_port(port);
+    ollama_config_set("timeout_ms", "300");
+    t0 = now_ms();
+    text = get_ollama_completion("find");
+    elapsed = now_ms() - t0;
+    check(text == NULL, "stuck server gives no suggestions");
+    check(elapsed < 600, "stuck server does not block past the deadline");
+    free(text);
+    stop_mock(mock);
+
+    // Nothing listening at all
+    port++;
+    use_port(port);
+    t0 = now_ms();
+    text = get_ollama_completion("cat");
+    check(text == NULL && now_ms() - t0 < 1200, "refused connection fails fast");
+    free(text);
+
+    printf("%s\n", failures ? "Some tests failed" : "All tests passed");
+    return failures ? 1 : 0;
+}
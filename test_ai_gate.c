@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "ollama_integration.h"
+#include "ollama_config.h"
+#include "ollama_gate.h"
+#include "test_mock.h"
+
+// Exercises single-flight sharing, priorities, the rate limiter and the
+// circuit breaker in front of Ollama, partly against mock_ollama.
+// Run from the source directory after building mock_ollama.
+
+static void *complete_thread(void *arg) {
+    return get_ollama_completion((const char *)arg);
+}
+
+// Holds the only slot, then records the order the queued requests got in
+static int order[2];
+static int order_len;
+static pthread_mutex_t order_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *queued_thread(void *arg) {
+    int priority = *(int *)arg;
+    if (ollama_gate_enter(priority, 0, ollama_gate_now_ms() + 2000) == OLLAMA_GATE_OK) {
+        pthread_mutex_lock(&order_lock);
+        order[order_len++] = priority;
+        pthread_mutex_unlock(&order_lock);
+        ollama_gate_leave(1);
+    }
+    return NULL;
+}
+
+int main(void) {
+    int port = 19000 + getpid() % 1000;
+    struct ollama_gate_stats gs;
+    double t0;
+
+    ollama_config_set("model", "small");
+    ollama_config_set("timeout_ms", "2000");
+    ollama_config_set("rate_limit", "0");
+
+    // Two identical TABs at once: one request, both get the answer
+    pid_t mock = start_mock(port, "-l 300");
+    use_port(port);
+    pthread_t a, b;
+    void *ra, *rb;
+    t0 = ollama_gate_now_ms();
+    pthread_create(&a, NULL, complete_thread, "ls");
+    usleep(50 * 1000);
+    pthread_create(&b, NULL, complete_thread, "ls");
+    pthread_join(a, &ra);
+    pthread_join(b, &rb);
+    double elapsed = ollama_gate_now_ms() - t0;
+    ollama_gate_get_stats(&gs);
+    check(ra && rb && strcmp(ra, rb) == 0, "identical concurrent requests get the same answer");
+    check(gs.coalesced == 1, "identical concurrent requests are sent once");
+    check(elapsed < 550, "the second request does not queue behind the first");
+    free(ra);
+    free(rb);
+
+    // Right after it finished, the same request is answered without asking
+    t0 = ollama_gate_now_ms();
+    char *text = get_ollama_completion("ls");
+    check(text && ollama_gate_now_ms() - t0 < 50, "a repeated TAB reuses the answer just received");
+    free(text);
+    usleep(1000 * 1000); // let the warm-up the first answer started finish
+    stop_mock(mock);
+
+    // With one slot taken, a TAB goes ahead of queued speculative work
+    ollama_config_set("max_inflight", "1");
+    ollama_gate_enter(OLLAMA_PRIORITY_INTERACTIVE, 0, ollama_gate_now_ms() + 1000);
+    int speculative = OLLAMA_PRIORITY_SPECULATIVE, interactive = OLLAMA_PRIORITY_INTERACTIVE;
+    pthread_create(&a, NULL, queued_thread, &speculative);
+    usleep(50 * 1000);
+    pthread_create(&b, NULL, queued_thread, &interactive);
+    usleep(50 * 1000);
+    ollama_gate_leave(1);
+    pthread_join(a, NULL);
+    pthread_join(b, NULL);
+    check(order_len == 2 && order[0] == OLLAMA_PRIORITY_INTERACTIVE, "interactive requests jump the queue");
+
+    // Token bucket: a burst of two, then one token every 100 ms
+    ollama_gate_reset();
+    ollama_config_set("rate_limit", "10");
+    ollama_config_set("rate_burst", "2");
+    for (int i = 0; i < 2; i++) {
+        ollama_gate_enter(OLLAMA_PRIORITY_INTERACTIVE, 1, ollama_gate_now_ms() + 1000);
+        ollama_gate_leave(1);
+    }
+    check(ollama_gate_enter(OLLAMA_PRIORITY_SPECULATIVE, 1, ollama_gate_now_ms() + 1000) == OLLAMA_GATE_LIMITED,
+          "speculative work is dropped when out of tokens");
+    t0 = ollama_gate_now_ms();
+    int rc = ollama_gate_enter(OLLAMA_PRIORITY_INTERACTIVE, 1, ollama_gate_now_ms() + 1000);
+    elapsed = ollama_gate_now_ms() - t0;
+    check(rc == OLLAMA_GATE_OK && elapsed > 60 && elapsed < 200, "a TAB waits for the next token");
+    ollama_gate_leave(1);
+    check(ollama_gate_enter(OLLAMA_PRIORITY_INTERACTIVE, 1, ollama_gate_now_ms() + 20) == OLLAMA_GATE_LIMITED,
+          "a TAB gives up at its deadline");
+    ollama_config_set("rate_limit", "0");
+
+    // Nothing listening: after three failures calls fail fast
+    ollama_gate_reset();
+    ollama_config_set("breaker_failures", "3");
+    ollama_config_set("breaker_cooldown_ms", "500");
+    port++;
+    use_port(port);
+    for (int i = 0; i < 3; i++) {
+        char prompt[16];
+        snprintf(prompt, sizeof(prompt), "cat %d", i);
+        free(get_ollama_completion(prompt));
+    }
+    ollama_gate_get_stats(&gs);
+    check(gs.trips == 1 && gs.open_ms > 0, "repeated connection failures open the circuit");
+    t0 = ollama_gate_now_ms();
+    text = get_ollama_completion("cat 3");
+    ollama_gate_get_stats(&gs);
+    check(text == NULL && ollama_gate_now_ms() - t0 < 5 && gs.rejected == 1, "an open circuit fails fast");
+
+    // After the cool-down one trial goes through and closes it again
+    mock = start_mock(port, "-d 1");
+    usleep(600 * 1000);
+    text = get_ollama_completion("cat 4");
+    ollama_gate_get_stats(&gs);
+    check(text != NULL && gs.open_ms == 0 && gs.failures == 0, "a successful trial closes the circuit");
+    free(text);
+    stop_mock(mock);
+
+    printf("%s\n", failures ? "Some tests failed" : "All tests passed");
+    return failures ? 1 : 0;
+}
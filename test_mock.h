@@ -0,0 +1,115 @@
+#ifndef TEST_MOCK_H
+#define TEST_MOCK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "ollama_config.h"
+
+// Shared by the tests and benchmarks that run against mock_ollama: start and
+// stop the mock, point the client at it, and count failed checks.
+// Run them from the source directory after building mock_ollama.
+
+#define MOCK_READY_MS 5000
+
+static int failures = 0;
+
+static inline void check(int cond, const char *what) {
+    printf("%s %s\n", cond ? "\033[32mPASS\033[0m" : "\033[31mFAIL\033[0m", what);
+    if (!cond) {
+        failures++;
+    }
+}
+
+// 1 once something accepts connections on 127.0.0.1:port
+static inline int mock_listening(int port) {
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    close(fd);
+    return ok;
+}
+
+// Start ./mock_ollama on port with extra arguments separated by blanks
+// (e.g. "-d 1 -f 500"), and wait until it accepts connections. Returns the
+// pid, or -1 if the mock exited or was not listening within MOCK_READY_MS.
+static inline pid_t start_mock(int port, const char *args) {
+    char port_str[16], buf[256], *argv[32];
+    int argc = 0;
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    snprintf(buf, sizeof(buf), "%s", args ? args : "");
+    argv[argc++] = "mock_ollama";
+    argv[argc++] = "-p";
+    argv[argc++] = port_str;
+    for (char *save, *tok = strtok_r(buf, " ", &save); tok && argc < 31; tok = strtok_r(NULL, " ", &save)) {
+        argv[argc++] = tok;
+    }
+    argv[argc] = NULL;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stdout);
+        execv("./mock_ollama", argv);
+        perror("exec mock_ollama");
+        _exit(127);
+    }
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    struct timespec t0, t;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (;;) {
+        if (mock_listening(port)) {
+            return pid;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid) {
+            fprintf(stderr, "mock_ollama -p %d %s exited before listening\n", port, args ? args : "");
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        if ((t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000 > MOCK_READY_MS) {
+            fprintf(stderr, "mock_ollama -p %d %s not listening after %d ms\n", port, args ? args : "",
+                    MOCK_READY_MS);
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            return -1;
+        }
+        usleep(5 * 1000);
+    }
+}
+
+static inline void stop_mock(pid_t pid) {
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+// Point every backend at the mock on port
+static inline void use_port(int port) {
+    char url[128];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/api/generate", port);
+    ollama_config_set("endpoint", url);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/completion", port);
+    ollama_config_set("llamacpp_endpoint", url);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/v1/completions", port);
+    ollama_config_set("openai_endpoint", url);
+}
+
+#endif // TEST_MOCK_H